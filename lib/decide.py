@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+# decide.py
+"""Client for the door controller's local decision service (DecisionService.h).
+
+  query  ask the device about some UIDs and print its answers
+  bench  send batches for a while, report round-trip percentiles and rates
+
+Frames are little-endian: a query is `magic u16, version u8, count u8, tag
+u32` followed by `count` uint64 UID hashes (compute_uid_hash in server.py);
+the reply is `magic, version, count, tag, sync_age_s u32` followed by
+`count` answer bytes (0 unknown, 1 deny, 2 allow), one reply per query, in
+order.
+"""
+import argparse
+import random
+import socket
+import struct
+import time
+
+DECISION_PORT = 7701
+MAGIC = 0x5144
+VERSION = 1
+BATCH_MAX = 64
+QUERY = struct.Struct("<HBBI")
+REPLY = struct.Struct("<HBBII")
+ANSWERS = {0: "unknown", 1: "deny", 2: "allow"}
+
+
+def uid_hash(uid):
+    # Same FNV-1a 64 as compute_uid_hash() in server.py and UidKey::hash()
+    h = 0xcbf29ce484222325
+    for c in uid.strip().upper():
+        h ^= ord(c)
+        h = (h * 0x100000001b3) & 0xFFFFFFFFFFFFFFFF
+    return h
+
+
+class DecisionClient:
+    def __init__(self, host, port=DECISION_PORT, timeout=5.0):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = b""
+        self.tag = 0
+
+    def send(self, hashes):
+        if len(hashes) > BATCH_MAX:
+            raise ValueError(f"at most {BATCH_MAX} hashes per query")
+        self.tag = (self.tag + 1) & 0xFFFFFFFF
+        self.sock.sendall(QUERY.pack(MAGIC, VERSION, len(hashes), self.tag) +
+                          struct.pack(f"<{len(hashes)}Q", *hashes))
+        return self.tag
+
+    def _read(self, n):
+        while len(self.buf) < n:
+            chunk = self.sock.recv(4096)
+            if not chunk:
+                raise ConnectionError("device closed the connection")
+            self.buf += chunk
+        out, self.buf = self.buf[:n], self.buf[n:]
+        return out
+
+    def receive(self):
+        magic, version, count, tag, age = REPLY.unpack(self._read(REPLY.size))
+        if magic != MAGIC or version != VERSION:
+            raise ValueError("not a decision reply")
+        return tag, age, list(self._read(count))
+
+    def close(self):
+        self.sock.close()
+
+
+def cmd_query(args):
+    client = DecisionClient(args.device, args.port)
+    try:
+        client.send([uid_hash(u) for u in args.uid])
+        _, age, answers = client.receive()
+    finally:
+        client.close()
+    print(f"sync age: {'never synced' if age == 0xFFFFFFFF else f'{age} s'}")
+    for uid, a in zip(args.uid, answers):
+        print(f"{uid:20} {ANSWERS.get(a, a)}")
+
+
+def percentile(sorted_values, p):
+    return sorted_values[min(len(sorted_values) - 1, int(len(sorted_values) * p))]
+
+
+def cmd_bench(args):
+    rng = random.Random(args.seed)
+    uids = [u.strip() for u in open(args.uids)] if args.uids else []
+    pool = [uid_hash(u) for u in uids if u] or [rng.getrandbits(64) for _ in range(1000)]
+    client = DecisionClient(args.device, args.port)
+    rtts = []
+    counts = {0: 0, 1: 0, 2: 0}
+    sent_at = {}
+    started = time.perf_counter()
+    deadline = started + args.seconds
+    try:
+        # Keep `pipeline` queries in flight
+        while time.perf_counter() < deadline or sent_at:
+            while len(sent_at) < args.pipeline and time.perf_counter() < deadline:
+                sent_at[client.send([rng.choice(pool) for _ in range(args.batch)])] = time.perf_counter()
+            tag, _, answers = client.receive()
+            rtts.append(time.perf_counter() - sent_at.pop(tag))
+            for a in answers:
+                counts[a] = counts.get(a, 0) + 1
+    finally:
+        client.close()
+    elapsed = time.perf_counter() - started
+    rtts.sort()
+    ms = [percentile(rtts, p) * 1000 for p in (0.5, 0.95, 0.99)] + [rtts[-1] * 1000]
+    print(f"batches    {len(rtts)} x {args.batch} hashes, pipeline {args.pipeline}, {elapsed:.1f} s")
+    print(f"rate       {len(rtts) / elapsed:.0f} batches/s, {len(rtts) * args.batch / elapsed:.0f} lookups/s")
+    print(f"rtt        p50={ms[0]:.2f} p95={ms[1]:.2f} p99={ms[2]:.2f} max={ms[3]:.2f} ms")
+    print("answers    " + " ".join(f"{ANSWERS[k]}={v}" for k, v in sorted(counts.items())))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("query", help="decide some UIDs")
+    p.add_argument("--device", required=True, help="device IP")
+    p.add_argument("--port", type=int, default=DECISION_PORT)
+    p.add_argument("uid", nargs="+", help="UID as hex, e.g. 04A1B2C3")
+    p.set_defaults(fn=cmd_query)
+
+    p = sub.add_parser("bench", help="round-trip latency and throughput")
+    p.add_argument("--device", required=True, help="device IP")
+    p.add_argument("--port", type=int, default=DECISION_PORT)
+    p.add_argument("--seconds", type=float, default=10)
+    p.add_argument("--batch", type=int, default=16, help=f"hashes per query (max {BATCH_MAX})")
+    p.add_argument("--pipeline", type=int, default=1, help="queries in flight")
+    p.add_argument("--uids", help="file with one UID per line (default: random hashes)")
+    p.add_argument("--seed", type=int, default=1)
+    p.set_defaults(fn=cmd_bench)
+
+    args = ap.parse_args()
+    args.fn(args)
+
+
+if __name__ == "__main__":
+    main()
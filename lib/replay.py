@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+# replay.py
+"""Scan-trace replay harness: realistic door traffic on the bench.
+
+Traces are CSV, one scan per line, `<t_ms>,<uid hex>,<reader>`, times
+ascending (the format ScanReplay reads on the device).
+
+  record   export the scans a server stored (scan_events) as a trace
+  gen      synthesize a trace: steady traffic, queues at the door, double
+           swipes and unknown cards
+  run      replay the trace on a SCAN_REPLAY build (`pio run -e replay`,
+           trace uploaded as /trace.csv with `pio run -e replay -t uploadfs`)
+           while the server injects latency, errors, outages and ETag churn,
+           then report decision latency, drops, requests and flash writes
+
+Run the server against a scratch copy for `run`, the replayed scans are
+uploaded again:  CARDS_DB=/tmp/replay.db python lib/server.py
+"""
+import argparse
+import json
+import random
+import socket
+import sqlite3
+import sys
+import time
+import urllib.request
+
+CONSOLE_PORT = 23
+PROMPT = b"> "
+
+
+# ---------- traces ----------
+def write_trace(path, events, comment):
+    events.sort(key=lambda e: e[0])
+    with open(path, "w") as f:
+        f.write(f"# {comment}\n# t_ms,uid,reader\n")
+        for t, uid, reader in events:
+            f.write(f"{t},{uid},{reader}\n")
+    print(f"{path}: {len(events)} scans over {events[-1][0] / 1000.0 if events else 0:.1f} s")
+
+
+def known_uids(db_path, limit):
+    db = sqlite3.connect(db_path)
+    rows = db.execute("SELECT uid FROM cards WHERE deleted_at IS NULL ORDER BY random() LIMIT ?", (limit,)).fetchall()
+    db.close()
+    return [r[0] for r in rows]
+
+
+def random_uid(rng):
+    # 4-byte (single size) or 7-byte (double size) UIDs, as readers return them
+    return "".join(f"{rng.randrange(256):02X}" for _ in range(rng.choice((4, 4, 7))))
+
+
+def cmd_record(args):
+    db = sqlite3.connect(args.db)
+    query = "SELECT scanned_at, uid, reader FROM scan_events WHERE scanned_at IS NOT NULL"
+    params = []
+    if args.device:
+        query += " AND device = ?"
+        params.append(args.device)
+    if args.hours:
+        query += " AND scanned_at >= ?"
+        params.append(time.time() - args.hours * 3600)
+    rows = db.execute(query + " ORDER BY scanned_at", params).fetchall()
+    db.close()
+    if not rows:
+        sys.exit("no recorded scans match")
+    first = rows[0][0]
+    events = [(int(round((at - first) * 1000)), uid, reader) for at, uid, reader in rows]
+    write_trace(args.out, events, f"recorded from {args.db}")
+
+
+def cmd_gen(args):
+    rng = random.Random(args.seed)
+    cards = known_uids(args.db, args.cards) if args.db else []
+    cards += [random_uid(rng) for _ in range(max(0, args.cards - len(cards)))]
+    strangers = [random_uid(rng) for _ in range(max(1, args.cards // 10))]
+    span_ms = int(args.minutes * 60000)
+
+    def card():
+        return rng.choice(strangers) if rng.random() < args.unknown else rng.choice(cards)
+
+    events = []
+    # Steady traffic: Poisson arrivals over all doors
+    t = 0.0
+    while args.rate > 0:
+        t += rng.expovariate(args.rate / 60000.0)
+        if t >= span_ms:
+            break
+        events.append((int(t), card(), rng.randrange(args.readers)))
+    # Queues at one door: people badging in one after another
+    for _ in range(args.bursts):
+        t = rng.uniform(0, span_ms)
+        reader = rng.randrange(args.readers)
+        for _ in range(args.burst_size):
+            events.append((int(t), card(), reader))
+            t += rng.uniform(args.burst_gap_ms * 0.5, args.burst_gap_ms * 1.5)
+    # Second swipe of the same card when the door did not open fast enough
+    for t, uid, reader in list(events):
+        if rng.random() < args.repeat:
+            events.append((int(t + rng.uniform(300, 1500)), uid, reader))
+    events = [e for e in events if e[0] < span_ms]
+    write_trace(args.out, events, f"generated seed={args.seed} rate={args.rate}/min bursts={args.bursts}x{args.burst_size}")
+
+
+# ---------- run ----------
+class DeviceConsole:
+    """Line-based client for the device's telnet console (Console.h)."""
+
+    def __init__(self, host, port, timeout=5.0):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.buf = b""
+        self.read_until(PROMPT)
+
+    def read_until(self, marker):
+        while marker not in self.buf:
+            chunk = self.sock.recv(4096)
+            if not chunk:
+                raise ConnectionError("console closed")
+            # Drop telnet option negotiation (IAC sequences)
+            while b"\xff" in chunk:
+                i = chunk.index(b"\xff")
+                chunk = chunk[:i] + chunk[i + 3:]
+            self.buf += chunk
+        out, self.buf = self.buf.split(marker, 1)
+        return out.decode("latin-1")
+
+    def command(self, line):
+        self.sock.sendall(line.encode() + b"\r\n")
+        return self.read_until(PROMPT).strip()
+
+    def report(self):
+        for line in self.command("replay").splitlines():
+            if line.startswith("{"):
+                return json.loads(line)
+        raise ValueError("no replay report (is this a SCAN_REPLAY build?)")
+
+    def close(self):
+        try:
+            self.command("quit")
+        except (OSError, ConnectionError):
+            pass
+        self.sock.close()
+
+
+def faults(server, body=None):
+    req = urllib.request.Request(server.rstrip("/") + "/api/test/faults",
+                                 data=json.dumps(body).encode() if body is not None else None,
+                                 headers={"Content-Type": "application/json"})
+    with urllib.request.urlopen(req, timeout=5) as resp:
+        return json.load(resp)
+
+
+def parse_outage(text):
+    start, _, length = text.partition(":")
+    return float(start), float(length or 10)
+
+
+def print_report(rep, server_state):
+    replay = rep["replay"]
+    lat = rep["latency"]
+    counters = lat.get("counters", {})
+    print(f"scans      injected={replay['injected']} dropped_at_reader={replay['dropped']} "
+          f"skipped_lines={replay['skipped']} max_schedule_lag={replay['max_lag_us'] / 1000.0:.1f} ms "
+          f"elapsed={replay['elapsed_ms'] / 1000.0:.1f} s")
+    for stage in ("decision", "cache", "server"):
+        s = lat.get("stages", {}).get(stage)
+        if s and s[0]:
+            print(f"{stage:10} n={s[0]} p50={s[1] / 1000.0:.1f} p95={s[2] / 1000.0:.1f} "
+                  f"p99={s[3] / 1000.0:.1f} max={s[4] / 1000.0:.1f} ms")
+    q = rep["scan_log"]
+    print(f"scan log   pending={q['pending']} ram_high_water={q['ram_high_water']} "
+          f"dropped_ram={q['dropped_ram']} dropped_flash={q['dropped_flash']} uploaded={q['uploaded']}")
+    print(f"decisions  cache_hits={counters.get('cache_hits')} server_fallbacks={counters.get('server_fallbacks')} "
+          f"late={counters.get('server_late')} offline={counters.get('offline_decisions')}")
+    print(f"requests   device={counters.get('http_requests')} server={server_state.get('requests_total')} "
+          f"sync_bytes={counters.get('sync_bytes')}")
+    for key, n in sorted(server_state.get("requests", {}).items()):
+        print(f"             {key:32} {n}")
+    print(f"flash      writes={counters.get('flash_writes')} bytes={counters.get('flash_bytes')}")
+    budget = lat.get("budget_us")
+    decision = lat.get("stages", {}).get("decision")
+    if budget and decision and decision[0]:
+        print(f"budget     p99 {'within' if decision[3] <= budget else 'OVER'} {budget / 1000.0:.0f} ms")
+
+
+def cmd_run(args):
+    outages = sorted(parse_outage(o) for o in args.outage)
+    settings = {"reset": True, "latency_ms": args.latency_ms, "jitter_ms": args.jitter_ms,
+                "error_rate": args.error_rate, "etag_churn_s": args.churn_s}
+    faults(args.server, settings)
+    host, _, port = args.device.partition(":")
+    console = DeviceConsole(host, int(port or CONSOLE_PORT))
+    try:
+        print(console.command(f"replay start {args.speed} {args.passes}"))
+        started = time.time()
+        rep = None
+        while True:
+            time.sleep(args.poll_s)
+            elapsed = time.time() - started
+            while outages and outages[0][0] <= elapsed:
+                _, length = outages.pop(0)
+                faults(args.server, {"outage_s": length})
+                print(f"[{elapsed:6.1f} s] server outage for {length:.0f} s")
+            rep = console.report()
+            r = rep["replay"]
+            print(f"[{elapsed:6.1f} s] injected={r['injected']} dropped={r['dropped']} server_up={rep['server_up']}")
+            if not r["running"]:
+                break
+        server_state = faults(args.server)
+        print()
+        print_report(rep, server_state)
+        if args.json:
+            with open(args.json, "w") as f:
+                json.dump({"device": rep, "server": server_state, "settings": settings}, f, indent=2)
+    except KeyboardInterrupt:
+        console.command("replay stop")
+    finally:
+        console.close()
+        faults(args.server, {"reset": True})
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("record", help="export recorded scans as a trace")
+    p.add_argument("--db", default="cards.db")
+    p.add_argument("--device", help="only this device (MAC as uploaded)")
+    p.add_argument("--hours", type=float, help="only the last N hours")
+    p.add_argument("--out", default="data/trace.csv")
+    p.set_defaults(fn=cmd_record)
+
+    p = sub.add_parser("gen", help="synthesize door traffic")
+    p.add_argument("--minutes", type=float, default=10)
+    p.add_argument("--readers", type=int, default=2)
+    p.add_argument("--rate", type=float, default=6, help="steady scans per minute over all doors")
+    p.add_argument("--bursts", type=int, default=5, help="queues at a door")
+    p.add_argument("--burst-size", type=int, default=12)
+    p.add_argument("--burst-gap-ms", type=float, default=1200, help="mean time between people in a queue")
+    p.add_argument("--unknown", type=float, default=0.05, help="fraction of cards the device does not know")
+    p.add_argument("--repeat", type=float, default=0.1, help="fraction swiped twice")
+    p.add_argument("--cards", type=int, default=200, help="card population")
+    p.add_argument("--db", help="take card UIDs from this server DB")
+    p.add_argument("--seed", type=int, default=1)
+    p.add_argument("--out", default="data/trace.csv")
+    p.set_defaults(fn=cmd_gen)
+
+    p = sub.add_parser("run", help="replay on the device and report")
+    p.add_argument("--device", required=True, help="device IP[:console port]")
+    p.add_argument("--server", default="http://127.0.0.1:5000")
+    p.add_argument("--speed", type=int, default=100, help="percent of recorded time")
+    p.add_argument("--passes", type=int, default=1)
+    p.add_argument("--latency-ms", type=float, default=0)
+    p.add_argument("--jitter-ms", type=float, default=0)
+    p.add_argument("--error-rate", type=float, default=0)
+    p.add_argument("--churn-s", type=float, default=0, help="new sync ETag this often")
+    p.add_argument("--outage", action="append", default=[], metavar="START:LEN",
+                   help="server down LEN s from START s into the run (repeatable)")
+    p.add_argument("--poll-s", type=float, default=2)
+    p.add_argument("--json", help="also write the raw reports here")
+    p.set_defaults(fn=cmd_run)
+
+    args = ap.parse_args()
+    args.fn(args)
+
+
+if __name__ == "__main__":
+    main()
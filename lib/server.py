@@ -1,18 +1,22 @@
 # server.py
-from flask import Flask, request, jsonify, g, render_template, send_file, make_response
+from flask import Flask, Response, request, jsonify, g, render_template, send_file, make_response
 import sqlite3, time, io, os
+import json
+import threading
 import struct
+import zlib
 import re
 import hashlib
+import random
 try:
     from flask_cors import CORS
 except Exception:
     # If flask_cors isn't available, provide a no-op CORS to keep the app working.
     def CORS(app, *args, **kwargs):
         return None
-#from pybloom_live import ScalableBloomFilter
 
-DB_PATH = "cards.db"
+# CARDS_DB points a scratch server (load tests, lib/replay.py) at a copy
+DB_PATH = os.environ.get("CARDS_DB", "cards.db")
 
 
 app = Flask(__name__, template_folder=".")
@@ -30,6 +34,19 @@ def get_db():
         db.row_factory = sqlite3.Row
     return db
 
+SCAN_EVENTS_SCHEMA = """
+    CREATE TABLE IF NOT EXISTS {name} (
+        device TEXT NOT NULL,
+        boot INTEGER NOT NULL,
+        seq INTEGER NOT NULL,
+        uid TEXT NOT NULL,
+        scanned_at REAL,
+        received_at REAL NOT NULL,
+        reader INTEGER NOT NULL DEFAULT 0,
+        PRIMARY KEY (device, boot, seq)
+    );
+"""
+
 def init_db():
     db = get_db()
     db.execute("""
@@ -48,6 +65,30 @@ def init_db():
             value INTEGER
         );
     """)
+    # Append-only log of bit changes; version is the delta sync cursor
+    db.execute("""
+        CREATE TABLE IF NOT EXISTS sync_log (
+            version INTEGER PRIMARY KEY AUTOINCREMENT,
+            card_id INTEGER NOT NULL,
+            bit INTEGER NOT NULL
+        );
+    """)
+    # Scan events uploaded in batches; (device, boot, seq) makes retries idempotent
+    db.execute(SCAN_EVENTS_SCHEMA.format(name="scan_events"))
+    # Databases from before multi-reader devices lack the reader column
+    columns = {r["name"]: r for r in db.execute("PRAGMA table_info(scan_events)")}
+    if "reader" not in columns:
+        db.execute("ALTER TABLE scan_events ADD COLUMN reader INTEGER NOT NULL DEFAULT 0")
+    # ... and older ones key on (device, seq), which drops the scans of a
+    # device that restarts its numbering: rebuild with the boot in the key
+    if not columns["boot"]["pk"]:
+        db.execute(SCAN_EVENTS_SCHEMA.format(name="scan_events_new"))
+        db.execute("""
+            INSERT INTO scan_events_new(device, boot, seq, uid, scanned_at, received_at, reader)
+            SELECT device, boot, seq, uid, scanned_at, received_at, reader FROM scan_events ORDER BY rowid
+        """)
+        db.execute("DROP TABLE scan_events")
+        db.execute("ALTER TABLE scan_events_new RENAME TO scan_events")
     db.execute("INSERT OR IGNORE INTO counter(name, value) VALUES('next_card_id', 1)")
     db.commit()
 
@@ -69,6 +110,7 @@ def ensure_db_initialized():
 @app.before_request
 def before_request():
     ensure_db_initialized()
+    return apply_faults()
 
 @app.teardown_appcontext
 def close_db(exc):
@@ -76,46 +118,6 @@ def close_db(exc):
     if db: db.close()
 
     
-# ---------- Sync cache (bitset + etag) ----------
-_sync_cache = None
-_sync_etag = None
-_sync_max_id = None
-_sync_bits_len = None
-
-def invalidate_sync_cache():
-    global _sync_cache, _sync_etag, _sync_max_id, _sync_bits_len
-    _sync_cache = None
-    _sync_etag = None
-    _sync_max_id = None
-    _sync_bits_len = None
-
-def build_sync_cache():
-    """Build and cache the compact bit array and its etag."""
-    global _sync_cache, _sync_etag, _sync_max_id, _sync_bits_len
-    db = get_db()
-    row = db.execute("SELECT COALESCE(MAX(card_id), 0) FROM cards WHERE card_id IS NOT NULL").fetchone()
-    max_id = int(row[0])
-    bits = bytearray((max_id + 7) // 8)
-    cur = db.execute("SELECT card_id FROM cards WHERE authorized=1 AND deleted_at IS NULL AND card_id IS NOT NULL")
-    for r in cur:
-        idx = int(r[0])
-        if idx >= 0:
-            bits[idx // 8] |= (1 << (idx % 8))
-    # compute etag once for this blob
-    etag = hashlib.sha1(bytes(bits)).hexdigest()
-    _sync_cache = bits
-    _sync_etag = etag
-    _sync_max_id = max_id
-    _sync_bits_len = len(bits)
-    return _sync_cache, _sync_etag, _sync_max_id, _sync_bits_len
-
-def get_sync_cache():
-    """Return (bits, etag, max_id, bits_len), building cache if needed."""
-    global _sync_cache
-    if _sync_cache is None:
-        return build_sync_cache()
-    return _sync_cache, _sync_etag, _sync_max_id, _sync_bits_len
-
 # ---------- API ----------
 @app.route("/api/cards", methods=["GET"])
 def list_cards():
@@ -146,16 +148,20 @@ def add_card():
             uid_hash=excluded.uid_hash;
     """,(uid,auth,now,uid_hash))
     assign_card_id(uid)
+    record_sync_change(uid)
     db.commit()
     invalidate_sync_cache()
+    publish_event("sync", {"version": current_sync_version()})
     return jsonify({"ok":True,"uid":uid,"hash":uid_hash}),201
 
 @app.route("/api/cards/<uid>", methods=["DELETE"])
 def delete_card(uid):
     db = get_db()
     db.execute("UPDATE cards SET deleted_at=? WHERE uid=?", (int(time.time()), uid))
+    record_sync_change(uid)
     db.commit()
     invalidate_sync_cache()
+    publish_event("revoke", {"uid": uid, "version": current_sync_version()})
     return jsonify({"ok":True,"uid":uid})
 
 @app.route("/api/cards/<uid>", methods=["PATCH"])
@@ -166,8 +172,10 @@ def update_card(uid):
     auth = 1 if data["authorized"] else 0
     db = get_db()
     db.execute("UPDATE cards SET authorized=? WHERE uid=?", (auth, uid))
+    record_sync_change(uid)
     db.commit()
     invalidate_sync_cache()
+    publish_event("sync" if auth else "revoke", {"uid": uid, "version": current_sync_version()})
     return jsonify({"ok":True,"uid":uid,"authorized":auth})
 
 @app.route("/api/cards/<uid>", methods=["GET"])
@@ -185,14 +193,9 @@ def get_card(uid):
 
 # ---------- ENROLLMENT FEATURE ----------
 
-@app.route("/api/last_scan", methods=["POST"])
-def last_scan():
-    """Called by ESP32 when a card is scanned."""
+def handle_scan(uid, allow_enroll=True):
+    """Record a scanned UID and apply a pending enroll mode to it."""
     global last_scanned, enroll_mode
-    data = request.get_json(force=True)
-    uid = data.get("uid")
-    if not uid:
-        return jsonify({"error": "uid required"}), 400
     last_scanned = uid
     # Log for diagnostics so UI and server logs show the most recent scanned UID
     try:
@@ -203,7 +206,7 @@ def last_scan():
     uid_hash = compute_uid_hash(uid)
 
     # If we are in enroll mode, act now:
-    if enroll_mode in ("grant", "revoke"):
+    if allow_enroll and enroll_mode in ("grant", "revoke"):
         db = get_db()
         auth = 1 if enroll_mode == "grant" else 0
         now = int(time.time())
@@ -216,12 +219,90 @@ def last_scan():
                 uid_hash=excluded.uid_hash;
         """,(uid,auth,now,uid_hash))
         assign_card_id(uid)  # Ensure card_id is assigned
+        record_sync_change(uid)
         db.commit()
         invalidate_sync_cache()
 
         enroll_mode = None  # reset after one use
-        return jsonify({"ok":True,"enrolled":True,"mode":auth,"uid":uid,"hash":uid_hash})
-    return jsonify({"ok":True,"uid":uid,"enrolled":False,"hash":uid_hash})
+        publish_event("enroll", {"mode": None})
+        publish_event("sync" if auth else "revoke", {"uid": uid, "version": current_sync_version()})
+        return {"ok":True,"enrolled":True,"mode":auth,"uid":uid,"hash":uid_hash}
+    return {"ok":True,"uid":uid,"enrolled":False,"hash":uid_hash}
+
+@app.route("/api/last_scan", methods=["POST"])
+def last_scan():
+    """Called by ESP32 when a card is scanned."""
+    data = request.get_json(force=True)
+    uid = data.get("uid")
+    if not uid:
+        return jsonify({"error": "uid required"}), 400
+    return jsonify(handle_scan(uid))
+
+# Batched upload from the device scan log (src/ScanLog.h):
+#   { "device": "<mac>", "boot": n, "now": uptime_ms,
+#     "stats": {...counters...},
+#     "scans": [ { "seq": n, "boot": n, "t": uptime_ms, "reader": n, "uid": "..." }, ... ] }
+# `reader` is the reader/door index on a multi-reader device (default 0).
+# Reply { ok, acked: <highest seq stored>, enrolled, [mode, uid] }. The device
+# drops everything up to `acked`; resent records are ignored by (boot, seq).
+SCAN_BATCH_MAX = 64
+SCAN_ENROLL_MAX_AGE_MS = 10000   # backlog replayed after an outage never enrolls
+SCAN_EVENTS_KEEP = 100000
+device_stats = {}                # device -> last reported scan log counters
+
+@app.route("/api/last_scan/batch", methods=["POST"])
+def last_scan_batch():
+    data = request.get_json(force=True) or {}
+    scans = data.get("scans")
+    if not isinstance(scans, list) or len(scans) > SCAN_BATCH_MAX:
+        return jsonify({"error": f"scans must be a list of at most {SCAN_BATCH_MAX}"}), 400
+    device = str(data.get("device") or "unknown")[:32]
+    try:
+        boot = int(data.get("boot", 0))
+        now_ms = int(data.get("now", 0))
+    except (TypeError, ValueError):
+        return jsonify({"error": "boot/now must be integers"}), 400
+    if isinstance(data.get("stats"), dict):
+        device_stats[device] = dict(data["stats"], updated_at=int(time.time()))
+
+    received = time.time()
+    db = get_db()
+    acked = None
+    enrolled = None
+    for item in sorted((s for s in scans if isinstance(s, dict)), key=lambda s: int(s.get("seq", -1))):
+        try:
+            seq = int(item["seq"])
+            rec_boot = int(item.get("boot", boot))
+            t = int(item.get("t", now_ms))
+            reader = int(item.get("reader", 0))
+        except (KeyError, TypeError, ValueError):
+            continue
+        acked = seq if acked is None else max(acked, seq)
+        uid = str(item.get("uid") or "").strip().upper()
+        if not validate_uid(uid)[0]:
+            continue  # acked anyway so one bad record cannot wedge the queue
+        # Uptimes only compare within the current boot
+        age_ms = max(0, now_ms - t) if rec_boot == boot else None
+        scanned_at = received - age_ms / 1000.0 if age_ms is not None else None
+        cur = db.execute("INSERT OR IGNORE INTO scan_events(device, boot, seq, uid, scanned_at, received_at, reader) VALUES(?,?,?,?,?,?,?)",
+                         (device, rec_boot, seq, uid, scanned_at, received, reader))
+        if cur.rowcount == 0:
+            continue  # retry of a stored record
+        result = handle_scan(uid, allow_enroll=age_ms is not None and age_ms <= SCAN_ENROLL_MAX_AGE_MS)
+        if result["enrolled"]:
+            enrolled = result
+    db.execute("DELETE FROM scan_events WHERE rowid <= (SELECT MAX(rowid) FROM scan_events) - ?", (SCAN_EVENTS_KEEP,))
+    db.commit()
+    reply = {"ok": True, "acked": acked, "enrolled": enrolled is not None}
+    if enrolled:
+        reply.update(mode=enrolled["mode"], uid=enrolled["uid"])
+    return jsonify(reply)
+
+@app.route("/api/scan_stats", methods=["GET"])
+def scan_stats():
+    """Scan log counters last reported by each device (pending, high-water,
+    dropped), including its scan-path latency histograms under `latency`."""
+    return jsonify(device_stats)
 
 @app.route("/api/enroll", methods=["POST"])
 def set_enroll_mode():
@@ -232,6 +313,7 @@ def set_enroll_mode():
     if mode not in ("grant","revoke",None):
         return jsonify({"error":"mode must be 'grant' or 'revoke'"}),400
     enroll_mode = mode
+    publish_event("enroll", {"mode": enroll_mode})
     return jsonify({"ok":True,"mode":enroll_mode})
 
 @app.route("/api/status", methods=["GET"])
@@ -244,6 +326,131 @@ def status():
     resp.headers['Cache-Control'] = 'no-store, no-cache, must-revalidate, max-age=0'
     return resp
 
+# ---------- FAULT INJECTION ----------
+# Load tests (lib/replay.py) degrade the device API on purpose. Faults:
+#   latency_ms, jitter_ms  delay before every /api/* reply (fixed + uniform)
+#   error_rate             fraction of requests answered 503 at random
+#   outage_s               answer 503 to everything for that long, from now
+#   etag_churn_s           new sync ETag this often, cards unchanged
+# POST /api/test/faults sets them (keys left out keep their value,
+# {"reset": true} clears faults and counters first); GET returns them with
+# the requests per endpoint since the last reset. /api/test/* is exempt.
+FAULT_DEFAULTS = {"latency_ms": 0, "jitter_ms": 0, "error_rate": 0.0, "etag_churn_s": 0}
+_faults = dict(FAULT_DEFAULTS)
+_outage_until = 0.0
+_etag_salt = 0
+_etag_churned_at = 0.0
+_request_counts = {}
+_fault_lock = threading.Lock()
+
+def apply_faults():
+    """before_request hook: count the request, then inject the faults."""
+    global _etag_salt, _etag_churned_at
+    path = request.path
+    if not path.startswith("/api/") or path.startswith("/api/test/"):
+        return None
+    now = time.time()
+    with _fault_lock:
+        # Cards' own paths group by endpoint, not by uid
+        key = request.method + " " + ("/api/cards/<uid>" if path.startswith("/api/cards/") else path)
+        _request_counts[key] = _request_counts.get(key, 0) + 1
+        faults = dict(_faults)
+        churn = faults["etag_churn_s"]
+        if churn and now - _etag_churned_at >= churn:
+            _etag_churned_at = now
+            _etag_salt += 1
+            invalidate_sync_cache()
+    if now < _outage_until or (faults["error_rate"] and random.random() < faults["error_rate"]):
+        return jsonify({"error": "injected fault"}), 503
+    delay_ms = faults["latency_ms"] + random.uniform(0, faults["jitter_ms"])
+    if delay_ms > 0:
+        time.sleep(delay_ms / 1000.0)
+    return None
+
+@app.route("/api/test/faults", methods=["GET", "POST"])
+def test_faults():
+    global _faults, _outage_until, _request_counts
+    if request.method == "POST":
+        data = request.get_json(force=True) or {}
+        with _fault_lock:
+            if data.get("reset"):
+                _faults = dict(FAULT_DEFAULTS)
+                _outage_until = 0.0
+                _request_counts = {}
+            for name, default in FAULT_DEFAULTS.items():
+                if name in data:
+                    try:
+                        _faults[name] = type(default)(data[name])
+                    except (TypeError, ValueError):
+                        return jsonify({"error": f"{name} must be a number"}), 400
+            if "outage_s" in data:
+                try:
+                    _outage_until = time.time() + max(0.0, float(data["outage_s"] or 0))
+                except (TypeError, ValueError):
+                    return jsonify({"error": "outage_s must be a number"}), 400
+    with _fault_lock:
+        return jsonify({"faults": _faults,
+                        "outage_left_s": max(0.0, round(_outage_until - time.time(), 1)),
+                        "etag_salt": _etag_salt,
+                        "requests": dict(_request_counts),
+                        "requests_total": sum(_request_counts.values())})
+
+# ---------- PUSH EVENTS ----------
+# Server-sent events on /api/events replace device polling of /api/status.
+# Events (data is JSON):
+#   state   {"enroll_mode", "version"}  sent first on every (re)connect
+#   enroll  {"mode"}                    enroll mode changed
+#   sync    {"version"[, "uid"]}        cards changed; devices re-sync
+#   revoke  {"uid", "version"}          card deleted or deauthorized
+# A ": ping" comment every EVENT_HEARTBEAT_S lets devices detect dead links.
+# Events missed while disconnected are covered by the `state` snapshot:
+# devices compare its version with their own sync cursor.
+EVENT_HEARTBEAT_S = 15
+EVENT_BACKLOG = 64
+_event_cond = threading.Condition()
+_event_seq = 0
+_events = []          # (seq, name, data) ring of the last EVENT_BACKLOG events
+
+def publish_event(name, payload):
+    """Queue an event for every connected /api/events stream."""
+    global _event_seq
+    data = json.dumps(payload, separators=(",", ":"))
+    with _event_cond:
+        _event_seq += 1
+        _events.append((_event_seq, name, data))
+        del _events[:-EVENT_BACKLOG]
+        _event_cond.notify_all()
+
+def format_event(name, data, seq=None):
+    head = f"id: {seq}\n" if seq is not None else ""
+    return f"{head}event: {name}\ndata: {data}\n\n"
+
+def event_stream(snapshot, start_seq):
+    yield format_event("state", json.dumps(snapshot, separators=(",", ":")))
+    seen = start_seq
+    while True:
+        with _event_cond:
+            if _event_seq == seen:
+                _event_cond.wait(EVENT_HEARTBEAT_S)
+            pending = [e for e in _events if e[0] > seen]
+            seen = _event_seq
+        if not pending:
+            yield ": ping\n\n"
+            continue
+        for seq, name, data in pending:
+            yield format_event(name, data, seq)
+
+@app.route("/api/events", methods=["GET"])
+def events():
+    """Long-lived text/event-stream of enroll/sync/revoke notices."""
+    with _event_cond:
+        start_seq = _event_seq
+    snapshot = {"enroll_mode": enroll_mode, "version": current_sync_version()}
+    resp = Response(event_stream(snapshot, start_seq), mimetype="text/event-stream")
+    resp.headers['Cache-Control'] = 'no-store'
+    resp.headers['X-Accel-Buffering'] = 'no'
+    return resp
+
 # ---------- DASHBOARD ----------
 @app.route("/")
 def dashboard():
@@ -264,36 +471,124 @@ def validate_uid(uid):
     return True, None
 
 # ---------- Sync cache (bitset + etag) ----------
+# Binary sync framing (mirrors src/SyncFormat.h on the device):
+#   magic  "RBS1"  4 bytes
+#   max_id uint32  little-endian
+#   length uint32  number of bitset bytes that follow
+#   crc32  uint32  zlib CRC-32 of those bytes
+SYNC_MAGIC = b"RBS1"
+SYNC_HEADER = struct.Struct("<4sIII")
+SYNC_MIME = "application/octet-stream"
+# Delta reply for /api/sync?since=<version|etag>:
+#   "RBD1", from_version, to_version, max_id, count, crc32 (all uint32)
+#   then `count` ranges of (start uint32, length uint16, op uint8, pad uint8)
+#   op 1 = set bits start..start+length-1, op 0 = clear them.
+DELTA_MAGIC = b"RBD1"
+DELTA_HEADER = struct.Struct("<4sIIIII")
+DELTA_RANGE = struct.Struct("<IHBx")
+DELTA_MAX_RANGES = 64     # larger gaps get a full bitset instead
+SYNC_LOG_KEEP = 5000      # change log entries retained for deltas
+SYNC_VERSION_HEADER = "X-Sync-Version"
+# Compressed full bitset replies. The device lists what it decodes in
+# X-Sync-Encoding; the reply names the encoding used (absent: none).
+#   deflate  zlib stream with a 512-byte window (the device inflates into a
+#            512-byte ring, so the window must not grow)
+#   rle      tokens varint(n << 1 | repeat) (LEB128): repeat 1 is followed by
+#            one byte written n times, repeat 0 by n literal bytes
+SYNC_ENCODING_HEADER = "X-Sync-Encoding"
+DEFLATE_WBITS = 9
+RLE_MIN_RUN = 4           # shorter repeats stay in the literal stretch
+# UID index for /api/sync/index: "RBI1", count, crc32, reserved (uint32),
+# then `count` uint64 uid hashes (ascending) followed by `count` uint32
+# card_ids in the same order. crc32 covers both arrays.
+INDEX_MAGIC = b"RBI1"
+INDEX_HEADER = struct.Struct("<4sIII")
+# Xor filter over every known uid_hash for /api/sync/filter:
+#   "RBF1", count, block_length, crc32 (uint32), seed (uint64)
+#   then 3 * block_length one-byte fingerprints. crc32 covers the fingerprints.
+FILTER_MAGIC = b"RBF1"
+FILTER_HEADER = struct.Struct("<4sIIIQ")
+
 _sync_cache = None
 _sync_etag = None
 _sync_max_id = None
 _sync_bits_len = None
+_sync_blob = None
+_sync_encoded = {}    # encoding -> full binary reply in that encoding
+_sync_version = None
+_etag_versions = {}   # recent etag -> version, so ?since= also accepts an etag
+_index_blob = None
+_index_etag = None
+_filter_blob = None
+_filter_etag = None
 
 def invalidate_sync_cache():
-    global _sync_cache, _sync_etag, _sync_max_id, _sync_bits_len
+    global _sync_cache, _sync_etag, _sync_max_id, _sync_bits_len, _sync_blob, _sync_encoded, _sync_version
+    global _index_blob, _index_etag, _filter_blob, _filter_etag
     _sync_cache = None
+    _sync_version = None
+    _index_blob = None
+    _index_etag = None
+    _filter_blob = None
+    _filter_etag = None
     _sync_etag = None
     _sync_max_id = None
     _sync_bits_len = None
+    _sync_blob = None
+    _sync_encoded = {}
+
+def _varint(v):
+    out = bytearray()
+    while v >= 0x80:
+        out.append((v & 0x7F) | 0x80)
+        v >>= 7
+    out.append(v)
+    return out
+
+def rle_encode(data):
+    """Run-length encode `data` (see SYNC_ENCODING_HEADER)."""
+    out = bytearray()
+    pos = 0
+    for m in re.finditer(rb"(.)\1{%d,}" % (RLE_MIN_RUN - 1), data, re.S):
+        if m.start() > pos:
+            out += _varint((m.start() - pos) << 1) + data[pos:m.start()]
+        out += _varint((m.end() - m.start()) << 1 | 1) + m.group(1)
+        pos = m.end()
+    if pos < len(data):
+        out += _varint((len(data) - pos) << 1) + data[pos:]
+    return bytes(out)
+
+def deflate_encode(data):
+    c = zlib.compressobj(9, zlib.DEFLATED, DEFLATE_WBITS)
+    return c.compress(data) + c.flush()
 
 def build_sync_cache():
     """Build and cache the compact bit array and its etag."""
-    global _sync_cache, _sync_etag, _sync_max_id, _sync_bits_len
+    global _sync_cache, _sync_etag, _sync_max_id, _sync_bits_len, _sync_blob, _sync_encoded, _sync_version
     db = get_db()
+    _sync_version = current_sync_version()
     row = db.execute("SELECT COALESCE(MAX(card_id), 0) FROM cards WHERE card_id IS NOT NULL").fetchone()
     max_id = int(row[0])
-    bits = bytearray((max_id + 7) // 8)
+    # bits 0..max_id inclusive (same sizing as AuthSync::calcBitsetBytes)
+    bits = bytearray(max_id // 8 + 1)
     cur = db.execute("SELECT card_id FROM cards WHERE authorized=1 AND deleted_at IS NULL AND card_id IS NOT NULL")
     for r in cur:
         idx = int(r[0])
         if idx >= 0:
             bits[idx // 8] |= (1 << (idx % 8))
-    # compute etag once for this blob
-    etag = hashlib.sha1(bytes(bits)).hexdigest()
+    # compute etag once for this blob (salted by the ETag churn fault)
+    etag = hashlib.sha1(bytes(bits) + (str(_etag_salt).encode() if _etag_salt else b"")).hexdigest()
     _sync_cache = bits
     _sync_etag = etag
     _sync_max_id = max_id
     _sync_bits_len = len(bits)
+    # binary reply is built once per etag, not per request
+    _sync_blob = SYNC_HEADER.pack(SYNC_MAGIC, max_id, len(bits), zlib.crc32(bits) & 0xFFFFFFFF) + bytes(bits)
+    # ...and so are its compressed forms
+    _sync_encoded = {"deflate": deflate_encode(_sync_blob), "rle": rle_encode(_sync_blob)}
+    if len(_etag_versions) > 64:
+        _etag_versions.clear()
+    _etag_versions[etag] = _sync_version
     return _sync_cache, _sync_etag, _sync_max_id, _sync_bits_len
 
 def get_sync_cache():
@@ -303,6 +598,143 @@ def get_sync_cache():
         return build_sync_cache()
     return _sync_cache, _sync_etag, _sync_max_id, _sync_bits_len
 
+def current_sync_version():
+    row = get_db().execute("SELECT COALESCE(MAX(version), 0) FROM sync_log").fetchone()
+    return int(row[0])
+
+def parse_since(token):
+    """Resolve a ?since= cursor given as a version number or an etag."""
+    if token is None:
+        return None
+    if token.isdigit():
+        return int(token)
+    return _etag_versions.get(token)
+
+def build_sync_delta(since, version, max_id):
+    """Return the binary delta from `since` to `version`, or None when the
+    device has to take the full bitset (log pruned, cursor ahead, too many
+    ranges)."""
+    if since is None or since > version:
+        return None
+    db = get_db()
+    oldest = db.execute("SELECT MIN(version) FROM sync_log").fetchone()[0]
+    if oldest is None or since < oldest - 1:
+        return None
+    latest = {}
+    for r in db.execute("SELECT card_id, bit FROM sync_log WHERE version > ? AND version <= ? ORDER BY version",
+                        (since, version)):
+        latest[int(r[0])] = int(r[1])
+    # collapse into runs of consecutive ids with the same final bit
+    ranges = []
+    for cid in sorted(latest):
+        op = latest[cid]
+        if ranges and ranges[-1][2] == op and ranges[-1][0] + ranges[-1][1] == cid and ranges[-1][1] < 0xFFFF:
+            ranges[-1][1] += 1
+        else:
+            ranges.append([cid, 1, op])
+    if len(ranges) > DELTA_MAX_RANGES:
+        return None
+    body = b"".join(DELTA_RANGE.pack(start, length, op) for start, length, op in ranges)
+    return DELTA_HEADER.pack(DELTA_MAGIC, since, version, max_id, len(ranges),
+                             zlib.crc32(body) & 0xFFFFFFFF) + body
+
+def build_index_cache():
+    """Build the sorted uid_hash -> card_id table sent to devices."""
+    global _index_blob, _index_etag
+    db = get_db()
+    pairs = []
+    for r in db.execute("SELECT uid, uid_hash, card_id FROM cards WHERE deleted_at IS NULL AND card_id IS NOT NULL"):
+        h = r["uid_hash"] or compute_uid_hash(r["uid"])
+        pairs.append((int(h, 16), int(r["card_id"])))
+    pairs.sort()
+    body = b"".join(struct.pack("<Q", h) for h, _ in pairs) + b"".join(struct.pack("<I", cid) for _, cid in pairs)
+    _index_blob = INDEX_HEADER.pack(INDEX_MAGIC, len(pairs), zlib.crc32(body) & 0xFFFFFFFF, 0) + body
+    _index_etag = hashlib.sha1(_index_blob).hexdigest()
+    return _index_blob, _index_etag
+
+# ---------- Xor filter (matches src/XorFilter.cpp) ----------
+_M64 = 0xFFFFFFFFFFFFFFFF
+
+def _xor_mix(h):
+    """murmur3 64-bit finalizer"""
+    h ^= h >> 33
+    h = (h * 0xff51afd7ed558ccd) & _M64
+    h ^= h >> 33
+    h = (h * 0xc4ceb9fe1a85ec53) & _M64
+    h ^= h >> 33
+    return h
+
+def _xor_slots(h, block):
+    def rotl(x, r):
+        return ((x << r) | (x >> (64 - r))) & _M64
+    def reduce(x):
+        return ((x & 0xFFFFFFFF) * block) >> 32
+    return (reduce(h), reduce(rotl(h, 21)) + block, reduce(rotl(h, 42)) + 2 * block)
+
+def build_xor8(keys):
+    """Return (seed, block_length, fingerprints) for an xor8 filter."""
+    keys = sorted(set(keys))
+    block = (32 + (123 * len(keys) + 99) // 100) // 3
+    cap = 3 * block
+    rng = random.Random(len(keys))
+    while True:
+        seed = rng.getrandbits(64)
+        hashes = [_xor_mix((k + seed) & _M64) for k in keys]
+        xormask = [0] * cap
+        count = [0] * cap
+        for h in hashes:
+            for i in _xor_slots(h, block):
+                xormask[i] ^= h
+                count[i] += 1
+        queue = [i for i in range(cap) if count[i] == 1]
+        stack = []
+        while queue:
+            i = queue.pop()
+            if count[i] != 1:
+                continue
+            h = xormask[i]
+            stack.append((i, h))
+            for j in _xor_slots(h, block):
+                xormask[j] ^= h
+                count[j] -= 1
+                if count[j] == 1:
+                    queue.append(j)
+        if len(stack) == len(keys):
+            break
+    fps = bytearray(cap)
+    for i, h in reversed(stack):
+        a, b, c = _xor_slots(h, block)
+        fps[i] = ((h ^ (h >> 32)) & 0xFF) ^ fps[a] ^ fps[b] ^ fps[c]
+    return seed, block, fps
+
+def build_filter_cache():
+    """Build the xor filter blob over the uid_hash of every known card."""
+    global _filter_blob, _filter_etag
+    db = get_db()
+    keys = [int(r["uid_hash"] or compute_uid_hash(r["uid"]), 16)
+            for r in db.execute("SELECT uid, uid_hash FROM cards WHERE deleted_at IS NULL")]
+    seed, block, fps = build_xor8(keys)
+    _filter_blob = FILTER_HEADER.pack(FILTER_MAGIC, len(set(keys)), block,
+                                      zlib.crc32(fps) & 0xFFFFFFFF, seed) + bytes(fps)
+    _filter_etag = hashlib.sha1(_filter_blob).hexdigest()
+    return _filter_blob, _filter_etag
+
+def wants_binary_sync():
+    """Device asks for the binary framing via Accept or ?format=bin."""
+    if request.args.get("format") == "bin":
+        return True
+    return SYNC_MIME in request.headers.get("Accept", "")
+
+def pick_sync_encoding():
+    """Smallest cached form of the full reply the device can decode, as
+    (body, encoding name or None)."""
+    offered = {e.strip().lower() for e in request.headers.get(SYNC_ENCODING_HEADER, "").split(",")}
+    body, name = _sync_blob, None
+    for enc, blob in _sync_encoded.items():
+        if enc in offered and len(blob) < len(body):
+            body, name = blob, enc
+    return body, name
+
 @app.route("/api/sync", methods=["GET"])
 def get_sync_packet():
     # Use the cached bitset + etag and support conditional GET
@@ -313,10 +745,46 @@ def get_sync_packet():
     if inm and inm == etag:
         return ('', 304)
 
+    if wants_binary_sync():
+        delta = build_sync_delta(parse_since(request.args.get("since")), _sync_version, max_id)
+        # Deltas are at most a few hundred bytes and go out as they are
+        body, encoding = (delta, None) if delta is not None else pick_sync_encoding()
+        resp = make_response(body)
+        resp.headers['Content-Type'] = SYNC_MIME
+        if encoding:
+            resp.headers[SYNC_ENCODING_HEADER] = encoding
+        resp.headers['ETag'] = etag
+        resp.headers[SYNC_VERSION_HEADER] = str(_sync_version)
+        return resp
+
     return jsonify({
         "max_id": max_id,
         "bits": bits.hex()
-    }), 200, { 'ETag': etag }
+    }), 200, { 'ETag': etag, SYNC_VERSION_HEADER: str(_sync_version) }
+
+@app.route("/api/sync/index", methods=["GET"])
+def get_sync_index():
+    """UID hash -> card_id table so devices can resolve cards offline."""
+    blob, etag = (_index_blob, _index_etag) if _index_blob is not None else build_index_cache()
+    inm = request.headers.get('If-None-Match')
+    if inm and inm == etag:
+        return ('', 304)
+    resp = make_response(blob)
+    resp.headers['Content-Type'] = SYNC_MIME
+    resp.headers['ETag'] = etag
+    return resp
+
+@app.route("/api/sync/filter", methods=["GET"])
+def get_sync_filter():
+    """Xor filter of known uid hashes; devices reject foreign cards locally."""
+    blob, etag = (_filter_blob, _filter_etag) if _filter_blob is not None else build_filter_cache()
+    inm = request.headers.get('If-None-Match')
+    if inm and inm == etag:
+        return ('', 304)
+    resp = make_response(blob)
+    resp.headers['Content-Type'] = SYNC_MIME
+    resp.headers['ETag'] = etag
+    return resp
 
 # New lightweight metadata endpoint for cheap checks
 @app.route("/api/sync/meta", methods=["GET"])
@@ -325,10 +793,21 @@ def get_sync_meta():
     return jsonify({
         "max_id": max_id,
         "etag": etag,
-        "bits_len": bits_len
+        "bits_len": bits_len,
+        "version": _sync_version
     })
 
 #---- Helpers ----
+def record_sync_change(uid):
+    """Append the card's effective bit to the sync change log (caller commits)."""
+    db = get_db()
+    r = db.execute("SELECT card_id, authorized, deleted_at FROM cards WHERE uid=?", (uid,)).fetchone()
+    if not r or r["card_id"] is None:
+        return
+    bit = 1 if (r["authorized"] and r["deleted_at"] is None) else 0
+    db.execute("INSERT INTO sync_log(card_id, bit) VALUES(?,?)", (int(r["card_id"]), bit))
+    db.execute("DELETE FROM sync_log WHERE version <= (SELECT MAX(version) FROM sync_log) - ?", (SYNC_LOG_KEEP,))
+
 def assign_card_id(uid):
     db = get_db()
     # Get next ID and increment atomically
@@ -347,6 +826,10 @@ if __name__ == "__main__":
     import logging, traceback
     logging.basicConfig(level=logging.DEBUG)
     print(">>> Starting server.py - launching Flask app on 0.0.0.0:5000", flush=True)
+    # HTTP/1.1 so devices can keep one connection open across requests
+    # (werkzeug's default HTTP/1.0 closes the socket after every reply)
+    from werkzeug.serving import WSGIRequestHandler
+    WSGIRequestHandler.protocol_version = "HTTP/1.1"
     try:
         # run without the reloader to keep all output in the same process
         app.run(host="0.0.0.0", port=5000, debug=False, use_reloader=False)
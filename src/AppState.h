@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include "Lockfree.h"
+
+// State and requests shared between loop(), NetworkTask and the timer
+// callbacks. Everything here is a single atomic word: no String, no heap,
+// no lock.
+
+// Server enroll mode ("enroll_mode" in /api/status and the event stream)
+enum EnrollMode : uint8_t { ENROLL_NONE, ENROLL_GRANT, ENROLL_REVOKE };
+
+inline EnrollMode parseEnrollMode(const char *name) {
+    if (name && strcmp(name, "grant") == 0) return ENROLL_GRANT;
+    if (name && strcmp(name, "revoke") == 0) return ENROLL_REVOKE;
+    return ENROLL_NONE;
+}
+
+inline const char *enrollModeName(EnrollMode mode) {
+    return mode == ENROLL_GRANT ? "grant" : mode == ENROLL_REVOKE ? "revoke" : "none";
+}
+
+// Device status written by NetworkTask, read by anyone. Word layout: bits
+// 0-1 EnrollMode, bit 2 event stream live, bits 16-31 change counter
+// (wraps), so a reader can tell from one load whether to redraw.
+class AppStatus {
+public:
+    struct Snapshot {
+        EnrollMode enroll;
+        bool pushLive;
+        uint16_t changes;
+    };
+
+    static Snapshot decode(uint32_t word) {
+        return Snapshot{static_cast<EnrollMode>(word & ENROLL_MASK), (word & PUSH_LIVE) != 0,
+                        static_cast<uint16_t>(word >> 16)};
+    }
+
+    Snapshot load() const { return decode(word_.load(std::memory_order_acquire)); }
+    EnrollMode enroll() const { return load().enroll; }
+
+    // True when the value changed (and the change counter moved)
+    bool setEnroll(EnrollMode mode) { return update(ENROLL_MASK, mode & ENROLL_MASK); }
+    bool setPushLive(bool live) { return update(PUSH_LIVE, live ? PUSH_LIVE : 0); }
+
+private:
+    static constexpr uint32_t ENROLL_MASK = 0x3;
+    static constexpr uint32_t PUSH_LIVE = 0x4;
+    static constexpr uint32_t CHANGE_STEP = 1UL << 16;
+
+    std::atomic<uint32_t> word_{0};
+
+    bool update(uint32_t mask, uint32_t bits) {
+        uint32_t old = word_.load(std::memory_order_relaxed);
+        for (;;) {
+            if ((old & mask) == bits) return false;
+            const uint32_t next = ((old & ~mask) | bits) + CHANGE_STEP;
+            if (word_.compare_exchange_weak(old, next, std::memory_order_release, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+};
+
+// RequestBits raised for NetworkTask (timers, console, events, loop())
+enum NetRequest : uint32_t {
+    NET_SYNC = 1UL << 0,         // run AuthSync::update()
+    NET_ENROLL_POLL = 1UL << 1,  // poll /api/status now (after a scan)
+    NET_WIFI_UP = 1UL << 2,      // station got an IP: probe and sync now
+};
+
+// RequestBits raised for loop()
+enum LoopRequest : uint32_t {
+    LOOP_DISPLAY = 1UL << 0,     // publish a fresh display snapshot
+    LOOP_WIFI = 1UL << 1,        // Wi-Fi connected or lost: redraw the status line
+};
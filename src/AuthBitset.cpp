@@ -0,0 +1,66 @@
+#include "AuthBitset.h"
+#include "Lockfree.h"
+#include <cstring>
+
+// AuthBitset
+// ----------
+// Lookups announce themselves in the slot's reader count and then
+// re-check the state word; the writer changes the word first and drains
+// the count before it touches a slot's set. Either the lookup sees the
+// new word and backs off, or the writer sees the lookup and waits for it
+// (sequentially consistent atomics on both sides).
+
+bool AuthBitset::lookup(uint32_t id, bool &set) const {
+    for (;;) {
+        const uint32_t w = word_.load();
+        if (!(w & VALID)) return false;
+        const Slot &s = slots_[w & SLOT_MASK];
+        s.readers.fetch_add(1);
+        if (word_.load() != w) {
+            // Published meanwhile: the slot may be freed, use the new one
+            s.readers.fetch_sub(1);
+            continue;
+        }
+        const bool inRange = s.set.loaded() && id <= s.set.maxId();
+        if (inRange) set = s.set.contains(id);
+        s.readers.fetch_sub(1);
+        return inRange;
+    }
+}
+
+void AuthBitset::drain(const Slot &slot) {
+    // A lookup preempted on this core needs the CPU to leave
+    spinWait([&slot] { return slot.readers.load() != 0; });
+}
+
+void AuthBitset::publish(CardSet &fresh, const char *etag) {
+    const uint32_t w = word_.load();
+    const uint32_t cur = w & SLOT_MASK;
+    Slot &next = slots_[1 - cur];
+    Slot &prev = slots_[cur];
+
+    // Idle since the last publish; a late lookup may still be backing off
+    drain(next);
+    next.set.swap(fresh);
+    fresh.clear();
+    if (etag) {
+        strncpy(next.etag, etag, ETAG_MAX);
+        next.etag[ETAG_MAX] = '\0';
+    } else if (w & VALID) {
+        memcpy(next.etag, prev.etag, sizeof(next.etag));
+    } else {
+        next.etag[0] = '\0';
+    }
+    word_.store((((w >> GEN_SHIFT) + 1) << GEN_SHIFT) | VALID | (1 - cur));
+
+    // Scans now start on `next`; free the old image once the last one left
+    drain(prev);
+    prev.set.clear();
+}
+
+void AuthBitset::clear() {
+    const uint32_t w = word_.load();
+    word_.store(w & ~VALID);
+    drain(slots_[w & SLOT_MASK]);
+    slots_[w & SLOT_MASK].set.clear();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "CardSet.h"
+
+// The authorization set (card_id in the set = authorized) as published
+// generations of CardSet images: scans read the published one while a
+// sync builds the next with CardSet::Builder, then one atomic store of the
+// state word (slot, valid flag, generation counter) publishes set, max_id
+// and ETag together. A failed build never touches the published
+// generation. Once scans have left it, the previous generation is freed,
+// so two images exist only while a sync is running.
+//
+// lookup() may run in any task and never waits: it only retries when a
+// generation was published between its two loads of the state word, and
+// publications are a sync apart. Everything else is for the one writer
+// (the task running syncs).
+class AuthBitset {
+public:
+    static constexpr size_t ETAG_MAX = 47;
+
+    AuthBitset() = default;
+
+    AuthBitset(const AuthBitset&) = delete;
+    AuthBitset& operator=(const AuthBitset&) = delete;
+
+    // Any task: false when nothing is published or `id` is beyond max_id
+    bool lookup(uint32_t id, bool &set) const;
+
+    // Writer: the published generation
+    bool valid() const { return word_.load(std::memory_order_relaxed) & VALID; }
+    const CardSet &set() const { return active().set; }
+    uint32_t maxId() const { return valid() ? active().set.maxId() : 0; }
+    const char *etag() const { return valid() ? active().etag : ""; }
+    uint32_t generation() const { return word_.load(std::memory_order_relaxed) >> GEN_SHIFT; }
+
+    // Writer: publish `fresh` (left empty) with its ETag; nullptr keeps
+    // the previous one
+    void publish(CardSet &fresh, const char *etag);
+    // Withdraw and free the published generation
+    void clear();
+
+private:
+    static constexpr uint32_t SLOT_MASK = 0x1;
+    static constexpr uint32_t VALID = 0x2;
+    static constexpr uint32_t GEN_SHIFT = 2;
+
+    struct Slot {
+        CardSet set;
+        char etag[ETAG_MAX + 1] = "";
+        // Lookups currently reading this slot
+        mutable std::atomic<uint32_t> readers{0};
+    };
+
+    Slot slots_[2];
+    std::atomic<uint32_t> word_{0};
+
+    const Slot &active() const { return slots_[word_.load(std::memory_order_relaxed) & SLOT_MASK]; }
+    // Wait until no lookup reads `slot` any more
+    static void drain(const Slot &slot);
+};
@@ -0,0 +1,80 @@
+#include "AuthJournal.h"
+#include "Latency.h"
+#include <algorithm>
+#include <LittleFS.h>
+
+// AuthJournal
+// -----------
+// The pending buffer is shared between loop() (append) and NetworkTask
+// (flush), guarded by a spinlock held only for the memcpy.
+
+namespace {
+    const char *JOURNAL_FILE = "/allow_deny.log";
+}
+
+File AuthJournal::openLog(const char *mode) {
+    if (!LittleFS.begin()) return File();
+    if (mode[0] == 'r' && !LittleFS.exists(JOURNAL_FILE)) return File();
+    return LittleFS.open(JOURNAL_FILE, mode);
+}
+
+bool AuthJournal::append(uint64_t hash, bool allowed) {
+    bool ok = false;
+    portENTER_CRITICAL(&mux_);
+    if (pendingCount_ < PENDING_MAX) {
+        pending_[pendingCount_] = Record{hash, static_cast<uint8_t>(allowed ? 1 : 0)};
+        pendingCount_ = pendingCount_ + 1;
+        ok = true;
+    } else {
+        ++dropped_;
+    }
+    portEXIT_CRITICAL(&mux_);
+    return ok;
+}
+
+void AuthJournal::discardPending() {
+    portENTER_CRITICAL(&mux_);
+    pendingCount_ = 0;
+    portEXIT_CRITICAL(&mux_);
+}
+
+bool AuthJournal::flushDue(unsigned long now) const {
+    const size_t n = pendingCount_;
+    if (n == 0) return false;
+    return n >= FLUSH_BATCH || now - lastFlush_ >= FLUSH_INTERVAL_MS;
+}
+
+bool AuthJournal::flush(unsigned long now) {
+    Record batch[PENDING_MAX];
+    size_t n = 0;
+    portENTER_CRITICAL(&mux_);
+    n = pendingCount_;
+    memcpy(batch, pending_, n * sizeof(Record));
+    pendingCount_ = 0;
+    portEXIT_CRITICAL(&mux_);
+    lastFlush_ = now;
+    if (n == 0) return true;
+
+    File f = openLog(FILE_APPEND);
+    const size_t bytes = n * sizeof(Record);
+    const bool ok = f && f.write(reinterpret_cast<const uint8_t*>(batch), bytes) == bytes;
+    if (f) f.close();
+    if (ok) Latency::flashWrite(bytes);
+    if (!ok) {
+        // Put the batch back in front of anything appended meanwhile
+        portENTER_CRITICAL(&mux_);
+        const size_t keep = std::min(PENDING_MAX - n, static_cast<size_t>(pendingCount_));
+        memmove(pending_ + n, pending_, keep * sizeof(Record));
+        memcpy(pending_, batch, bytes);
+        pendingCount_ = n + keep;
+        portEXIT_CRITICAL(&mux_);
+        return false;
+    }
+    logRecords_ += n;
+    return true;
+}
+
+void AuthJournal::truncate() {
+    if (LittleFS.begin()) LittleFS.remove(JOURNAL_FILE);
+    logRecords_ = 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <FS.h>
+
+// Write-ahead journal for learned allow/deny results.
+//
+// The scan path only appends a record to a small RAM buffer (no flash I/O).
+// NetworkTask calls flush() to append the buffered records to
+// `/allow_deny.log` in one write; AuthSync compacts the log into the
+// `/learned.bin` snapshot once it passes COMPACT_RECORDS and replays it on
+// boot. Records carry final values, so replaying twice is harmless.
+class AuthJournal {
+public:
+    struct __attribute__((packed)) Record {
+        uint64_t hash;
+        uint8_t allowed; // 1 = allow, 0 = deny
+    };
+    static_assert(sizeof(Record) == 9, "journal record is 9 bytes on flash");
+
+    // RAM buffer between scan path and NetworkTask
+    static constexpr size_t PENDING_MAX = 32;
+    // Flush when this many records are waiting, or FLUSH_INTERVAL_MS passed
+    static constexpr size_t FLUSH_BATCH = 8;
+    static constexpr unsigned long FLUSH_INTERVAL_MS = 1000;
+    // Log length that triggers compaction into the base snapshot
+    static constexpr size_t COMPACT_RECORDS = 512;
+
+    AuthJournal() = default;
+
+    // Queue a record (any task). False when the buffer is full; the result
+    // then stays in RAM only and is re-learned on the next server lookup.
+    bool append(uint64_t hash, bool allowed);
+
+    // Drop buffered records (e.g. a new sync generation retired them)
+    void discardPending();
+
+    // True when buffered records should be written now
+    bool flushDue(unsigned long now) const;
+
+    // Append buffered records to the log file. Returns false on I/O error;
+    // the records are then kept for the next attempt.
+    bool flush(unsigned long now);
+
+    bool needsCompaction() const { return logRecords_ >= COMPACT_RECORDS; }
+
+    // Remove the log after its contents were folded into the snapshot
+    void truncate();
+
+    // Apply every intact record in the log through fn(hash, allowed).
+    // A torn trailing record (power loss mid-append) is ignored.
+    template <typename Fn>
+    size_t replay(Fn fn) {
+        File f = openLog(FILE_READ);
+        if (!f) return 0;
+        Record r{};
+        size_t n = 0;
+        while (f.read(reinterpret_cast<uint8_t*>(&r), sizeof(r)) == sizeof(r)) {
+            fn(r.hash, r.allowed != 0);
+            ++n;
+        }
+        f.close();
+        logRecords_ = n;
+        return n;
+    }
+
+    size_t pending() const { return pendingCount_; }
+    size_t logRecords() const { return logRecords_; }
+    uint32_t dropped() const { return dropped_; }
+
+private:
+    Record pending_[PENDING_MAX] = {};
+    volatile size_t pendingCount_ = 0;
+    size_t logRecords_ = 0;
+    uint32_t dropped_ = 0;
+    unsigned long lastFlush_ = 0;
+    portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+
+    static File openLog(const char *mode);
+};
@@ -1,8 +1,13 @@
 #include "AuthSync.h"
 #include "HashUtils.h"
+#include "Latency.h"
+#include "Log.h"
+#include "SyncFormat.h"
+#include "SyncJson.h"
 #include <algorithm>
 #include <ArduinoJson.h>
 #include <cstdlib>
+#include <cstring>
 #include <HTTPClient.h>
 #include <LittleFS.h>
 #include <limits>
@@ -15,11 +20,38 @@
  responsiveness but is not optimizing to minimize server traffic*/
 
 
-// Translation-unit local static storage for the authorization bitset.
-// Allocated in BSS to avoid heap usage. Size driven by AuthSync::MAX_SAFE_BYTES.
-// MAX_SAFE_CARDS = 200000 -> bytes = (200000+7)/8 = 25000
 namespace {
-    uint8_t authorized_bits_storage[25000];
+    // "RBH1": /allow_deny.bin holding two FlatHashSet slot tables
+    constexpr uint32_t ALLOW_DENY_MAGIC = 0x31484252UL;
+
+    // Clock of the learned cache's TTLs; there is no wall clock, so a
+    // reboot starts a new timeline (see loadETagFromNVS())
+    uint32_t uptimeS() { return static_cast<uint32_t>(Latency::now() / 1000000); }
+
+    // Cap on reservations taken from the X-Allow-Count / X-Deny-Count headers
+    constexpr long SYNC_UIDS_MAX = 100000;
+
+    size_t headerCount(HTTPClient &http, const char *name) {
+        const long n = http.header(name).toInt();
+        return static_cast<size_t>(std::max(0L, std::min(n, SYNC_UIDS_MAX)));
+    }
+
+    // HTTPClient::writeToStream() target feeding a JSON sync reply to the
+    // reader; a rejected piece reports a short write and ends the transfer.
+    class JsonSink : public Stream {
+    public:
+        explicit JsonSink(SyncJsonReader &reader) : reader_(reader) {}
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t *buf, size_t len) override {
+            return reader_.feed(reinterpret_cast<const char*>(buf), len) ? len : 0;
+        }
+        int available() override { return 0; }
+        int read() override { return -1; }
+        int peek() override { return -1; }
+
+    private:
+        SyncJsonReader &reader_;
+    };
 }
 
 /*for each byte in input:
@@ -46,14 +78,25 @@ uint64_t AuthSync::hashUid(const String& s) {
     return fnv1a64(reinterpret_cast<const uint8_t*>(t.c_str()), t.length());
 */}
 
-AuthSync::AuthSync(const String& serverBase) : server_base(serverBase) {
+AuthSync::AuthSync(const String& serverBase, ServerSession *session)
+    : server_base(serverBase), session_(session) {
 
-    authorized_bits = authorized_bits_storage;
+    // Standalone use (tests, tools): keep a private connection
+    if (!session_) {
+        ownedSession_ = new ServerSession(serverBase);
+        session_ = ownedSession_;
+    }
+    learnedMutex_ = xSemaphoreCreateMutex();
 }
 
 AuthSync::~AuthSync() {
-    // authorized_bits points at static storage — don't free. Reset pointer for safety.
-    authorized_bits = nullptr;
+    delete ownedSession_;
+    ownedSession_ = nullptr;
+    session_ = nullptr;
+    if (learnedMutex_) {
+        vSemaphoreDelete(learnedMutex_);
+        learnedMutex_ = nullptr;
+    }
     if (prefsOpen_) {
         prefs_.end();
         prefsOpen_ = false;
@@ -68,52 +111,11 @@ size_t AuthSync::calcBitsetBytes(uint32_t maxId) {
     if (bits > std::numeric_limits<size_t>::max() - 7) return 0;
     return (bits + 7) / 8;
 }
-//Write a byte at index idx in the bitset, return true on success,
-//false when out of bounds or uninitialized
-bool AuthSync::writeByteAt(size_t idx, uint8_t val) const {
-    if (!authorized_bits) return false;
-    const size_t bytes = calcBitsetBytes(max_card_id);
-    if (bytes == 0) return false;
-    if (idx >= bytes) return false;
-    authorized_bits[idx] = val;
-    return true;
-}
-//Safe read of a byte at index idx in the bitset, return true on success,
-//false when out of bounds or uninitialized
-bool AuthSync::readByteAt(size_t idx, uint8_t &out) const {
-    if (!authorized_bits) return false;
-    const size_t bytes = calcBitsetBytes(max_card_id);
-    if (bytes == 0) return false;
-    if (idx >= bytes) return false;
-    out = authorized_bits[idx];
-    return true;
-}
-//checks whether a specific card ID’s authorization bit is set in the internal bitset
-// and returns true if it is, false otherwise.
-bool AuthSync::isBitSet(uint32_t id) const {
-    if (!authorized_bits) return false;
-    if (id > max_card_id) return false;
-    const size_t idx = (size_t)id >> 3;
-    const uint8_t bit = id & 7;
-    return ((authorized_bits[idx] >> bit) & 1) != 0;
-}
-//marks a specific card ID as authorized by setting its corresponding bit in the internal bitset.
-//Verify that buffer is allocated and id is within bounds before setting the bit.
-void AuthSync::setBit(uint32_t id) const {
-    if (!authorized_bits) return;//buffer is initialized
-    if (id > max_card_id) return;//bounds check
-    const size_t idx = (size_t)id >> 3;
-    const uint8_t bit = id & 7;
-    authorized_bits[idx] |= 1u << bit;
-}
-//Reverse of setBit: clears the authorization bit for a specific card ID,
-// marking it as unauthorized. Verify buffer and bounds before clearing.
-void AuthSync::clearBit(uint32_t id) const {
-    if (!authorized_bits) return;//buffer is initialized
-    if (id > max_card_id) return;//bounds check
-    const size_t idx = (size_t)id >> 3; //divide by 8
-    const uint8_t bit = id & 7;
-    authorized_bits[idx] &= ~(1u << bit);
+
+namespace {
+    // Bit helpers for a chunk bitmap under construction (`low` = id within the chunk)
+    inline void setBitIn(uint8_t *bits, uint32_t low) { bits[low >> 3] |= 1u << (low & 7); }
+    inline void clearBitIn(uint8_t *bits, uint32_t low) { bits[low >> 3] &= ~(1u << (low & 7)); }
 }
 
 // Open NVS and load any cached hashes first for offline use
@@ -128,6 +130,8 @@ bool AuthSync::begin() {
     if (LittleFS.begin()) {
         loadBitsetFromFS();
     }
+    // Tables still loaded from LittleFS move into the store once
+    if (unstoredTables_ && store_.ready()) persistTables(unstoredTables_);
     return syncFromServer();
 }
 
@@ -143,93 +147,271 @@ bool AuthSync::preloadOffline() {
         if (LittleFS.begin()) {
             loadBitsetFromFS();
         }
+        if (unstoredTables_ && store_.ready()) persistTables(unstoredTables_);
         return true;
     }
     return false;
 }
 
 bool AuthSync::update() {
-    if (millis() - last_sync > SYNC_INTERVAL) {
+#ifdef MESH_SYNC
+    const bool relaxed = push_active_ || mesh_covered_;
+#else
+    const bool relaxed = push_active_;
+#endif
+    const unsigned long interval = relaxed ? PUSH_SYNC_INTERVAL : SYNC_INTERVAL;
+    if (force_sync_ || millis() - last_sync > interval) {
         return syncFromServer();
     }
     return true;
 }
 
-bool AuthSync::isAuthorized(const String& uid) {
-    // Compute and log hash for debugging/offline cache tracking
-    const uint64_t h = hashUid(uid);
-    Serial.printf("[AuthSync] UID: %s -> Hash: 0x%016llX\n", uid.c_str(), h);
+bool AuthSync::isAuthorized(const UidKey& uid, uint64_t h) {
+#if APP_LOG_LEVEL >= APP_LOG_DEBUG
+    char hex[UidKey::HEX_CHARS + 1];
+    uid.toHex(hex);
+    LOG_D("[AuthSync] UID: %s -> Hash: 0x%016llX", hex, h);
+#endif
 
-    // Priority 1: Check local cache first (deny takes precedence)
-    const bool denied = std::binary_search(denyHashes_.begin(), denyHashes_.end(), h);
-    if (denied) {
-        Serial.println("[AuthSync] Found in deny cache -> DENIED");
-        return false;
-    }
-    const bool allowed = std::binary_search(allowHashes_.begin(), allowHashes_.end(), h);
-    if (allowed) {
-        Serial.println("[AuthSync] Found in allow cache -> AUTHORIZED");
-        return true;
+    bool allowed = false;
+    int64_t t = Latency::now();
+    const bool known = decideLocally(h, allowed);
+    t = Latency::lap(Latency::STAGE_CACHE, t);
+    if (known) {
+        Latency::count(Latency::CACHE_HITS);
+        return allowed;
     }
 
-    // Priority 2: Unknown card - query server if online
-    Serial.println("[AuthSync] Unknown card; checking server...");
+    // Priority 3: Unknown card - query server if online. With a worker the
+    // scan path waits at most lookup_deadline_ms instead of a full request.
+    LOG_I("[AuthSync] Unknown card; checking server...");
     if (WiFi.status() == WL_CONNECTED && server_base.length() > 0) {
-        int card_id = -1;
-        bool server_allowed = false;
-        if (getCardAuthFromServer(uid, card_id, server_allowed)) {
+        Latency::count(Latency::SERVER_FALLBACKS);
+        bool answered = false;
+        if (lookupWorker_) {
+            answered = awaitServerLookup(uid, h, allowed);
+        } else {
+            int card_id = -1;
+            answered = getCardAuthFromServer(uid, card_id, allowed);
             // Learn the server result for offline use next time
-            addKnownAuth(uid, server_allowed);
-            Serial.printf("[AuthSync] Server says: %s\n", server_allowed ? "AUTHORIZED" : "DENIED");
-            return server_allowed;
+            if (answered) addKnownAuth(h, allowed);
+        }
+        Latency::lap(Latency::STAGE_SERVER, t);
+        if (answered) {
+            LOG_I("[AuthSync] Server says: %s", allowed ? "AUTHORIZED" : "DENIED");
+            return allowed;
         }
     }
 
-    // Priority 3: Offline and unknown - deny by default
-    Serial.println("[AuthSync] Offline + unknown -> DENIED by default");
-    return false;
+    Latency::count(Latency::OFFLINE_DECISIONS);
+    // Priority 4: Offline (or late) and unknown - configured policy
+    LOG_I("[AuthSync] Offline + unknown -> %s by policy", offline_allow_unknown_ ? "AUTHORIZED" : "DENIED");
+    return offline_allow_unknown_;
 }
 
-bool AuthSync::getCardAuthFromServer(const String& uid, int &card_id, bool &authorized) {
-    card_id = -1;
-    authorized = false;
-    // Guard: need WiFi and a configured server base
-    if (WiFi.status() != WL_CONNECTED || server_base.length() == 0) return false;
+AuthSync::LocalSource AuthSync::lookupLocal(uint64_t h, bool &bit, uint32_t &cardId,
+                                            LearnedCache::Lookup &learned) const {
+    // One lock-free read section over the tables; NetworkTask swaps them
+    // (syncs, revocations, learned results) under tables_
+    LocalSource source = SRC_NONE;
+    const uint32_t now = uptimeS();
+    learned = LearnedCache::MISS;
+    tables_.read([&] {
+        source = SRC_NONE;
+        // Priority 0: Xor filter over every card the server knows. A negative
+        // is definite, so foreign cards are rejected without any table walk
+        // or server round trip. Bypassed while the server reported newer
+        // changes.
+        if (!filter_stale_ && !knownFilter_.mayContain(h)) {
+            source = SRC_FILTER;
+            return;
+        }
+        // Priority 1: Synced index + bitset (authoritative as of the last
+        // sync). Ids beyond the current bitset mean the index is newer; fall
+        // through.
+        if (uidIndex_.find(h, cardId) && bitset_.lookup(cardId, bit)) {
+            source = SRC_INDEX;
+            return;
+        }
+        // Priority 2: Learned server answers. Every one is newer than the
+        // lists: a sync that replaces them retires the cache.
+        learned = learned_.find(h, now, bit);
+        if (learned == LearnedCache::HIT) {
+            source = SRC_LEARNED;
+            return;
+        }
+        // Priority 3: Server lists (deny takes precedence)
+        if (denyHashes_.contains(h)) {
+            source = SRC_DENY;
+        } else if (allowHashes_.contains(h)) {
+            source = SRC_ALLOW;
+        }
+    });
+    return source;
+}
+
+bool AuthSync::decideLocally(uint64_t h, bool &allowed, bool scan) {
+    uint32_t card_id_local = 0;
+    bool bit = false;
+    LearnedCache::Lookup learned = LearnedCache::MISS;
+    // Logging waits until the read section is left
+    const LocalSource source = lookupLocal(h, bit, card_id_local, learned);
+    if (scan && source != SRC_FILTER && source != SRC_INDEX) learned_.note(learned);
+
+    switch (source) {
+    case SRC_FILTER:
+        LOG_I("[AuthSync] Not in known-card filter -> DENIED");
+        allowed = false;
+        return true;
+    case SRC_INDEX:
+        allowed = bit;
+        LOG_I("[AuthSync] Index card_id=%u -> %s", card_id_local, allowed ? "AUTHORIZED" : "DENIED");
+        return true;
+    case SRC_LEARNED:
+        allowed = bit;
+        LOG_I("[AuthSync] Learned answer -> %s", allowed ? "AUTHORIZED" : "DENIED");
+        return true;
+    case SRC_DENY:
+        LOG_I("[AuthSync] Found in deny list -> DENIED");
+        allowed = false;
+        return true;
+    case SRC_ALLOW:
+        LOG_I("[AuthSync] Found in allow list -> AUTHORIZED");
+        allowed = true;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool AuthSync::decideCached(uint64_t h, bool &allowed) const {
+    uint32_t cardId = 0;
+    bool bit = false;
+    LearnedCache::Lookup learned = LearnedCache::MISS;
+    switch (lookupLocal(h, bit, cardId, learned)) {
+    case SRC_NONE:
+        return false;
+    case SRC_FILTER:
+    case SRC_DENY:
+        allowed = false;
+        return true;
+    case SRC_ALLOW:
+        allowed = true;
+        return true;
+    default:
+        allowed = bit;
+        return true;
+    }
+}
+
+uint32_t AuthSync::syncAgeS() const {
+    return last_sync ? (millis() - last_sync) / 1000 : UINT32_MAX;
+}
+
+void AuthSync::setLookupWorker(TaskHandle_t worker, unsigned long deadlineMs) {
+    lookup_deadline_ms = deadlineMs;
+    lookupWorker_ = worker;
+}
 
-    // Backoff: only apply if we've actually probed before (last_server_probe != 0)
-    if (!server_last_ok && last_server_probe != 0 && (millis() - last_server_probe) < 10000) {
-        return false; // use offline cache immediately
-    }
-
-    // Periodic lightweight server status probe (cached) to avoid expensive lookups when server down
-    if (millis() - last_server_probe > 5000 || last_server_probe == 0) {
-        last_server_probe = millis();
-        HTTPClient ping;
-        // Further reduce probe timeout to minimize per-scan delay when offline.
-        // A very short timeout risks false negatives on a slow network; tune if needed.
-        ping.setTimeout(250); // was 1000ms
-        ping.begin(server_base + "/api/status");
-        const int sc = ping.GET();
-        ping.end();
-        server_last_ok = (sc == 200);
-        if (!server_last_ok) {
-            Serial.println("[AuthSync] Server status probe failed quickly; using offline cache");
-            return false; // return immediately to avoid extra delay this scan
+bool AuthSync::awaitServerLookup(const UidKey& uid, uint64_t h, bool &allowed) {
+    // Same guard as the inline path: known down means no point in waiting
+    if (!session_->health().up()) return false;
+
+    LookupRequest req{};
+    req.uid = uid;
+    req.hash = h;
+    // Drop a notification left over from an earlier, abandoned lookup
+    ulTaskNotifyTake(pdTRUE, 0);
+    req.ticket = ++lookupTicket_ & LOOKUP_TICKET_MASK;
+    if (req.ticket == 0) req.ticket = ++lookupTicket_ & LOOKUP_TICKET_MASK;
+    // Waiter before ticket: the worker notifies whoever the ticket names
+    lookupWaiter_.store(xTaskGetCurrentTaskHandle(), std::memory_order_relaxed);
+    lookupWaitTicket_.store(req.ticket, std::memory_order_release);
+
+    auto answerFor = [this](uint32_t ticket, uint32_t &done) {
+        done = lookupDone_.load(std::memory_order_acquire);
+        return (done >> 2) == ticket;
+    };
+    uint32_t done = 0;
+    if (lookups_.push(req)) {
+        xTaskNotifyGive(lookupWorker_);
+        const unsigned long start = millis();
+        for (;;) {
+            const unsigned long elapsed = millis() - start;
+            if (elapsed >= lookup_deadline_ms) break;
+            // Other notifications (card reads) only cause a re-check
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(lookup_deadline_ms - elapsed));
+            if (answerFor(req.ticket, done)) break;
         }
+    } else {
+        LOG_W("[AuthSync] Lookup queue full");
     }
-    if (!server_last_ok) return false;  // fallback to offline caches
 
-    // Additional quick guard: if probe just failed we already returned
-    HTTPClient http;
-    http.setTimeout(1200); // reduce per-card lookup timeout
-    http.begin(server_base + "/api/cards/" + uid);
-    const int code = http.GET();
-    if (code != 200) {
-        http.end();
+    lookupWaitTicket_.store(0, std::memory_order_release);
+    // Re-check: the answer may have landed right at the deadline
+    const bool answered = answerFor(req.ticket, done);
+    allowed = done & 1;
+
+    if (!answered) {
+        ++lookups_late_;
+        Latency::count(Latency::SERVER_LATE);
+        LOG_W("[AuthSync] Lookup missed %lu ms deadline", lookup_deadline_ms);
         return false;
     }
-    String payload = http.getString();
-    http.end();
+    ++lookups_on_time_;
+    return done & 2;
+}
+
+void AuthSync::serviceLookups() {
+    LookupRequest req{};
+    while (lookups_.pop(req)) {
+        bool allowed = false;
+        // A repeated scan of a card answered (late) meanwhile needs no request
+        bool found = decideLocally(req.hash, allowed, false);
+        if (!found) {
+            int card_id = -1;
+            found = getCardAuthFromServer(req.uid, card_id, allowed);
+            // Learn the server result even if the scan stopped waiting
+            if (found) addKnownAuth(req.hash, allowed);
+        }
+
+        // A scan that gave up meanwhile finds the answer under its ticket
+        // and ignores it; the notification is dropped by the next lookup
+        TaskHandle_t waiter = nullptr;
+        if (lookupWaitTicket_.load(std::memory_order_acquire) == req.ticket) {
+            lookupDone_.store(req.ticket << 2 | (found ? 2U : 0U) | (allowed ? 1U : 0U), std::memory_order_release);
+            waiter = lookupWaiter_.load(std::memory_order_relaxed);
+        }
+        if (waiter) {
+            xTaskNotifyGive(waiter);
+        } else if (found) {
+            char hex[UidKey::HEX_CHARS + 1];
+            req.uid.toHex(hex);
+            LOG_I("[AuthSync] Late answer for %s learned: %s", hex, allowed ? "AUTHORIZED" : "DENIED");
+        }
+    }
+}
+
+bool AuthSync::getCardAuthFromServer(const UidKey& uid, int &card_id, bool &authorized) {
+    card_id = -1;
+    authorized = false;
+    // Guard: need WiFi and a configured server base
+    if (WiFi.status() != WL_CONNECTED || server_base.length() == 0) return false;
+
+    // Shared reachability (NetworkTask probes, real traffic refreshes it).
+    // Not known to be up: use the offline caches without touching the network.
+    if (!session_->health().up()) return false;
+
+    // Reduced per-card lookup timeout; also bounds the wait for a sync in
+    // progress on the shared connection.
+    char path[sizeof("/api/cards/") + UidKey::HEX_CHARS];
+    memcpy(path, "/api/cards/", sizeof("/api/cards/") - 1);
+    uid.toHex(path + sizeof("/api/cards/") - 1);
+    ServerSession::Request req(*session_, path, 1200, pdMS_TO_TICKS(1200));
+    if (!req.acquired()) return false;
+    const int code = req.GET();
+    if (code != 200) return false;
+    const String payload = req.body();
 
     JsonDocument doc;
     const DeserializationError err = deserializeJson(doc, payload);
@@ -251,28 +433,34 @@ bool AuthSync::getCardAuthFromServer(const String& uid, int &card_id, bool &auth
     // reachability checks the code follows this policy:
     //
     // 1. Bootstrap / initial probe:
-    //    - When the device boots `last_server_probe` will be zero. In that
-    //      case `syncFromServer()` will perform a single short, synchronous
-    //      `/api/status` probe so the initial call (usually from `begin()` in
-    //      setup) can decide whether to attempt the first sync immediately.
+    //    - When the device boots reachability is UNKNOWN. In that case
+    //      `syncFromServer()` performs a single short `/api/status` probe so
+    //      the initial call (usually from `begin()` in setup) can decide
+    //      whether to attempt the first sync immediately.
     //
-    // 2. Centralized periodic probes (preferred after boot):
-    //    - After boot a single central timer (implemented in `NetworkTask`)
-    //      performs periodic `/api/status` probes and updates a shared
-    //      reachability flag. That timer also calls `AuthSync::setServerProbeResult`
-    //      so AuthSync uses the same cached result and timestamp. This prevents
-    //      multiple components from issuing redundant status probes.
+    // 2. Shared reachability (Reachability.h, owned by the ServerSession):
+    //    - Every exchange on the session reports its outcome, so successful
+    //      real traffic keeps the state UP without extra probes. NetworkTask
+    //      only probes after a quiet period, or when a backoff retry is due.
     //
     // 3. Backoff after failures:
-    //    - If a recent probe indicates the server was unreachable, `syncFromServer`
-    //      enforces a short backoff window and skips attempts to avoid hammering
-    //      a dead server.
+    //    - While the state is DOWN syncs and card lookups are skipped; the
+    //      NetworkTask retries with jittered exponential backoff.
     //
     // 4. ETag and incremental update:
     //    - When the server returns bitset data the response may include an
     //      `ETag`. `syncFromServer()` stores that ETag in NVS and uses it in
     //      future syncs via `If-None-Match` headers to receive HTTP 304 and
     //      avoid re-downloading unchanged data.
+    //    - The device asks for the binary framing (SyncFormat.h). That reply
+    //      is read in SyncFormat::STREAM_CHUNK pieces, compressed chunk by
+    //      chunk into the next CardSet and CRC-checked, so heap use follows
+    //      the authorized cards, not max_id. JSON replies are still accepted
+    //      from older servers.
+    //    - Once a sync carried `X-Sync-Version`, later syncs send `?since=`.
+    //      The server answers with a delta (set/clear card_id ranges) that
+    //      re-encodes only the touched 64K-id chunks; `/bits.bin` holds the
+    //      compressed image. Large gaps get a full bitset instead.
     //
     // 5. Allow/deny lists handling:
     //    - If the server returns explicit `allow`/`deny` arrays they are
@@ -286,150 +474,168 @@ bool AuthSync::getCardAuthFromServer(const String& uid, int &card_id, bool &auth
     // keeping all components aligned on server reachability.
     // ---------------------------------------------------------------------------
 bool AuthSync::syncFromServer() {
-    if (WiFi.status() != WL_CONNECTED || server_base.length() == 0)
-        return false;
-    // Backoff: only after a failed probe and not on the very first attempt (last_server_probe != 0)
-    if (!server_last_ok && last_server_probe != 0 && (millis() - last_server_probe) < 10000) {
-        Serial.println("[AuthSync] Backoff active; skipping sync");
-        return false;
+    bool changed = false;
+    uint32_t version = sync_version;
+    if (!syncBitsetFromServer(changed, version)) return false;
+    uint8_t dirty = changed ? TABLE_CARDS : 0;
+    // Card ids only move when the bitset does, so a 304 needs no index or
+    // filter check unless a table is missing or the server told us it changed.
+    bool tablesOk = true;
+    bool updated = false;
+    if (changed || filter_stale_ || uidIndex_.empty()) {
+        tablesOk = syncIndexFromServer(updated) && tablesOk;
+        if (updated) dirty |= TABLE_INDEX;
+    }
+    if (changed || filter_stale_ || !knownFilter_.loaded()) {
+        tablesOk = syncFilterFromServer(updated) && tablesOk;
+        if (updated) dirty |= TABLE_FILTER;
     }
+    // One flash write for the whole sync. Version last: a crash before this
+    // point replays the same delta, which is idempotent because ranges carry
+    // final bit values. Without a persisted set the next sync is a full one.
+    const uint8_t saved = dirty ? persistTables(dirty) : 0;
+    if (changed) saveSyncVersion((saved & TABLE_CARDS) ? version : 0);
+    if (changed) learned_stale_ = true;
+    if (tablesOk) {
+        filter_stale_ = false;
+        force_sync_ = false;
+        if (learned_stale_) invalidateLearned();
+    }
+    return true;
+}
 
-    // Only perform an inline reachability probe on the very first sync attempt.
-    // After the initial probe we rely on the external server-check timer
-    // (NetworkTask) to update `server_last_ok` and `last_server_probe` so
-    // we don't duplicate probes here.
-    if (last_server_probe == 0) {
-        // First-time probe: do a quick reachability check so the initial
-        // sync (called from setup()) can proceed when no external timer has
-        // yet run.
-        last_server_probe = millis();
-        HTTPClient ping;
-        ping.setTimeout(1000); // short probe for initial sync
-        ping.begin(server_base + "/api/status");
-        const int sc = ping.GET();
-        ping.end();
-        server_last_ok = (sc == 200);
-        if (!server_last_ok) {
-            Serial.println("[AuthSync] Sync aborted: initial probe failed (server unreachable)");
+bool AuthSync::syncBitsetFromServer(bool &changed, uint32_t &version) {
+    changed = false;
+    if (WiFi.status() != WL_CONNECTED || server_base.length() == 0)
+        return false;
+    const Reachability &health = session_->health();
+    if (health.state() == Reachability::UNKNOWN) {
+        // First attempt before NetworkTask probed (begin() from setup): a
+        // short probe decides whether the full sync is worth trying.
+        if (!session_->probe(1000)) {
+            LOG_W("[AuthSync] Sync aborted: initial probe failed (server unreachable)");
             return false;
         }
-    } else if (!server_last_ok) {
-        // An external timer (NetworkTask) has already probed and reported the
-        // server as unreachable — skip the sync to avoid redundant network calls.
-        Serial.println("[AuthSync] Sync aborted: server unreachable (cached)");
+    } else if (health.down()) {
+        // NetworkTask retries with backoff; don't add traffic to a dead server
+        LOG_W("[AuthSync] Sync aborted: server unreachable (cached)");
         return false;
     }
 
-    HTTPClient http;
-    http.setTimeout(2000);  // shorter sync timeout
-    http.begin(server_base + "/api/sync");
+    // With a known change-log version ask for a delta; the server decides
+    // whether a delta or the full bitset is cheaper.
+    String path = "/api/sync";
+    if (sync_version != 0 && bitset_.maxId() != 0) {
+        path += "?since=" + String(sync_version);
+    }
+    ServerSession::Request req(*session_, path, 2000);  // shorter sync timeout
+    if (!req.acquired()) return false;
+    HTTPClient &http = req.http();
+    // Headers must be registered before GET() or header() returns empty
+    static const char *kSyncHeaders[] = {"ETag", "Content-Type", SyncFormat::VERSION_HEADER,
+                                         SyncFormat::ENCODING_HEADER, SyncFormat::ALLOW_COUNT_HEADER,
+                                         SyncFormat::DENY_COUNT_HEADER};
+    http.collectHeaders(kSyncHeaders, 6);
+    // Prefer the binary framing; older servers ignore this and reply JSON
+    http.addHeader("Accept", SyncFormat::BINARY_MIME);
+    // Cuts the radio-on time of a full sync; the server picks the smaller
+    http.addHeader(SyncFormat::ENCODING_HEADER, String(SyncFormat::ENCODING_DEFLATE) + ", " + SyncFormat::ENCODING_RLE);
     // Send If-None-Match header if we have a saved ETag to allow 304 responses
-    if (last_etag.length()) {
-        http.addHeader("If-None-Match", last_etag);
+    if (bitset_.etag()[0]) {
+        http.addHeader("If-None-Match", bitset_.etag());
     }
-    const int code = http.GET();
+    const int code = req.GET();
 
     if (code == 304) {
         // Not modified — nothing to do. Update last_sync and return success.
         last_sync = millis();
-        Serial.println("[AuthSync] Sync: 304 Not Modified — skipping update");
-        http.end();
+        LOG_I("[AuthSync] Sync: 304 Not Modified — skipping update");
         return true;
     }
     if (code != 200) {
-        Serial.printf("[AuthSync] Sync failed with code: %d\n", code);
-        http.end();
+        LOG_W("[AuthSync] Sync failed with code: %d", code);
         return false;
     }
 
-    String payload = http.getString();
-    http.end();
-
-    JsonDocument doc;
-    const DeserializationError err = deserializeJson(doc, payload);
-    if (err) {
-        Serial.printf("[AuthSync] JSON parse error: %s\n", err.c_str());
-        return false;
-    }
-
-    // Extract new maximum card ID and bitset hex from server payload
-    const uint32_t new_max = doc["max_id"] | 0;
-    const String hex = doc["bits"].as<String>();
-
-    // Save new ETag header from server (if returned)
+    // Save new ETag header from server (if returned). Only committed once
+    // the payload has been applied so a failed sync is retried next time.
     const String serverEtag = http.header("ETag");
-    if (serverEtag.length()) {
-        last_etag = serverEtag;
-        if (prefsOpen_) prefs_.putString("bitset_etag", last_etag);
-    }
+    const auto serverVersion = static_cast<uint32_t>(http.header(SyncFormat::VERSION_HEADER).toInt());
 
-    // Use the static storage; validate size fits
-    const size_t bytes = calcBitsetBytes(new_max);
-    if (bytes == 0 || bytes > MAX_SAFE_BYTES) {
-        Serial.println("[AuthSync] Sync failed: requested bitset too large for static buffer");
-        max_card_id = 0;
-        return false;
+    if (http.header("Content-Type").startsWith(SyncFormat::BINARY_MIME)) {
+        SyncDecoder::Encoding encoding;
+        if (!SyncDecoder::parse(http.header(SyncFormat::ENCODING_HEADER), encoding)) {
+            LOG_W("[AuthSync] Sync failed: unknown encoding '%s'", http.header(SyncFormat::ENCODING_HEADER).c_str());
+            return false;
+        }
+        bool wasDelta = false;
+        if (!readBinarySync(req, encoding, serverEtag.length() ? serverEtag.c_str() : nullptr, wasDelta)) {
+            // A rejected delta means our cursor is unusable; next sync is full
+            if (wasDelta) saveSyncVersion(0);
+            return false;
+        }
+        if (serverEtag.length()) putPref("bitset_etag", bitset_.etag());
+        last_sync = millis();
+        version = serverVersion;
+        changed = true;
+        LOG_I("[AuthSync] Synced max_id=%u version=%u gen=%u (%s)", bitset_.maxId(),
+                      serverVersion, bitset_.generation(), wasDelta ? "delta" : "binary");
+        return true;
     }
-    // Zero only the required portion
-    std::fill_n(authorized_bits, bytes, 0);
 
-    // Decode the hex bitset payload (two characters per byte) into
-    // the newly allocated buffer using the bounds-checked writer.
-    for (size_t i = 0; i + 1 < hex.length(); i += 2) {
-        String byteStr = hex.substring(i, i + 2);
-        const auto v = static_cast<uint8_t>(strtol(byteStr.c_str(), nullptr, 16));
-        if (!writeByteAt(i / 2, v)) break;
+    // Legacy JSON reply: { max_id, bits: "<hex>" [, allow/deny arrays] },
+    // parsed as it streams in (sized or chunked) instead of buffered whole.
+    // Size both tables once from the optional count headers so large lists
+    // never rehash mid-stream.
+    FlatHashSet allowNew;
+    FlatHashSet denyNew;
+    allowNew.reserve(headerCount(http, SyncFormat::ALLOW_COUNT_HEADER));
+    denyNew.reserve(headerCount(http, SyncFormat::DENY_COUNT_HEADER));
+    SyncJsonReader reader(allowNew, denyNew);
+    JsonSink sink(reader);
+    const int written = http.writeToStream(&sink);
+    Latency::count(Latency::SYNC_BYTES, reader.bytes());
+
+    // An oversized, malformed or unbuildable reply keeps the current generation
+    CardSet fresh;
+    if (written < 0 || !reader.finish(fresh)) {
+        LOG_W("[AuthSync] JSON sync rejected after %u bytes (max_id=%u)",
+              static_cast<unsigned>(reader.bytes()), reader.maxId());
+        return false;
     }
+    req.markConsumed();
+    bitset_.publish(fresh, serverEtag.length() ? serverEtag.c_str() : nullptr);
+    if (serverEtag.length()) putPref("bitset_etag", bitset_.etag());
 
-    // Commit the new bitset and record the time of this successful sync.
-    max_card_id = new_max;
+    // Record the time of this successful sync; syncFromServer() persists
     last_sync = millis();
-
-    // Persist the bitset snapshot to filesystem for faster boot/offline use
-    if (LittleFS.begin()) {
-        saveBitsetToFS(bytes);
-    }
-
-    // Optionally refresh offline allow/deny UID hash lists when the
-    // server includes arrays of UIDs. These are normalized, hashed,
-    // de-duplicated, and then swapped into the in-memory caches.
-    if (doc["allow"].is<JsonArray>() || doc["allow_uids"].is<JsonArray>() ||
-        doc["deny"].is<JsonArray>()  || doc["deny_uids"].is<JsonArray>()) {
-        std::vector<uint64_t> allowNew;
-        std::vector<uint64_t> denyNew;
-// Extract optional allow/deny UID arrays from the sync JSON, normalize + hash
-// each UID into 64-bit values, and append to the new vectors.
-        auto loadArray = [&](const char* key, std::vector<uint64_t>& out){
-            const JsonVariant var = doc[key];
-            if (!var.is<JsonArray>()) return;
-            for (JsonVariant v : var.as<JsonArray>()) {
-                String uid = v.as<const char*>();
-                out.push_back(hashUid(uid));
-            }
-        };
-//std::sort magic incantation
-
-        loadArray("allow", allowNew);
-        loadArray("allow_uids", allowNew);
-        loadArray("deny", denyNew);
-        loadArray("deny_uids", denyNew);
-
-        std::sort(allowNew.begin(), allowNew.end());//
-        allowNew.erase(std::unique(allowNew.begin(), allowNew.end()), allowNew.end());
-        std::sort(denyNew.begin(), denyNew.end());
-        denyNew.erase(std::unique(denyNew.begin(), denyNew.end()), denyNew.end());
-
-        if (!allowNew.empty() || !denyNew.empty()) {
+    version = serverVersion;
+    changed = true;
+
+    // Optionally refresh offline allow/deny UID hash lists when the server
+    // includes arrays of UIDs: already normalized, hashed and de-duplicated
+    // by the reader, they replace the in-memory caches.
+    if (reader.skipped()) {
+        LOG_W("[AuthSync] Skipped %u UID(s) longer than %u characters", static_cast<unsigned>(reader.skipped()),
+              static_cast<unsigned>(SyncJsonReader::UID_MAX));
+    }
+    if (!allowNew.empty() || !denyNew.empty()) {
+        if (learnedMutex_) xSemaphoreTake(learnedMutex_, portMAX_DELAY);
+        {
+            SeqGuard::Write publish(tables_);
             allowHashes_.swap(allowNew);
             denyHashes_.swap(denyNew);
-            saveETagToNVS();
-            //It then saves the new vectors to NVS for persistence across reboots.
-
         }
+        // Learned results go with the generation (syncFromServer())
+        saveETagToNVS();
+        if (learnedMutex_) xSemaphoreGive(learnedMutex_);
+        LOG_I("[AuthSync] Lists synced: %u allow, %u deny", static_cast<unsigned>(allowHashes_.size()),
+              static_cast<unsigned>(denyHashes_.size()));
     }
 
     // Log a compact summary of the sync result for debugging.
-    Serial.printf("[AuthSync] Synced max_id=%u (%u bytes heap)\n", max_card_id, bytes);
+    LOG_I("[AuthSync] Synced max_id=%u cards=%u (%u bytes) gen=%u", bitset_.maxId(), bitset_.set().cards(),
+                  static_cast<unsigned>(bitset_.set().imageBytes()), bitset_.generation());
     return true;
 }
 //Old and uncalled, commented out until verified no longer used
@@ -445,7 +651,7 @@ bool AuthSync::syncFromServer() {
     int code = http.GET();
 
     if (code != 200) {
-        Serial.printf("[AuthSync] Card lookup failed: %d\n", code);
+        LOG_W("[AuthSync] Card lookup failed: %d", code);
         http.end();
         return -1;
     }
@@ -456,7 +662,7 @@ bool AuthSync::syncFromServer() {
     JsonDocument doc;
     const DeserializationError err = deserializeJson(doc, payload);
     if (err) {
-        Serial.printf("[AuthSync] JSON parse error: %s\n", err.c_str());
+        LOG_W("[AuthSync] JSON parse error: %s", err.c_str());
         return -1;
     }
 
@@ -467,28 +673,313 @@ bool AuthSync::syncFromServer() {
     return doc["card_id"] | -1;
 }*/
 
+// GET a binary table endpoint (`/api/sync/index`, `/api/sync/filter`) with
+// If-None-Match and stream the body into `load`. `updated` is false on 304.
+// Older servers without the endpoint reply 404, leaving the table as is.
+bool AuthSync::fetchTableFromServer(const char *path, String &etag, const char *nvsKey, bool conditional,
+                                    const std::function<bool(const SyncFormat::ReadFn&)> &load, bool &updated) {
+    updated = false;
+    ServerSession::Request req(*session_, path, 2000);
+    if (!req.acquired()) return false;
+    HTTPClient &http = req.http();
+    static const char *kTableHeaders[] = {"ETag"};
+    http.collectHeaders(kTableHeaders, 1);
+    if (conditional && etag.length()) {
+        http.addHeader("If-None-Match", etag);
+    }
+    const int code = req.GET();
+    if (code == 304) return true;
+    if (code != 200) {
+        LOG_W("[AuthSync] %s failed with code: %d", path, code);
+        return false;
+    }
+    const String newEtag = http.header("ETag");
+    WiFiClient *stream = http.getStreamPtr();
+    const bool ok = stream && load([&http, stream](uint8_t *dst, size_t len) {
+        return readStreamFully(http, *stream, dst, len);
+    });
+    if (!ok) return false;
+    req.markConsumed();
+    etag = newEtag;
+    putPref(nvsKey, etag.c_str());
+    updated = true;
+    return true;
+}
+
+bool AuthSync::syncIndexFromServer(bool &updated) {
+    const bool ok = fetchTableFromServer("/api/sync/index", index_etag, "index_etag", !uidIndex_.empty(),
+        [this](const SyncFormat::ReadFn &rd) {
+            // Downloaded off to the side; scans keep using the old index
+            UidIndex fresh;
+            if (!fresh.load(rd)) return false;
+            SeqGuard::Write publish(tables_);
+            uidIndex_.swap(fresh);
+            return true;
+        }, updated);
+    if (!ok || !updated) return ok;
+    LOG_I("[AuthSync] UID index synced: %u entries", static_cast<unsigned>(uidIndex_.size()));
+    return true;
+}
+
+bool AuthSync::syncFilterFromServer(bool &updated) {
+    const bool ok = fetchTableFromServer("/api/sync/filter", filter_etag, "filter_etag", knownFilter_.loaded(),
+        [this](const SyncFormat::ReadFn &rd) {
+            XorFilter fresh;
+            if (!fresh.load(rd)) {
+                // The old filter may miss new cards: bypass it until a
+                // table sync succeeds
+                filter_stale_ = true;
+                return false;
+            }
+            SeqGuard::Write publish(tables_);
+            knownFilter_.swap(fresh);
+            return true;
+        }, updated);
+    if (!ok || !updated) return ok;
+    LOG_I("[AuthSync] Filter synced: %u keys, %u bytes", static_cast<unsigned>(knownFilter_.keyCount()),
+                  static_cast<unsigned>(knownFilter_.memoryBytes()));
+    return true;
+}
+
+// Stream a binary `/api/sync` reply straight from the socket, through the
+// decoder when the server compressed it. The leading magic selects a full
+// bitset (BitsetHeader) or a delta (DeltaHeader).
+bool AuthSync::readBinarySync(ServerSession::Request &req, SyncDecoder::Encoding encoding, const char *etag,
+                              bool &wasDelta) {
+    wasDelta = false;
+    HTTPClient &http = req.http();
+    WiFiClient *stream = http.getStreamPtr();
+    if (!stream) return false;
+
+    // Never pull past the body; the decoder may ask for more than is left
+    const int size = http.getSize();
+    size_t left = size > 0 ? static_cast<size_t>(size) : std::numeric_limits<size_t>::max();
+    SyncDecoder body(encoding, [&http, stream, &left](uint8_t *dst, size_t len) {
+        const size_t n = readStreamSome(http, *stream, dst, std::min(len, left));
+        left -= n;
+        return n;
+    });
+    if (!body.begin()) {
+        LOG_W("[AuthSync] Binary sync: no memory for the decoder");
+        return false;
+    }
+    const SyncFormat::ReadFn rd = [&body](uint8_t *dst, size_t len) { return body.read(dst, len); };
+
+    uint32_t magic = 0;
+    bool ok;
+    if (!rd(reinterpret_cast<uint8_t*>(&magic), sizeof(magic))) {
+        LOG_W("[AuthSync] Binary sync: short header");
+        return false;
+    }
+    if (magic == SyncFormat::DELTA_MAGIC) {
+        wasDelta = true;
+        ok = applyDelta(rd, etag);
+    } else {
+        SyncFormat::BitsetHeader hdr{};
+        hdr.magic = magic;
+        if (magic != SyncFormat::BITSET_MAGIC ||
+            !rd(reinterpret_cast<uint8_t*>(&hdr) + sizeof(magic), sizeof(hdr) - sizeof(magic))) {
+            LOG_W("[AuthSync] Binary sync: bad header");
+            return false;
+        }
+        ok = readBitsetBody(rd, hdr.max_id, hdr.length, hdr.crc32, etag);
+    }
+    // The frame carries its own CRC; a bad end of the encoding only costs the
+    // socket (the unread rest would be parsed as the next reply)
+    if (ok && body.finish()) {
+        req.markConsumed();
+    } else if (ok) {
+        LOG_W("[AuthSync] Binary sync: encoded body did not end with the frame");
+    }
+    if (ok && encoding != SyncDecoder::IDENTITY) {
+        LOG_I("[AuthSync] Sync body %s: %u -> %u bytes",
+              encoding == SyncDecoder::DEFLATE ? SyncFormat::ENCODING_DEFLATE : SyncFormat::ENCODING_RLE,
+              static_cast<unsigned>(body.encodedBytes()), static_cast<unsigned>(body.decodedBytes()));
+    }
+    return ok;
+}
+
+// Read a full bitset body into the next generation. No payload-sized buffer
+// is allocated; SyncFormat::STREAM_CHUNK pieces are compressed into the new
+// CardSet as they arrive and scans keep answering from the published
+// generation meanwhile.
+bool AuthSync::readBitsetBody(const SyncFormat::ReadFn &rd, uint32_t maxId, uint32_t length, uint32_t crc32,
+                              const char *etag) {
+    CardSet::Builder builder;
+    if (maxId > MAX_CARD_ID || length > calcBitsetBytes(maxId) || !builder.begin(maxId)) {
+        LOG_W("[AuthSync] Binary sync: bad header or no memory (max_id=%u len=%u)", maxId, length);
+        return false;
+    }
+
+    static uint8_t piece[SyncFormat::STREAM_CHUNK];
+    uint32_t crc = 0;
+    size_t got = 0;
+    while (got < length) {
+        const size_t want = std::min<size_t>(SyncFormat::STREAM_CHUNK, length - got);
+        if (!rd(piece, want)) break;
+        crc = HashUtils::crc32Update(crc, piece, want);
+        if (!builder.append(piece, want)) break;
+        got += want;
+    }
+    // finish() leaves the ids a short body did not cover (servers that size
+    // the bitset as (max_id+7)/8 send one byte less) empty
+    CardSet fresh;
+    if (got != length || crc != crc32 || !builder.finish(fresh)) {
+        LOG_W("[AuthSync] Binary sync: %s after %u/%u bytes; keeping generation %u",
+                      got != length ? "truncated or out of memory" : crc != crc32 ? "CRC mismatch" : "out of memory",
+                      static_cast<unsigned>(got), static_cast<unsigned>(length), bitset_.generation());
+        return false;
+    }
+    bitset_.publish(fresh, etag);
+    return true;
+}
+
+// Apply a delta reply to the published set. Records are buffered (at most
+// DELTA_MAX_RANGES * 8 bytes) and CRC-checked before anything is applied.
+// The next generation copies untouched 64K-id chunks as they are and
+// re-encodes the touched ones; scans see the whole delta at once when it
+// is published.
+bool AuthSync::applyDelta(const SyncFormat::ReadFn &rd, const char *etag) {
+    SyncFormat::DeltaHeader hdr{};
+    hdr.magic = SyncFormat::DELTA_MAGIC;
+    if (!rd(reinterpret_cast<uint8_t*>(&hdr) + sizeof(hdr.magic), sizeof(hdr) - sizeof(hdr.magic))) {
+        return false;
+    }
+    if (hdr.from_version != sync_version || hdr.count > SyncFormat::DELTA_MAX_RANGES ||
+        hdr.max_id > MAX_CARD_ID || hdr.max_id < bitset_.maxId()) {
+        LOG_W("[AuthSync] Delta rejected (from=%u have=%u count=%u max_id=%u)",
+                      hdr.from_version, sync_version, hdr.count, hdr.max_id);
+        return false;
+    }
+
+    static SyncFormat::DeltaRange ranges[SyncFormat::DELTA_MAX_RANGES];
+    const size_t recBytes = hdr.count * sizeof(SyncFormat::DeltaRange);
+    if (recBytes && !rd(reinterpret_cast<uint8_t*>(ranges), recBytes)) {
+        return false;
+    }
+    if (HashUtils::crc32Update(0, reinterpret_cast<const uint8_t*>(ranges), recBytes) != hdr.crc32) {
+        LOG_W("[AuthSync] Delta CRC mismatch");
+        return false;
+    }
+
+    // New card ids beyond the old max_id start out empty
+    const CardSet &current = bitset_.set();
+    CardSet::Builder builder;
+    if (!builder.begin(hdr.max_id)) return false;
+    size_t touched = 0;
+    while (builder.chunk() <= (hdr.max_id >> 16)) {
+        const uint32_t first = builder.chunk() << 16;
+        const uint32_t end = std::min<uint32_t>(first + (CardSet::CHUNK_IDS - 1), hdr.max_id);
+        uint8_t *bits = nullptr;
+        // Ranges apply in record order, later ones win
+        for (size_t i = 0; i < hdr.count; ++i) {
+            const SyncFormat::DeltaRange &r = ranges[i];
+            if (r.length == 0 || r.start > end) continue;
+            const uint32_t last = std::min<uint32_t>(r.start + r.length - 1, end);
+            if (last < first) continue;
+            if (!bits) {
+                bits = builder.bits();
+                current.expand(builder.chunk(), bits);
+            }
+            for (uint32_t id = std::max(r.start, first); id <= last; ++id) {
+                if (r.op == SyncFormat::DELTA_SET) setBitIn(bits, id - first); else clearBitIn(bits, id - first);
+            }
+        }
+        if (bits) ++touched;
+        if (!(bits ? builder.commit() : builder.copy(current))) return false;
+    }
+    CardSet fresh;
+    if (!builder.finish(fresh)) return false;
+    bitset_.publish(fresh, etag);
+#ifdef MESH_SYNC
+    if (deltaTap_) deltaTap_(hdr, ranges, bitset_.etag());
+#endif
+    LOG_I("[AuthSync] Applied delta %u -> %u (%u ranges, %u chunk(s) re-encoded)",
+                  hdr.from_version, hdr.to_version, hdr.count, static_cast<unsigned>(touched));
+    return true;
+}
+
+// Read what the socket has, up to `len` bytes; 0 once the connection drops
+// or stalls past the HTTPClient timeout (or for len == 0).
+size_t AuthSync::readStreamSome(HTTPClient &http, WiFiClient &stream, uint8_t *dst, size_t len) {
+    const unsigned long start = millis();
+    while (len) {
+        const int avail = stream.available();
+        if (avail <= 0) {
+            if (!http.connected() || millis() - start > 2000) return 0;
+            vTaskDelay(1);
+            continue;
+        }
+        const size_t n = stream.readBytes(dst, std::min<size_t>(len, (size_t)avail));
+        Latency::count(Latency::SYNC_BYTES, n);
+        return n;
+    }
+    return 0;
+}
+
+// Read exactly `len` bytes or give up when the connection drops or stalls
+bool AuthSync::readStreamFully(HTTPClient &http, WiFiClient &stream, uint8_t *dst, size_t len) {
+    for (size_t got = 0; got < len;) {
+        const size_t n = readStreamSome(http, stream, dst + got, len - got);
+        if (n == 0) return false;
+        got += n;
+    }
+    return true;
+}
+
 // -------------------- Offline cache helpers --------------------
-void AuthSync::addKnownAuth(const String& uid, bool allowed) {
-    // Learn a card's authorization status for offline use by
-
-    const uint64_t h = hashUid(uid);
-    // Ensure sorted insert - helper lambda
-    auto insert_sorted = [](std::vector<uint64_t>& vec, uint64_t val){
-        const auto it = std::lower_bound(vec.begin(), vec.end(), val);
-        if (it == vec.end() || *it != val) vec.insert(it, val);
-    };
+void AuthSync::addKnownAuth(uint64_t h, bool allowed) {
+    // Learn a card's authorization status (by UID hash) for offline use.
+    // The mutex orders writers and a compaction reading the table; the
+    // write section keeps scans off the set being rewritten.
+    if (learnedMutex_) xSemaphoreTake(learnedMutex_, portMAX_DELAY);
+    bool stored = false;
+    {
+        SeqGuard::Write edit(tables_);
+        stored = learned_.insert(h, allowed, uptimeS());
+    }
+    if (learnedMutex_) xSemaphoreGive(learnedMutex_);
+    if (!stored) return;
+    // Persisted later by flushLearned(); no flash I/O on the scan path
+    if (!journal_.append(h, allowed)) {
+        LOG_W("[AuthSync] Journal buffer full; result kept in RAM only");
+    }
+}
+
+void AuthSync::invalidateLearned() {
+    learned_stale_ = false;
+    if (learnedMutex_) xSemaphoreTake(learnedMutex_, portMAX_DELAY);
+    {
+        SeqGuard::Write edit(tables_);
+        learned_.invalidate();
+    }
+    // Nothing on flash may bring the old results back
+    journal_.discardPending();
+    journal_.truncate();
+    LearnedCache::removeFromFS();
+    if (learnedMutex_) xSemaphoreGive(learnedMutex_);
+    LOG_I("[AuthSync] Learned cache retired (epoch %u)", learned_.epoch());
+}
 
-    if (allowed) {
-        // Remove from deny if present
-        const auto it = std::lower_bound(denyHashes_.begin(), denyHashes_.end(), h);
-        if (it != denyHashes_.end() && *it == h) denyHashes_.erase(it);
-        insert_sorted(allowHashes_, h);
+void AuthSync::flushLearned() {
+    const unsigned long now = millis();
+    if (!journal_.flushDue(now)) return;
+    if (!journal_.flush(now)) {
+        LOG_W("[AuthSync] Warning: journal append failed");
+        return;
+    }
+    if (!journal_.needsCompaction()) return;
+    // Fold the log into the snapshot, then drop it. A crash in between only
+    // replays records that the snapshot already contains.
+    if (learnedMutex_) xSemaphoreTake(learnedMutex_, portMAX_DELAY);
+    const bool saved = learned_.saveToFS(uptimeS());
+    if (learnedMutex_) xSemaphoreGive(learnedMutex_);
+    if (saved) {
+        journal_.truncate();
+        LOG_I("[AuthSync] Compacted learned journal into snapshot");
     } else {
-        const auto it = std::lower_bound(allowHashes_.begin(), allowHashes_.end(), h);
-        if (it != allowHashes_.end() && *it == h) allowHashes_.erase(it);
-        insert_sorted(denyHashes_, h);
+        LOG_W("[AuthSync] Warning: journal compaction failed");
     }
-    saveETagToNVS();
 }
 
 bool AuthSync::saveAllowDenyToFS() const {
@@ -497,14 +988,16 @@ bool AuthSync::saveAllowDenyToFS() const {
     const char *final = "/allow_deny.bin";
     File f = LittleFS.open(tmp, FILE_WRITE);
     if (!f) return false;
-    // Write counts as 32-bit little-endian
-    const uint32_t an = (uint32_t)allowHashes_.size();
-    const uint32_t dn = (uint32_t)denyHashes_.size();
-    f.write(reinterpret_cast<const uint8_t*>(&an), sizeof(an));
-    f.write(reinterpret_cast<const uint8_t*>(&dn), sizeof(dn));
-    if (an) f.write(reinterpret_cast<const uint8_t*>(allowHashes_.data()), an * sizeof(uint64_t));
-    if (dn) f.write(reinterpret_cast<const uint8_t*>(denyHashes_.data()), dn * sizeof(uint64_t));
+    // Magic, then both tables in their in-memory slot layout
+    const uint32_t magic = ALLOW_DENY_MAGIC;
+    const bool ok = f.write(reinterpret_cast<const uint8_t*>(&magic), sizeof(magic)) == sizeof(magic) &&
+                    allowHashes_.writeTo(f) && denyHashes_.writeTo(f);
+    if (ok) Latency::flashWrite(f.size());
     f.close();
+    if (!ok) {
+        LittleFS.remove(tmp);
+        return false;
+    }
     LittleFS.remove(final);
     if (!LittleFS.rename(tmp, final)) {
         LittleFS.remove(tmp);
@@ -520,153 +1013,416 @@ bool AuthSync::loadAllowDenyFromFS() {
     File f = LittleFS.open(final, FILE_READ);
     if (!f) return false;
     if (f.size() < static_cast<int>(sizeof(uint32_t))*2) { f.close(); return false; }
-    uint32_t an = 0, dn = 0;
-    f.read(reinterpret_cast<uint8_t*>(&an), sizeof(an));
+    uint32_t first = 0;
+    f.read(reinterpret_cast<uint8_t*>(&first), sizeof(first));
+    if (first == ALLOW_DENY_MAGIC) {
+        // Current format: slot arrays are read back verbatim, no rehash
+        FlatHashSet allowNew;
+        FlatHashSet denyNew;
+        const bool ok = allowNew.readFrom(f) && denyNew.readFrom(f);
+        f.close();
+        if (!ok) return false;
+        SeqGuard::Write publish(tables_);
+        allowHashes_.swap(allowNew);
+        denyHashes_.swap(denyNew);
+        return true;
+    }
+    // Legacy format: two uint32 counts followed by the sorted hash arrays.
+    // Converted once; the next save writes the current format.
+    uint32_t an = first, dn = 0;
     f.read(reinterpret_cast<uint8_t*>(&dn), sizeof(dn));
     // Basic sanity check
     const size_t expected = sizeof(uint32_t)*2 + (size_t)an * sizeof(uint64_t) + (size_t)dn * sizeof(uint64_t);
     if ((size_t)f.size() < expected) { f.close(); return false; }
-    allowHashes_.assign(an, 0);
-    denyHashes_.assign(dn, 0);
-    // Read hashes
-    if (an) f.read(reinterpret_cast<uint8_t*>(allowHashes_.data()), an * sizeof(uint64_t));
-    if (dn) f.read(reinterpret_cast<uint8_t*>(denyHashes_.data()), dn * sizeof(uint64_t));
+    FlatHashSet allowNew;
+    FlatHashSet denyNew;
+    allowNew.reserve(an);
+    denyNew.reserve(dn);
+    uint64_t h = 0;
+    for (uint32_t i = 0; i < an && f.read(reinterpret_cast<uint8_t*>(&h), sizeof(h)) == sizeof(h); ++i) allowNew.insert(h);
+    for (uint32_t i = 0; i < dn && f.read(reinterpret_cast<uint8_t*>(&h), sizeof(h)) == sizeof(h); ++i) denyNew.insert(h);
     f.close();
-    // Ensure sorted
-    std::sort(allowHashes_.begin(), allowHashes_.end());
-    std::sort(denyHashes_.begin(), denyHashes_.end());
+    SeqGuard::Write publish(tables_);
+    allowHashes_.swap(allowNew);
+    denyHashes_.swap(denyNew);
     return true;
 }
 
 // Update saveToNVS to call saveAllowDenyToFS()
 void AuthSync::saveETagToNVS() {
     if (!prefsOpen_) return;
-    // Persist last_etag only
-    if (last_etag.length()) {
-        prefs_.putString("bitset_etag", last_etag);
+    // Persist the bitset ETag only
+    if (bitset_.etag()[0]) {
+        putPref("bitset_etag", bitset_.etag());
     } else {
         prefs_.remove("bitset_etag");
     }
     // Persist allow/deny vectors to LittleFS (best-effort - log on failure, no retry)
     if (!saveAllowDenyToFS()) {
-        Serial.println("[AuthSync] Warning: failed to persist allow/deny to LittleFS");
+        LOG_W("[AuthSync] Warning: failed to persist allow/deny to LittleFS");
     }
 }
 
 void AuthSync::loadETagFromNVS() {
     if (!prefsOpen_) return;
-    // Restore persisted ETag if present
-    if (prefs_.isKey("bitset_etag")) {
-        last_etag = prefs_.getString("bitset_etag", "");
-    } else {
-        last_etag = "";
+    // The bitset ETag is restored together with its data by loadBitsetFromFS()
+    sync_version = prefs_.getUInt("sync_ver", 0);
+    store_.begin();
+    // Table files are only trusted together with their ETags. A file is
+    // newer than the store (written when a commit failed), so it wins.
+    if (uidIndex_.empty()) {
+        UidIndex fresh;
+        if (fresh.loadFromFS()) {
+            index_etag = prefs_.getString("index_etag", "");
+            unstoredTables_ |= TABLE_INDEX;
+            SeqGuard::Write publish(tables_);
+            uidIndex_.swap(fresh);
+        } else if (!attachTables(TABLE_INDEX)) {
+            index_etag = String();
+        }
+    }
+    if (!knownFilter_.loaded()) {
+        XorFilter fresh;
+        if (fresh.loadFromFS()) {
+            filter_etag = prefs_.getString("filter_etag", "");
+            unstoredTables_ |= TABLE_FILTER;
+            SeqGuard::Write publish(tables_);
+            knownFilter_.swap(fresh);
+        } else if (!attachTables(TABLE_FILTER)) {
+            filter_etag = String();
+        }
     }
-    // Attempt to load allow/deny from LittleFS; if it fails leave vectors empty
+    // Attempt to load allow/deny from LittleFS; if it fails leave sets empty
     loadAllowDenyFromFS();
+    // Learned results: the snapshot with the TTL each had left, then the
+    // records since (boot, before scans). Time spent powered off is not
+    // known, so it does not count; journal records get a full TTL.
+    const uint32_t now = uptimeS();
+    size_t replayed = 0;
+    {
+        SeqGuard::Write edit(tables_);
+        learned_.loadFromFS(now);
+        replayed = journal_.replay([this, now](uint64_t h, bool allowed) { learned_.insert(h, allowed, now); });
+    }
+    if (replayed) LOG_I("[AuthSync] Replayed %u journal records", static_cast<unsigned>(replayed));
 }
 
-bool AuthSync::saveBitsetToFS(size_t bytes) {
-    if (bytes == 0) return false;
-    const char *tmp = "/bits.bin.tmp";
-    const char *final = "/bits.bin";
-    File f = LittleFS.open(tmp, FILE_WRITE);
-    if (!f) {
-        Serial.println("[AuthSync] Failed to open tmp file for bitset");
-        return false;
-    }
-    //removed redundant reinterpret_cast<const uint8_t*> from below
-    const size_t written = f.write((authorized_bits), bytes);
-    f.close();
-    if (written != bytes) {
-        Serial.println("[AuthSync] Failed to write full bitset to tmp file");
-        LittleFS.remove(tmp);
-        return false;
-    }
-    LittleFS.remove(final);
-    if (!LittleFS.rename(tmp, final)) {
-        Serial.println("[AuthSync] Failed to rename bitset tmp file");
+bool AuthSync::saveBitsetToFS() {
+    const CardSet &set = bitset_.set();
+    if (!bitset_.valid() || !set.saveToFS()) {
+        LOG_W("[AuthSync] Failed to write card set snapshot");
         return false;
     }
-    if (prefsOpen_) prefs_.putUInt("max_id", max_card_id);
-    Serial.printf("[AuthSync] Saved bitset snapshot %u bytes\n", static_cast<unsigned>(bytes));
+    Latency::flashWrite(set.imageBytes());
+    putPref("max_id", set.maxId());
+    LOG_I("[AuthSync] Saved card set snapshot %u bytes (%u cards)", static_cast<unsigned>(set.imageBytes()),
+                  set.cards());
     return true;
 }
 
 bool AuthSync::loadBitsetFromFS() {
+    // The ETag is only trusted together with the data it describes
+    const String etag = prefsOpen_ ? prefs_.getString("bitset_etag", "") : String();
+    CardSet fresh;
+    if (fresh.loadFromFS()) {
+        bitset_.publish(fresh, etag.c_str());
+        unstoredTables_ |= TABLE_CARDS;
+        return true;
+    }
+    if (attachTables(TABLE_CARDS)) return true;
+
+    // Raw bitset written by older firmware: convert it once (a store
+    // commit removes /bits.bin, so this never shadows a stored set)
     const char *final = "/bits.bin";
     if (!LittleFS.exists(final)) return false;
     File f = LittleFS.open(final, FILE_READ);
     if (!f) return false;
     const size_t bytes = f.size();
-    if (bytes == 0 || bytes > MAX_SAFE_BYTES) {
+    const uint32_t fileMax = bytes ? (uint32_t)((bytes * 8) - 1) : 0;
+    const uint32_t maxId = prefsOpen_ ? prefs_.getUInt("max_id", fileMax) : fileMax;
+    CardSet::Builder builder;
+    if (bytes == 0 || maxId > MAX_CARD_ID || !builder.begin(maxId)) {
         f.close();
-        Serial.println("[AuthSync] Bitset file size invalid or too large");
+        LOG_W("[AuthSync] Bitset file size invalid or too large");
         return false;
     }
-    const size_t r = f.read(reinterpret_cast<uint8_t*>(authorized_bits), bytes);
+    static uint8_t piece[SyncFormat::STREAM_CHUNK];
+    size_t got = 0;
+    while (got < bytes) {
+        const size_t want = std::min<size_t>(sizeof(piece), bytes - got);
+        if (f.read(piece, want) != want || !builder.append(piece, want)) break;
+        got += want;
+    }
     f.close();
-    if (r != bytes) {
-        Serial.println("[AuthSync] Failed to read full bitset from file");
+    if (got != bytes || !builder.finish(fresh)) {
+        LOG_W("[AuthSync] Failed to read full bitset from file");
         return false;
     }
-    if (prefsOpen_) {
-        max_card_id = prefs_.getUInt("max_id", (uint32_t)((bytes * 8) - 1));
-    } else {
-        max_card_id = (uint32_t)((bytes * 8) - 1);
-    }
-    Serial.printf("[AuthSync] Loaded bitset snapshot %u bytes, max_id=%u\n", static_cast<unsigned>(bytes), max_card_id);
+    bitset_.publish(fresh, etag.c_str());
+    LOG_I("[AuthSync] Converted raw bitset snapshot %u bytes, max_id=%u", static_cast<unsigned>(bytes), maxId);
+    unstoredTables_ |= TABLE_CARDS;
+    if (!store_.ready()) saveBitsetToFS();
     return true;
 }
 
-#ifdef AUTH_TEST_HOOK
-// Test helper to simulate a very large `max_card_id` safely in unit tests.
-void AuthSync::TEST_setMaxCardId(size_t maxCardId) {
-    // Cap to a sane maximum for a NodeMCU-32S to avoid exhausting device memory.
-    // 200k cards -> ~25 KB bitset, which is safe on typical ESP32 dev boards.
-    const size_t SAFE_MAX = 200000UL; // 200,000 cards (~25 KB bitset)
-    if (maxCardId > SAFE_MAX) maxCardId = SAFE_MAX;
-
-    // Update max_card_id and compute required bytes
-    max_card_id = (uint32_t)maxCardId;
-    size_t nbytes = calcBitsetBytes(max_card_id);
-    if (nbytes == 0) {
-        // nothing to allocate
-        return;
+uint8_t AuthSync::persistTables(uint8_t dirty) {
+    if (store_.ready()) {
+        // A slot holds every table: unchanged ones are copied over from the
+        // old slot (or RAM), then all of them move onto the new one
+        const CardSet &set = bitset_.set();
+        TableStore::Source sources[TableStore::TABLE_COUNT];
+        if (bitset_.valid() && set.loaded()) {
+            sources[TableStore::TABLE_CARDS] = {set.imageBytes(),
+                [&set](const SyncFormat::WriteFn &out) { return set.writeImage(out); }, bitset_.etag()};
+        }
+        if (!uidIndex_.empty()) {
+            sources[TableStore::TABLE_INDEX] = {uidIndex_.imageBytes(),
+                [this](const SyncFormat::WriteFn &out) { return uidIndex_.writeImage(out); }, index_etag.c_str()};
+        }
+        if (knownFilter_.loaded()) {
+            sources[TableStore::TABLE_FILTER] = {knownFilter_.imageBytes(),
+                [this](const SyncFormat::WriteFn &out) { return knownFilter_.writeImage(out); }, filter_etag.c_str()};
+        }
+        if (store_.commit(sources)) {
+            attachTables(TABLE_ALL);
+            store_.releasePrevious();
+            // Snapshots left in LittleFS would shadow the store at boot
+            CardSet::removeFromFS();
+            UidIndex::removeFromFS();
+            XorFilter::removeFromFS();
+            unstoredTables_ = 0;
+            return TABLE_ALL;
+        }
+        LOG_W("[AuthSync] Table store commit failed; saving to LittleFS");
+        unstoredTables_ |= dirty;
     }
+    if (!LittleFS.begin()) return 0;
+    uint8_t saved = 0;
+    if ((dirty & TABLE_CARDS) && saveBitsetToFS()) saved |= TABLE_CARDS;
+    if (dirty & TABLE_INDEX) {
+        if (uidIndex_.saveToFS()) {
+            Latency::flashWrite(uidIndex_.imageBytes());
+            saved |= TABLE_INDEX;
+        } else {
+            LOG_W("[AuthSync] Warning: failed to persist uid index");
+        }
+    }
+    if (dirty & TABLE_FILTER) {
+        if (knownFilter_.saveToFS()) {
+            Latency::flashWrite(knownFilter_.imageBytes());
+            saved |= TABLE_FILTER;
+        } else {
+            LOG_W("[AuthSync] Warning: failed to persist xor filter");
+        }
+    }
+    return saved;
+}
 
-    if (nbytes > MAX_SAFE_BYTES) {
-        // should not happen due to SAFE_MAX cap, but guard anyway
-        nbytes = MAX_SAFE_BYTES;
+uint8_t AuthSync::attachTables(uint8_t which) {
+    size_t bytes = 0;
+    const uint8_t *image = nullptr;
+    uint8_t attached = 0;
+    CardSet set;
+    if ((which & TABLE_CARDS) && (image = store_.image(TableStore::TABLE_CARDS, bytes)) && set.attach(image, bytes)) {
+        bitset_.publish(set, store_.etag(TableStore::TABLE_CARDS));
+        attached |= TABLE_CARDS;
+    }
+    UidIndex index;
+    if ((which & TABLE_INDEX) && (image = store_.image(TableStore::TABLE_INDEX, bytes)) && index.attach(image, bytes)) {
+        index_etag = store_.etag(TableStore::TABLE_INDEX);
+        attached |= TABLE_INDEX;
+    }
+    XorFilter filter;
+    if ((which & TABLE_FILTER) && (image = store_.image(TableStore::TABLE_FILTER, bytes)) &&
+        filter.attach(image, bytes)) {
+        filter_etag = store_.etag(TableStore::TABLE_FILTER);
+        attached |= TABLE_FILTER;
     }
+    if (attached & (TABLE_INDEX | TABLE_FILTER)) {
+        SeqGuard::Write publish(tables_);
+        if (attached & TABLE_INDEX) uidIndex_.swap(index);
+        if (attached & TABLE_FILTER) knownFilter_.swap(filter);
+    }
+    // The replaced tables (heap or the old slot) are released on return
+    return attached;
+}
+
+void AuthSync::saveSyncVersion(uint32_t version) {
+    sync_version = version;
+    putPref("sync_ver", sync_version);
+}
+
+void AuthSync::putPref(const char *key, const char *value) {
+    if (prefsOpen_) Latency::flashWrite(prefs_.putString(key, value));
+}
+
+void AuthSync::putPref(const char *key, uint32_t value) {
+    if (prefsOpen_) Latency::flashWrite(prefs_.putUInt(key, value));
+}
 
-    // Point to the static storage and zero the used portion
-    authorized_bits = authorized_bits_storage;
-    // avoid C-style memset (tooling may warn); use std::fill_n
-    std::fill_n(authorized_bits, nbytes, 0);
+#ifdef AUTH_TEST_HOOK
+// Test helper to simulate a very large max_id safely in unit tests.
+void AuthSync::TEST_setMaxCardId(size_t maxCardId) {
+    // Cap to the largest id the set accepts; an empty set of that span costs
+    // only its 2 KB chunk directory.
+    const size_t SAFE_MAX = MAX_CARD_ID;
+    if (maxCardId > SAFE_MAX) maxCardId = SAFE_MAX;
+
+    // Publish an empty generation of that size
+    CardSet::Builder builder;
+    CardSet fresh;
+    if (builder.begin((uint32_t)maxCardId) && builder.finish(fresh)) bitset_.publish(fresh, nullptr);
 }
 #endif
 
-void AuthSync::dumpMemoryStats() const {
+void AuthSync::dumpMemoryStats(Print &out) const {
     // Print free heap
     const size_t freeHeap = esp_get_free_heap_size();
     const size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
-    Serial.printf("[AuthSync] freeHeap=%u largestFreeBlock=%u\n", static_cast<unsigned>(freeHeap), static_cast<unsigned>(largest));
+    out.printf("[AuthSync] freeHeap=%u largestFreeBlock=%u\n", static_cast<unsigned>(freeHeap), static_cast<unsigned>(largest));
 
     // Hash vectors
-    Serial.printf("[AuthSync] allowHashes entries=%u bytes=%u\n", static_cast<unsigned>(allowHashes_.size()), static_cast<unsigned>(allowHashes_.size() * sizeof(uint64_t)));
-    Serial.printf("[AuthSync] denyHashes  entries=%u bytes=%u\n", static_cast<unsigned>(denyHashes_.size()), static_cast<unsigned>(denyHashes_.size() * sizeof(uint64_t)));
+    out.printf("[AuthSync] allowHashes entries=%u bytes=%u\n", static_cast<unsigned>(allowHashes_.size()), static_cast<unsigned>(allowHashes_.memoryBytes()));
+    out.printf("[AuthSync] denyHashes  entries=%u bytes=%u\n", static_cast<unsigned>(denyHashes_.size()), static_cast<unsigned>(denyHashes_.memoryBytes()));
+
+    const LearnedCache::Stats ls = learned_.stats();
+    out.printf("[AuthSync] learned     entries=%u/%u bytes=%u epoch=%u\n", static_cast<unsigned>(learned_.size(uptimeS())), static_cast<unsigned>(learned_.capacity()), static_cast<unsigned>(learned_.memoryBytes()), learned_.epoch());
+    out.printf("[AuthSync] learned     hits=%u misses=%u expired=%u inserts=%u evictions=%u retired=%u\n", ls.hits, ls.misses, ls.expired, ls.inserts, ls.evictions, ls.invalidations);
+    out.printf("[AuthSync] journal     pending=%u logged=%u dropped=%u\n", static_cast<unsigned>(journal_.pending()), static_cast<unsigned>(journal_.logRecords()), static_cast<unsigned>(journal_.dropped()));
+    out.printf("[AuthSync] filter      keys=%u bytes=%u%s\n", static_cast<unsigned>(knownFilter_.keyCount()), static_cast<unsigned>(knownFilter_.memoryBytes()), knownFilter_.mapped() ? " (mapped)" : "");
+    out.printf("[AuthSync] uidIndex    entries=%u bytes=%u%s\n", static_cast<unsigned>(uidIndex_.size()), static_cast<unsigned>(uidIndex_.memoryBytes()), uidIndex_.mapped() ? " (mapped)" : "");
+    if (session_) {
+        out.printf("[AuthSync] session     requests=%u connects=%u busy=%u\n", static_cast<unsigned>(session_->requests()), static_cast<unsigned>(session_->connects()), static_cast<unsigned>(session_->busySkips()));
+    }
+    out.printf("[AuthSync] lookups     on_time=%u late=%u queued=%u deadline=%lums\n", static_cast<unsigned>(lookups_on_time_), static_cast<unsigned>(lookups_late_), static_cast<unsigned>(lookups_.size()), lookup_deadline_ms);
+    Latency::print(out);
+
+    // Card set usage (raw = what an uncompressed bitset would take)
+    const CardSet &set = bitset_.set();
+    out.printf("[AuthSync] card set    max_id=%u cards=%u bytes=%u raw=%u gen=%u%s\n", set.maxId(), set.cards(), static_cast<unsigned>(set.imageBytes()), static_cast<unsigned>(calcBitsetBytes(set.maxId())), bitset_.generation(), set.mapped() ? " (mapped)" : "");
+    out.printf("[AuthSync] card set    chunks=%u array=%u runs=%u bitmap=%u\n", set.chunks(), static_cast<unsigned>(set.chunksOf(CardSet::ARRAY)), static_cast<unsigned>(set.chunksOf(CardSet::RUNS)), static_cast<unsigned>(set.chunksOf(CardSet::BITMAP)));
+    if (store_.ready()) {
+        out.printf("[AuthSync] table store slot=%u seq=%u used=%u/%u commits=%u failed=%u\n", store_.slot(), store_.seq(), static_cast<unsigned>(store_.usedBytes()), static_cast<unsigned>(store_.slotBytes()), store_.commits(), store_.failures());
+    }
+}
 
-    // Bitset usage
-    const size_t bitBytes = calcBitsetBytes(max_card_id);
-    Serial.printf("[AuthSync] max_card_id=%u bitset_bytes=%u MAX_SAFE_BYTES=%u\n", max_card_id, static_cast<unsigned>(bitBytes), static_cast<unsigned>(MAX_SAFE_BYTES));
+void AuthSync::printSyncState(Print &out) const {
+    out.printf("[AuthSync] bitset etag=%s version=%u max_id=%u gen=%u\n", bitset_.etag()[0] ? bitset_.etag() : "-",
+               sync_version, bitset_.maxId(), bitset_.generation());
+    out.printf("[AuthSync] index  etag=%s\n", index_etag.length() ? index_etag.c_str() : "-");
+    out.printf("[AuthSync] filter etag=%s%s\n", filter_etag.length() ? filter_etag.c_str() : "-",
+               filter_stale_ ? " (stale)" : "");
+    out.printf("[AuthSync] last sync %lus ago%s%s\n", (millis() - last_sync) / 1000,
+               force_sync_ ? ", sync pending" : "", push_active_ ? ", push active" : "");
 }
 
 #ifdef AUTH_TEST_HOOK
 void AuthSync::TEST_dumpMemoryStats() const {
     dumpMemoryStats();
 }
+
+bool AuthSync::TEST_fillTables(size_t listEntries, uint32_t maxId) {
+    // Every third card authorized and `listEntries` distinct hashes per list
+    CardSet::Builder builder;
+    if (maxId > MAX_CARD_ID || !builder.begin(maxId)) return false;
+    while (builder.chunk() <= (maxId >> 16)) {
+        uint8_t *bits = builder.bits();
+        const uint32_t first = builder.chunk() << 16;
+        const uint32_t end = std::min<uint32_t>(first + (CardSet::CHUNK_IDS - 1), maxId);
+        for (uint32_t id = first + (3 - first % 3) % 3; id <= end; id += 3) setBitIn(bits, id - first);
+        if (!builder.commit()) return false;
+    }
+    CardSet fresh;
+    if (!builder.finish(fresh)) return false;
+    bitset_.publish(fresh, nullptr);
+
+    FlatHashSet allowNew;
+    FlatHashSet denyNew;
+    if (!allowNew.reserve(listEntries) || !denyNew.reserve(listEntries)) return false;
+    for (size_t i = 1; i <= listEntries; ++i) {
+        allowNew.insert(i * 0x9E3779B97F4A7C15ULL);
+        denyNew.insert((i + listEntries) * 0x9E3779B97F4A7C15ULL);
+    }
+    SeqGuard::Write publish(tables_);
+    allowHashes_.swap(allowNew);
+    denyHashes_.swap(denyNew);
+    return true;
+}
 #endif
-void AuthSync::setServerProbeResult(bool ok, unsigned long probeMillis) {
-    server_last_ok = ok;
-    last_server_probe = probeMillis;
+void AuthSync::notifyServerChanged() {
+    filter_stale_ = true;
+    force_sync_ = true;
+}
+
+void AuthSync::requestSync() {
+    force_sync_ = true;
+}
+
+void AuthSync::setPushActive(bool active) {
+    push_active_ = active;
+}
+
+void AuthSync::notifyServerVersion(uint32_t version) {
+    if (version != sync_version) notifyServerChanged();
+}
+
+void AuthSync::revokeLearned(const String &uid) {
+    revokeHash(hashUid(uid));
+}
+
+void AuthSync::revokeHash(uint64_t h) {
+    // Only matters when the card is not in the index yet; the bitset
+    // catches up on the next sync. A learned deny outranks the lists.
+    bool allowed = false;
+    if (learnedMutex_) xSemaphoreTake(learnedMutex_, portMAX_DELAY);
+    const bool allows = (learned_.find(h, uptimeS(), allowed) == LearnedCache::HIT && allowed) ||
+                        allowHashes_.contains(h);
+    if (learnedMutex_) xSemaphoreGive(learnedMutex_);
+    if (allows) addKnownAuth(h, false);
+    notifyServerChanged();
+}
+
+
+
+#ifdef MESH_SYNC
+AuthSync::PeerState AuthSync::peerState() const {
+    const CardSet &set = bitset_.set();
+    return PeerState{sync_version, static_cast<uint32_t>(set.imageBytes()), set.crc(),
+                     HashUtils::crc32Update(0, reinterpret_cast<const uint8_t*>(index_etag.c_str()), index_etag.length()),
+                     HashUtils::crc32Update(0, reinterpret_cast<const uint8_t*>(filter_etag.c_str()), filter_etag.length())};
 }
+
+bool AuthSync::applyPeerSync(const SyncFormat::ReadFn &rd, const char *etag, uint32_t version) {
+    uint32_t magic = 0;
+    if (!rd(reinterpret_cast<uint8_t*>(&magic), sizeof(magic))) return false;
+    bool ok = false;
+    if (magic == SyncFormat::DELTA_MAGIC) {
+        ok = applyDelta(rd, etag);
+    } else if (magic == CardSet::MAGIC) {
+        // The image is read from its magic on; hand back the bytes taken
+        size_t replay = sizeof(magic);
+        CardSet fresh;
+        ok = fresh.load([&](uint8_t *dst, size_t len) {
+            const size_t n = std::min(replay, len);
+            memcpy(dst, reinterpret_cast<const uint8_t*>(&magic) + (sizeof(magic) - replay), n);
+            replay -= n;
+            return n == len || rd(dst + n, len - n);
+        });
+        if (ok) bitset_.publish(fresh, etag);
+    }
+    if (!ok) {
+        LOG_W("[AuthSync] Peer sync rejected; keeping generation %u", bitset_.generation());
+        return false;
+    }
+    putPref("bitset_etag", bitset_.etag());
+    last_sync = millis();
+    // Like a server sync: one flash write, version last. The learned cache
+    // is retired by the next sync that also brings index and filter.
+    const uint8_t saved = persistTables(TABLE_CARDS);
+    saveSyncVersion((saved & TABLE_CARDS) ? version : 0);
+    learned_stale_ = true;
+    LOG_I("[AuthSync] Peer sync: max_id=%u version=%u gen=%u (%s)", bitset_.maxId(), version, bitset_.generation(),
+          magic == SyncFormat::DELTA_MAGIC ? "delta" : "image");
+    return true;
+}
+#endif
@@ -3,31 +3,127 @@
 
 #include <HTTPClient.h>
 #include <Preferences.h>
+#include <atomic>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 #include <vector>
+#include "AuthBitset.h"
+#include "AuthJournal.h"
+#include "FlatHashSet.h"
+#include "LearnedCache.h"
+#include "Lockfree.h"
+#include "ServerSession.h"
+#include "SyncDecoder.h"
+#include "TableStore.h"
+#include "UidKey.h"
+#include "UidIndex.h"
+#include "XorFilter.h"
+
+// Decision for unknown cards when the server cannot answer within the scan
+// deadline (unreachable, busy or slow). Override in platformio.ini
+// build_flags with -DAUTH_OFFLINE_ALLOW_UNKNOWN=1 to fail open.
+#ifndef AUTH_OFFLINE_ALLOW_UNKNOWN
+#define AUTH_OFFLINE_ALLOW_UNKNOWN 0
+#endif
 
 
 class AuthSync {
 public:
-    explicit AuthSync(const String &serverBase);
+    // `session` is the shared keep-alive connection owned by NetworkTask;
+    // without one AuthSync opens its own.
+    explicit AuthSync(const String &serverBase, ServerSession *session = nullptr);
  ~AuthSync();
  // frees heap memory
-// Maximum number of cards preconfigured at compile time. Adjust to fit device
-// max_card_id checks current use at runtime
-// must not exceed MAX_SAFE_BYTES.
-    static constexpr size_t MAX_SAFE_CARDS = 200000UL; // centralized max value
-    // Maximum bytes required for the static bitset buffer
-    static constexpr size_t MAX_SAFE_BYTES = (MAX_SAFE_CARDS + 7) / 8;
+    // Largest card_id accepted from the server. The set is sized at runtime
+    // by its authorized cards; this only guards the size math.
+    static constexpr uint32_t MAX_CARD_ID = CardSet::MAX_ID;
     bool begin();                         // initial sync (call from setup())
     bool update();                        // periodic sync (call from loop or timer)
     bool preloadOffline();                // load NVS caches only (no network attempt)
-    // Main function used after every scan
-    bool isAuthorized(const String &uid);
-    // Dump runtime memory stats to Serial for diagnostics
-    void dumpMemoryStats() const;
+    // Main function used after every scan; `h` is uid.hash(), computed
+    // once by the caller
+    bool isAuthorized(const UidKey &uid, uint64_t h);
+    bool isAuthorized(const UidKey &uid) { return isAuthorized(uid, uid.hash()); }
+    // Dump runtime memory stats (Serial, or the remote console)
+    void dumpMemoryStats(Print &out = Serial) const;
+    // Sync ETags, change-log version and time since the last sync
+    void printSyncState(Print &out) const;
+    // The server answered a sync (200 or 304) since boot
+    bool hasSynced() const { return last_sync != 0; }
+
+    // The server changed cards (e.g. an enrollment was acknowledged): the
+    // known-card filter may miss new cards, so bypass it and sync on the
+    // next update() instead of waiting for SYNC_INTERVAL.
+    void notifyServerChanged();
+    // Sync on the next update() regardless of SYNC_INTERVAL (console)
+    void requestSync();
+
+    // Push channel hooks (NetworkTask). While the event stream is live the
+    // server announces every change, so update() only syncs when told to
+    // (plus a slow safety-net interval).
+    void setPushActive(bool active);
+    // Sync if the server's change-log version differs from ours
+    void notifyServerVersion(uint32_t version);
+    // Card deleted/deauthorized on the server: deny it until the next sync
+    // even when it was learned or listed as allowed
+    void revokeLearned(const String &uid);
+    void revokeHash(uint64_t h);
+
+    // Persist learned results batched by the journal; call from NetworkTask.
+    // Cheap when nothing is pending.
+    void flushLearned();
+
+    // Asynchronous unknown-card lookups. Once a worker task is attached,
+    // isAuthorized() queues the server lookup for it (SPSC ring: one
+    // scanning task, one worker) and waits at most `deadlineMs` for the
+    // answer (task notification) before applying the offline policy.
+    // Without a worker the lookup runs inline.
+    static constexpr unsigned long LOOKUP_DEADLINE_MS = 300;
+    void setLookupWorker(TaskHandle_t worker, unsigned long deadlineMs = LOOKUP_DEADLINE_MS);
+    // Worker side (NetworkTask): answer queued lookups. Results are learned
+    // even when the scan already timed out, so the next presentation of
+    // that card is decided locally.
+    void serviceLookups();
+    void setOfflinePolicy(bool allowUnknown) { offline_allow_unknown_ = allowUnknown; }
 
-    // Keep AuthSync informed of central server probe results (called by NetworkTask)
-    // The timer/NetworkTask calls this to share reachability state and timestamp.
-    void setServerProbeResult(bool ok, unsigned long probeMillis);
+    // Decision from the synced tables, learned answers and lists only: no
+    // server, no logging, lock-free from any task (DecisionService). False
+    // when they do not know the card.
+    bool decideCached(uint64_t h, bool &allowed) const;
+    // Seconds since the server last answered a sync, UINT32_MAX before that
+    uint32_t syncAgeS() const;
+
+#ifdef MESH_SYNC
+    // Door controllers sharing sync data over ESP-NOW (MeshSync.h). All of
+    // it runs in NetworkTask, the task that runs syncs.
+    struct PeerState {
+        uint32_t version;     // change-log version (0 = unknown)
+        uint32_t imageBytes;  // card set image
+        uint32_t imageCrc;
+        uint32_t indexTag;    // CRC-32 of the index / filter ETags
+        uint32_t filterTag;
+    };
+    PeerState peerState() const;
+    const char *bitsetEtag() const { return bitset_.etag(); }
+    uint32_t syncVersion() const { return sync_version; }
+    // Published card set image bytes, served to neighbours
+    bool readImage(size_t offset, uint8_t *dst, size_t len) const {
+        return bitset_.set().readImage(offset, dst, len);
+    }
+    // Apply a sync frame pulled from a neighbour the way a server reply is
+    // applied: a delta (SyncFormat::DELTA_MAGIC) through applyDelta(), or a
+    // whole card set image. Published with `etag`, persisted, and `version`
+    // saved as the delta cursor.
+    bool applyPeerSync(const SyncFormat::ReadFn &rd, const char *etag, uint32_t version);
+    // Sees every delta applied (server or neighbour) with the ETag it led
+    // to, so it can be handed on
+    using DeltaTap = std::function<void(const SyncFormat::DeltaHeader &hdr, const SyncFormat::DeltaRange *ranges,
+                                        const char *etag)>;
+    void setDeltaTap(DeltaTap tap) { deltaTap_ = std::move(tap); }
+    // A mesh source polls the server for this door: only the safety-net
+    // interval is left to update()
+    void setMeshCovered(bool covered) { mesh_covered_ = covered; }
+#endif
 
 #ifdef AUTH_TEST_HOOK
     // Test-only helper: set an artificial max_card_id for overflow/safety tests.
@@ -35,52 +131,163 @@ public:
     void TEST_setMaxCardId(size_t maxCardId);
     // Test hook to dump runtime memory stats (calls dumpMemoryStats())
     void TEST_dumpMemoryStats() const;
+    // Benchmark hooks (test/test_bench): synthetic tables, then the private
+    // persistence paths on them
+    bool TEST_fillTables(size_t listEntries, uint32_t maxId);
+    bool TEST_saveAllowDenyToFS() const { return saveAllowDenyToFS(); }
+    bool TEST_saveBitsetToFS() { return saveBitsetToFS(); }
+    bool TEST_loadBitsetFromFS() { return loadBitsetFromFS(); }
+    // Delta path (test_authsync): the reply body after its magic
+    bool TEST_applyDelta(const SyncFormat::ReadFn &rd, const char *etag) { return applyDelta(rd, etag); }
+    uint32_t TEST_syncVersion() const { return sync_version; }
+    bool TEST_hasCard(uint32_t id) const {
+        bool set = false;
+        return bitset_.lookup(id, set) && set;
+    }
 #endif
 
-    uint32_t getCardCount() const { return max_card_id + 1; }
-    size_t   getMemoryUsed() const { return calcBitsetBytes(max_card_id); }
+    uint32_t getCardCount() const { return bitset_.maxId() + 1; }
+    size_t   getMemoryUsed() const { return bitset_.set().memoryBytes(); }
 
 private:
     String   server_base;
-    // Pointer to the bitset storage. Points at a translation-unit static buffer
-    // (no heap allocation) provided by AuthSync.cpp. The code expects this
-    // to be a valid byte array of at least calcBitsetBytes(max_card_id) bytes.
-    uint8_t *authorized_bits = nullptr;
-    uint32_t max_card_id = 0;
+    ServerSession *session_ = nullptr;
+    ServerSession *ownedSession_ = nullptr;
+    // Authorized card ids (compressed CardSet) with max_id and ETag; syncs
+    // build the next generation off to the side and publish it at once
+    AuthBitset bitset_;
     unsigned long last_sync = 0;
     unsigned long SYNC_INTERVAL = 60000;
+    // Periodic sync while change events are pushed (covers lost events)
+    unsigned long PUSH_SYNC_INTERVAL = 600000;
+    volatile bool push_active_ = false;
+#ifdef MESH_SYNC
+    bool mesh_covered_ = false;
+    DeltaTap deltaTap_;
+#endif
+
+    // Unknown-card lookups handed to the worker task. Tickets (30 bits) tie
+    // a late answer to the scan that asked; 0 means nobody is waiting. The
+    // worker publishes the answer as one word: ticket << 2 | found << 1 |
+    // allowed.
+    static constexpr size_t LOOKUP_QUEUE_LEN = 4;
+    static constexpr uint32_t LOOKUP_TICKET_MASK = 0x3FFFFFFF;
+    struct LookupRequest {
+        uint32_t ticket;
+        UidKey uid;
+        uint64_t hash;
+    };
+    SpscRing<LookupRequest, LOOKUP_QUEUE_LEN> lookups_;
+    TaskHandle_t lookupWorker_ = nullptr;
+    unsigned long lookup_deadline_ms = LOOKUP_DEADLINE_MS;
+    std::atomic<TaskHandle_t> lookupWaiter_{nullptr};
+    std::atomic<uint32_t> lookupWaitTicket_{0};
+    std::atomic<uint32_t> lookupDone_{0};
+    uint32_t lookupTicket_ = 0;
+    uint32_t lookups_on_time_ = 0;
+    uint32_t lookups_late_ = 0;
+    bool offline_allow_unknown_ = AUTH_OFFLINE_ALLOW_UNKNOWN;
 
-    unsigned long last_server_probe = 0;
-    bool server_last_ok = false;
-    bool serverPreviouslyUnreachable = false;
 
     bool syncFromServer();
-    bool getCardAuthFromServer(const String& uid, int &card_id, bool &authorized);
+    // Bitset part of a sync; `changed` is false for a 304 reply, `version`
+    // receives the server's change-log version (saved once persisted)
+    bool syncBitsetFromServer(bool &changed, uint32_t &version);
+    // Refresh the uid_hash -> card_id table (`/api/sync/index`)
+    bool syncIndexFromServer(bool &updated);
+    // Refresh the known-card xor filter (`/api/sync/filter`)
+    bool syncFilterFromServer(bool &updated);
+    bool fetchTableFromServer(const char *path, String &etag, const char *nvsKey, bool conditional,
+                              const std::function<bool(const SyncFormat::ReadFn&)> &load, bool &updated);
+    // Binary `/api/sync` reply streamed from the socket (decoded on the way
+    // when compressed) into the bitset (published with `etag`, nullptr
+    // keeps the current one)
+    bool readBinarySync(ServerSession::Request &req, SyncDecoder::Encoding encoding, const char *etag,
+                        bool &wasDelta);
+    bool readBitsetBody(const SyncFormat::ReadFn &rd, uint32_t maxId, uint32_t length, uint32_t crc32,
+                        const char *etag);
+    bool applyDelta(const SyncFormat::ReadFn &rd, const char *etag);
+    static size_t readStreamSome(HTTPClient &http, WiFiClient &stream, uint8_t *dst, size_t len);
+    static bool readStreamFully(HTTPClient &http, WiFiClient &stream, uint8_t *dst, size_t len);
+    bool getCardAuthFromServer(const UidKey& uid, int &card_id, bool &authorized);
+    // Where a local decision came from
+    enum LocalSource : uint8_t { SRC_NONE, SRC_FILTER, SRC_INDEX, SRC_LEARNED, SRC_DENY, SRC_ALLOW };
+    // One read section over filter, index + bitset, learned cache and
+    // lists (any task): `bit` is the answer of INDEX and LEARNED
+    LocalSource lookupLocal(uint64_t h, bool &bit, uint32_t &cardId, LearnedCache::Lookup &learned) const;
+    // Filter, index + bitset, learned cache and lists; false when the card
+    // is unknown. `scan` counts the learned cache lookup in its stats.
+    bool decideLocally(uint64_t h, bool &allowed, bool scan = true);
+    // Queue a lookup for the worker and wait up to lookup_deadline_ms
+    bool awaitServerLookup(const UidKey& uid, uint64_t h, bool &allowed);
     //int getCardIdFromServer(const String& uid) const; //redundant from earlier implementation
-    void addKnownAuth(const String& uid, bool allowed);
+    void addKnownAuth(uint64_t h, bool allowed);
+    // Retire every learned result once the synced tables describe a new
+    // generation (they now decide the cards the results were learned for)
+    void invalidateLearned();
     static uint64_t hashUid(const String& s);
 
     void saveETagToNVS();
     void loadETagFromNVS();
-    // Persist/load the bitset snapshot to LittleFS (atomic write/rename)
-    bool saveBitsetToFS(size_t bytes);
+    // Persist/load the card set snapshot to LittleFS (atomic write/rename).
+    // Loading also converts a raw bitset left by older firmware.
+    bool saveBitsetToFS();
     bool loadBitsetFromFS();
+    void saveSyncVersion(uint32_t version);
+    // NVS writes (no-ops without the namespace), counted as flash writes
+    void putPref(const char *key, const char *value);
+    void putPref(const char *key, uint32_t value);
+
+    // Table bits for persistTables()/attachTables()
+    static constexpr uint8_t TABLE_CARDS = 1u << TableStore::TABLE_CARDS;
+    static constexpr uint8_t TABLE_INDEX = 1u << TableStore::TABLE_INDEX;
+    static constexpr uint8_t TABLE_FILTER = 1u << TableStore::TABLE_FILTER;
+    static constexpr uint8_t TABLE_ALL = TABLE_CARDS | TABLE_INDEX | TABLE_FILTER;
+    // Persist after a sync: one store commit of every table, or the
+    // `dirty` ones to LittleFS without a store. Returns the tables saved.
+    uint8_t persistTables(uint8_t dirty);
+    // Switch `which` tables to their images in the active store slot (and
+    // its ETags); returns the tables attached
+    uint8_t attachTables(uint8_t which);
 
     Preferences prefs_;
     bool prefsOpen_ = false;
-    std::vector<uint64_t> allowHashes_;
-    std::vector<uint64_t> denyHashes_;
-    // Persisted ETag for the last downloaded bitset (used for If-None-Match)
-    String last_etag;
-    // Persist allow/deny hash vectors to LittleFS instead of NVS
+    // Server allow/deny lists (authoritative as of the last list sync,
+    // `/allow_deny.bin`)
+    FlatHashSet allowHashes_;
+    FlatHashSet denyHashes_;
+    // Server answers for cards the tables did not decide, bounded and
+    // expiring; snapshot `/learned.bin`
+    LearnedCache learned_;
+    // Learned results since the last /learned.bin snapshot
+    AuthJournal journal_;
+    // A sync brought new tables but not all of them arrived yet: the
+    // learned results stay until they have
+    bool learned_stale_ = false;
+    // Serializes the writers of the learned cache and the lists (and
+    // compaction reading them); the scan path never takes it when a lookup
+    // worker is attached
+    SemaphoreHandle_t learnedMutex_ = nullptr;
+    // Filter, index, lists and learned cache are read lock-free by decideLocally();
+    // every swap or edit of them happens inside a tables_ write section
+    SeqGuard tables_;
+    // Server change-log version the bitset corresponds to (0 = unknown,
+    // forces a full sync). Sent as `?since=` to request a delta.
+    uint32_t sync_version = 0;
+    // Maps UID hashes to card_ids so the bitset can answer scans locally
+    UidIndex uidIndex_;
+    String index_etag;
+    // Fast negative pre-check over all known cards
+    XorFilter knownFilter_;
+    String filter_etag;
+    std::atomic<bool> filter_stale_{false};
+    bool force_sync_ = false;
+    // Flash-mapped card set, index and filter (`authdb` partition)
+    TableStore store_;
+    // Tables loaded from LittleFS at boot, moved into the store once
+    uint8_t unstoredTables_ = 0;
+    // Persist allow/deny hash sets to LittleFS instead of NVS
     bool saveAllowDenyToFS() const;
     bool loadAllowDenyFromFS();
-#if 1
-     static size_t calcBitsetBytes(uint32_t maxId);
-    bool isBitSet(uint32_t id) const;
-    void setBit(uint32_t id) const;
-    void clearBit(uint32_t id) const;
-    bool writeByteAt(size_t idx, uint8_t val) const;
-    bool readByteAt(size_t idx, uint8_t &out) const;
-#endif
+    static size_t calcBitsetBytes(uint32_t maxId);
 };
@@ -0,0 +1,104 @@
+#include "CardReader.h"
+#include "Latency.h"
+#include "Log.h"
+#include <cstring>
+
+// CardReader
+// ----------
+// IRQ arming follows the MFRC522 datasheet: clear ComIrqReg, flush the
+// FIFO, load REQA and start Transceive with StartSend and a 7-bit frame.
+// A card answering with ATQA sets RxIRq and is left in READY state, so
+// PICC_ReadCardSerial() can go straight to anticollision. The library
+// raises RxIRq again during that exchange; the manager finds those edges
+// with answered() == false and ignores them.
+//
+// The IRQ pin is the OR of the enabled flags, so answered() clears exactly
+// the flags it saw: a flag left set would hold the line low and swallow
+// the next edge.
+
+namespace {
+    // DivIEnReg: drive the IRQ pin push-pull (no pull-up needed)
+    constexpr uint8_t IRQ_PUSH_PULL = 0x80;
+    // BitFramingReg: StartSend, 7 valid bits in the last byte (short frame)
+    constexpr uint8_t REQA_FRAMING = 0x87;
+    // ComIrqReg: Set1 = 0 clears every flag written as 1
+    constexpr uint8_t IRQ_CLEAR_ALL = 0x7F;
+    constexpr uint8_t FIFO_FLUSH = 0x80;
+}
+
+CardReader::CardReader(uint8_t id, uint8_t ssPin, uint8_t rstPin) : rfid_(ssPin, rstPin), id_(id) {}
+
+CardReader::~CardReader() {
+    if (attached_) detachInterrupt(irqPin_);
+}
+
+void CardReader::begin(Mode mode, int irqPin) {
+    rfid_.PCD_Init();
+    if (mode == MODE_IRQ && irqPin < 0) {
+        LOG_W("[Reader] Reader %u has no IRQ pin; polling it instead", id_);
+        mode = MODE_POLL;
+    }
+    mode_ = mode;
+    irqPin_ = irqPin;
+    if (mode_ == MODE_IRQ) {
+        rfid_.PCD_WriteRegister(MFRC522::DivIEnReg, IRQ_PUSH_PULL);
+        rfid_.PCD_WriteRegister(MFRC522::ComIEnReg, IRQ_ENABLE);
+        rfid_.PCD_WriteRegister(MFRC522::ComIrqReg, IRQ_CLEAR_ALL);
+        pinMode(irqPin_, INPUT_PULLUP);
+    }
+}
+
+void CardReader::attachIrq(TaskHandle_t task) {
+    if (mode_ != MODE_IRQ || attached_) return;
+    // The task handle must exist before the first edge
+    task_ = task;
+    attachInterruptArg(irqPin_, onIrq, this, FALLING);
+    attached_ = true;
+}
+
+void IRAM_ATTR CardReader::onIrq(void *self) {
+    CardReader *reader = static_cast<CardReader*>(self);
+    reader->irqAt_ = esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(reader->task_, 1UL << reader->id_, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void CardReader::arm() {
+    rfid_.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Idle);
+    rfid_.PCD_WriteRegister(MFRC522::ComIrqReg, IRQ_CLEAR_ALL);
+    rfid_.PCD_WriteRegister(MFRC522::FIFOLevelReg, FIFO_FLUSH);
+    rfid_.PCD_WriteRegister(MFRC522::FIFODataReg, MFRC522::PICC_CMD_REQA);
+    rfid_.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Transceive);
+    rfid_.PCD_WriteRegister(MFRC522::BitFramingReg, REQA_FRAMING);
+}
+
+bool CardReader::answered() {
+    const uint8_t seen = rfid_.PCD_ReadRegister(MFRC522::ComIrqReg) & (RX_IRQ | IDLE_IRQ);
+    if (seen) rfid_.PCD_WriteRegister(MFRC522::ComIrqReg, seen);
+    // IdleIRq alone: the command ended (aborted) without an answer
+    return seen & RX_IRQ;
+}
+
+bool CardReader::poll() {
+    return rfid_.PICC_IsNewCardPresent();
+}
+
+bool CardReader::read(Scan &out, int64_t presented) {
+    if (!rfid_.PICC_ReadCardSerial()) return false;
+    const int64_t t = Latency::lap(Latency::STAGE_READ, presented);
+    out = Scan{UidKey(rfid_.uid.uidByte, rfid_.uid.size), presented, id_};
+    Latency::lap(Latency::STAGE_UID, t);
+    rfid_.PICC_HaltA();
+    rfid_.PCD_StopCrypto1();
+    if (mode_ == MODE_IRQ) rfid_.PCD_WriteRegister(MFRC522::ComIrqReg, IRQ_CLEAR_ALL);
+    return true;
+}
+
+CardReader::Mode CardReader::parseMode(const char *name) {
+    return name && strcmp(name, "irq") == 0 ? MODE_IRQ : MODE_POLL;
+}
+
+const char *CardReader::modeName(Mode mode) {
+    return mode == MODE_IRQ ? "irq" : "poll";
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <MFRC522.h>
+#include "UidKey.h"
+
+// Reader timing. Override in platformio.ini build_flags. The SPI clock is
+// the MFRC522 library's own MFRC522_SPICLOCK (4 MHz by default, the chip
+// accepts up to 10 MHz), e.g. -DMFRC522_SPICLOCK=10000000.
+#ifndef RFID_IRQ_PIN
+#define RFID_IRQ_PIN 4
+#endif
+// IRQ mode: how often a REQA is sent to look for a card entering the field
+#ifndef RFID_REQA_INTERVAL_MS
+#define RFID_REQA_INTERVAL_MS 50
+#endif
+// Poll mode: pause between polling rounds over the readers
+#ifndef RFID_POLL_INTERVAL_MS
+#define RFID_POLL_INTERVAL_MS 10
+#endif
+// Per reader: pause after a card was read before looking for the next one
+#ifndef RFID_DEBOUNCE_MS
+#define RFID_DEBOUNCE_MS 100
+#endif
+
+// One MFRC522 on the shared SPI bus (own SS pin). The chip driver only;
+// ReaderManager schedules the readers from its task.
+//
+// MODE_IRQ: arm() starts a REQA transceive. The chip drives its IRQ pin
+// when the answer arrives (RxIRq) or the command ends (IdleIRq); the GPIO
+// ISR sets this reader's bit in the manager task's notification value and
+// answered() tells a card apart from an aborted command. Without a card
+// nothing arrives and the manager re-arms after RFID_REQA_INTERVAL_MS.
+// MODE_POLL is the classic PICC_IsNewCardPresent() check, for boards
+// without the IRQ line wired.
+class CardReader {
+public:
+    enum Mode : uint8_t { MODE_POLL, MODE_IRQ };
+
+    struct Scan {
+        UidKey uid;
+        int64_t presented;  // Latency::now() when the card was detected
+        uint8_t reader;     // index of the reader (door) that read it
+    };
+
+    CardReader(uint8_t id, uint8_t ssPin, uint8_t rstPin);
+    ~CardReader();
+
+    CardReader(const CardReader&) = delete;
+    CardReader& operator=(const CardReader&) = delete;
+
+    // Init the chip (after SPI.begin()). MODE_IRQ without a usable pin
+    // falls back to polling.
+    void begin(Mode mode, int irqPin);
+    // Route the IRQ pin to `task` as notification bit (1 << id)
+    void attachIrq(TaskHandle_t task);
+
+    uint8_t id() const { return id_; }
+    Mode mode() const { return mode_; }
+
+    // MODE_IRQ: start a REQA; answered() after the IRQ fired
+    void arm();
+    bool answered();
+    int64_t irqAt() const { return irqAt_; }
+    // MODE_POLL: a card in the field answered a REQA
+    bool poll();
+
+    // Anticollision, HaltA; false when the card left or collided
+    bool read(Scan &out, int64_t presented);
+
+    // Parse the config.json `reader_mode` value ("irq" / "poll")
+    static Mode parseMode(const char *name);
+    static const char *modeName(Mode mode);
+
+private:
+    // ComIEnReg: IRQ pin active low, RxIEn, IdleIEn
+    static constexpr uint8_t IRQ_ENABLE = 0x80 | 0x20 | 0x10;
+    static constexpr uint8_t RX_IRQ = 0x20;
+    static constexpr uint8_t IDLE_IRQ = 0x10;
+
+    MFRC522 rfid_;
+    uint8_t id_;
+    Mode mode_ = MODE_POLL;
+    int irqPin_ = -1;
+    bool attached_ = false;
+    TaskHandle_t task_ = nullptr;
+    volatile int64_t irqAt_ = 0;
+
+    static void IRAM_ATTR onIrq(void *self);
+};
@@ -0,0 +1,458 @@
+#include "CardSet.h"
+#include "HashUtils.h"
+#include "Log.h"
+#include <algorithm>
+#include <cstring>
+#include <LittleFS.h>
+#include <esp_heap_caps.h>
+
+// CardSet
+// -------
+// Container sizes are rounded up to 4 bytes so every container (and the
+// uint16 arrays inside) stays aligned within the image. The last chunk's
+// bitmap only covers ids up to max_id, so a small dense site pays
+// max_id / 8 bytes at most, like the raw bitset did.
+
+namespace {
+    const char *SET_FILE = "/bits.bin";
+    const char *SET_TMP  = "/bits.bin.tmp";
+
+    constexpr size_t ALIGN = 4;
+
+    size_t aligned(size_t len) { return (len + ALIGN - 1) & ~(ALIGN - 1); }
+
+    // Bitmap bytes of chunk `c` in a set covering 0..maxId
+    size_t bitmapBytes(uint32_t maxId, uint32_t c) {
+        return c == (maxId >> 16) ? ((maxId & 0xFFFF) >> 3) + 1 : CardSet::CHUNK_BYTES;
+    }
+
+    size_t containerBytes(uint32_t maxId, uint32_t c, const CardSet::Chunk &chunk) {
+        switch (chunk.kind) {
+        case CardSet::ARRAY:  return aligned(chunk.count * sizeof(uint16_t));
+        case CardSet::RUNS:   return chunk.count * 2 * sizeof(uint16_t);
+        case CardSet::BITMAP: return aligned(bitmapBytes(maxId, c));
+        default:              return 0;
+        }
+    }
+
+    void *allocImage(size_t bytes) {
+        void *p = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+        if (p) return p;
+        if (heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) < bytes + CardSet::HEAP_RESERVE) {
+            return nullptr;
+        }
+        return heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+    }
+
+    inline uint32_t loadWord(const uint8_t *p) {
+        uint32_t w;
+        memcpy(&w, p, sizeof(w));
+        return w;
+    }
+}
+
+CardSet::~CardSet() {
+    clear();
+}
+
+void CardSet::clear() {
+    if (image_ && owned_) heap_caps_free(image_);
+    image_ = nullptr;
+    bytes_ = 0;
+    owned_ = true;
+}
+
+void CardSet::swap(CardSet &other) noexcept {
+    std::swap(image_, other.image_);
+    std::swap(bytes_, other.bytes_);
+    std::swap(owned_, other.owned_);
+}
+
+void CardSet::adopt(uint8_t *image, size_t bytes) {
+    clear();
+    image_ = image;
+    bytes_ = bytes;
+}
+
+bool CardSet::contains(uint32_t id) const {
+    if (!image_ || id > header().max_id) return false;
+    const Chunk &chunk = directory()[id >> 16];
+    const uint16_t low = static_cast<uint16_t>(id & 0xFFFF);
+    const uint8_t *data = containers() + chunk.offset;
+    switch (chunk.kind) {
+    case BITMAP:
+        return ((data[low >> 3] >> (low & 7)) & 1) != 0;
+    case ARRAY: {
+        const auto *values = reinterpret_cast<const uint16_t*>(data);
+        return std::binary_search(values, values + chunk.count, low);
+    }
+    case RUNS: {
+        // Last run starting at or before `low`
+        const auto *runs = reinterpret_cast<const uint16_t*>(data);
+        size_t lo = 0;
+        size_t hi = chunk.count;
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            if (runs[2 * mid] <= low) lo = mid + 1; else hi = mid;
+        }
+        return lo > 0 && low <= runs[2 * (lo - 1) + 1];
+    }
+    default:
+        return false;
+    }
+}
+
+size_t CardSet::chunksOf(Kind kind) const {
+    size_t n = 0;
+    for (uint32_t c = 0; c < chunks(); ++c) {
+        if (directory()[c].kind == kind) ++n;
+    }
+    return n;
+}
+
+void CardSet::expand(uint32_t c, uint8_t *bits) const {
+    if (c >= chunks()) return;
+    const Chunk &chunk = directory()[c];
+    const uint8_t *data = containers() + chunk.offset;
+    switch (chunk.kind) {
+    case BITMAP:
+        memcpy(bits, data, bitmapBytes(header().max_id, c));
+        break;
+    case ARRAY: {
+        const auto *values = reinterpret_cast<const uint16_t*>(data);
+        for (size_t i = 0; i < chunk.count; ++i) bits[values[i] >> 3] |= 1u << (values[i] & 7);
+        break;
+    }
+    case RUNS: {
+        const auto *runs = reinterpret_cast<const uint16_t*>(data);
+        for (size_t i = 0; i < chunk.count; ++i) {
+            for (uint32_t low = runs[2 * i]; low <= runs[2 * i + 1]; ++low) bits[low >> 3] |= 1u << (low & 7);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+bool CardSet::valid(const uint8_t *image, size_t bytes, bool crc) {
+    if (bytes < sizeof(Header)) return false;
+    const Header &hdr = *reinterpret_cast<const Header*>(image);
+    if (hdr.magic != MAGIC || hdr.max_id > MAX_ID || hdr.chunks != (hdr.max_id >> 16) + 1 ||
+        bytes != overheadBytes(hdr.max_id) + hdr.payload) {
+        return false;
+    }
+    const auto *dir = reinterpret_cast<const Chunk*>(image + sizeof(Header));
+    for (uint32_t c = 0; c < hdr.chunks; ++c) {
+        const Chunk &chunk = dir[c];
+        if (chunk.kind > BITMAP || chunk.offset % ALIGN ||
+            chunk.offset + containerBytes(hdr.max_id, c, chunk) > hdr.payload) {
+            return false;
+        }
+    }
+    return !crc || HashUtils::crc32Update(0, image + sizeof(Header), bytes - sizeof(Header)) == hdr.crc32;
+}
+
+bool CardSet::load(const ReadFn &readFn) {
+    Header hdr{};
+    if (!readFn(reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr))) return false;
+    if (hdr.magic != MAGIC || hdr.max_id > MAX_ID || hdr.payload > (MAX_ID >> 3) + CHUNK_BYTES) {
+        LOG_W("[CardSet] Bad set header");
+        return false;
+    }
+    const size_t bytes = overheadBytes(hdr.max_id) + hdr.payload;
+    auto *image = static_cast<uint8_t*>(allocImage(bytes));
+    if (!image) {
+        LOG_E("[CardSet] No memory for a %u byte set", static_cast<unsigned>(bytes));
+        return false;
+    }
+    memcpy(image, &hdr, sizeof(hdr));
+    if (!readFn(image + sizeof(hdr), bytes - sizeof(hdr)) || !valid(image, bytes, true)) {
+        LOG_W("[CardSet] Set image truncated or CRC mismatch");
+        heap_caps_free(image);
+        return false;
+    }
+    adopt(image, bytes);
+    return true;
+}
+
+bool CardSet::attach(const uint8_t *image, size_t bytes) {
+    if (!image || reinterpret_cast<uintptr_t>(image) % ALIGN || !valid(image, bytes, false)) {
+        LOG_W("[CardSet] Bad set image");
+        return false;
+    }
+    clear();
+    // Never written through: the image is immutable once built
+    image_ = const_cast<uint8_t*>(image);
+    bytes_ = bytes;
+    owned_ = false;
+    return true;
+}
+
+bool CardSet::readImage(size_t offset, uint8_t *dst, size_t len) const {
+    if (!image_ || offset > bytes_ || len > bytes_ - offset) return false;
+    memcpy(dst, image_ + offset, len);
+    return true;
+}
+
+bool CardSet::saveToFS() const {
+    if (!image_ || !LittleFS.begin()) return false;
+    File f = LittleFS.open(SET_TMP, FILE_WRITE);
+    if (!f) return false;
+    const bool ok = f.write(image_, bytes_) == bytes_;
+    f.close();
+    if (!ok) {
+        LittleFS.remove(SET_TMP);
+        return false;
+    }
+    LittleFS.remove(SET_FILE);
+    if (!LittleFS.rename(SET_TMP, SET_FILE)) {
+        LittleFS.remove(SET_TMP);
+        return false;
+    }
+    return true;
+}
+
+bool CardSet::loadFromFS() {
+    if (!LittleFS.begin() || !LittleFS.exists(SET_FILE)) return false;
+    File f = LittleFS.open(SET_FILE, FILE_READ);
+    if (!f) return false;
+    // Older firmware kept the raw bitset here; leave those to the caller
+    uint32_t magic = 0;
+    bool ok = f.read(reinterpret_cast<uint8_t*>(&magic), sizeof(magic)) == sizeof(magic) && magic == MAGIC &&
+              f.seek(0);
+    if (ok) ok = load([&f](uint8_t *dst, size_t len) { return f.read(dst, len) == len; });
+    f.close();
+    if (ok) LOG_I("[CardSet] Loaded %u cards (%u bytes) from FS", cards(), static_cast<unsigned>(bytes_));
+    return ok;
+}
+
+void CardSet::removeFromFS() {
+    if (LittleFS.begin() && LittleFS.exists(SET_FILE)) LittleFS.remove(SET_FILE);
+}
+
+// -------------------- Builder --------------------
+
+CardSet::Builder::~Builder() {
+    reset();
+}
+
+void CardSet::Builder::reset() {
+    if (scratch_) heap_caps_free(scratch_);
+    if (image_) heap_caps_free(image_);
+    scratch_ = nullptr;
+    image_ = nullptr;
+    cap_ = used_ = 0;
+    maxId_ = chunks_ = next_ = cards_ = 0;
+    fill_ = 0;
+    touched_ = failed_ = false;
+}
+
+bool CardSet::Builder::begin(uint32_t maxId) {
+    reset();
+    if (maxId > MAX_ID) return false;
+    maxId_ = maxId;
+    chunks_ = (maxId >> 16) + 1;
+    scratch_ = static_cast<uint8_t*>(heap_caps_malloc(CHUNK_BYTES, MALLOC_CAP_8BIT));
+    used_ = overheadBytes(maxId);
+    if (!scratch_ || !reserve(0)) {
+        LOG_E("[CardSet] No memory to build a set up to id %u", maxId);
+        reset();
+        return false;
+    }
+    memset(image_, 0, used_);
+    memset(scratch_, 0, CHUNK_BYTES);
+    return true;
+}
+
+size_t CardSet::Builder::chunkBytes(uint32_t c) const {
+    return bitmapBytes(maxId_, c);
+}
+
+bool CardSet::Builder::reserve(size_t more) {
+    if (used_ + more <= cap_) return true;
+    size_t cap = std::max<size_t>(cap_ ? cap_ * 2 : used_ + 256, used_ + more);
+    auto *grown = static_cast<uint8_t*>(allocImage(cap));
+    if (!grown) {
+        failed_ = true;
+        return false;
+    }
+    if (image_) {
+        memcpy(grown, image_, used_);
+        heap_caps_free(image_);
+    }
+    image_ = grown;
+    cap_ = cap;
+    return true;
+}
+
+void CardSet::Builder::clearScratch() {
+    if (touched_) memset(scratch_, 0, CHUNK_BYTES);
+    touched_ = false;
+    fill_ = 0;
+}
+
+uint8_t *CardSet::Builder::bits() {
+    touched_ = true;
+    return scratch_;
+}
+
+void CardSet::Builder::place(Kind kind, uint16_t count, size_t len) {
+    auto *dir = reinterpret_cast<Chunk*>(image_ + sizeof(Header));
+    const size_t overhead = overheadBytes(maxId_);
+    dir[next_].offset = static_cast<uint32_t>(used_ - overhead);
+    dir[next_].kind = kind;
+    dir[next_].count = count;
+    // Padding stays zero so the CRC is stable
+    memset(image_ + used_ + len, 0, aligned(len) - len);
+    used_ += aligned(len);
+    ++next_;
+    clearScratch();
+}
+
+bool CardSet::Builder::commit() {
+    if (failed_ || !scratch_ || next_ >= chunks_) return false;
+    if (!touched_) {
+        place(EMPTY, 0, 0);
+        return true;
+    }
+    const size_t len = chunkBytes(next_);
+    // Drop bits past max_id in the last byte (raw bitsets may carry them)
+    if (next_ == chunks_ - 1 && ((maxId_ & 7) != 7)) scratch_[len - 1] &= (1u << ((maxId_ & 7) + 1)) - 1;
+    if (len < CHUNK_BYTES) memset(scratch_ + len, 0, aligned(len) - len);
+
+    // Cardinality and run count in one pass over 32-bit words
+    const size_t words = aligned(len) / 4;
+    uint32_t count = 0;
+    uint32_t runs = 0;
+    uint32_t carry = 0;
+    for (size_t i = 0; i < words; ++i) {
+        const uint32_t w = loadWord(scratch_ + 4 * i);
+        count += __builtin_popcount(w);
+        runs += __builtin_popcount(w & ~((w << 1) | carry));
+        carry = w >> 31;
+    }
+    if (count == 0) {
+        place(EMPTY, 0, 0);
+        return true;
+    }
+
+    const size_t arrayLen = count * sizeof(uint16_t);
+    const size_t runLen = runs * 2 * sizeof(uint16_t);
+    const bool useArray = arrayLen < len && arrayLen <= runLen;
+    const bool useRuns = !useArray && runLen < len;
+    const size_t out = useArray ? arrayLen : useRuns ? runLen : len;
+    if (!reserve(aligned(out))) return false;
+
+    uint8_t *dst = image_ + used_;
+    if (useArray || useRuns) {
+        auto *values = reinterpret_cast<uint16_t*>(dst);
+        size_t n = 0;
+        bool inRun = false;
+        for (size_t i = 0; i < words; ++i) {
+            uint32_t w = loadWord(scratch_ + 4 * i);
+            if (useArray) {
+                while (w) {
+                    values[n++] = static_cast<uint16_t>(i * 32 + __builtin_ctz(w));
+                    w &= w - 1;
+                }
+                continue;
+            }
+            for (uint32_t b = 0; b < 32; ++b) {
+                const bool set = (w >> b) & 1;
+                const auto low = static_cast<uint16_t>(i * 32 + b);
+                if (set && !inRun) values[n++] = low;
+                if (!set && inRun) values[n++] = static_cast<uint16_t>(low - 1);
+                inRun = set;
+            }
+        }
+        if (inRun) values[n++] = static_cast<uint16_t>(words * 32 - 1);
+        place(useArray ? ARRAY : RUNS, static_cast<uint16_t>(useArray ? count : runs), out);
+    } else {
+        memcpy(dst, scratch_, len);
+        place(BITMAP, 0, len);
+    }
+    cards_ += count;
+    return true;
+}
+
+bool CardSet::Builder::copy(const CardSet &from) {
+    if (failed_ || !scratch_ || next_ >= chunks_ || touched_) return false;
+    // Only chunks of the same extent can be taken verbatim
+    if (next_ >= from.chunks() || bitmapBytes(from.maxId(), next_) != chunkBytes(next_)) {
+        from.expand(next_, bits());
+        return commit();
+    }
+    const Chunk &chunk = from.directory()[next_];
+    const size_t len = containerBytes(from.maxId(), next_, chunk);
+    if (!reserve(len)) return false;
+    memcpy(image_ + used_, from.containers() + chunk.offset, len);
+    switch (chunk.kind) {
+    case ARRAY:
+        cards_ += chunk.count;
+        break;
+    case RUNS: {
+        const auto *runs = reinterpret_cast<const uint16_t*>(image_ + used_);
+        for (size_t i = 0; i < chunk.count; ++i) cards_ += runs[2 * i + 1] - runs[2 * i] + 1;
+        break;
+    }
+    case BITMAP:
+        for (size_t i = 0; i < len; i += 4) cards_ += __builtin_popcount(loadWord(image_ + used_ + i));
+        break;
+    default:
+        break;
+    }
+    place(static_cast<Kind>(chunk.kind), chunk.count, len);
+    return true;
+}
+
+bool CardSet::Builder::append(const uint8_t *bytes, size_t n) {
+    while (n && !failed_) {
+        if (next_ >= chunks_) return true;  // beyond max_id
+        const size_t len = chunkBytes(next_);
+        const size_t take = std::min(n, len - fill_);
+        for (size_t i = 0; i < take; ++i) {
+            if (bytes[i]) {
+                touched_ = true;
+                break;
+            }
+        }
+        if (touched_) memcpy(scratch_ + fill_, bytes, take);
+        fill_ += take;
+        bytes += take;
+        n -= take;
+        if (fill_ == len && !commit()) return false;
+    }
+    return !failed_;
+}
+
+bool CardSet::Builder::finish(CardSet &out) {
+    if (!scratch_) return false;
+    while (next_ < chunks_ && !failed_) commit();
+    if (failed_) {
+        LOG_E("[CardSet] Out of memory building set (%u bytes so far)", static_cast<unsigned>(used_));
+        reset();
+        return false;
+    }
+    auto &hdr = *reinterpret_cast<Header*>(image_);
+    hdr.magic = MAGIC;
+    hdr.max_id = maxId_;
+    hdr.cards = cards_;
+    hdr.chunks = chunks_;
+    hdr.payload = static_cast<uint32_t>(used_ - overheadBytes(maxId_));
+    hdr.crc32 = HashUtils::crc32Update(0, image_ + sizeof(Header), used_ - sizeof(Header));
+
+    // Hand over an exact-size image; keep the grown one if that fails
+    uint8_t *image = image_;
+    if (cap_ > used_) {
+        if (auto *exact = static_cast<uint8_t*>(allocImage(used_))) {
+            memcpy(exact, image_, used_);
+            heap_caps_free(image_);
+            image = exact;
+        }
+    }
+    out.adopt(image, used_);
+    image_ = nullptr;
+    reset();
+    return true;
+}
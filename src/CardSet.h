@@ -0,0 +1,170 @@
+#pragma once
+
+#include <Arduino.h>
+#include "SyncFormat.h"
+
+// Authorized card ids, stored roaring-style: ids are split into chunks of
+// 65536 (the high 16 bits) and every chunk keeps whichever container is
+// smallest for its contents:
+//   ARRAY   sorted low halves, 2 bytes per card (sparse chunks)
+//   RUNS    sorted [first, last] pairs, 4 bytes per run (id ranges)
+//   BITMAP  one bit per id, 8 KB at most (dense chunks)
+// Memory follows the authorized cards and their layout rather than max_id:
+// a site with 300 cards costs a few hundred bytes, ids freed by deletions
+// cost nothing. contains() jumps straight to the chunk through a directory
+// indexed by the high half, then does a bit test or a binary search of at
+// most 12 steps (containers are only chosen while below 8 KB).
+//
+// A set is one immutable image: Header, one Chunk per 64K ids, containers.
+// The same image is the `/bits.bin` snapshot. Images come from PSRAM when
+// the board has it, otherwise from internal heap while HEAP_RESERVE stays
+// free. CardSet::Builder produces them in id order, from raw bitset bytes
+// or from an existing set plus edits.
+class CardSet {
+public:
+    static constexpr uint32_t MAGIC = 0x31524252UL; // "RBR1"
+    // Largest card id accepted (guards size math: 256 chunks, 2 KB directory)
+    static constexpr uint32_t MAX_ID = (1UL << 24) - 1;
+    static constexpr uint32_t CHUNK_IDS = 1UL << 16;
+    static constexpr size_t CHUNK_BYTES = CHUNK_IDS / 8;
+    static constexpr size_t HEAP_RESERVE = 32 * 1024;
+
+    enum Kind : uint16_t { EMPTY = 0, ARRAY = 1, RUNS = 2, BITMAP = 3 };
+
+    struct __attribute__((packed)) Header {
+        uint32_t magic;
+        uint32_t max_id;
+        uint32_t cards;    // ids in the set
+        uint32_t chunks;   // (max_id >> 16) + 1 directory entries
+        uint32_t payload;  // container bytes after the directory
+        uint32_t crc32;    // zlib CRC-32 over directory and containers
+    };
+    static_assert(sizeof(Header) == 24, "CardSet::Header is the file layout");
+
+    struct __attribute__((packed)) Chunk {
+        uint32_t offset;   // into the containers, 4-byte aligned
+        uint16_t kind;
+        uint16_t count;    // ARRAY entries or RUNS pairs (BITMAP: 0)
+    };
+    static_assert(sizeof(Chunk) == 8, "CardSet::Chunk is the file layout");
+
+    class Builder;
+
+    CardSet() = default;
+    ~CardSet();
+    CardSet(const CardSet&) = delete;
+    CardSet& operator=(const CardSet&) = delete;
+
+    // False for ids beyond max_id (and for an empty set)
+    bool contains(uint32_t id) const;
+
+    bool loaded() const { return image_ != nullptr; }
+    uint32_t maxId() const { return image_ ? header().max_id : 0; }
+    uint32_t cards() const { return image_ ? header().cards : 0; }
+    uint32_t chunks() const { return image_ ? header().chunks : 0; }
+    // Heap bytes; an attached image costs none
+    size_t memoryBytes() const { return owned_ ? bytes_ : 0; }
+    size_t imageBytes() const { return bytes_; }
+    bool mapped() const { return image_ && !owned_; }
+    // Image CRC from the header (identifies the generation to peers)
+    uint32_t crc() const { return image_ ? header().crc32 : 0; }
+    // Chunks stored as `kind` (stats)
+    size_t chunksOf(Kind kind) const;
+
+    // Set the bits of chunk `c` in `bits` (CHUNK_BYTES, zeroed by the caller)
+    void expand(uint32_t c, uint8_t *bits) const;
+
+    using ReadFn = SyncFormat::ReadFn;
+    using WriteFn = SyncFormat::WriteFn;
+
+    // Read an image; swapped in only when complete and the CRC matches
+    bool load(const ReadFn &readFn);
+
+    // Use an image in place (e.g. mapped flash) instead of copying it. The
+    // structure is checked, the CRC is left to whoever wrote the image; it
+    // must stay readable and 4-byte aligned until the set is cleared.
+    bool attach(const uint8_t *image, size_t bytes);
+    bool writeImage(const WriteFn &out) const { return image_ && out(image_, bytes_); }
+    // Image bytes [offset, offset + len); false past the end
+    bool readImage(size_t offset, uint8_t *dst, size_t len) const;
+
+    // Persist/load the `/bits.bin` snapshot (the image as is). loadFromFS()
+    // fails on files without MAGIC (raw bitsets from older firmware).
+    bool saveToFS() const;
+    bool loadFromFS();
+    static void removeFromFS();
+
+    void clear();
+    void swap(CardSet &other) noexcept;
+
+    // Image bytes of an empty set covering 0..maxId
+    static size_t overheadBytes(uint32_t maxId) {
+        return sizeof(Header) + ((maxId >> 16) + 1) * sizeof(Chunk);
+    }
+
+private:
+    uint8_t *image_ = nullptr;
+    size_t bytes_ = 0;
+    bool owned_ = true;
+
+    const Header &header() const { return *reinterpret_cast<const Header*>(image_); }
+    const Chunk *directory() const { return reinterpret_cast<const Chunk*>(image_ + sizeof(Header)); }
+    const uint8_t *containers() const { return image_ + sizeof(Header) + header().chunks * sizeof(Chunk); }
+    // Header, bounds of every container and (with `crc`) the CRC
+    static bool valid(const uint8_t *image, size_t bytes, bool crc);
+    void adopt(uint8_t *image, size_t bytes);
+
+    friend class Builder;
+};
+
+// Builds a CardSet chunk by chunk in id order. Feed raw bitset bytes with
+// append(), or go chunk by chunk: fill bits() (e.g. from expand()) and
+// commit(), or copy() a chunk unchanged from another set. Needs one 8 KB
+// scratch bitmap while building; the image grows as containers are added.
+class CardSet::Builder {
+public:
+    Builder() = default;
+    ~Builder();
+    Builder(const Builder&) = delete;
+    Builder& operator=(const Builder&) = delete;
+
+    // Start a set covering ids 0..maxId; false beyond MAX_ID or without memory
+    bool begin(uint32_t maxId);
+
+    // Raw bitset bytes continuing where the last call stopped (bit i of
+    // byte n is id 8n + i); bits beyond max_id are dropped
+    bool append(const uint8_t *bytes, size_t n);
+
+    // Chunk being built and its (zeroed) bitmap
+    uint32_t chunk() const { return next_; }
+    uint8_t *bits();
+    // Encode bits() as chunk() and move on
+    bool commit();
+    // Take chunk() from `from` as is (bits() must be untouched)
+    bool copy(const CardSet &from);
+
+    // Encode the remaining chunks (empty) and hand the image to `out`
+    bool finish(CardSet &out);
+    // Drop the build and its memory
+    void reset();
+
+private:
+    uint8_t *scratch_ = nullptr;
+    uint8_t *image_ = nullptr;
+    size_t cap_ = 0;
+    size_t used_ = 0;
+    uint32_t maxId_ = 0;
+    uint32_t chunks_ = 0;
+    uint32_t next_ = 0;
+    uint32_t cards_ = 0;
+    // Bytes of the current chunk written by append()
+    size_t fill_ = 0;
+    bool touched_ = false;
+    bool failed_ = false;
+
+    size_t chunkBytes(uint32_t c) const;
+    bool reserve(size_t more);
+    // Directory entry for next_, container bytes are at image_ + used_
+    void place(Kind kind, uint16_t count, size_t len);
+    void clearScratch();
+};
@@ -33,6 +33,55 @@ bool ConfigManager::loadConfig(String& ssid, String& pass, String& serverBase) {
     return true;
 }
 
+// loadReaderConfig
+// ----------------
+// Reads the reader fields from the same /config.json. Separate from
+// loadConfig() so the network settings keep their signature; the file is
+// small and only read at boot. Returns false if the file is missing or
+// unparsable, leaving the defaults untouched.
+bool ConfigManager::loadReaderConfig(String& mode, ReaderPins* readers, size_t max, size_t& count) {
+    String json = readConfigJson();
+    if (json.length() == 0) return false;
+
+    JsonDocument doc;
+    if (deserializeJson(doc, json)) return false;
+
+    mode = String(doc["reader_mode"] | mode.c_str());
+    const JsonArray list = doc["readers"].as<JsonArray>();
+    if (list.size() == 0) {
+        if (max > 0) readers[0].irq = doc["reader_irq_pin"] | readers[0].irq;
+        return true;
+    }
+    // Every entry needs its own SS; RST defaults to the built-in reader's
+    // (the modules may share one reset line)
+    const int sharedRst = readers[0].rst;
+    count = 0;
+    for (JsonObject r : list) {
+        if (count >= max) break;
+        if (!r["ss"].is<int>()) continue;
+        readers[count].ss = r["ss"];
+        readers[count].rst = r["rst"] | sharedRst;
+        readers[count].irq = r["irq"] | -1;
+        ++count;
+    }
+    return true;
+}
+
+// loadMeshConfig
+// --------------
+// Reads `mesh_key` from the same /config.json. Returns false if the file is
+// missing or unparsable, leaving `key` untouched.
+bool ConfigManager::loadMeshConfig(String& key) {
+    String json = readConfigJson();
+    if (json.length() == 0) return false;
+
+    JsonDocument doc;
+    if (deserializeJson(doc, json)) return false;
+
+    key = String(doc["mesh_key"] | key.c_str());
+    return true;
+}
+
 // saveConfig
 // ----------
 // Serializes the given ssid/password/serverBase values into JSON and
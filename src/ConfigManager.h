@@ -7,6 +7,23 @@ public:
     // Load configuration from LittleFS
     static bool loadConfig(String& ssid, String& pass, String& serverBase);
     
+    // Pins of one card reader; irq < 0 when the IRQ line is not wired
+    struct ReaderPins {
+        int ss;
+        int rst;
+        int irq;
+    };
+
+    // Optional card reader settings: `reader_mode` ("irq" or "poll") and
+    // either a `readers` array of {"ss", "rst", "irq"} objects (one per
+    // door, at most `max`; "ss" required) or `reader_irq_pin` for the single
+    // reader in readers[0]. Missing fields keep the values passed in.
+    static bool loadReaderConfig(String& mode, ReaderPins* readers, size_t max, size_t& count);
+
+    // Optional `mesh_key`: secret shared by the door controllers of a site
+    // (MESH_SYNC builds); without it the mesh stays off
+    static bool loadMeshConfig(String& key);
+
     // Save configuration to LittleFS
     static bool saveConfig(const String& ssid, const String& pass, const String& serverBase);
     
@@ -0,0 +1,249 @@
+#include "Console.h"
+#include "Log.h"
+#include <algorithm>
+#include <cstring>
+
+// Console
+// -------
+// lwIP reports acked byte counts for the connection as a whole, so every
+// add() is recorded as a Segment and acks are consumed in that order; only
+// the stream part advances streamAcked_. The stream ring is pumped from the
+// AsyncTCP task (ack and 125 ms poll callbacks); the log task only appends.
+
+Console *Console::active_ = nullptr;
+
+namespace {
+    constexpr uint8_t TELNET_IAC = 0xFF;
+    constexpr size_t COMMAND_QUEUE_LEN = 4;
+    const char PROMPT[] = "> ";
+}
+
+Console::Console(uint16_t port) : telnet_(port) {
+    mutex_ = xSemaphoreCreateMutex();
+    commands_ = xQueueCreate(COMMAND_QUEUE_LEN, LINE_MAX);
+}
+
+Console::~Console() {
+    if (active_ == this) {
+        Log::setSink(nullptr);
+        active_ = nullptr;
+    }
+    if (started_) telnet_.stop();
+    if (commands_) vQueueDelete(commands_);
+    if (mutex_) vSemaphoreDelete(mutex_);
+}
+
+bool Console::begin() {
+    if (started_) return true;
+    if (CONSOLE_PORT == 0 || !mutex_ || !commands_) return false;
+    telnet_.onConnect([this](void *, AsyncClient *c) { onConnect(c); });
+    telnet_.onDisconnect([this](AsyncClient *c) { onDisconnect(c); });
+    if (!telnet_.begin(true, false)) return false;
+    started_ = true;
+    active_ = this;
+    Log::setSink(logSink);
+    LOG_I("[Console] Telnet console on port %u", static_cast<unsigned>(CONSOLE_PORT));
+    return true;
+}
+
+void Console::onConnect(AsyncClient *c) {
+    if (client_) {
+        // One client at a time; AsyncTelnet frees it on disconnect
+        c->write("console busy\r\n");
+        c->close();
+        return;
+    }
+    c->onData([this](void *, AsyncClient *, void *data, size_t len) {
+        onData(static_cast<const char*>(data), len);
+    });
+    c->onAck([this](void *, AsyncClient *, size_t len, uint32_t) { onAck(len); });
+    c->onPoll([this](void *, AsyncClient *) {
+        xSemaphoreTake(mutex_, portMAX_DELAY);
+        pumpStream();
+        xSemaphoreGive(mutex_);
+    });
+    xSemaphoreTake(mutex_, portMAX_DELAY);
+    resetTx();
+    lineLen_ = 0;
+    iacSkip_ = 0;
+    closeRequested_ = false;
+    client_ = c;
+    sendCopy("RFID door console - type 'help'\r\n", 33);
+    sendCopy(PROMPT, sizeof(PROMPT) - 1);
+    xSemaphoreGive(mutex_);
+    LOG_I("[Console] Client connected from %s", c->remoteIP().toString().c_str());
+}
+
+void Console::onDisconnect(AsyncClient *c) {
+    xSemaphoreTake(mutex_, portMAX_DELAY);
+    const bool ours = client_ == c;
+    if (ours) {
+        client_ = nullptr;
+        streaming_ = false;
+        // lwIP dropped whatever was still referencing the ring
+        resetTx();
+    }
+    xSemaphoreGive(mutex_);
+    if (ours) LOG_I("[Console] Client disconnected");
+}
+
+void Console::onData(const char *data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        const uint8_t c = static_cast<uint8_t>(data[i]);
+        // Skip telnet negotiation (IAC <verb> <option>)
+        if (iacSkip_) {
+            --iacSkip_;
+            continue;
+        }
+        if (c == TELNET_IAC) {
+            iacSkip_ = 2;
+            continue;
+        }
+        if (c == '\n') {
+            line_[lineLen_] = '\0';
+            if (lineLen_ > 0 && xQueueSend(commands_, line_, 0) != pdTRUE) {
+                xSemaphoreTake(mutex_, portMAX_DELAY);
+                sendCopy("busy\r\n", 6);
+                xSemaphoreGive(mutex_);
+            }
+            lineLen_ = 0;
+        } else if (c == '\b' || c == 0x7F) {
+            if (lineLen_ > 0) --lineLen_;
+        } else if (c >= 0x20 && c < 0x7F && lineLen_ < LINE_MAX - 1) {
+            line_[lineLen_++] = static_cast<char>(c);
+        }
+    }
+}
+
+void Console::onAck(size_t len) {
+    xSemaphoreTake(mutex_, portMAX_DELAY);
+    while (len > 0 && inflightCount_ > 0) {
+        Segment &seg = inflight_[inflightStart_];
+        const size_t n = std::min<size_t>(len, seg.len);
+        if (seg.stream) streamAcked_ += n;
+        seg.len -= n;
+        len -= n;
+        if (seg.len == 0) {
+            inflightStart_ = (inflightStart_ + 1) % INFLIGHT_MAX;
+            --inflightCount_;
+        }
+    }
+    pumpStream();
+    xSemaphoreGive(mutex_);
+}
+
+void Console::poll() {
+    char line[LINE_MAX];
+    while (xQueueReceive(commands_, line, 0) == pdTRUE) {
+        {
+            Reply out(*this);
+            if (handler_) {
+                handler_(line, out);
+            } else {
+                out.println("no commands");
+            }
+            if (!closeRequested_) out.print(PROMPT);
+        }
+        if (closeRequested_) {
+            closeRequested_ = false;
+            xSemaphoreTake(mutex_, portMAX_DELAY);
+            if (client_) client_->close();
+            xSemaphoreGive(mutex_);
+        }
+    }
+}
+
+void Console::setStreaming(bool on) {
+    streaming_ = on;
+}
+
+void Console::logSink(const char *line, size_t len) {
+    Console *self = active_;
+    if (!self || !self->streaming_ || !self->client_) return;
+    // Log task: bounded wait, never stall it behind a slow send
+    if (xSemaphoreTake(self->mutex_, pdMS_TO_TICKS(5)) != pdTRUE) {
+        ++self->streamDropped_;
+        return;
+    }
+    self->appendStream(line, len);
+    xSemaphoreGive(self->mutex_);
+}
+
+void Console::appendStream(const char *data, size_t len) {
+    if (!client_) return;
+    if (CONSOLE_STREAM_BYTES - (streamHead_ - streamAcked_) < len + 2) {
+        ++streamDropped_;
+        return;
+    }
+    for (size_t i = 0; i < len + 2; ++i) {
+        const char c = i < len ? data[i] : (i == len ? '\r' : '\n');
+        stream_[(streamHead_ + i) % CONSOLE_STREAM_BYTES] = c;
+    }
+    streamHead_ += len + 2;
+}
+
+void Console::pumpStream() {
+    if (!client_) return;
+    bool added = false;
+    while (streamSent_ != streamHead_ && inflightCount_ < INFLIGHT_MAX) {
+        const size_t off = streamSent_ % CONSOLE_STREAM_BYTES;
+        const size_t want = std::min<size_t>(streamHead_ - streamSent_, CONSOLE_STREAM_BYTES - off);
+        const size_t n = std::min(want, client_->space());
+        if (n == 0) break;
+        // By reference: the bytes stay put until onAck() releases them
+        const size_t queued = client_->add(stream_ + off, n, 0);
+        if (queued == 0) break;
+        pushSegment(queued, true);
+        streamSent_ += queued;
+        added = true;
+    }
+    if (added) client_->send();
+}
+
+size_t Console::sendCopy(const char *data, size_t len) {
+    if (!client_ || inflightCount_ >= INFLIGHT_MAX) return 0;
+    const size_t n = std::min(len, client_->space());
+    if (n == 0) return 0;
+    const size_t queued = client_->add(data, n, ASYNC_WRITE_FLAG_COPY);
+    if (queued == 0) return 0;
+    pushSegment(queued, false);
+    client_->send();
+    return queued;
+}
+
+bool Console::pushSegment(size_t len, bool stream) {
+    if (inflightCount_ >= INFLIGHT_MAX) return false;
+    inflight_[(inflightStart_ + inflightCount_) % INFLIGHT_MAX] = Segment{static_cast<uint16_t>(len), stream};
+    ++inflightCount_;
+    return true;
+}
+
+void Console::resetTx() {
+    streamHead_ = streamSent_ = streamAcked_ = 0;
+    inflightStart_ = inflightCount_ = 0;
+}
+
+size_t Console::Reply::write(uint8_t c) {
+    if (c == '\n') {
+        if (len_ + 2 > sizeof(buf_)) flush();
+        buf_[len_++] = '\r';
+    } else if (len_ + 1 > sizeof(buf_)) {
+        flush();
+    }
+    buf_[len_++] = static_cast<char>(c);
+    return 1;
+}
+
+size_t Console::Reply::write(const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; ++i) write(data[i]);
+    return len;
+}
+
+void Console::Reply::flush() {
+    if (len_ == 0) return;
+    xSemaphoreTake(console_.mutex_, portMAX_DELAY);
+    // A full send buffer truncates the reply rather than blocking
+    console_.sendCopy(buf_, len_);
+    xSemaphoreGive(console_.mutex_);
+    len_ = 0;
+}
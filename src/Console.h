@@ -0,0 +1,116 @@
+#pragma once
+
+#include <AsyncTelnet.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <functional>
+
+// Telnet console port and size of the log stream ring. Override in
+// platformio.ini build_flags; -DCONSOLE_PORT=0 leaves the console off.
+#ifndef CONSOLE_PORT
+#define CONSOLE_PORT 23
+#endif
+#ifndef CONSOLE_STREAM_BYTES
+#define CONSOLE_STREAM_BYTES 2048
+#endif
+
+// Remote diagnostics console on the bundled AsyncTelnet server (one client
+// at a time).
+//
+// Socket callbacks run on the AsyncTCP task: input is split into lines and
+// queued, and poll() runs them on NetworkTask, which owns the state the
+// commands read. The RFID loop never touches the socket. Command replies
+// are transient and sent with ASYNC_WRITE_FLAG_COPY. Streamed log lines are
+// appended to a ring that lwIP sends from by reference; ring bytes are only
+// reused once the peer acked them.
+class Console {
+public:
+    // Runs one command line; write the reply to `out`
+    using Handler = std::function<void(const char *line, Print &out)>;
+
+    static constexpr size_t LINE_MAX = 64;
+
+    explicit Console(uint16_t port = CONSOLE_PORT);
+    ~Console();
+
+    Console(const Console&) = delete;
+    Console& operator=(const Console&) = delete;
+
+    // Start listening (NetworkTask, once Wi-Fi is up)
+    bool begin();
+    bool started() const { return started_; }
+    bool connected() const { return client_ != nullptr; }
+
+    void setHandler(Handler handler) { handler_ = std::move(handler); }
+    // NetworkTask: run queued command lines
+    void poll();
+
+    // Forward async log lines to the client (`log on`)
+    void setStreaming(bool on);
+    bool streaming() const { return streaming_; }
+    // Close the connection after the current reply (`quit`)
+    void requestClose() { closeRequested_ = true; }
+
+    // Log::Sink for the console that called begin()
+    static void logSink(const char *line, size_t len);
+
+private:
+    // Buffers a reply and sends it in copied chunks, "\n" -> "\r\n"
+    class Reply : public Print {
+    public:
+        explicit Reply(Console &console) : console_(console) {}
+        ~Reply() override { flush(); }
+        size_t write(uint8_t c) override;
+        size_t write(const uint8_t *data, size_t len) override;
+        void flush();
+
+    private:
+        Console &console_;
+        char buf_[128];
+        size_t len_ = 0;
+    };
+
+    // Bytes handed to lwIP, in send order, until the peer acks them
+    struct Segment {
+        uint16_t len;
+        bool stream;  // points into stream_ (zero-copy)
+    };
+    static constexpr size_t INFLIGHT_MAX = 16;
+
+    AsyncTelnet telnet_;
+    bool started_ = false;
+    AsyncClient *volatile client_ = nullptr;
+    SemaphoreHandle_t mutex_ = nullptr;
+    QueueHandle_t commands_ = nullptr;
+    Handler handler_;
+
+    // Input line assembly (AsyncTCP task)
+    char line_[LINE_MAX];
+    size_t lineLen_ = 0;
+    uint8_t iacSkip_ = 0;
+
+    volatile bool streaming_ = false;
+    volatile bool closeRequested_ = false;
+    char stream_[CONSOLE_STREAM_BYTES];
+    uint32_t streamHead_ = 0;   // appended
+    uint32_t streamSent_ = 0;   // handed to lwIP
+    uint32_t streamAcked_ = 0;  // reusable
+    uint32_t streamDropped_ = 0;
+    Segment inflight_[INFLIGHT_MAX];
+    size_t inflightStart_ = 0;
+    size_t inflightCount_ = 0;
+
+    static Console *active_;
+
+    void onConnect(AsyncClient *client);
+    void onDisconnect(AsyncClient *client);
+    void onData(const char *data, size_t len);
+    void onAck(size_t len);
+
+    // Callers hold mutex_
+    void appendStream(const char *data, size_t len);
+    void pumpStream();
+    size_t sendCopy(const char *data, size_t len);
+    bool pushSegment(size_t len, bool stream);
+    void resetTx();
+};
@@ -0,0 +1,212 @@
+#include "DecisionService.h"
+#include "AuthSync.h"
+#include "Latency.h"
+#include "Log.h"
+#include <algorithm>
+#include <cstring>
+
+// DecisionService
+// ---------------
+// A connection is a slot in conns_; its callbacks capture the slot. The
+// stats are plain words written by the AsyncTCP task and read anywhere.
+
+DecisionService::DecisionService(AuthSync &auth, uint16_t port) : auth_(auth), server_(port) {}
+
+DecisionService::~DecisionService() {
+    if (started_) server_.end();
+    for (Conn &conn : conns_) {
+        if (conn.client) drop(conn);
+    }
+    reapRetired();
+}
+
+bool DecisionService::begin() {
+    if (started_) return true;
+    if (DECISION_PORT == 0) return false;
+    server_.onClient([this](void *, AsyncClient *c) { onClient(c); }, nullptr);
+    server_.setNoDelay(true);
+    server_.begin();
+    started_ = true;
+    LOG_I("[Decide] Decision service on port %u", static_cast<unsigned>(DECISION_PORT));
+    return true;
+}
+
+void DecisionService::onClient(AsyncClient *c) {
+    if (!c) return;
+    reapRetired();
+    Conn *conn = nullptr;
+    for (Conn &slot : conns_) {
+        if (!slot.client) {
+            conn = &slot;
+            break;
+        }
+    }
+    if (!conn) {
+        ++stats_.refused;
+        c->onDisconnect([this](void *, AsyncClient *gone) {
+            reapRetired();
+            retired_ = gone;
+        }, nullptr);
+        c->close(true);
+        return;
+    }
+    conn->client = c;
+    conn->inLen = 0;
+    conn->since = 0;
+    conn->stalled = false;
+    conn->owed = 0;
+    conn->lastPoll = millis();
+    ++stats_.accepted;
+    c->setNoDelay(true);
+    c->onDisconnect([this, conn](void *, AsyncClient *) { onDisconnect(*conn); }, nullptr);
+    c->onData([this, conn](void *, AsyncClient *, void *data, size_t len) {
+        onData(*conn, static_cast<const uint8_t*>(data), len);
+    }, nullptr);
+    c->onAck([this, conn](void *, AsyncClient *, size_t, uint32_t) { pump(*conn); }, nullptr);
+    c->onPoll([this, conn](void *, AsyncClient *) { onPoll(*conn); }, nullptr);
+    LOG_I("[Decide] Client connected from %s", c->remoteIP().toString().c_str());
+}
+
+void DecisionService::onDisconnect(Conn &conn) {
+    if (!conn.client) return;
+    reapRetired();
+    retired_ = conn.client;
+    conn.client = nullptr;
+    conn.inLen = 0;
+    LOG_I("[Decide] Client disconnected");
+}
+
+void DecisionService::reapRetired() {
+    if (!retired_) return;
+    retired_->free();
+    delete retired_;
+    retired_ = nullptr;
+}
+
+void DecisionService::drop(Conn &conn) {
+    // close() reports the disconnect at once (onDisconnect)
+    if (conn.client) conn.client->close(true);
+}
+
+void DecisionService::onData(Conn &conn, const uint8_t *data, size_t len) {
+    if (!conn.client) return;
+    stats_.bytesIn += len;
+    // The window reopens as frames are answered (pump)
+    conn.client->ackLater();
+    // A frame completed now starts its clock now; stalled ones keep theirs
+    if (!conn.stalled) conn.since = Latency::now();
+    // A packet may carry more than the buffer: take it in pieces while the
+    // frames before are answered
+    while (len > 0) {
+        const size_t n = std::min(len, sizeof(conn.in) - conn.inLen);
+        if (n == 0) {
+            ++stats_.overflows;
+            LOG_W("[Decide] Client overran %u buffered bytes; closing", static_cast<unsigned>(sizeof(conn.in)));
+            drop(conn);
+            return;
+        }
+        memcpy(conn.in + conn.inLen, data, n);
+        conn.inLen += n;
+        data += n;
+        len -= n;
+        stats_.pendingHigh = std::max<uint32_t>(stats_.pendingHigh, conn.inLen);
+        pump(conn);
+        if (!conn.client) return;
+    }
+}
+
+void DecisionService::onPoll(Conn &conn) {
+    const uint32_t now = millis();
+    if (now - conn.lastPoll > 2 * POLL_INTERVAL_MS) ++stats_.pollGaps;
+    conn.lastPoll = now;
+    pump(conn);
+}
+
+void DecisionService::pump(Conn &conn) {
+    using namespace DecisionFormat;
+    AsyncClient *c = conn.client;
+    if (!c) return;
+    size_t used = 0;
+    bool queued = false;
+    conn.stalled = false;
+    uint8_t out[REPLY_MAX];
+    while (conn.inLen - used >= sizeof(Query)) {
+        Query q;
+        memcpy(&q, conn.in + used, sizeof(q));
+        if (q.magic != MAGIC || q.version != VERSION || q.count > BATCH_MAX) {
+            ++stats_.badFrames;
+            LOG_W("[Decide] Malformed query frame; closing");
+            drop(conn);
+            return;
+        }
+        const size_t need = sizeof(Query) + q.count * sizeof(uint64_t);
+        if (conn.inLen - used < need) break;
+        const size_t replyLen = sizeof(Reply) + q.count;
+        if (c->space() < replyLen) {
+            // The ack of what is in flight frees the room (onAck)
+            ++stats_.stalls;
+            conn.stalled = true;
+            break;
+        }
+        const Reply r{MAGIC, VERSION, q.count, q.tag, auth_.syncAgeS()};
+        memcpy(out, &r, sizeof(r));
+        const uint8_t *hashes = conn.in + used + sizeof(Query);
+        for (size_t i = 0; i < q.count; ++i) {
+            uint64_t h;
+            memcpy(&h, hashes + i * sizeof(h), sizeof(h));
+            bool allowed = false;
+            Answer a = UNKNOWN;
+            if (auth_.decideCached(h, allowed)) a = allowed ? ALLOW : DENY;
+            out[sizeof(Reply) + i] = a;
+            if (a == ALLOW) {
+                ++stats_.allowed;
+            } else if (a == DENY) {
+                ++stats_.denied;
+            } else {
+                ++stats_.unknown;
+            }
+        }
+        if (c->add(reinterpret_cast<const char*>(out), replyLen, ASYNC_WRITE_FLAG_COPY) != replyLen) {
+            // space() said it fits; lwIP out of segments: wait for an ack
+            ++stats_.stalls;
+            conn.stalled = true;
+            break;
+        }
+        queued = true;
+        used += need;
+        ++stats_.batches;
+        stats_.queries += q.count;
+        stats_.bytesOut += replyLen;
+        Latency::record(Latency::STAGE_LOCAL_API, static_cast<uint32_t>(Latency::now() - conn.since));
+    }
+    if (queued) c->send();
+    if (used) {
+        conn.inLen -= used;
+        memmove(conn.in, conn.in + used, conn.inLen);
+        conn.owed += used;
+    }
+    // Called from onData, the packet being delivered is only added to the
+    // client's ack count once the callback returns: the rest of it goes
+    // with the next event (the ack of this reply)
+    if (conn.owed) conn.owed -= c->ack(conn.owed);
+}
+
+DecisionService::Stats DecisionService::stats() const {
+    Stats s = stats_;
+    s.active = 0;
+    s.pending = 0;
+    for (const Conn &conn : conns_) {
+        if (!conn.client) continue;
+        ++s.active;
+        s.pending += conn.inLen;
+    }
+    return s;
+}
+
+void DecisionService::print(Print &out) const {
+    const Stats s = stats();
+    out.printf("[Decide] clients=%u accepted=%u refused=%u batches=%u queries=%u allow=%u deny=%u unknown=%u\n",
+               s.active, s.accepted, s.refused, s.batches, s.queries, s.allowed, s.denied, s.unknown);
+    out.printf("[Decide] in=%u out=%u pending=%u pending_high=%u stalls=%u overflows=%u bad=%u poll_gaps=%u\n",
+               s.bytesIn, s.bytesOut, s.pending, s.pendingHigh, s.stalls, s.overflows, s.badFrames, s.pollGaps);
+}
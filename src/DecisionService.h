@@ -0,0 +1,141 @@
+#pragma once
+
+#include <AsyncTCP.h>
+
+class AuthSync;
+
+// TCP port of the local decision service and its limits. Override in
+// platformio.ini build_flags; -DDECISION_PORT=0 leaves the service off.
+#ifndef DECISION_PORT
+#define DECISION_PORT 7701
+#endif
+#ifndef DECISION_CLIENTS
+#define DECISION_CLIENTS 4
+#endif
+// Unanswered query bytes held per connection (at least one full batch)
+#ifndef DECISION_IN_BYTES
+#define DECISION_IN_BYTES 1024
+#endif
+
+// Binary protocol of the decision service. A client sends Query frames,
+// each followed by `count` UID hashes (uint64, UidKey::hash() /
+// compute_uid_hash() in lib/server.py); the device answers every frame,
+// in order, with a Reply followed by `count` Answer bytes. Little-endian
+// like SyncFormat. count 0 is a ping.
+namespace DecisionFormat {
+    constexpr uint16_t MAGIC = 0x5144;  // "DQ"
+    constexpr uint8_t VERSION = 1;
+    constexpr size_t BATCH_MAX = 64;
+
+    struct __attribute__((packed)) Query {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t count;
+        uint32_t tag;       // echoed in the reply
+    };
+
+    enum Answer : uint8_t { UNKNOWN = 0, DENY = 1, ALLOW = 2 };
+
+    struct __attribute__((packed)) Reply {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t count;
+        uint32_t tag;
+        uint32_t syncAgeS;  // since the last server sync, UINT32_MAX before one
+    };
+
+    constexpr size_t QUERY_MAX = sizeof(Query) + BATCH_MAX * sizeof(uint64_t);
+    constexpr size_t REPLY_MAX = sizeof(Reply) + BATCH_MAX;
+}
+
+// Local decision service for devices next to the door (turnstiles, PIN
+// pads): batched UID-hash queries answered from the synced tables on the
+// bundled AsyncServer, so they need neither the server nor the reader
+// task.
+//
+// Everything runs in AsyncTCP callbacks. Answers come from
+// AuthSync::decideCached(), the scan path's lock-free read of filter,
+// index, learned cache and lists; a card those do not decide is UNKNOWN
+// (no server lookup from here). Replies are queued copied with Nagle off.
+//
+// Backpressure, per connection: received bytes are acked to lwIP only once
+// their frame is answered (ackLater()/ack()), so a client that stops
+// reading replies sees its TCP window close. A frame whose reply does not
+// fit the send buffer waits for the next ack callback; acks are never
+// dropped from AsyncTCP's event queue, while polls are throttled and then
+// discarded as it fills, so the poll callback is a fallback only (gaps
+// between polls are counted as congestion). A client that keeps sending
+// while more than DECISION_IN_BYTES wait on stalled replies is
+// disconnected. The buffer also bounds the work one callback does, keeping
+// the AsyncTCP task (and the console) responsive.
+class DecisionService {
+public:
+    struct Stats {
+        uint32_t accepted;
+        uint32_t refused;       // every slot busy
+        uint32_t active;
+        uint32_t batches;
+        uint32_t queries;
+        uint32_t allowed;
+        uint32_t denied;
+        uint32_t unknown;
+        uint32_t bytesIn;
+        uint32_t bytesOut;
+        uint32_t stalls;        // replies that waited for send buffer space
+        uint32_t overflows;     // connections closed for overrunning the buffer
+        uint32_t badFrames;     // connections closed for a malformed frame
+        uint32_t pollGaps;      // polls that came late (AsyncTCP queue congested)
+        uint32_t pending;       // unanswered bytes now, all connections
+        uint32_t pendingHigh;   // most unanswered bytes on one connection
+    };
+
+    // lwIP polls every CONFIG_ASYNC_TCP_POLL_TIMER slow-timer ticks (500 ms)
+    static constexpr uint32_t POLL_INTERVAL_MS = 500;
+
+    explicit DecisionService(AuthSync &auth, uint16_t port = DECISION_PORT);
+    ~DecisionService();
+
+    DecisionService(const DecisionService&) = delete;
+    DecisionService& operator=(const DecisionService&) = delete;
+
+    // Start listening (NetworkTask, once Wi-Fi is up)
+    bool begin();
+    bool started() const { return started_; }
+
+    Stats stats() const;
+    // Console `stats`
+    void print(Print &out) const;
+
+private:
+    static_assert(DECISION_IN_BYTES >= DecisionFormat::QUERY_MAX, "DECISION_IN_BYTES holds one full batch");
+
+    struct Conn {
+        AsyncClient *client;
+        int64_t since;        // the oldest unanswered frame was complete
+        uint32_t lastPoll;
+        uint32_t owed;        // answered bytes not acked to lwIP yet
+        uint16_t inLen;
+        bool stalled;         // a reply is waiting for send buffer space
+        uint8_t in[DECISION_IN_BYTES];
+    };
+
+    AuthSync &auth_;
+    AsyncServer server_;
+    bool started_ = false;
+    Conn conns_[DECISION_CLIENTS] = {};
+    // Last disconnected client, deleted on a later event: a close from
+    // inside one of its own callbacks must not free it under AsyncTCP
+    AsyncClient *retired_ = nullptr;
+    // Written by the AsyncTCP task only
+    Stats stats_ = {};
+
+    void onClient(AsyncClient *c);
+    void onDisconnect(Conn &conn);
+    void onData(Conn &conn, const uint8_t *data, size_t len);
+    void onPoll(Conn &conn);
+    // Answer the complete frames buffered while their replies fit
+    void pump(Conn &conn);
+    // Drop the connection, its buffered bytes unanswered
+    void drop(Conn &conn);
+    void reapRetired();
+};
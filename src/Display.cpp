@@ -0,0 +1,134 @@
+#include "Display.h"
+#include "Log.h"
+#include <cstring>
+
+// Display
+// -------
+// In U8x8 text mode one character is one 8x8 tile, so the shadow frame is
+// simply the characters on screen. Changed tiles are sent as runs (one
+// drawString() each) to keep the per-transfer addressing overhead low.
+
+Display::Display(uint8_t clockPin, uint8_t dataPin)
+    : u8x8_(/* reset=*/U8X8_PIN_NONE, clockPin, dataPin) {
+    memset(shown_, ' ', sizeof(shown_));
+}
+
+Display::~Display() {
+    if (task_) vTaskDelete(task_);
+    if (mailbox_) vQueueDelete(mailbox_);
+}
+
+bool Display::begin(UBaseType_t priority, BaseType_t core) {
+    if (task_) return true;
+    if (!mailbox_) mailbox_ = xQueueCreate(1, sizeof(State));
+    if (!mailbox_) return false;
+    u8x8_.setBusClock(DISPLAY_I2C_HZ);
+    u8x8_.begin();
+    u8x8_.setFont(u8x8_font_chroma48medium8_r);
+    u8x8_.clear();
+    memset(shown_, ' ', sizeof(shown_));
+#if defined(CONFIG_FREERTOS_UNICORE)
+    (void)core;
+    const BaseType_t ok = xTaskCreate(taskEntry, "disp_task", 2048, this, priority, &task_);
+#else
+    const BaseType_t ok = xTaskCreatePinnedToCore(taskEntry, "disp_task", 2048, this, priority, &task_, core);
+#endif
+    if (ok != pdPASS) {
+        task_ = nullptr;
+        LOG_E("[Display] Failed to start display task");
+        return false;
+    }
+    return true;
+}
+
+void Display::publish(const State &state) {
+    if (!mailbox_) return;
+    xQueueOverwrite(mailbox_, &state);
+    published_.fetch_add(1, std::memory_order_relaxed);
+}
+
+Display::Stats Display::stats() const {
+    return Stats{published_.load(std::memory_order_relaxed), frames_, tiles_};
+}
+
+void Display::taskEntry(void *self) {
+    static_cast<Display*>(self)->run();
+}
+
+void Display::run() {
+    State state;
+    char frame[ROWS][COLS];
+    bool blinkOn = false;
+    TickType_t nextBlink = xTaskGetTickCount() + pdMS_TO_TICKS(DISPLAY_BLINK_MS);
+    for (;;) {
+        // Only an active enroll indicator needs a timed wakeup
+        TickType_t wait = portMAX_DELAY;
+        if (state.enroll != ENROLL_NONE) {
+            const TickType_t now = xTaskGetTickCount();
+            wait = static_cast<int32_t>(nextBlink - now) > 0 ? nextBlink - now : 0;
+        }
+        xQueueReceive(mailbox_, &state, wait);
+        // Absolute schedule: frequent snapshots must not hold the blink back
+        const TickType_t now = xTaskGetTickCount();
+        if (static_cast<int32_t>(now - nextBlink) >= 0) {
+            blinkOn = !blinkOn;
+            nextBlink = now + pdMS_TO_TICKS(DISPLAY_BLINK_MS);
+        }
+        compose(state, blinkOn, frame);
+        flush(frame);
+        ++frames_;
+    }
+}
+
+namespace {
+    // Copy up to the end of the row; the rest of the row stays blank
+    void put(char (&row)[Display::COLS], uint8_t col, const char *text) {
+        for (; col < Display::COLS && *text; ++col, ++text) row[col] = *text;
+    }
+}
+
+void Display::compose(const State &state, bool blinkOn, char (&frame)[ROWS][COLS]) {
+    memset(frame, ' ', sizeof(frame));
+    put(frame[0], 0, "RFID Access");
+    if (state.enroll != ENROLL_NONE && blinkOn) {
+        put(frame[0], 14, state.enroll == ENROLL_GRANT ? "GR" : "RV");
+    }
+
+    char hex[UidKey::HEX_CHARS + 1];
+    put(frame[1], 0, "UID:");
+    if (state.uid.empty()) {
+        put(frame[1], 4, "NONE");
+    } else {
+        state.uid.toHex(hex);
+        put(frame[1], 4, hex);
+    }
+    put(frame[2], 0, state.status);
+    put(frame[3], 0, state.serverUp ? "DB OK" : "DB OFFLINE");
+    put(frame[4], 0, state.authorized ? "Auth:YES" : "Auth:NO");
+    if (!state.uid.empty()) {
+        snprintf(hex, sizeof(hex), "H:%08X", static_cast<unsigned>(state.hash & 0xFFFFFFFF));
+        put(frame[7], 0, hex);
+    }
+}
+
+void Display::flush(const char (&frame)[ROWS][COLS]) {
+    char run[COLS + 1];
+    for (uint8_t y = 0; y < ROWS; ++y) {
+        uint8_t x = 0;
+        while (x < COLS) {
+            if (frame[y][x] == shown_[y][x]) {
+                ++x;
+                continue;
+            }
+            const uint8_t start = x;
+            while (x < COLS && frame[y][x] != shown_[y][x]) {
+                run[x - start] = frame[y][x];
+                shown_[y][x] = frame[y][x];
+                ++x;
+            }
+            run[x - start] = '\0';
+            u8x8_.drawString(start, y, run);
+            tiles_ += x - start;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <U8x8lib.h>
+#include <atomic>
+#include <freertos/queue.h>
+#include "AppState.h"
+#include "UidKey.h"
+
+// I2C bus clock for the OLED and enroll indicator blink period. Override in
+// platformio.ini build_flags, e.g. -DDISPLAY_I2C_HZ=100000 for long wires.
+#ifndef DISPLAY_I2C_HZ
+#define DISPLAY_I2C_HZ 400000
+#endif
+#ifndef DISPLAY_BLINK_MS
+#define DISPLAY_BLINK_MS 500
+#endif
+
+// OLED status screen driven by its own task.
+//
+// Other tasks publish a complete State snapshot into a one-slot mailbox
+// (xQueueOverwrite, never blocks); snapshots published while a frame is
+// being sent collapse into the newest one. The task renders the snapshot
+// into a 16x8 character frame, diffs it against a shadow of what the panel
+// shows and sends only the changed 8x8 tiles over hardware I2C. The enroll
+// indicator blinks from the task's own timer, so nobody has to publish to
+// animate it. Only the task touches the U8x8 driver after begin().
+class Display {
+public:
+    static constexpr uint8_t COLS = 16;
+    static constexpr uint8_t ROWS = 8;
+    static constexpr size_t STATUS_MAX = 12;
+
+    struct State {
+        UidKey uid;                       // empty: nothing scanned yet
+        uint64_t hash = 0;                // uid.hash(), low 32 bits shown
+        bool authorized = false;
+        bool serverUp = false;
+        EnrollMode enroll = ENROLL_NONE;
+        char status[STATUS_MAX + 1] = ""; // boot / Wi-Fi line
+    };
+
+    struct Stats {
+        uint32_t published;  // snapshots handed in
+        uint32_t frames;     // frames rendered
+        uint32_t tiles;      // tiles sent to the panel
+    };
+
+    Display(uint8_t clockPin, uint8_t dataPin);
+    ~Display();
+
+    Display(const Display&) = delete;
+    Display& operator=(const Display&) = delete;
+
+    // Initialize the panel and start the task (setup()). False leaves the
+    // display dark; publish() is still safe to call.
+    bool begin(UBaseType_t priority = tskIDLE_PRIORITY + 1, BaseType_t core = 0);
+
+    // Replace the pending snapshot (any task); never waits for the bus
+    void publish(const State &state);
+
+    Stats stats() const;
+
+private:
+    U8X8_SSD1315_128X64_NONAME_HW_I2C u8x8_;
+    QueueHandle_t mailbox_ = nullptr;
+    TaskHandle_t task_ = nullptr;
+    // What the panel currently shows, one character per tile
+    char shown_[ROWS][COLS];
+    std::atomic<uint32_t> published_{0};
+    volatile uint32_t frames_ = 0;
+    volatile uint32_t tiles_ = 0;
+
+    static void taskEntry(void *self);
+    void run();
+    static void compose(const State &state, bool blinkOn, char (&frame)[ROWS][COLS]);
+    // Send the tiles that differ from shown_
+    void flush(const char (&frame)[ROWS][COLS]);
+};
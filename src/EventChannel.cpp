@@ -0,0 +1,246 @@
+#include "EventChannel.h"
+#include "Log.h"
+#include <WiFi.h>
+#include <algorithm>
+#include <cstring>
+
+// EventChannel
+// ------------
+// Bytes are parsed one at a time through a small state machine: status
+// line, headers, optional chunked transfer framing (werkzeug chunks
+// streamed HTTP/1.1 replies), then SSE lines. A header line longer than
+// DATA_MAX is truncated; an SSE event with an oversized line or data is
+// not dispatched but counted and reported to the drop handler.
+
+namespace {
+    int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // Case-insensitive "Name:" prefix match for header lines
+    bool headerIs(const char *line, const char *name) {
+        const size_t n = strlen(name);
+        return strncasecmp(line, name, n) == 0 && line[n] == ':';
+    }
+}
+
+EventChannel::EventChannel(const String &baseUrl) {
+    // SERVER_BASE is "http://host[:port][/prefix]"
+    String rest = baseUrl;
+    const int scheme = rest.indexOf("://");
+    if (scheme >= 0) rest = rest.substring(scheme + 3);
+    const int slash = rest.indexOf('/');
+    String authority = slash >= 0 ? rest.substring(0, slash) : rest;
+    String prefix = slash >= 0 ? rest.substring(slash) : String();
+    while (prefix.endsWith("/")) prefix.remove(prefix.length() - 1);
+    const int colon = authority.indexOf(':');
+    if (colon >= 0) {
+        port_ = static_cast<uint16_t>(authority.substring(colon + 1).toInt());
+        authority = authority.substring(0, colon);
+    }
+    host_ = authority;
+    path_ = prefix + "/api/events";
+}
+
+void EventChannel::stop() {
+    client_.stop();
+    live_ = false;
+    state_ = State::Idle;
+}
+
+void EventChannel::fail(unsigned long now, const char *why) {
+    if (state_ != State::Idle) {
+        LOG_I("[Events] Stream closed (%s); retry in %lu ms", why, backoff_);
+    }
+    stop();
+    nextAttempt_ = now + backoff_;
+    backoff_ = std::min(backoff_ * 2, RECONNECT_MAX_MS);
+}
+
+bool EventChannel::open(unsigned long now) {
+    if (host_.length() == 0 || WiFi.status() != WL_CONNECTED) return false;
+    ++reconnects_;
+    if (!client_.connect(host_.c_str(), port_, CONNECT_TIMEOUT_MS)) return false;
+    client_.print(String("GET ") + path_ + " HTTP/1.1\r\n"
+                  "Host: " + host_ + "\r\n"
+                  "Accept: text/event-stream\r\n"
+                  "Cache-Control: no-cache\r\n\r\n");
+    state_ = State::Status;
+    chunked_ = false;
+    lineLen_ = 0;
+    lineOverflow_ = false;
+    event_[0] = '\0';
+    dataLen_ = 0;
+    eventTruncated_ = false;
+    lastData_ = now;
+    return true;
+}
+
+void EventChannel::poll(unsigned long now) {
+    if (state_ == State::Idle) {
+        if (static_cast<long>(now - nextAttempt_) < 0) return;
+        if (!open(now)) {
+            fail(now, "connect");
+            return;
+        }
+    }
+    if (!client_.connected() && client_.available() <= 0) {
+        fail(now, "peer");
+        return;
+    }
+    uint8_t buf[128];
+    int avail = client_.available();
+    while (avail > 0 && state_ != State::Idle) {
+        const int n = client_.read(buf, std::min<size_t>(sizeof(buf), static_cast<size_t>(avail)));
+        if (n <= 0) break;
+        lastData_ = now;
+        for (int i = 0; i < n && state_ != State::Idle; ++i) {
+            feed(static_cast<char>(buf[i]), now);
+        }
+        avail = client_.available();
+    }
+    if (state_ != State::Idle && now - lastData_ > IDLE_TIMEOUT_MS) {
+        fail(now, "idle");
+    }
+}
+
+// Transport layer: status line, headers and chunk framing
+void EventChannel::feed(char c, unsigned long now) {
+    switch (state_) {
+    case State::Status:
+    case State::Headers:
+        if (c == '\n') {
+            line_[lineLen_] = '\0';
+            handleHeaderLine(now);
+            lineLen_ = 0;
+        } else if (c != '\r' && lineLen_ + 1 < sizeof(line_)) {
+            line_[lineLen_++] = c;
+        }
+        break;
+    case State::ChunkSize:
+        if (c == '\n') {
+            if (chunkLeft_ == 0) {
+                fail(now, "end of stream");
+            } else {
+                state_ = State::ChunkData;
+            }
+        } else if (c == ';') {
+            chunkExt_ = true; // chunk extensions are ignored
+        } else if (!chunkExt_) {
+            const int v = hexValue(c);
+            if (v >= 0) chunkLeft_ = (chunkLeft_ << 4) | static_cast<size_t>(v);
+        }
+        break;
+    case State::ChunkData:
+        feedStream(c);
+        if (--chunkLeft_ == 0) state_ = State::ChunkEnd;
+        break;
+    case State::ChunkEnd:
+        if (c == '\n') {
+            state_ = State::ChunkSize;
+            chunkLeft_ = 0;
+            chunkExt_ = false;
+        }
+        break;
+    case State::Body:
+        feedStream(c);
+        break;
+    case State::Idle:
+        break;
+    }
+}
+
+void EventChannel::handleHeaderLine(unsigned long now) {
+    if (state_ == State::Status) {
+        // "HTTP/1.1 200 OK"
+        const char *sp = strchr(line_, ' ');
+        if (!sp || atoi(sp + 1) != 200) {
+            fail(now, "status");
+            return;
+        }
+        state_ = State::Headers;
+        return;
+    }
+    if (lineLen_ == 0) {
+        state_ = chunked_ ? State::ChunkSize : State::Body;
+        chunkLeft_ = 0;
+        chunkExt_ = false;
+        live_ = true;
+        backoff_ = RECONNECT_MIN_MS;
+        LOG_I("[Events] Stream open (%s:%u%s)", host_.c_str(), port_, path_.c_str());
+        return;
+    }
+    if (headerIs(line_, "Transfer-Encoding") && strstr(line_, "chunked")) {
+        chunked_ = true;
+    }
+}
+
+// SSE layer: "field: value" lines, blank line ends an event
+void EventChannel::feedStream(char c) {
+    if (c == '\r') return;
+    if (c != '\n') {
+        if (lineLen_ + 1 < sizeof(line_)) {
+            line_[lineLen_++] = c;
+        } else {
+            lineOverflow_ = true;
+        }
+        return;
+    }
+    line_[lineLen_] = '\0';
+    if (lineLen_ == 0) {
+        dispatch();
+    } else if (!lineOverflow_) {
+        handleEventLine();
+    } else if (line_[0] != ':') {
+        // Only an overlong comment is harmless to lose
+        eventTruncated_ = true;
+    }
+    lineLen_ = 0;
+    lineOverflow_ = false;
+}
+
+void EventChannel::handleEventLine() {
+    if (line_[0] == ':') return; // comment / heartbeat
+    char *value = strchr(line_, ':');
+    if (value) {
+        *value++ = '\0';
+        if (*value == ' ') ++value;
+    } else {
+        value = line_ + lineLen_;
+    }
+    if (strcmp(line_, "event") == 0) {
+        strncpy(event_, value, sizeof(event_) - 1);
+        event_[sizeof(event_) - 1] = '\0';
+    } else if (strcmp(line_, "data") == 0) {
+        // Multiple data lines are joined with '\n'
+        const size_t len = strlen(value);
+        if (dataLen_ + len + 2 > sizeof(data_)) {
+            eventTruncated_ = true;
+            return;
+        }
+        if (dataLen_) data_[dataLen_++] = '\n';
+        memcpy(data_ + dataLen_, value, len);
+        dataLen_ += len;
+        data_[dataLen_] = '\0';
+    }
+}
+
+void EventChannel::dispatch() {
+    if (dataLen_ == 0 && event_[0] == '\0' && !eventTruncated_) return;
+    data_[dataLen_] = '\0';
+    const char *name = event_[0] ? event_ : "message";
+    if (eventTruncated_) {
+        // Partial data would parse as a different event
+        ++dropped_;
+        LOG_W("[Events] Dropped oversized %s event (%u so far)", name, static_cast<unsigned>(dropped_));
+        if (dropHandler_) dropHandler_(name);
+    } else if (handler_) {
+        handler_(name, data_);
+    }
+    event_[0] = '\0';
+    dataLen_ = 0;
+    eventTruncated_ = false;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <WiFiClient.h>
+#include <functional>
+
+// Client for the server-sent event stream on `/api/events` (lib/server.py).
+//
+// Owned and driven by NetworkTask: poll() reconnects with exponential
+// backoff, reads whatever bytes are available and dispatches complete
+// events to the handler. Apart from the TCP connect itself it never blocks.
+// The stream runs on its own socket, separate from ServerSession.
+class EventChannel {
+public:
+    // `event` is the SSE event name ("message" when absent), `data` the
+    // joined data lines. Both are only valid during the call.
+    using Handler = std::function<void(const char *event, const char *data)>;
+    // Called instead of Handler for an event that did not fit DATA_MAX
+    using DropHandler = std::function<void(const char *event)>;
+
+    static constexpr unsigned long RECONNECT_MIN_MS = 2000;
+    static constexpr unsigned long RECONNECT_MAX_MS = 60000;
+    // Server sends a heartbeat every 15 s; three missed ones end the link
+    static constexpr unsigned long IDLE_TIMEOUT_MS = 45000;
+    static constexpr int32_t CONNECT_TIMEOUT_MS = 1500;
+    static constexpr size_t DATA_MAX = 256;
+    static constexpr size_t EVENT_MAX = 24;
+
+    explicit EventChannel(const String &baseUrl);
+
+    void setHandler(Handler handler) { handler_ = std::move(handler); }
+    void setDropHandler(DropHandler handler) { dropHandler_ = std::move(handler); }
+
+    // Call every NetworkTask iteration
+    void poll(unsigned long now);
+    void stop();
+
+    // True once the server answered 200 and the stream is live. Safe to
+    // read from other tasks.
+    bool connected() const { return live_; }
+    uint32_t reconnects() const { return reconnects_; }
+    // Events skipped because a line or their data exceeded DATA_MAX
+    uint32_t dropped() const { return dropped_; }
+
+private:
+    enum class State : uint8_t { Idle, Status, Headers, ChunkSize, ChunkData, ChunkEnd, Body };
+
+    String host_;
+    String path_;
+    uint16_t port_ = 80;
+    WiFiClient client_;
+    Handler handler_;
+    DropHandler dropHandler_;
+
+    State state_ = State::Idle;
+    volatile bool live_ = false;
+    bool chunked_ = false;
+    bool chunkExt_ = false;
+    size_t chunkLeft_ = 0;
+    unsigned long lastData_ = 0;
+    unsigned long nextAttempt_ = 0;
+    unsigned long backoff_ = RECONNECT_MIN_MS;
+    uint32_t reconnects_ = 0;
+    uint32_t dropped_ = 0;
+
+    // Current header / SSE line
+    char line_[DATA_MAX] = {};
+    size_t lineLen_ = 0;
+    bool lineOverflow_ = false;
+    char event_[EVENT_MAX] = {};
+    char data_[DATA_MAX] = {};
+    size_t dataLen_ = 0;
+    bool eventTruncated_ = false;
+
+    bool open(unsigned long now);
+    void fail(unsigned long now, const char *why);
+    void feed(char c, unsigned long now);
+    void feedStream(char c);
+    void handleHeaderLine(unsigned long now);
+    void handleEventLine();
+    void dispatch();
+};
@@ -0,0 +1,172 @@
+#include "FlatHashSet.h"
+#include <esp_heap_caps.h>
+#include <utility>
+
+// FlatHashSet
+// -----------
+// See FlatHashSet.h. Keys are already FNV-1a hashes, so the slot index is a
+// cheap fold of the two 32-bit halves rather than a second hash function.
+
+FlatHashSet::~FlatHashSet() {
+    if (slots_) heap_caps_free(slots_);
+}
+
+FlatHashSet::FlatHashSet(FlatHashSet &&other) noexcept {
+    swap(other);
+}
+
+FlatHashSet &FlatHashSet::operator=(FlatHashSet &&other) noexcept {
+    if (this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+void FlatHashSet::swap(FlatHashSet &other) noexcept {
+    std::swap(slots_, other.slots_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(count_, other.count_);
+    std::swap(tombstones_, other.tombstones_);
+    std::swap(hasZero_, other.hasZero_);
+    std::swap(hasOne_, other.hasOne_);
+}
+
+void FlatHashSet::clear() {
+    if (slots_) heap_caps_free(slots_);
+    slots_ = nullptr;
+    capacity_ = 0;
+    count_ = 0;
+    tombstones_ = 0;
+    hasZero_ = false;
+    hasOne_ = false;
+}
+
+size_t FlatHashSet::capacityFor(size_t n) {
+    size_t cap = MIN_CAPACITY;
+    while (cap * LOAD_NUM < (n + 1) * LOAD_DEN) cap <<= 1;
+    return cap;
+}
+
+bool FlatHashSet::contains(uint64_t key) const {
+    if (key == EMPTY) return hasZero_;
+    if (key == TOMBSTONE) return hasOne_;
+    if (capacity_ == 0) return false;
+    // Load factor < 1 guarantees an empty slot terminates the probe
+    for (size_t i = slotFor(key);; i = (i + 1) & (capacity_ - 1)) {
+        const uint64_t v = slots_[i];
+        if (v == key) return true;
+        if (v == EMPTY) return false;
+    }
+}
+
+bool FlatHashSet::insert(uint64_t key) {
+    if (key == EMPTY) { const bool added = !hasZero_; hasZero_ = true; return added; }
+    if (key == TOMBSTONE) { const bool added = !hasOne_; hasOne_ = true; return added; }
+    if ((count_ + tombstones_ + 1) * LOAD_DEN > capacity_ * LOAD_NUM) {
+        // Grow only for live keys; a table full of tombstones is rebuilt in place
+        const size_t target = capacity_ ? capacityFor(count_ + 1) : MIN_CAPACITY;
+        if (!rehash(target > capacity_ ? target : capacity_)) return false;
+    }
+    size_t firstFree = capacity_;
+    for (size_t i = slotFor(key);; i = (i + 1) & (capacity_ - 1)) {
+        const uint64_t v = slots_[i];
+        if (v == key) return false;
+        if (v == TOMBSTONE && firstFree == capacity_) firstFree = i;
+        if (v == EMPTY) {
+            if (firstFree == capacity_) firstFree = i;
+            break;
+        }
+    }
+    if (slots_[firstFree] == TOMBSTONE) --tombstones_;
+    slots_[firstFree] = key;
+    ++count_;
+    return true;
+}
+
+bool FlatHashSet::erase(uint64_t key) {
+    if (key == EMPTY) { const bool had = hasZero_; hasZero_ = false; return had; }
+    if (key == TOMBSTONE) { const bool had = hasOne_; hasOne_ = false; return had; }
+    if (capacity_ == 0) return false;
+    for (size_t i = slotFor(key);; i = (i + 1) & (capacity_ - 1)) {
+        const uint64_t v = slots_[i];
+        if (v == EMPTY) return false;
+        if (v == key) {
+            slots_[i] = TOMBSTONE;
+            --count_;
+            ++tombstones_;
+            return true;
+        }
+    }
+}
+
+bool FlatHashSet::reserve(size_t n) {
+    const size_t target = capacityFor(n);
+    if (target <= capacity_) return true;
+    return rehash(target);
+}
+
+bool FlatHashSet::rehash(size_t newCapacity) {
+    auto *fresh = static_cast<uint64_t*>(heap_caps_calloc(newCapacity, sizeof(uint64_t), MALLOC_CAP_8BIT));
+    if (!fresh) return false;
+    const size_t mask = newCapacity - 1;
+    for (size_t i = 0; i < capacity_; ++i) {
+        const uint64_t v = slots_[i];
+        if (v <= TOMBSTONE) continue;
+        size_t j = (static_cast<uint32_t>(v) ^ static_cast<uint32_t>(v >> 32)) & mask;
+        while (fresh[j] != EMPTY) j = (j + 1) & mask;
+        fresh[j] = v;
+    }
+    if (slots_) heap_caps_free(slots_);
+    slots_ = fresh;
+    capacity_ = newCapacity;
+    tombstones_ = 0;
+    return true;
+}
+
+bool FlatHashSet::writeTo(fs::File &f) const {
+    const DiskHeader hdr{static_cast<uint32_t>(capacity_), static_cast<uint32_t>(count_),
+                         static_cast<uint32_t>(tombstones_), hasZero_, hasOne_, 0};
+    if (f.write(reinterpret_cast<const uint8_t*>(&hdr), sizeof(hdr)) != sizeof(hdr)) return false;
+    const size_t bytes = capacity_ * sizeof(uint64_t);
+    return bytes == 0 || f.write(reinterpret_cast<const uint8_t*>(slots_), bytes) == bytes;
+}
+
+bool FlatHashSet::readFrom(fs::File &f) {
+    DiskHeader hdr{};
+    if (f.read(reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr)) != sizeof(hdr)) return false;
+    // Capacity must be a power of two with room for the stored keys
+    if (hdr.capacity != 0 && ((hdr.capacity & (hdr.capacity - 1)) != 0 ||
+                              hdr.count + hdr.tombstones >= hdr.capacity)) {
+        return false;
+    }
+    if (hdr.capacity == 0 && hdr.count != 0) return false;
+    if ((size_t)f.available() < (size_t)hdr.capacity * sizeof(uint64_t)) return false;
+
+    FlatHashSet loaded;
+    if (hdr.capacity) {
+        loaded.slots_ = static_cast<uint64_t*>(heap_caps_malloc(hdr.capacity * sizeof(uint64_t), MALLOC_CAP_8BIT));
+        if (!loaded.slots_) return false;
+        const size_t bytes = hdr.capacity * sizeof(uint64_t);
+        if (f.read(reinterpret_cast<uint8_t*>(loaded.slots_), bytes) != bytes) return false;
+        // The probes rely on an EMPTY slot to stop: the slots must agree with
+        // the header, which already leaves at least one free
+        size_t live = 0, deleted = 0;
+        for (size_t i = 0; i < hdr.capacity; ++i) {
+            const uint64_t v = loaded.slots_[i];
+            if (v == TOMBSTONE) {
+                ++deleted;
+            } else if (v != EMPTY) {
+                ++live;
+            }
+        }
+        if (live != hdr.count || deleted != hdr.tombstones) return false;
+    }
+    loaded.capacity_ = hdr.capacity;
+    loaded.count_ = hdr.count;
+    loaded.tombstones_ = hdr.tombstones;
+    loaded.hasZero_ = hdr.hasZero != 0;
+    loaded.hasOne_ = hdr.hasOne != 0;
+    swap(loaded);
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <FS.h>
+
+// Open-addressing hash set of 64-bit UID hashes (linear probing, one
+// contiguous slot array). Used for the allow/deny caches in place of sorted
+// vectors: insert/erase/lookup are O(1) on average and the slot array is
+// written to flash as-is, so loading needs neither sorting nor rehashing.
+//
+// Slot values 0 and 1 mark empty/deleted slots; the (astronomically rare)
+// keys 0 and 1 are tracked in flags instead.
+class FlatHashSet {
+public:
+    FlatHashSet() = default;
+    ~FlatHashSet();
+    FlatHashSet(const FlatHashSet &) = delete;
+    FlatHashSet &operator=(const FlatHashSet &) = delete;
+    FlatHashSet(FlatHashSet &&other) noexcept;
+    FlatHashSet &operator=(FlatHashSet &&other) noexcept;
+
+    bool contains(uint64_t key) const;
+    // Returns true when the key was newly added
+    bool insert(uint64_t key);
+    // Returns true when the key was present
+    bool erase(uint64_t key);
+    void clear();
+    void swap(FlatHashSet &other) noexcept;
+
+    // Size the table for `n` keys up front (e.g. from a sync payload count)
+    bool reserve(size_t n);
+
+    size_t size() const { return count_ + (hasZero_ ? 1 : 0) + (hasOne_ ? 1 : 0); }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return capacity_; }
+    size_t memoryBytes() const { return capacity_ * sizeof(uint64_t); }
+
+    // Visit every key (order is slot order, not sorted)
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        if (hasZero_) fn(0ULL);
+        if (hasOne_) fn(1ULL);
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (slots_[i] > TOMBSTONE) fn(slots_[i]);
+        }
+    }
+
+    // Serialize as header + raw slot array (the in-memory layout)
+    bool writeTo(fs::File &f) const;
+    bool readFrom(fs::File &f);
+
+private:
+    static constexpr uint64_t EMPTY = 0;
+    static constexpr uint64_t TOMBSTONE = 1;
+    // Keep (used + deleted) slots at or below 3/4 of capacity
+    static constexpr size_t LOAD_NUM = 3;
+    static constexpr size_t LOAD_DEN = 4;
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    struct __attribute__((packed)) DiskHeader {
+        uint32_t capacity;
+        uint32_t count;      // live keys stored in slots
+        uint32_t tombstones;
+        uint8_t  hasZero;
+        uint8_t  hasOne;
+        uint16_t reserved;
+    };
+
+    uint64_t *slots_ = nullptr;
+    size_t capacity_ = 0;   // power of two, or 0
+    size_t count_ = 0;
+    size_t tombstones_ = 0;
+    bool hasZero_ = false;
+    bool hasOne_ = false;
+
+    size_t slotFor(uint64_t key) const {
+        return (static_cast<uint32_t>(key) ^ static_cast<uint32_t>(key >> 32)) & (capacity_ - 1);
+    }
+    bool rehash(size_t newCapacity);
+    static size_t capacityFor(size_t n);
+};
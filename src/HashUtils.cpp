@@ -4,23 +4,30 @@
 
 
 
-static uint64_t fnv1a64_bytes(const uint8_t* data, size_t len) {
-    uint64_t hash = 0xcbf29ce484222325ULL;
-    for (size_t i = 0; i < len; ++i) {
-        constexpr uint64_t prime = 0x100000001b3ULL;
-        hash ^= data[i];
-        hash *= prime;
-    }
-    return hash;
-}
+// Nibble-wise CRC-32 (reflected polynomial 0xEDB88320). A 16-entry table
+// keeps flash use at 64 bytes while staying fast enough for streamed syncs.
+static constexpr uint32_t CRC32_NIBBLE[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
 
 namespace HashUtils {
     uint64_t hashUid(const String &s) {
         String t = s;
         t.trim();
         t.toUpperCase();
-        return fnv1a64_bytes(reinterpret_cast<const uint8_t*>(t.c_str()), t.length());
+        return fnv1a64(t.c_str(), t.length());
     }
-}//
-// Created by fatta on 2025-12-01.
-//
\ No newline at end of file
+
+    uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t len) {
+        crc = ~crc;
+        for (size_t i = 0; i < len; ++i) {
+            crc ^= data[i];
+            crc = (crc >> 4) ^ CRC32_NIBBLE[crc & 0x0F];
+            crc = (crc >> 4) ^ CRC32_NIBBLE[crc & 0x0F];
+        }
+        return ~crc;
+    }
+}
@@ -6,8 +6,27 @@
 
 
 namespace HashUtils {
-    // Normalize (trim, uppercase) then return 64-bit FNV-1a hash of the input
-    uint64_t hashUid(const String &s);
-}
+    constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+    constexpr uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+    // One FNV-1a 64 step; chain from FNV_OFFSET
+    constexpr uint64_t fnv1a64Step(uint64_t hash, uint8_t byte) {
+        return (hash ^ byte) * FNV_PRIME;
+    }
 
+    constexpr uint64_t fnv1a64(const char *data, size_t len) {
+        uint64_t hash = FNV_OFFSET;
+        for (size_t i = 0; i < len; ++i) {
+            hash = fnv1a64Step(hash, static_cast<uint8_t>(data[i]));
+        }
+        return hash;
+    }
 
+    // Normalize (trim, uppercase) then return 64-bit FNV-1a hash of the input.
+    // Scans use UidKey::hash(), which needs no String.
+    uint64_t hashUid(const String &s);
+
+    // Incremental zlib-compatible CRC-32. Start with crc = 0 and feed the
+    // previous result back in for each chunk (same as Python zlib.crc32).
+    uint32_t crc32Update(uint32_t crc, const uint8_t *data, size_t len);
+}
@@ -0,0 +1,200 @@
+#include "Latency.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+// Latency
+// -------
+// Bucket b < 4 holds exactly b us. Above that, bucket 4*(o-1)+s covers the
+// quarter s of the octave [2^o, 2^(o+1)); the last bucket also takes any
+// overflow (> ~8.4 s). Percentiles report the bucket's upper bound, capped
+// by the exact maximum.
+//
+// Every cell is a relaxed atomic, so recording from the scan path takes no
+// lock. A summary taken while samples arrive may be off by those samples.
+
+namespace {
+    constexpr size_t BUCKETS = 88;
+
+    struct StageHist {
+        uint32_t buckets[BUCKETS];
+        uint32_t count;
+        uint32_t max;
+    };
+
+    struct LiveHist {
+        std::atomic<uint32_t> buckets[BUCKETS];
+        std::atomic<uint32_t> count;
+        std::atomic<uint32_t> max;
+    };
+
+    struct State {
+        LiveHist stages[Latency::STAGE_COUNT];
+        std::atomic<uint32_t> counters[Latency::COUNTER_COUNT];
+        std::atomic<uint32_t> milestones[Latency::MILESTONE_COUNT];
+    };
+
+    State stats;
+
+    const char *const STAGE_NAMES[Latency::STAGE_COUNT] = {
+        "read", "uid", "hash", "cache", "server", "display", "reader_gap", "decision", "local_api"};
+    const char *const COUNTER_NAMES[Latency::COUNTER_COUNT] = {
+        "cache_hits", "server_fallbacks", "server_late", "offline_decisions", "sync_bytes",
+        "http_requests", "flash_writes", "flash_bytes"};
+    const char *const MILESTONE_NAMES[Latency::MILESTONE_COUNT] = {
+        "setup", "cache_ready", "readers_up", "wifi_up", "synced", "first_scan"};
+
+    size_t bucketOf(uint32_t us) {
+        if (us < 4) return us;
+        const unsigned octave = 31 - __builtin_clz(us);
+        const size_t b = 4 * (octave - 1) + ((us >> (octave - 2)) & 3);
+        return b < BUCKETS ? b : BUCKETS - 1;
+    }
+
+    uint32_t upperBoundOf(size_t b) {
+        if (b < 4) return b;
+        const unsigned octave = b / 4 + 1;
+        const uint32_t width = 1UL << (octave - 2);
+        return ((4 + b % 4) << (octave - 2)) + width - 1;
+    }
+
+    // Smallest bucket bound covering `permille`/1000 of the samples
+    uint32_t percentile(const StageHist &h, uint32_t permille) {
+        if (h.count == 0) return 0;
+        const uint64_t rank = (static_cast<uint64_t>(h.count) * permille + 999) / 1000;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            seen += h.buckets[b];
+            if (seen >= rank) return b == BUCKETS - 1 ? h.max : std::min(upperBoundOf(b), h.max);
+        }
+        return h.max;
+    }
+}
+
+namespace Latency {
+
+void record(Stage stage, uint32_t us) {
+    if (stage >= STAGE_COUNT) return;
+    LiveHist &h = stats.stages[stage];
+    h.buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    h.count.fetch_add(1, std::memory_order_relaxed);
+    uint32_t max = h.max.load(std::memory_order_relaxed);
+    while (us > max && !h.max.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+}
+
+int64_t lap(Stage stage, int64_t start) {
+    const int64_t t = now();
+    const int64_t d = t - start;
+    record(stage, d < 0 ? 0 : d > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(d));
+    return t;
+}
+
+void count(Counter counter, uint32_t n) {
+    if (counter >= COUNTER_COUNT) return;
+    stats.counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+void mark(Milestone milestone) {
+    if (milestone >= MILESTONE_COUNT) return;
+    // 0 is "not reached", so a mark at the very first microsecond reads 1
+    const int64_t t = now();
+    const uint32_t at = t < 1 ? 1 : t > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(t);
+    uint32_t unset = 0;
+    stats.milestones[milestone].compare_exchange_strong(unset, at, std::memory_order_relaxed);
+}
+
+Summary summary(Stage stage) {
+    Summary s{};
+    if (stage >= STAGE_COUNT) return s;
+    // Copy first: percentiles walk the buckets twice
+    const LiveHist &live = stats.stages[stage];
+    StageHist h;
+    for (size_t b = 0; b < BUCKETS; ++b) h.buckets[b] = live.buckets[b].load(std::memory_order_relaxed);
+    h.count = live.count.load(std::memory_order_relaxed);
+    h.max = live.max.load(std::memory_order_relaxed);
+    s.count = h.count;
+    s.p50 = percentile(h, 500);
+    s.p95 = percentile(h, 950);
+    s.p99 = percentile(h, 990);
+    s.max = h.max;
+    return s;
+}
+
+uint32_t counter(Counter counter) {
+    if (counter >= COUNTER_COUNT) return 0;
+    return stats.counters[counter].load(std::memory_order_relaxed);
+}
+
+const char *stageName(Stage stage) {
+    return stage < STAGE_COUNT ? STAGE_NAMES[stage] : "?";
+}
+
+const char *counterName(Counter counter) {
+    return counter < COUNTER_COUNT ? COUNTER_NAMES[counter] : "?";
+}
+
+uint32_t milestoneAt(Milestone milestone) {
+    if (milestone >= MILESTONE_COUNT) return 0;
+    return stats.milestones[milestone].load(std::memory_order_relaxed);
+}
+
+const char *milestoneName(Milestone milestone) {
+    return milestone < MILESTONE_COUNT ? MILESTONE_NAMES[milestone] : "?";
+}
+
+void print(Print &out) {
+    out.println("[Latency] stage      count    p50us    p95us    p99us    maxus");
+    for (uint8_t i = 0; i < STAGE_COUNT; ++i) {
+        const Summary s = summary(static_cast<Stage>(i));
+        out.printf("[Latency] %-9s %6u %8u %8u %8u %8u\n", STAGE_NAMES[i], s.count, s.p50, s.p95, s.p99, s.max);
+    }
+    const Summary d = summary(STAGE_DECISION);
+    out.printf("[Latency] budget=%uus decision p99=%uus%s\n", static_cast<unsigned>(LATENCY_BUDGET_US), d.p99,
+                  d.p99 > LATENCY_BUDGET_US ? " OVER BUDGET" : "");
+    out.print("[Latency]");
+    for (uint8_t i = 0; i < COUNTER_COUNT; ++i) {
+        out.printf(" %s=%u", COUNTER_NAMES[i], counter(static_cast<Counter>(i)));
+    }
+    out.println();
+    out.print("[Latency] boot ms:");
+    for (uint8_t i = 0; i < MILESTONE_COUNT; ++i) {
+        const uint32_t at = milestoneAt(static_cast<Milestone>(i));
+        if (at) out.printf(" %s=%u", MILESTONE_NAMES[i], static_cast<unsigned>(at / 1000));
+        else out.printf(" %s=-", MILESTONE_NAMES[i]);
+    }
+    out.println();
+}
+
+void toJson(JsonObject out) {
+    out["budget_us"] = static_cast<uint32_t>(LATENCY_BUDGET_US);
+    JsonObject stages = out["stages"].to<JsonObject>();
+    for (uint8_t i = 0; i < STAGE_COUNT; ++i) {
+        const Summary s = summary(static_cast<Stage>(i));
+        JsonArray a = stages[STAGE_NAMES[i]].to<JsonArray>();
+        a.add(s.count);
+        a.add(s.p50);
+        a.add(s.p95);
+        a.add(s.p99);
+        a.add(s.max);
+    }
+    JsonObject counters = out["counters"].to<JsonObject>();
+    for (uint8_t i = 0; i < COUNTER_COUNT; ++i) {
+        counters[COUNTER_NAMES[i]] = counter(static_cast<Counter>(i));
+    }
+    JsonObject boot = out["boot"].to<JsonObject>();
+    for (uint8_t i = 0; i < MILESTONE_COUNT; ++i) {
+        boot[MILESTONE_NAMES[i]] = milestoneAt(static_cast<Milestone>(i));
+    }
+}
+
+void reset() {
+    for (LiveHist &h : stats.stages) {
+        for (std::atomic<uint32_t> &b : h.buckets) b.store(0, std::memory_order_relaxed);
+        h.count.store(0, std::memory_order_relaxed);
+        h.max.store(0, std::memory_order_relaxed);
+    }
+    for (std::atomic<uint32_t> &c : stats.counters) c.store(0, std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <esp_timer.h>
+
+// Scan-to-decision latency budget (microseconds) checked against the p99 of
+// the STAGE_DECISION stage. Override in platformio.ini build_flags, e.g.
+// -DLATENCY_BUDGET_US=100000.
+#ifndef LATENCY_BUDGET_US
+#define LATENCY_BUDGET_US 150000
+#endif
+
+// Lightweight latency instrumentation for the scan path.
+//
+// Each stage keeps a fixed-bucket histogram of esp_timer_get_time() deltas
+// (four buckets per power of two, so percentiles are within 25%), plus a
+// few event counters and the boot milestones (time since reset when each
+// was first reached). Everything lives in one static struct; recording is
+// a short critical section and safe from any task.
+//
+// toJson() layout (also sent in the scan batch `stats`, see
+// /api/scan_stats):
+//   { "budget_us", "stages": { "<name>": [count, p50, p95, p99, max] },
+//     "counters": { "<name>": n }, "boot": { "<milestone>": t } }
+//   -- times in microseconds, boot milestones not reached yet are 0
+namespace Latency {
+    enum Stage : uint8_t {
+        STAGE_READ,        // detection -> PICC_ReadCardSerial done (reader task)
+        STAGE_UID,         // UidKey from the reader bytes
+        STAGE_HASH,        // UidKey::hash
+        STAGE_CACHE,       // filter / index + bitset / learned caches
+        STAGE_SERVER,      // unknown-card lookup (wait on NetworkTask or inline)
+        STAGE_DISPLAY,     // publishing the display snapshot after a scan
+        STAGE_READER_GAP,  // time between two looks at the same reader (REQA/poll)
+        STAGE_DECISION,    // card present -> authorization decided
+        STAGE_LOCAL_API,   // DecisionService: query batch received -> reply queued
+        STAGE_COUNT
+    };
+
+    enum Counter : uint8_t {
+        CACHE_HITS,        // decided from local data
+        SERVER_FALLBACKS,  // unknown card sent to the server
+        SERVER_LATE,       // lookup missed the scan deadline
+        OFFLINE_DECISIONS, // decided by the offline policy
+        SYNC_BYTES,        // sync payload bytes read from the server
+        HTTP_REQUESTS,     // requests sent on the server session
+        FLASH_WRITES,      // file, partition and NVS writes
+        FLASH_BYTES,       // bytes in those writes
+        COUNTER_COUNT
+    };
+
+    // Boot phases, in the order they usually complete. Scans are served
+    // from BOOT_READERS_UP on; the network comes up behind them.
+    enum Milestone : uint8_t {
+        BOOT_SETUP,        // setup() entered
+        BOOT_CACHE_READY,  // offline tables loaded (preloadOffline)
+        BOOT_READERS_UP,   // reader task running: cards are decided from here
+        BOOT_WIFI_UP,      // station got an IP
+        BOOT_SYNCED,       // first successful sync with the server
+        BOOT_FIRST_SCAN,   // first card decided
+        MILESTONE_COUNT
+    };
+
+    struct Summary {
+        uint32_t count;
+        uint32_t p50;
+        uint32_t p95;
+        uint32_t p99;
+        uint32_t max;
+    };
+
+    inline int64_t now() { return esp_timer_get_time(); }
+
+    void record(Stage stage, uint32_t us);
+    // Record the time since `start` and return the current time, so stages
+    // can be chained: t = lap(STAGE_READ, t); ... t = lap(STAGE_UID, t);
+    int64_t lap(Stage stage, int64_t start);
+    void count(Counter counter, uint32_t n = 1);
+    // Note `milestone` now unless it was reached before (any task)
+    void mark(Milestone milestone);
+    // One write of `bytes` to flash (FLASH_WRITES, FLASH_BYTES)
+    inline void flashWrite(size_t bytes) {
+        count(FLASH_WRITES);
+        count(FLASH_BYTES, static_cast<uint32_t>(bytes));
+    }
+
+    Summary summary(Stage stage);
+    uint32_t counter(Counter counter);
+    const char *stageName(Stage stage);
+    const char *counterName(Counter counter);
+    // Microseconds since reset, 0 while not reached
+    uint32_t milestoneAt(Milestone milestone);
+    const char *milestoneName(Milestone milestone);
+
+    // Human-readable table (dumpMemoryStats, console)
+    void print(Print &out = Serial);
+    // Machine-readable snapshot (layout above)
+    void toJson(JsonObject out);
+    // Clears stages and counters; boot milestones are kept
+    void reset();
+}
@@ -0,0 +1,210 @@
+#include "LearnedCache.h"
+#include "Latency.h"
+#include "Log.h"
+#include <LittleFS.h>
+#include <algorithm>
+#include <esp_heap_caps.h>
+#include <new>
+
+// LearnedCache
+// ------------
+// The table is allocated on the first insert, from PSRAM when the board has
+// it, otherwise from internal heap while HEAP_RESERVE stays free, and then
+// kept for the life of the cache: evictions and invalidations reuse slots.
+
+namespace {
+    const char *LEARNED_FILE = "/learned.bin";
+    const char *LEARNED_TMP  = "/learned.bin.tmp";
+    // "RBL1"
+    constexpr uint32_t LEARNED_MAGIC = 0x314C4252UL;
+    constexpr size_t LEARNED_HEAP_RESERVE = 32 * 1024;
+
+    void *allocLearned(size_t bytes) {
+        void *p = heap_caps_calloc(1, bytes, MALLOC_CAP_SPIRAM);
+        if (p) return p;
+        if (heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) < bytes + LEARNED_HEAP_RESERVE) return nullptr;
+        return heap_caps_calloc(1, bytes, MALLOC_CAP_8BIT);
+    }
+}
+
+LearnedCache::LearnedCache(size_t entries, uint32_t allowTtlS, uint32_t denyTtlS)
+    : allowTtlS_(allowTtlS), denyTtlS_(denyTtlS) {
+    sets_ = 1;
+    while (sets_ * WAYS < entries) sets_ <<= 1;
+}
+
+LearnedCache::~LearnedCache() {
+    clear();
+}
+
+bool LearnedCache::allocate() {
+    if (entries_) return true;
+    const size_t bytes = capacity() * sizeof(Entry) + sets_;
+    auto *mem = static_cast<uint8_t*>(allocLearned(bytes));
+    if (!mem) {
+        LOG_W("[Learned] No memory for %u entries", static_cast<unsigned>(capacity()));
+        return false;
+    }
+    entries_ = reinterpret_cast<Entry*>(mem);
+    for (size_t i = 0; i < capacity(); ++i) new (&entries_[i]) Entry();
+    hands_ = mem + capacity() * sizeof(Entry);
+    return true;
+}
+
+void LearnedCache::clear() {
+    if (entries_) heap_caps_free(entries_);
+    entries_ = nullptr;
+    hands_ = nullptr;
+}
+
+LearnedCache::Lookup LearnedCache::find(uint64_t hash, uint32_t nowS, bool &allowed) const {
+    if (!entries_) return MISS;
+    Entry *set = setFor(hash);
+    for (size_t w = 0; w < WAYS; ++w) {
+        Entry &e = set[w];
+        if (e.hash != hash || e.expiresS == 0 || e.epoch != epoch_) continue;
+        if (e.expiresS <= nowS) return EXPIRED;
+        if (!e.ref.load(std::memory_order_relaxed)) e.ref.store(1, std::memory_order_relaxed);
+        allowed = e.allowed != 0;
+        return HIT;
+    }
+    return MISS;
+}
+
+void LearnedCache::note(Lookup result) {
+    switch (result) {
+    case HIT:
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        break;
+    case EXPIRED:
+        expired_.fetch_add(1, std::memory_order_relaxed);
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        break;
+    default:
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        break;
+    }
+}
+
+bool LearnedCache::insert(uint64_t hash, bool allowed, uint32_t nowS, uint32_t ttlS) {
+    if (!allocate()) return false;
+    Entry *set = setFor(hash);
+    // The card's own slot, else a free one (empty, expired or retired)
+    Entry *slot = nullptr;
+    for (size_t w = 0; w < WAYS && !slot; ++w) {
+        if (set[w].hash == hash && set[w].expiresS != 0) slot = &set[w];
+    }
+    for (size_t w = 0; w < WAYS && !slot; ++w) {
+        if (!live(set[w], nowS)) slot = &set[w];
+    }
+    if (!slot) {
+        // CLOCK: at most one lap clearing marks, then an unmarked entry
+        uint8_t &hand = hands_[(set - entries_) / WAYS];
+        for (;;) {
+            Entry &e = set[hand];
+            hand = (hand + 1) % WAYS;
+            if (!e.ref.load(std::memory_order_relaxed)) {
+                slot = &e;
+                break;
+            }
+            e.ref.store(0, std::memory_order_relaxed);
+        }
+        ++evictions_;
+    }
+    const uint32_t ttl = ttlS ? ttlS : (allowed ? allowTtlS_ : denyTtlS_);
+    slot->hash = hash;
+    slot->expiresS = std::max<uint32_t>(nowS + ttl, 1);
+    slot->epoch = epoch_;
+    slot->allowed = allowed ? 1 : 0;
+    slot->ref.store(1, std::memory_order_relaxed);
+    ++inserts_;
+    return true;
+}
+
+bool LearnedCache::erase(uint64_t hash, uint32_t nowS) {
+    if (!entries_) return false;
+    Entry *set = setFor(hash);
+    for (size_t w = 0; w < WAYS; ++w) {
+        if (set[w].hash != hash || set[w].expiresS == 0) continue;
+        const bool was = live(set[w], nowS);
+        set[w].expiresS = 0;
+        set[w].ref.store(0, std::memory_order_relaxed);
+        return was;
+    }
+    return false;
+}
+
+void LearnedCache::invalidate() {
+    ++invalidations_;
+    if (++epoch_ != 0) return;
+    // Epoch wrapped: entries of the old epoch 0 must not come back
+    epoch_ = 1;
+    for (size_t i = 0; entries_ && i < capacity(); ++i) entries_[i].expiresS = 0;
+}
+
+size_t LearnedCache::size(uint32_t nowS) const {
+    size_t n = 0;
+    for (size_t i = 0; entries_ && i < capacity(); ++i) {
+        if (live(entries_[i], nowS)) ++n;
+    }
+    return n;
+}
+
+LearnedCache::Stats LearnedCache::stats() const {
+    return Stats{hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed),
+                 expired_.load(std::memory_order_relaxed), inserts_, evictions_, invalidations_};
+}
+
+bool LearnedCache::saveToFS(uint32_t nowS) const {
+    if (!LittleFS.begin()) return false;
+    File f = LittleFS.open(LEARNED_TMP, FILE_WRITE);
+    if (!f) return false;
+    const uint32_t count = static_cast<uint32_t>(size(nowS));
+    bool ok = f.write(reinterpret_cast<const uint8_t*>(&LEARNED_MAGIC), sizeof(LEARNED_MAGIC)) == sizeof(LEARNED_MAGIC) &&
+              f.write(reinterpret_cast<const uint8_t*>(&count), sizeof(count)) == sizeof(count);
+    for (size_t i = 0; ok && entries_ && i < capacity(); ++i) {
+        const Entry &e = entries_[i];
+        if (!live(e, nowS)) continue;
+        const DiskRecord r{e.hash, e.expiresS - nowS, e.allowed};
+        ok = f.write(reinterpret_cast<const uint8_t*>(&r), sizeof(r)) == sizeof(r);
+    }
+    if (ok) Latency::flashWrite(f.size());
+    f.close();
+    if (!ok) {
+        LittleFS.remove(LEARNED_TMP);
+        return false;
+    }
+    LittleFS.remove(LEARNED_FILE);
+    if (!LittleFS.rename(LEARNED_TMP, LEARNED_FILE)) {
+        LittleFS.remove(LEARNED_TMP);
+        return false;
+    }
+    return true;
+}
+
+bool LearnedCache::loadFromFS(uint32_t nowS) {
+    if (!LittleFS.begin() || !LittleFS.exists(LEARNED_FILE)) return false;
+    File f = LittleFS.open(LEARNED_FILE, FILE_READ);
+    if (!f) return false;
+    uint32_t magic = 0;
+    uint32_t count = 0;
+    if (f.read(reinterpret_cast<uint8_t*>(&magic), sizeof(magic)) != sizeof(magic) || magic != LEARNED_MAGIC ||
+        f.read(reinterpret_cast<uint8_t*>(&count), sizeof(count)) != sizeof(count)) {
+        f.close();
+        return false;
+    }
+    DiskRecord r{};
+    uint32_t n = 0;
+    while (n < count && f.read(reinterpret_cast<uint8_t*>(&r), sizeof(r)) == sizeof(r)) {
+        // Never trust a TTL beyond what this build would grant
+        const uint32_t ttl = std::min(r.ttlS, r.allowed ? allowTtlS_ : denyTtlS_);
+        if (ttl && !insert(r.hash, r.allowed != 0, nowS, ttl)) break;
+        ++n;
+    }
+    f.close();
+    return true;
+}
+
+void LearnedCache::removeFromFS() {
+    if (LittleFS.begin() && LittleFS.exists(LEARNED_FILE)) LittleFS.remove(LEARNED_FILE);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <FS.h>
+#include <atomic>
+
+// Budget of the learned-result cache, in entries (16 bytes each). Override
+// in platformio.ini build_flags, e.g. -DLEARNED_CACHE_ENTRIES=2048.
+#ifndef LEARNED_CACHE_ENTRIES
+#define LEARNED_CACHE_ENTRIES 512
+#endif
+// How long a learned answer decides offline. Allows expire sooner: a card
+// revoked while the reader is cut off stops opening the door after this.
+#ifndef LEARNED_ALLOW_TTL_S
+#define LEARNED_ALLOW_TTL_S (60 * 60)
+#endif
+#ifndef LEARNED_DENY_TTL_S
+#define LEARNED_DENY_TTL_S (24 * 60 * 60)
+#endif
+
+// Fixed-size cache of server answers for cards the synced tables do not
+// decide (enrolled since the last sync, or no index at all).
+//
+// 4-way set associative over one table allocated once: a card can only
+// live in the four slots of its set, so lookups touch one cache line and
+// never probe further. Every entry carries its expiry (uptime seconds,
+// per-kind TTL) and the epoch it was learned in; invalidate() starts a
+// new epoch, which retires every entry at once without touching the
+// table. A full set evicts by CLOCK: lookups mark entries referenced, the
+// set's hand clears marks until it finds an unmarked entry.
+//
+// Readers (find) are lock-free inside AuthSync's tables_ read section;
+// writers are serialized by the caller and run inside a write section.
+// The reference mark is the one field readers write.
+class LearnedCache {
+public:
+    enum Lookup : uint8_t { MISS, HIT, EXPIRED };
+
+    struct Stats {
+        uint32_t hits;
+        uint32_t misses;      // expired lookups included
+        uint32_t expired;
+        uint32_t inserts;
+        uint32_t evictions;   // live entries pushed out by CLOCK
+        uint32_t invalidations;
+    };
+
+    static constexpr size_t WAYS = 4;
+
+    explicit LearnedCache(size_t entries = LEARNED_CACHE_ENTRIES, uint32_t allowTtlS = LEARNED_ALLOW_TTL_S,
+                          uint32_t denyTtlS = LEARNED_DENY_TTL_S);
+    ~LearnedCache();
+    LearnedCache(const LearnedCache&) = delete;
+    LearnedCache& operator=(const LearnedCache&) = delete;
+
+    // Reader side. HIT sets `allowed` and marks the entry referenced.
+    Lookup find(uint64_t hash, uint32_t nowS, bool &allowed) const;
+    // Count a lookup result (kept apart from find(), which a read section
+    // may run more than once)
+    void note(Lookup result);
+
+    // Writer side. Learn an answer for `ttlS` seconds (0 = the TTL of its
+    // kind); false without memory for the table.
+    bool insert(uint64_t hash, bool allowed, uint32_t nowS, uint32_t ttlS = 0);
+    // Forget a card; true when it had a live entry
+    bool erase(uint64_t hash, uint32_t nowS);
+    // Retire every entry (new sync generation)
+    void invalidate();
+    // Drop every entry and free the table
+    void clear();
+
+    // Live entries: walks the table, for stats only
+    size_t size(uint32_t nowS) const;
+    size_t capacity() const { return sets_ * WAYS; }
+    size_t memoryBytes() const { return entries_ ? capacity() * sizeof(Entry) + sets_ : 0; }
+    uint16_t epoch() const { return epoch_; }
+    Stats stats() const;
+
+    // Snapshot of the live entries with their remaining TTL in
+    // `/learned.bin` (atomic write/rename); loading restarts the clocks
+    // at `nowS`
+    bool saveToFS(uint32_t nowS) const;
+    bool loadFromFS(uint32_t nowS);
+    static void removeFromFS();
+
+private:
+    struct Entry {
+        uint64_t hash;
+        uint32_t expiresS;   // 0 = empty slot
+        uint16_t epoch;
+        uint8_t allowed;
+        std::atomic<uint8_t> ref;
+    };
+    static_assert(sizeof(Entry) == 16, "learned cache entry stays 16 bytes");
+
+    struct __attribute__((packed)) DiskRecord {
+        uint64_t hash;
+        uint32_t ttlS;       // seconds left when saved
+        uint8_t allowed;
+    };
+
+    Entry *entries_ = nullptr;
+    uint8_t *hands_ = nullptr;   // CLOCK hand per set
+    size_t sets_ = 0;            // power of two
+    uint32_t allowTtlS_;
+    uint32_t denyTtlS_;
+    uint16_t epoch_ = 1;
+
+    std::atomic<uint32_t> hits_{0};
+    std::atomic<uint32_t> misses_{0};
+    std::atomic<uint32_t> expired_{0};
+    uint32_t inserts_ = 0;
+    uint32_t evictions_ = 0;
+    uint32_t invalidations_ = 0;
+
+    bool allocate();
+    Entry *setFor(uint64_t hash) const {
+        return entries_ + ((static_cast<uint32_t>(hash) ^ static_cast<uint32_t>(hash >> 32)) & (sets_ - 1)) * WAYS;
+    }
+    bool live(const Entry &e, uint32_t nowS) const {
+        return e.expiresS > nowS && e.epoch == epoch_;
+    }
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+// Building blocks for handing state between the tasks (reader, loop(),
+// NetworkTask, display). None of them takes a mutex or allocates after
+// construction. SpscRing and RequestBits never wait; SeqGuard is a
+// spinning reader/writer guard whose waits yield the CPU (spinWait()).
+
+// Spin while `busy()` holds, yielding a tick after SPIN_LIMIT rounds so a
+// preempted task on the same core (the one being waited for) can run
+constexpr uint32_t SPIN_LIMIT = 64;
+
+template <typename Busy>
+inline void spinWait(Busy busy) {
+    for (uint32_t spins = 0; busy(); ++spins) {
+        if (spins >= SPIN_LIMIT) vTaskDelay(1);
+    }
+}
+
+// Single-producer/single-consumer ring of N trivially copyable slots (N a
+// power of two). The producer owns tail_, the consumer owns head_; each
+// side only reads the other's index, so push() and the consumer calls
+// never wait for each other. push() fails instead of overwriting.
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be a power of two");
+
+public:
+    static constexpr size_t CAPACITY = N;
+
+    // Producer
+    bool push(const T &item) {
+        const uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= N) return false;
+        slots_[tail & (N - 1)] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: oldest item; false when empty
+    bool pop(T &out) {
+        if (!peek(0, out)) return false;
+        drop(1);
+        return true;
+    }
+    // Consumer: copy item `i` (0 = oldest) without removing it
+    bool peek(size_t i, T &out) const {
+        const uint32_t head = head_.load(std::memory_order_relaxed);
+        if (i >= tail_.load(std::memory_order_acquire) - head) return false;
+        out = slots_[(head + i) & (N - 1)];
+        return true;
+    }
+    // Consumer: remove the `n` oldest items (at most size())
+    void drop(size_t n) {
+        const uint32_t head = head_.load(std::memory_order_relaxed);
+        const uint32_t avail = tail_.load(std::memory_order_acquire) - head;
+        head_.store(head + (n < avail ? n : avail), std::memory_order_release);
+    }
+
+    // Either side; a snapshot that may be stale by the time it is used
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+
+private:
+    T slots_[N];
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+};
+
+// Request bits raised by any task or timer callback and taken in one go by
+// the task that does the work: a raise between two take() calls is never
+// lost, repeated raises collapse into one.
+class RequestBits {
+public:
+    void raise(uint32_t bits) { bits_.fetch_or(bits, std::memory_order_release); }
+    // Clear and return every raised bit
+    uint32_t take() { return bits_.exchange(0, std::memory_order_acquire); }
+    // Clear and test the given bits only
+    bool take(uint32_t bits) { return bits_.fetch_and(~bits, std::memory_order_acquire) & bits; }
+    bool pending(uint32_t bits) const { return bits_.load(std::memory_order_relaxed) & bits; }
+
+private:
+    std::atomic<uint32_t> bits_{0};
+};
+
+// Guards tables that the scan path reads while one writer task (serialized
+// by other means) replaces or edits them. Readers only bump an atomic
+// count; a writer marks itself with an odd sequence number, then waits for
+// the readers already inside to leave, so it never frees or rehashes
+// memory under a lookup. Readers arriving during a write spin until it
+// ends (a swap or an insert: microseconds), and the writer spins until the
+// readers inside have left; both yield the CPU after a few rounds so a
+// preempted task on the same core can finish. Keep writes short: build
+// the new table first, then swap it in under the guard.
+class SeqGuard {
+public:
+    template <typename Fn>
+    void read(Fn fn) const {
+        for (;;) {
+            readers_.fetch_add(1);
+            if (!(seq_.load() & 1)) {
+                fn();
+                readers_.fetch_sub(1);
+                return;
+            }
+            readers_.fetch_sub(1);
+            // Wait outside, so the writer sees the count drop to zero
+            spinWait([this] { return (seq_.load() & 1) != 0; });
+        }
+    }
+
+    void beginWrite() {
+        seq_.fetch_add(1);
+        spinWait([this] { return readers_.load() != 0; });
+    }
+    void endWrite() { seq_.fetch_add(1); }
+
+    // Completed writes (two sequence steps each)
+    uint32_t writes() const { return seq_.load(std::memory_order_relaxed) / 2; }
+
+    class Write {
+    public:
+        explicit Write(SeqGuard &guard) : guard_(guard) { guard_.beginWrite(); }
+        ~Write() { guard_.endWrite(); }
+        Write(const Write&) = delete;
+        Write& operator=(const Write&) = delete;
+
+    private:
+        SeqGuard &guard_;
+    };
+
+private:
+    // Sequentially consistent on purpose: reader count and sequence form a
+    // Dekker-style handshake
+    mutable std::atomic<uint32_t> readers_{0};
+    std::atomic<uint32_t> seq_{0};
+};
@@ -0,0 +1,145 @@
+#include "Log.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <freertos/task.h>
+
+// Log
+// ---
+// Vyukov-style bounded queue: each slot carries a sequence number telling
+// producers (== position: free) and the consumer (== position + 1: filled)
+// whose turn it is. Slots store `seq - index` so that the zero-initialized
+// array starts out as "all free" without a constructor.
+
+namespace {
+    static_assert((LOG_SLOTS & (LOG_SLOTS - 1)) == 0, "LOG_SLOTS must be a power of two");
+    constexpr uint32_t MASK = LOG_SLOTS - 1;
+    constexpr unsigned long DRAIN_INTERVAL_MS = 20;
+
+    struct Slot {
+        std::atomic<uint32_t> turn;
+        uint8_t len;
+        char text[LOG_LINE_BYTES];
+    };
+
+    Slot slots[LOG_SLOTS];
+    std::atomic<uint32_t> enqueuePos{0};
+    uint32_t dequeuePos = 0;
+    std::atomic<uint32_t> writtenCount{0};
+    std::atomic<uint32_t> droppedCount{0};
+    uint32_t droppedReported = 0;
+    std::atomic<bool> started{false};
+    std::atomic<uint8_t> runtimeLevel{APP_LOG_LEVEL};
+    std::atomic<Log::Sink> sinkFn{nullptr};
+
+    uint32_t seqOf(const Slot &s, uint32_t pos) {
+        return s.turn.load(std::memory_order_acquire) + (pos & MASK);
+    }
+
+    void publish(Slot &s, uint32_t pos, uint32_t seq) {
+        s.turn.store(seq - (pos & MASK), std::memory_order_release);
+    }
+
+    void emit(const char *line, size_t len) {
+        Serial.write(reinterpret_cast<const uint8_t*>(line), len);
+        Serial.write('\n');
+        const Log::Sink sink = sinkFn.load(std::memory_order_acquire);
+        if (sink) sink(line, len);
+    }
+
+    void drainTask(void *) {
+        for (;;) {
+            Log::drain();
+            vTaskDelay(pdMS_TO_TICKS(DRAIN_INTERVAL_MS));
+        }
+    }
+}
+
+namespace Log {
+
+bool begin(UBaseType_t priority) {
+    if (started.exchange(true)) return true;
+    if (xTaskCreate(drainTask, "log_task", 2560, nullptr, priority, nullptr) != pdPASS) {
+        started = false;
+        Serial.println("[Log] Failed to start drain task; logging inline");
+        return false;
+    }
+    return true;
+}
+
+void setSink(Sink sink) {
+    sinkFn.store(sink, std::memory_order_release);
+}
+
+void setLevel(Level level) {
+    runtimeLevel = level;
+}
+
+Level level() {
+    return static_cast<Level>(runtimeLevel.load(std::memory_order_relaxed));
+}
+
+void write(Level level, const char *fmt, ...) {
+    if (level > runtimeLevel.load(std::memory_order_relaxed)) return;
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot *slot = nullptr;
+    for (;;) {
+        slot = &slots[pos & MASK];
+        const int32_t dif = static_cast<int32_t>(seqOf(*slot, pos) - pos);
+        if (dif == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (dif < 0) {
+            // Consumer is a full ring behind: drop rather than block
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    const int n = vsnprintf(slot->text, sizeof(slot->text), fmt, ap);
+    va_end(ap);
+    slot->len = static_cast<uint8_t>(n < 0 ? 0 : std::min<int>(n, sizeof(slot->text) - 1));
+    publish(*slot, pos, pos + 1);
+
+    if (!started.load(std::memory_order_relaxed)) drain();
+}
+
+size_t drain() {
+    size_t lines = 0;
+    char line[LOG_LINE_BYTES];
+    for (;;) {
+        Slot &slot = slots[dequeuePos & MASK];
+        if (seqOf(slot, dequeuePos) != dequeuePos + 1) break;
+        // Copy out and free the slot before the slow UART write
+        const size_t len = slot.len;
+        memcpy(line, slot.text, len);
+        publish(slot, dequeuePos, dequeuePos + LOG_SLOTS);
+        ++dequeuePos;
+        emit(line, len);
+        ++lines;
+    }
+    if (lines) writtenCount.fetch_add(lines, std::memory_order_relaxed);
+
+    const uint32_t dropped = droppedCount.load(std::memory_order_relaxed);
+    if (dropped != droppedReported) {
+        const int n = snprintf(line, sizeof(line), "[Log] %u line(s) dropped (ring full)",
+                               static_cast<unsigned>(dropped - droppedReported));
+        droppedReported = dropped;
+        emit(line, std::min<size_t>(n, sizeof(line) - 1));
+    }
+    return lines;
+}
+
+uint32_t written() {
+    return writtenCount.load(std::memory_order_relaxed);
+}
+
+uint32_t dropped() {
+    return droppedCount.load(std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Log levels; messages above APP_LOG_LEVEL are removed at compile time
+// (arguments are not evaluated). Override in platformio.ini build_flags,
+// e.g. -DAPP_LOG_LEVEL=4 for debug output or -DAPP_LOG_LEVEL=2 in production.
+#define APP_LOG_NONE  0
+#define APP_LOG_ERROR 1
+#define APP_LOG_WARN  2
+#define APP_LOG_INFO  3
+#define APP_LOG_DEBUG 4
+#ifndef APP_LOG_LEVEL
+#define APP_LOG_LEVEL APP_LOG_INFO
+#endif
+
+// Ring size (power of two) and maximum line length; longer lines are cut
+#ifndef LOG_SLOTS
+#define LOG_SLOTS 32
+#endif
+#ifndef LOG_LINE_BYTES
+#define LOG_LINE_BYTES 120
+#endif
+
+// Asynchronous line logger.
+//
+// LOG_x() formats straight into a slot of a fixed lock-free ring (bounded
+// MPMC sequence queue, so loop() and NetworkTask can log concurrently) and
+// returns; a low-priority task started by begin() drains the ring to
+// Serial and the optional network sink. A full ring drops the line and
+// counts it instead of blocking. Before begin() lines are written inline,
+// which keeps boot output ordered and lets tests run without the task.
+// Pass lines without a trailing newline.
+namespace Log {
+    enum Level : uint8_t {
+        LEVEL_ERROR = APP_LOG_ERROR,
+        LEVEL_WARN = APP_LOG_WARN,
+        LEVEL_INFO = APP_LOG_INFO,
+        LEVEL_DEBUG = APP_LOG_DEBUG,
+    };
+
+    // Extra output for every drained line (e.g. remote console); called
+    // from the drain task.
+    using Sink = void (*)(const char *line, size_t len);
+
+    // Start the drain task (setup())
+    bool begin(UBaseType_t priority = tskIDLE_PRIORITY);
+    void setSink(Sink sink);
+    // Runtime threshold below the compile-time one (default APP_LOG_LEVEL)
+    void setLevel(Level level);
+    Level level();
+
+    void write(Level level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    // Move queued lines to the outputs; returns the number written. Only
+    // the drain task calls this once begin() succeeded.
+    size_t drain();
+
+    uint32_t written();
+    uint32_t dropped();
+}
+
+#if APP_LOG_LEVEL >= APP_LOG_ERROR
+#define LOG_E(...) Log::write(Log::LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_E(...) ((void)0)
+#endif
+#if APP_LOG_LEVEL >= APP_LOG_WARN
+#define LOG_W(...) Log::write(Log::LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_W(...) ((void)0)
+#endif
+#if APP_LOG_LEVEL >= APP_LOG_INFO
+#define LOG_I(...) Log::write(Log::LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_I(...) ((void)0)
+#endif
+#if APP_LOG_LEVEL >= APP_LOG_DEBUG
+#define LOG_D(...) Log::write(Log::LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_D(...) ((void)0)
+#endif
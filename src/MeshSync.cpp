@@ -0,0 +1,677 @@
+#include "MeshSync.h"
+#include "AuthSync.h"
+#include "Log.h"
+#include <WiFi.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#ifdef MESH_SYNC
+
+#include <esp_now.h>
+#include <esp_random.h>
+#include <mbedtls/md.h>
+
+// MeshSync
+// --------
+// Requests, DATA and the handshake are unicast (MAC-level retries);
+// announcements and revocations are broadcast. A session per sender MAC
+// holds the boot and seq its answered challenge fixed; the first frame of
+// an unknown sender, or one under another boot id (it rebooted, or the
+// frame is recorded), is dropped and challenges it. DATA frames also only
+// count for the transfer whose random nonce they echo, and a transfer
+// reads the object in order: the reader (AuthSync) pulls bytes, a window
+// at a time, the way SyncDecoder pulls them off the socket.
+
+MeshSync *MeshSync::instance_ = nullptr;
+
+namespace {
+    const uint8_t MESH_BROADCAST[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    // Deltas chained in one pull before falling back to the image
+    constexpr int MESH_DELTA_CHAIN = 8;
+
+    void meshPrintMac(Print &out, const uint8_t *mac) {
+        out.printf("%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+
+    bool meshEtagIs(const MeshFormat::Announce &a, const char *etag) {
+        return strlen(etag) == a.etagLen && memcmp(a.etag, etag, a.etagLen) == 0;
+    }
+
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    void meshReceiveInfo(const esp_now_recv_info_t *info, const uint8_t *data, int len);
+#endif
+}
+
+MeshSync::~MeshSync() {
+    if (!started_) return;
+    esp_now_unregister_recv_cb();
+    esp_now_deinit();
+    instance_ = nullptr;
+}
+
+bool MeshSync::begin(const String &key, uint16_t site, TaskHandle_t wake) {
+    if (started_) return true;
+    if (key.length() == 0) {
+        LOG_W("[Mesh] No mesh_key configured; mesh off");
+        return false;
+    }
+    if (esp_now_init() != ESP_OK) {
+        LOG_E("[Mesh] ESP-NOW init failed");
+        return false;
+    }
+    key_ = key;
+    site_ = site;
+    wake_ = wake;
+    boot_ = esp_random();
+    WiFi.macAddress(self_);
+    instance_ = this;
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    esp_now_register_recv_cb(meshReceiveInfo);
+#else
+    esp_now_register_recv_cb(onReceive);
+#endif
+    if (!ensurePeer(MESH_BROADCAST)) {
+        LOG_E("[Mesh] Cannot add the broadcast peer");
+        esp_now_deinit();
+        instance_ = nullptr;
+        return false;
+    }
+    // Every delta applied here is kept for the neighbours
+    auth_.setDeltaTap([this](const SyncFormat::DeltaHeader &hdr, const SyncFormat::DeltaRange *ranges,
+                             const char *etag) { keepDelta(hdr, ranges, etag); });
+    started_ = true;
+    LOG_I("[Mesh] Started on channel %d, site %04x", WiFi.channel(), site_);
+    return true;
+}
+
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+namespace {
+    void meshReceiveInfo(const esp_now_recv_info_t *info, const uint8_t *data, int len) {
+        MeshSync::onReceive(info->src_addr, data, len);
+    }
+}
+#endif
+
+// Copy and hand over, nothing else
+void MeshSync::onReceive(const uint8_t *mac, const uint8_t *data, int len) {
+    MeshSync *self = instance_;
+    if (!self || !mac || len <= 0 || static_cast<size_t>(len) > MeshFormat::FRAME_MAX) return;
+    Rx rx;
+    memcpy(rx.mac, mac, sizeof(rx.mac));
+    rx.len = static_cast<uint8_t>(len);
+    memcpy(rx.bytes, data, len);
+    if (!self->rx_.push(rx)) {
+        self->rxDropped_ = self->rxDropped_ + 1;
+        return;
+    }
+    if (self->wake_) xTaskNotifyGive(self->wake_);
+}
+
+void MeshSync::tag(const uint8_t *frame, size_t len, uint8_t *out) const {
+    uint8_t mac[32];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), reinterpret_cast<const uint8_t*>(key_.c_str()),
+                    key_.length(), frame, len, mac);
+    memcpy(out, mac, MeshFormat::TAG_BYTES);
+}
+
+bool MeshSync::ensurePeer(const uint8_t *mac) {
+    if (esp_now_is_peer_exist(mac)) return true;
+    esp_now_peer_info_t info{};
+    memcpy(info.peer_addr, mac, sizeof(info.peer_addr));
+    info.channel = 0;  // the station's current channel
+    info.ifidx = WIFI_IF_STA;
+    info.encrypt = false;
+    return esp_now_add_peer(&info) == ESP_OK;
+}
+
+bool MeshSync::send(const uint8_t *mac, MeshFormat::Type type, const void *body, size_t len) {
+    uint8_t frame[MeshFormat::FRAME_MAX];
+    const MeshFormat::Header hdr{MeshFormat::MAGIC, MeshFormat::VERSION, type, 0, site_, 0, boot_, ++seq_};
+    const size_t n = sizeof(hdr) + len;
+    if (n + MeshFormat::TAG_BYTES > sizeof(frame) || !ensurePeer(mac)) return false;
+    memcpy(frame, &hdr, sizeof(hdr));
+    memcpy(frame + sizeof(hdr), body, len);
+    tag(frame, n, frame + n);
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        const esp_err_t err = esp_now_send(mac, frame, n + MeshFormat::TAG_BYTES);
+        if (err == ESP_OK) {
+            ++stats_.sent;
+            return true;
+        }
+        if (err != ESP_ERR_ESPNOW_NO_MEM) break;
+        // Driver queue full (a window in flight): let it drain
+        vTaskDelay(1);
+    }
+    return false;
+}
+
+MeshSync::Stats MeshSync::stats() const {
+    Stats s = stats_;
+    s.dropped = rxDropped_;
+    return s;
+}
+
+bool MeshSync::drain() {
+    Rx rx;
+    bool any = false;
+    while (rx_.pop(rx)) {
+        handle(rx);
+        any = true;
+    }
+    return any;
+}
+
+void MeshSync::handle(const Rx &rx) {
+    using namespace MeshFormat;
+    if (rx.len < sizeof(Header) + TAG_BYTES) {
+        ++stats_.rejected;
+        return;
+    }
+    Header hdr;
+    memcpy(&hdr, rx.bytes, sizeof(hdr));
+    const size_t signedLen = rx.len - TAG_BYTES;
+    uint8_t expect[TAG_BYTES];
+    if (hdr.magic != MAGIC || hdr.version != VERSION || hdr.site != site_) {
+        ++stats_.rejected;
+        return;
+    }
+    tag(rx.bytes, signedLen, expect);
+    // Constant time: no early exit on the first wrong byte
+    uint8_t diff = 0;
+    for (size_t i = 0; i < TAG_BYTES; ++i) diff |= expect[i] ^ rx.bytes[signedLen + i];
+    if (diff) {
+        ++stats_.rejected;
+        return;
+    }
+    ++stats_.received;
+
+    const uint8_t *body = rx.bytes + sizeof(Header);
+    const size_t bodyLen = signedLen - sizeof(Header);
+    const unsigned long now = millis();
+    if (hdr.type == CHALLENGE || hdr.type == RESPONSE) {
+        if (bodyLen != sizeof(Challenge)) {
+            ++stats_.rejected;
+            return;
+        }
+        Challenge c;
+        memcpy(&c, body, sizeof(c));
+        // A challenge is answered whoever sent it: the nonce, not the
+        // session, makes the response fresh
+        if (hdr.type == CHALLENGE) {
+            send(rx.mac, RESPONSE, &c, sizeof(c));
+        } else {
+            onResponse(rx.mac, hdr, c, now);
+        }
+        return;
+    }
+    if (!fresh(rx.mac, hdr, now)) {
+        ++stats_.stale;
+        return;
+    }
+    switch (hdr.type) {
+    case ANNOUNCE:
+        if (bodyLen == sizeof(Announce)) {
+            Announce a;
+            memcpy(&a, body, sizeof(a));
+            if (a.etagLen <= sizeof(a.etag)) onAnnounce(rx.mac, a, now);
+            return;
+        }
+        break;
+    case REQUEST:
+        if (bodyLen == sizeof(Request)) {
+            Request r;
+            memcpy(&r, body, sizeof(r));
+            onRequest(rx.mac, r);
+            return;
+        }
+        break;
+    case DATA:
+        if (bodyLen >= offsetof(Data, bytes) && bodyLen <= sizeof(Data)) {
+            Data d{};
+            memcpy(&d, body, bodyLen);
+            if (d.len == bodyLen - offsetof(Data, bytes)) {
+                onData(rx.mac, d);
+                return;
+            }
+        }
+        break;
+    case REVOKE:
+        if (bodyLen == sizeof(Revoke)) {
+            Revoke r;
+            memcpy(&r, body, sizeof(r));
+            onRevoke(r);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+    ++stats_.rejected;
+}
+
+MeshSync::Session *MeshSync::findSession(const uint8_t *mac) {
+    for (Session &s : sessions_) {
+        if (s.used && memcmp(s.mac, mac, sizeof(s.mac)) == 0) return &s;
+    }
+    return nullptr;
+}
+
+bool MeshSync::fresh(const uint8_t *mac, const MeshFormat::Header &hdr, unsigned long now) {
+    Session *s = findSession(mac);
+    if (!s) {
+        // A free slot, else the sender heard from least recently
+        for (Session &slot : sessions_) {
+            if (!slot.used) {
+                s = &slot;
+                break;
+            }
+            if (!s || now - slot.seenAt > now - s->seenAt) s = &slot;
+        }
+        *s = Session{};
+        memcpy(s->mac, mac, sizeof(s->mac));
+        s->used = true;
+    }
+    s->seenAt = now;
+    if (s->established && hdr.boot == s->boot) {
+        // Replayed (or reordered) within the boot the session knows
+        if (hdr.seq <= s->seq) return false;
+        s->seq = hdr.seq;
+        return true;
+    }
+    // A new sender, or another boot id: a reboot or a recorded frame, only
+    // an answer to a fresh nonce tells
+    if (!s->challenged || now - s->challengedAt >= CHALLENGE_MS) {
+        s->nonce = esp_random();
+        s->challenged = true;
+        s->challengedAt = now;
+        const MeshFormat::Challenge c{s->nonce};
+        send(mac, MeshFormat::CHALLENGE, &c, sizeof(c));
+    }
+    return false;
+}
+
+void MeshSync::onResponse(const uint8_t *mac, const MeshFormat::Header &hdr, const MeshFormat::Challenge &c,
+                          unsigned long now) {
+    Session *s = findSession(mac);
+    if (!s || !s->challenged || c.nonce != s->nonce) {
+        ++stats_.stale;
+        return;
+    }
+    s->challenged = false;
+    s->established = true;
+    s->boot = hdr.boot;
+    s->seq = hdr.seq;
+    s->seenAt = now;
+}
+
+void MeshSync::onAnnounce(const uint8_t *mac, const MeshFormat::Announce &a, unsigned long now) {
+    Peer *slot = nullptr;
+    Peer *oldest = nullptr;
+    for (Peer &p : peers_) {
+        if (p.used && memcmp(p.mac, mac, sizeof(p.mac)) == 0) {
+            slot = &p;
+            break;
+        }
+        if (!p.used) {
+            if (!slot) slot = &p;
+        } else if (!oldest || now - p.seenAt > now - oldest->seenAt) {
+            oldest = &p;
+        }
+    }
+    if (!slot || (slot->used && memcmp(slot->mac, mac, sizeof(slot->mac)) != 0)) slot = oldest;
+    if (!slot) return;
+    memcpy(slot->mac, mac, sizeof(slot->mac));
+    slot->seenAt = now;
+    slot->state = a;
+    slot->used = true;
+
+    // A source with the card set we hold but other index/filter ETags:
+    // enrollments happened, fetch those tables over HTTP (once per change)
+    if (a.flags & MeshFormat::SOURCE && meshEtagIs(a, auth_.bitsetEtag())) {
+        const AuthSync::PeerState mine = auth_.peerState();
+        const uint32_t tags = a.indexTag ^ (a.filterTag * 31);
+        if ((a.indexTag != mine.indexTag || a.filterTag != mine.filterTag) && tags != flaggedTags_) {
+            flaggedTags_ = tags;
+            auth_.notifyServerChanged();
+        }
+    }
+}
+
+void MeshSync::onRequest(const uint8_t *mac, const MeshFormat::Request &r) {
+    MeshFormat::Data d{};
+    d.object = r.object;
+    d.nonce = r.nonce;
+    const Delta *delta = nullptr;
+    bool have = false;
+    if (r.object == MeshFormat::OBJ_DELTA) {
+        delta = deltaFrom(r.key);
+        have = delta != nullptr;
+        d.total = have ? delta->len : 0;
+    } else if (r.object == MeshFormat::OBJ_IMAGE) {
+        const AuthSync::PeerState st = auth_.peerState();
+        have = st.imageBytes && st.imageCrc == r.key;
+        d.total = st.imageBytes;
+    }
+    if (!have) {
+        d.status = MeshFormat::DATA_GONE;
+        send(mac, MeshFormat::DATA, &d, offsetof(MeshFormat::Data, bytes));
+        return;
+    }
+    const uint8_t frames = std::min(r.frames, WINDOW_FRAMES);
+    for (uint8_t i = 0; i < frames; ++i) {
+        const uint32_t offset = r.offset + i * MeshFormat::DATA_BYTES;
+        if (offset >= d.total) break;
+        d.offset = offset;
+        d.len = static_cast<uint16_t>(std::min<uint32_t>(MeshFormat::DATA_BYTES, d.total - offset));
+        if (delta) {
+            memcpy(d.bytes, delta->bytes + offset, d.len);
+        } else if (!auth_.readImage(offset, d.bytes, d.len)) {
+            break;
+        }
+        if (!send(mac, MeshFormat::DATA, &d, offsetof(MeshFormat::Data, bytes) + d.len)) break;
+        ++stats_.served;
+    }
+}
+
+void MeshSync::onData(const uint8_t *mac, const MeshFormat::Data &d) {
+    Transfer &x = xfer_;
+    if (!x.active || d.nonce != x.nonce || d.object != x.object || memcmp(mac, x.peer, sizeof(x.peer)) != 0) return;
+    if (d.status == MeshFormat::DATA_GONE) {
+        x.gone = true;
+        return;
+    }
+    if (x.total == 0) x.total = d.total;
+    if (d.total != x.total || d.offset < x.winStart || (d.offset - x.winStart) % MeshFormat::DATA_BYTES) return;
+    const uint32_t frame = (d.offset - x.winStart) / MeshFormat::DATA_BYTES;
+    if (frame >= x.want || d.len != std::min<uint32_t>(MeshFormat::DATA_BYTES, x.total - d.offset)) return;
+    memcpy(x.window + frame * MeshFormat::DATA_BYTES, d.bytes, d.len);
+    x.have |= 1u << frame;
+}
+
+void MeshSync::onRevoke(const MeshFormat::Revoke &r) {
+    if (memcmp(r.origin, self_, sizeof(self_)) == 0) return;
+    Origin *o = nullptr;
+    for (Origin &slot : origins_) {
+        if (slot.used && memcmp(slot.mac, r.origin, sizeof(slot.mac)) == 0) {
+            o = &slot;
+            break;
+        }
+    }
+    // Seqs only order revocations within one boot of the origin
+    if (o && o->boot == r.originBoot && r.originSeq <= o->seq) return;
+    if (!o) {
+        o = &origins_[originNext_];
+        originNext_ = (originNext_ + 1) % (sizeof(origins_) / sizeof(origins_[0]));
+        memcpy(o->mac, r.origin, sizeof(o->mac));
+        o->used = true;
+    }
+    o->boot = r.originBoot;
+    o->seq = r.originSeq;
+    auth_.revokeHash(r.hash);
+    ++stats_.revocations;
+    LOG_I("[Mesh] Revocation 0x%016llX relayed", static_cast<unsigned long long>(r.hash));
+    if (r.hops > 0) {
+        MeshFormat::Revoke next = r;
+        --next.hops;
+        send(MESH_BROADCAST, MeshFormat::REVOKE, &next, sizeof(next));
+    }
+}
+
+void MeshSync::broadcastRevoke(uint64_t hash) {
+    if (!started_) return;
+    MeshFormat::Revoke r{};
+    r.hash = hash;
+    memcpy(r.origin, self_, sizeof(r.origin));
+    r.hops = REVOKE_HOPS;
+    r.originBoot = boot_;
+    r.originSeq = seq_ + 1;
+    send(MESH_BROADCAST, MeshFormat::REVOKE, &r, sizeof(r));
+}
+
+void MeshSync::keepDelta(const SyncFormat::DeltaHeader &hdr, const SyncFormat::DeltaRange *ranges,
+                         const char *etag) {
+    const size_t etagLen = std::min(strlen(etag), sizeof(MeshFormat::Announce::etag));
+    const size_t rangeBytes = hdr.count * sizeof(SyncFormat::DeltaRange);
+    Delta &d = deltas_[deltaNext_];
+    deltaNext_ = (deltaNext_ + 1) % DELTA_SLOTS;
+    uint8_t *out = d.bytes;
+    *out++ = static_cast<uint8_t>(etagLen);
+    memcpy(out, etag, etagLen);
+    out += etagLen;
+    memcpy(out, &hdr.to_version, sizeof(hdr.to_version));
+    out += sizeof(hdr.to_version);
+    memcpy(out, &hdr, sizeof(hdr));
+    out += sizeof(hdr);
+    memcpy(out, ranges, rangeBytes);
+    out += rangeBytes;
+    d.from = hdr.from_version;
+    d.len = static_cast<uint16_t>(out - d.bytes);
+}
+
+const MeshSync::Delta *MeshSync::deltaFrom(uint32_t version) const {
+    for (const Delta &d : deltas_) {
+        if (d.len && d.from == version) return &d;
+    }
+    return nullptr;
+}
+
+void MeshSync::announce(unsigned long now) {
+    const AuthSync::PeerState st = auth_.peerState();
+    MeshFormat::Announce a{};
+    a.version = st.version;
+    a.imageBytes = st.imageBytes;
+    a.imageCrc = st.imageCrc;
+    a.indexTag = st.indexTag;
+    a.filterTag = st.filterTag;
+    a.flags = (serverUp_ ? MeshFormat::CANDIDATE : 0) | (source_ ? MeshFormat::SOURCE : 0);
+    a.distance = distance_;
+    a.enroll = enroll_;
+    const char *etag = auth_.bitsetEtag();
+    a.etagLen = static_cast<uint8_t>(std::min(strlen(etag), sizeof(a.etag)));
+    memcpy(a.etag, etag, a.etagLen);
+    send(MESH_BROADCAST, MeshFormat::ANNOUNCE, &a, sizeof(a));
+    lastAnnounce_ = now;
+    announcedCrc_ = st.imageCrc;
+}
+
+void MeshSync::elect(unsigned long now) {
+    // Forget silent neighbours (and their unicast peer entries)
+    for (Peer &p : peers_) {
+        if (p.used && now - p.seenAt > PEER_TIMEOUT_MS) {
+            p.used = false;
+            esp_now_del_peer(p.mac);
+        }
+    }
+    // Sources: the MESH_SOURCES lowest MACs among doors reaching the server
+    size_t lower = 0;
+    const Peer *nearest = nullptr;
+    for (const Peer &p : peers_) {
+        if (!p.used) continue;
+        if ((p.state.flags & MeshFormat::CANDIDATE) && memcmp(p.mac, self_, sizeof(self_)) < 0) ++lower;
+        if (!nearest || p.state.distance < nearest->state.distance) nearest = &p;
+    }
+    const bool wasSource = source_;
+    source_ = serverUp_ && lower < MESH_SOURCES;
+    if (source_) {
+        distance_ = 0;
+    } else if (nearest && nearest->state.distance < MAX_DISTANCE) {
+        distance_ = nearest->state.distance + 1;
+        sourceEnroll_ = nearest->state.enroll;
+    } else {
+        distance_ = MeshFormat::NO_SOURCE;
+    }
+    const bool covered = !source_ && distance_ != MeshFormat::NO_SOURCE;
+    if (source_ != wasSource || covered != covered_) {
+        LOG_I("[Mesh] Role: %s", source_ ? "source" : covered ? "covered" : "alone");
+    }
+    covered_ = covered;
+    auth_.setMeshCovered(covered_);
+}
+
+void MeshSync::poll(unsigned long now) {
+    if (!started_) return;
+    drain();
+    elect(now);
+    if (now - lastAnnounce_ >= ANNOUNCE_MS || auth_.peerState().imageCrc != announcedCrc_) announce(now);
+    if (static_cast<long>(now - pullRetryAt_) < 0) return;
+
+    // Pull when a neighbour holds a newer card set: higher version, or the
+    // same one under another ETag from a source. The newest wins; the one
+    // that failed last goes last.
+    const AuthSync::PeerState mine = auth_.peerState();
+    const char *etag = auth_.bitsetEtag();
+    const Peer *best = nullptr;
+    for (const Peer &p : peers_) {
+        if (!p.used || p.state.etagLen == 0 || !p.state.imageBytes || meshEtagIs(p.state, etag)) continue;
+        const bool ahead = p.state.version > mine.version ||
+                           (p.state.version == mine.version && (p.state.flags & MeshFormat::SOURCE));
+        if (!ahead) continue;
+        const bool failed = memcmp(p.mac, failedPeer_, sizeof(failedPeer_)) == 0;
+        if (!best || p.state.version > best->state.version ||
+            (p.state.version == best->state.version && !failed)) {
+            best = &p;
+        }
+    }
+    if (best) pullFrom(*best, now);
+}
+
+void MeshSync::pullFrom(const Peer &peer, unsigned long now) {
+    // Copy: the peer table may change while frames are handled
+    const Peer from = peer;
+    const AuthSync::PeerState mine = auth_.peerState();
+    bool ok = mine.version != 0 && from.state.version > mine.version && pullDeltas(from);
+    if (!ok && !meshEtagIs(from.state, auth_.bitsetEtag())) ok = pullImage(from);
+    xfer_.active = false;
+    if (ok) {
+        memset(failedPeer_, 0, sizeof(failedPeer_));
+        announce(millis());
+        return;
+    }
+    ++stats_.pullFailures;
+    memcpy(failedPeer_, from.mac, sizeof(failedPeer_));
+    // Another neighbour (or the same, recovered) next round
+    pullRetryAt_ = now + ANNOUNCE_MS / 5;
+}
+
+bool MeshSync::pullDeltas(const Peer &peer) {
+    const SyncFormat::ReadFn rd = [this](uint8_t *dst, size_t len) { return readTransfer(dst, len); };
+    for (int step = 0; step < MESH_DELTA_CHAIN; ++step) {
+        if (meshEtagIs(peer.state, auth_.bitsetEtag())) return true;
+        startTransfer(peer.mac, MeshFormat::OBJ_DELTA, auth_.syncVersion(), 0);
+        uint8_t etagLen = 0;
+        char etag[sizeof(MeshFormat::Announce::etag) + 1];
+        uint32_t toVersion = 0;
+        if (!rd(&etagLen, 1) || etagLen > sizeof(etag) - 1 || !rd(reinterpret_cast<uint8_t*>(etag), etagLen) ||
+            !rd(reinterpret_cast<uint8_t*>(&toVersion), sizeof(toVersion))) {
+            return false;
+        }
+        etag[etagLen] = '\0';
+        if (!auth_.applyPeerSync(rd, etag, toVersion)) return false;
+        ++stats_.pulls;
+    }
+    return meshEtagIs(peer.state, auth_.bitsetEtag());
+}
+
+bool MeshSync::pullImage(const Peer &peer) {
+    char etag[sizeof(MeshFormat::Announce::etag) + 1];
+    memcpy(etag, peer.state.etag, peer.state.etagLen);
+    etag[peer.state.etagLen] = '\0';
+    startTransfer(peer.mac, MeshFormat::OBJ_IMAGE, peer.state.imageCrc, peer.state.imageBytes);
+    const SyncFormat::ReadFn rd = [this](uint8_t *dst, size_t len) { return readTransfer(dst, len); };
+    if (!auth_.applyPeerSync(rd, etag, peer.state.version)) return false;
+    ++stats_.pulls;
+    LOG_I("[Mesh] Card set image (%u bytes) pulled", static_cast<unsigned>(peer.state.imageBytes));
+    return true;
+}
+
+void MeshSync::startTransfer(const uint8_t *mac, uint8_t object, uint32_t key, uint32_t total) {
+    Transfer &x = xfer_;
+    memcpy(x.peer, mac, sizeof(x.peer));
+    x.object = object;
+    x.key = key;
+    x.nonce = esp_random();
+    x.total = total;
+    x.cursor = 0;
+    x.winStart = 0;
+    x.have = 0;
+    x.want = 0;
+    x.gone = false;
+    x.active = true;
+}
+
+bool MeshSync::fillWindow() {
+    Transfer &x = xfer_;
+    const auto framesLeft = [&x] {
+        return x.total ? (x.total - x.winStart + MeshFormat::DATA_BYTES - 1) / MeshFormat::DATA_BYTES
+                       : WINDOW_FRAMES;
+    };
+    if (x.total && x.winStart >= x.total) return false;
+    x.want = static_cast<uint8_t>(std::min<uint32_t>(WINDOW_FRAMES, framesLeft()));
+    x.have = 0;
+    for (uint8_t attempt = 0; attempt < WINDOW_RETRIES; ++attempt) {
+        // Ask for the frames from the first missing one on
+        uint8_t first = 0;
+        while (first < x.want && (x.have & (1u << first))) ++first;
+        MeshFormat::Request r{};
+        r.object = x.object;
+        r.frames = x.want - first;
+        r.nonce = x.nonce;
+        r.key = x.key;
+        r.offset = x.winStart + first * MeshFormat::DATA_BYTES;
+        if (!send(x.peer, MeshFormat::REQUEST, &r, sizeof(r))) return false;
+        const unsigned long start = millis();
+        for (;;) {
+            drain();
+            // The first frame may tell a smaller object than one window
+            x.want = static_cast<uint8_t>(std::min<uint32_t>(x.want, framesLeft()));
+            const uint32_t all = (1u << x.want) - 1;
+            if (x.gone) return false;
+            if ((x.have & all) == all) return true;
+            const unsigned long elapsed = millis() - start;
+            if (elapsed >= WINDOW_TIMEOUT_MS) break;
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WINDOW_TIMEOUT_MS - elapsed));
+        }
+    }
+    LOG_W("[Mesh] Pull stalled at %u/%u bytes", static_cast<unsigned>(x.winStart), static_cast<unsigned>(x.total));
+    return false;
+}
+
+bool MeshSync::readTransfer(uint8_t *dst, size_t len) {
+    Transfer &x = xfer_;
+    while (len > 0) {
+        const uint32_t winEnd = x.winStart + x.want * MeshFormat::DATA_BYTES;
+        if (x.want == 0 || x.cursor >= winEnd) {
+            x.winStart = x.cursor;
+            if (!fillWindow()) return false;
+            continue;
+        }
+        const uint32_t end = std::min(winEnd, x.total);
+        if (x.cursor >= end) return false;
+        const size_t n = std::min<size_t>(len, end - x.cursor);
+        memcpy(dst, x.window + (x.cursor - x.winStart), n);
+        x.cursor += n;
+        dst += n;
+        len -= n;
+    }
+    return true;
+}
+
+void MeshSync::print(Print &out) const {
+    const Stats s = stats();
+    out.printf("[Mesh] role=%s distance=%u site=%04x channel=%d\n",
+               source_ ? "source" : covered_ ? "covered" : "alone", distance_, site_, WiFi.channel());
+    out.printf("[Mesh] sent=%u received=%u rejected=%u stale=%u dropped=%u pulls=%u failed=%u served=%u revocations=%u\n",
+               s.sent, s.received, s.rejected, s.stale, s.dropped, s.pulls, s.pullFailures, s.served, s.revocations);
+    const unsigned long now = millis();
+    for (const Peer &p : peers_) {
+        if (!p.used) continue;
+        out.print("[Mesh] peer ");
+        meshPrintMac(out, p.mac);
+        out.printf(" age=%lums version=%u distance=%u%s%s etag=%.*s\n", now - p.seenAt, p.state.version,
+                   p.state.distance, p.state.flags & MeshFormat::SOURCE ? " source" : "",
+                   p.state.flags & MeshFormat::CANDIDATE ? " server" : "", p.state.etagLen, p.state.etag);
+    }
+}
+
+#endif // MESH_SYNC
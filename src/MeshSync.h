@@ -0,0 +1,327 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Lockfree.h"
+#include "SyncFormat.h"
+
+class AuthSync;
+
+// Controllers per site that poll the server for the others
+#ifndef MESH_SOURCES
+#define MESH_SOURCES 1
+#endif
+// Channel used when no access point is configured (with one, ESP-NOW runs
+// on the AP's channel, so every door of a site must use the same AP SSID
+// on one channel)
+#ifndef MESH_CHANNEL
+#define MESH_CHANNEL 1
+#endif
+
+// ESP-NOW frames between door controllers (MESH_SYNC builds). Every frame
+// is Header, body, then an 8-byte tag: HMAC-SHA256 over header and body
+// with the site's `mesh_key`, truncated. Little-endian like SyncFormat.
+//
+// The tag does not make a frame fresh. A receiver takes a sender's frames
+// only once the sender answered a CHALLENGE with a RESPONSE echoing its
+// nonce. The header of that answer fixes the sender's boot id and
+// sequence number, and later frames must carry the same boot and a higher
+// seq, so recorded frames cannot be replayed.
+namespace MeshFormat {
+    constexpr uint8_t MAGIC = 0xD5;
+    constexpr uint8_t VERSION = 2;
+    constexpr size_t TAG_BYTES = 8;
+    // ESP-NOW payload limit
+    constexpr size_t FRAME_MAX = 250;
+
+    enum Type : uint8_t { ANNOUNCE = 1, REQUEST = 2, DATA = 3, REVOKE = 4, CHALLENGE = 5, RESPONSE = 6 };
+
+    struct __attribute__((packed)) Header {
+        uint8_t magic;
+        uint8_t version;
+        uint8_t type;
+        uint8_t reserved;
+        uint16_t site;   // installations sharing a channel ignore each other
+        uint16_t pad;
+        uint32_t boot;   // random per sender boot
+        uint32_t seq;    // per sender, counts every frame sent since boot
+    };
+    static_assert(sizeof(Header) == 16, "mesh header is 16 bytes");
+
+    // CHALLENGE (unicast) and the RESPONSE echoing it
+    struct __attribute__((packed)) Challenge {
+        uint32_t nonce;
+    };
+
+    enum : uint8_t { CANDIDATE = 1u << 0, SOURCE = 1u << 1 };
+    // Hops to a source: 0 for a source, NO_SOURCE when none is in reach
+    constexpr uint8_t NO_SOURCE = 0xFF;
+
+    // Broadcast every MeshSync::ANNOUNCE_MS and whenever the card set changes
+    struct __attribute__((packed)) Announce {
+        uint32_t version;     // change-log version (0 = unknown)
+        uint32_t imageBytes;  // card set image a neighbour can pull
+        uint32_t imageCrc;
+        uint32_t indexTag;    // CRC-32 of the index / filter ETags
+        uint32_t filterTag;
+        uint8_t flags;        // CANDIDATE: server reachable; SOURCE: elected
+        uint8_t distance;
+        uint8_t enroll;       // source: its enroll mode (EnrollMode)
+        uint8_t etagLen;
+        char etag[48];        // bitset ETag, not terminated
+    };
+
+    enum : uint8_t { OBJ_DELTA = 1, OBJ_IMAGE = 2 };
+
+    // Pull part of an object from one neighbour (unicast). OBJ_DELTA is
+    // the delta leaving `key` (a version), OBJ_IMAGE the image whose CRC
+    // is `key`.
+    struct __attribute__((packed)) Request {
+        uint8_t object;
+        uint8_t frames;       // DATA frames wanted from `offset` on
+        uint16_t reserved;
+        uint32_t nonce;       // transfer id, echoed in DATA
+        uint32_t key;
+        uint32_t offset;
+    };
+
+    constexpr size_t DATA_BYTES = 200;
+    enum : uint8_t { DATA_OK = 0, DATA_GONE = 1 };
+
+    // One piece of the object; DATA_GONE when the neighbour no longer has it
+    struct __attribute__((packed)) Data {
+        uint8_t object;
+        uint8_t status;
+        uint16_t len;
+        uint32_t nonce;
+        uint32_t total;       // object bytes
+        uint32_t offset;
+        uint8_t bytes[DATA_BYTES];
+    };
+
+    // Revocation pushed by the server, flooded `hops` further
+    struct __attribute__((packed)) Revoke {
+        uint64_t hash;        // UID hash
+        uint8_t origin[6];    // station MAC of the door that heard it
+        uint8_t hops;
+        uint8_t reserved;
+        uint32_t originBoot;
+        uint32_t originSeq;
+    };
+
+    static_assert(sizeof(Header) + sizeof(Data) + TAG_BYTES <= FRAME_MAX, "DATA frame fits ESP-NOW");
+    static_assert(sizeof(Header) + sizeof(Announce) + TAG_BYTES <= FRAME_MAX, "ANNOUNCE frame fits ESP-NOW");
+}
+
+// Sync distribution between the door controllers of a site over ESP-NOW
+// (MESH_SYNC builds), so the server sees O(1) sync traffic per site.
+//
+// Every door announces its card set (version, ETag, image CRC) and
+// whether it reaches the server. The MESH_SOURCES lowest MACs among the
+// doors that do are sources: they sync from the server as before and
+// relay revocations at once. A door that hears a source (directly or
+// through a neighbour) is covered: it leaves /api/sync to update()'s
+// safety-net interval, drops its event stream and takes the enroll mode
+// from the source's announcement.
+//
+// A door behind a neighbour's announced ETag pulls from it, a window of
+// DATA frames per request: the delta from its own version when the
+// neighbour kept it (every door keeps the last DELTA_SLOTS it
+// applied), else the whole card set image. A door applies data with
+// AuthSync::applyPeerSync(), the server path, and then serves it too, so
+// a gap is filled by whichever neighbour has the data. Index and filter
+// still come from the server, and only when an announcement shows their
+// ETags changed (enrollments).
+//
+// The ESP-NOW receive callback only copies frames into a ring; checking,
+// serving and pulling run in NetworkTask from poll(). A pull blocks
+// NetworkTask like an HTTP sync does, for well under a second per image.
+class MeshSync {
+public:
+    struct Stats {
+        uint32_t sent;
+        uint32_t received;
+        uint32_t rejected;     // bad tag, site or length
+        uint32_t stale;        // replayed, or sent before the sender's handshake
+        uint32_t dropped;      // receive ring full
+        uint32_t pulls;        // objects applied
+        uint32_t pullFailures;
+        uint32_t served;       // DATA frames sent
+        uint32_t revocations;  // applied from neighbours
+    };
+
+    static constexpr unsigned long ANNOUNCE_MS = 5000;
+    // A neighbour silent this long is forgotten
+    static constexpr unsigned long PEER_TIMEOUT_MS = 3 * ANNOUNCE_MS;
+    static constexpr size_t PEERS_MAX = 8;
+    static constexpr size_t DELTA_SLOTS = 4;
+    static constexpr uint8_t WINDOW_FRAMES = 8;
+    static constexpr unsigned long WINDOW_TIMEOUT_MS = 80;
+    static constexpr uint8_t WINDOW_RETRIES = 4;
+    // Farthest a door may be from a source and still count as covered
+    static constexpr uint8_t MAX_DISTANCE = 3;
+    static constexpr uint8_t REVOKE_HOPS = 2;
+    // An unanswered challenge is repeated after this long
+    static constexpr unsigned long CHALLENGE_MS = 200;
+    static constexpr size_t SESSIONS_MAX = 2 * PEERS_MAX;
+
+    explicit MeshSync(AuthSync &auth) : auth_(auth) {}
+    ~MeshSync();
+    MeshSync(const MeshSync&) = delete;
+    MeshSync& operator=(const MeshSync&) = delete;
+
+    // Start ESP-NOW (Wi-Fi must be started). `site` separates installations
+    // on one channel, `wake` is notified when a frame arrives. False
+    // without a key or when ESP-NOW does not start.
+    bool begin(const String &key, uint16_t site, TaskHandle_t wake);
+    bool started() const { return started_; }
+
+    // NetworkTask, every iteration
+    void poll(unsigned long now);
+    // NetworkTask: what this door announces
+    void setServerUp(bool up) { serverUp_ = up; }
+    void setEnroll(uint8_t mode) { enroll_ = mode; }
+    // Relay a revocation the server pushed to this door
+    void broadcastRevoke(uint64_t hash);
+
+    bool source() const { return source_; }
+    bool covered() const { return covered_; }
+    // Enroll mode announced by the nearest source
+    uint8_t sourceEnroll() const { return sourceEnroll_; }
+    Stats stats() const;
+    void print(Print &out) const;
+
+    // ESP-NOW receive callback (Wi-Fi task)
+    static void onReceive(const uint8_t *mac, const uint8_t *data, int len);
+
+private:
+    struct Rx {
+        uint8_t mac[6];
+        uint8_t len;
+        uint8_t bytes[MeshFormat::FRAME_MAX];
+    };
+
+    struct Peer {
+        uint8_t mac[6];
+        unsigned long seenAt;
+        MeshFormat::Announce state;
+        bool used;
+    };
+
+    // Replay state of one sender
+    struct Session {
+        uint8_t mac[6];
+        bool used;
+        bool established;     // boot/seq came from an answered challenge
+        bool challenged;      // `nonce` is waiting for its RESPONSE
+        uint32_t boot;
+        uint32_t seq;         // highest accepted in `boot`
+        uint32_t nonce;
+        unsigned long seenAt;
+        unsigned long challengedAt;
+    };
+
+    // Object bytes of a kept delta: ETag length, ETag, version it leads
+    // to, delta frame
+    static constexpr size_t DELTA_OBJECT_MAX = 1 + sizeof(MeshFormat::Announce::etag) + sizeof(uint32_t) +
+                                               sizeof(SyncFormat::DeltaHeader) +
+                                               SyncFormat::DELTA_MAX_RANGES * sizeof(SyncFormat::DeltaRange);
+    struct Delta {
+        uint32_t from;
+        uint16_t len;
+        uint8_t bytes[DELTA_OBJECT_MAX];
+    };
+
+    // Receiving end of a pull
+    struct Transfer {
+        uint8_t peer[6];
+        uint8_t object;
+        uint32_t key;
+        uint32_t nonce;
+        uint32_t total;       // 0 until the first DATA frame tells
+        uint32_t cursor;      // object bytes handed to the reader
+        uint32_t winStart;    // first byte of the window
+        uint8_t have;         // window frames received (bit per frame)
+        uint8_t want;         // window frames requested
+        bool active;
+        bool gone;            // the neighbour no longer has the object
+        uint8_t window[WINDOW_FRAMES * MeshFormat::DATA_BYTES];
+    };
+
+    AuthSync &auth_;
+    String key_;
+    uint16_t site_ = 0;
+    bool started_ = false;
+    uint8_t self_[6] = {};
+    TaskHandle_t wake_ = nullptr;
+    uint32_t boot_ = 0;
+    uint32_t seq_ = 0;
+
+    SpscRing<Rx, 16> rx_;
+    volatile uint32_t rxDropped_ = 0;
+
+    Peer peers_[PEERS_MAX] = {};
+    Session sessions_[SESSIONS_MAX] = {};
+    Delta deltas_[DELTA_SLOTS] = {};
+    size_t deltaNext_ = 0;
+    // Newest revocation applied per origin door, so flooded copies are
+    // applied once
+    struct Origin {
+        uint8_t mac[6];
+        bool used;
+        uint32_t boot;
+        uint32_t seq;
+    };
+    Origin origins_[16] = {};
+    size_t originNext_ = 0;
+    Transfer xfer_ = {};
+    // A neighbour that failed the last pull is tried after the others
+    uint8_t failedPeer_[6] = {};
+    // Index/filter tags of a source already sent to the server path
+    uint32_t flaggedTags_ = 0;
+
+    bool serverUp_ = false;
+    uint8_t enroll_ = 0;
+    bool source_ = false;
+    bool covered_ = false;
+    uint8_t distance_ = MeshFormat::NO_SOURCE;
+    uint8_t sourceEnroll_ = 0;
+    unsigned long lastAnnounce_ = 0;
+    uint32_t announcedCrc_ = 0;
+    unsigned long pullRetryAt_ = 0;
+    Stats stats_ = {};
+
+    static MeshSync *instance_;
+
+    void tag(const uint8_t *frame, size_t len, uint8_t *out) const;
+    bool send(const uint8_t *mac, MeshFormat::Type type, const void *body, size_t len);
+    bool ensurePeer(const uint8_t *mac);
+    // Check and dispatch one received frame; DATA goes to the transfer
+    void handle(const Rx &rx);
+    // True when the frame continues the sender's session; anything else
+    // is dropped and challenges the sender
+    bool fresh(const uint8_t *mac, const MeshFormat::Header &hdr, unsigned long now);
+    Session *findSession(const uint8_t *mac);
+    void onResponse(const uint8_t *mac, const MeshFormat::Header &hdr, const MeshFormat::Challenge &c,
+                    unsigned long now);
+    void onAnnounce(const uint8_t *mac, const MeshFormat::Announce &a, unsigned long now);
+    void onRequest(const uint8_t *mac, const MeshFormat::Request &r);
+    void onData(const uint8_t *mac, const MeshFormat::Data &d);
+    void onRevoke(const MeshFormat::Revoke &r);
+    bool drain();
+
+    void announce(unsigned long now);
+    void elect(unsigned long now);
+    void keepDelta(const SyncFormat::DeltaHeader &hdr, const SyncFormat::DeltaRange *ranges, const char *etag);
+    const Delta *deltaFrom(uint32_t version) const;
+
+    // Bring the card set up to the neighbour's announced ETag
+    void pullFrom(const Peer &peer, unsigned long now);
+    bool pullDeltas(const Peer &peer);
+    bool pullImage(const Peer &peer);
+    // Start a transfer / read its next bytes (SyncFormat::ReadFn)
+    void startTransfer(const uint8_t *mac, uint8_t object, uint32_t key, uint32_t total);
+    bool readTransfer(uint8_t *dst, size_t len);
+    // Request the window at winStart and wait for all of it, re-asking for
+    // the frames still missing
+    bool fillWindow();
+};
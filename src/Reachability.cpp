@@ -0,0 +1,54 @@
+#include "Reachability.h"
+#include "Log.h"
+#include <algorithm>
+#include <esp_system.h>
+
+// Reachability
+// ------------
+// Transitions are logged as "[DB] Reachable=<0|1>" like the former server
+// check timer did.
+
+void Reachability::publish(State state, uint8_t failures) {
+    const uint32_t old = word_.load(std::memory_order_relaxed);
+    uint16_t transitions = transitionsOf(old);
+    if (stateOf(old) != state) ++transitions;
+    word_.store(static_cast<uint32_t>(state) | (static_cast<uint32_t>(failures) << 8) |
+                (static_cast<uint32_t>(transitions) << 16), std::memory_order_release);
+}
+
+void Reachability::reportSuccess(unsigned long now) {
+    portENTER_CRITICAL(&mux_);
+    const bool changed = stateOf(word_.load(std::memory_order_relaxed)) != UP;
+    lastOk_ = now;
+    backoff_ = BACKOFF_MIN_MS;
+    publish(UP, 0);
+    portEXIT_CRITICAL(&mux_);
+    if (changed) LOG_I("[DB] Reachable=1");
+}
+
+void Reachability::reportFailure(unsigned long now) {
+    portENTER_CRITICAL(&mux_);
+    const uint32_t old = word_.load(std::memory_order_relaxed);
+    const bool changed = stateOf(old) != DOWN;
+    const uint8_t failures = failuresOf(old) == 0xFF ? 0xFF : failuresOf(old) + 1;
+    // Jitter keeps a fleet of doors from retrying in lockstep after an outage
+    const unsigned long span = backoff_ / 2;
+    const unsigned long delay = backoff_ - backoff_ / 4 + (span ? esp_random() % span : 0);
+    nextProbe_ = now + delay;
+    backoff_ = std::min(backoff_ * 2, BACKOFF_MAX_MS);
+    publish(DOWN, failures);
+    portEXIT_CRITICAL(&mux_);
+    if (changed) LOG_I("[DB] Reachable=0 (retry in %lu ms)", delay);
+}
+
+bool Reachability::probeDue(unsigned long now) const {
+    switch (state()) {
+    case UP:
+        return now - lastOk_ >= IDLE_PROBE_MS;
+    case DOWN:
+        return static_cast<long>(now - nextProbe_) >= 0;
+    case UNKNOWN:
+    default:
+        return true;
+    }
+}
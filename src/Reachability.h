@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+// Server reachability shared by every module (display, scan upload, card
+// lookups, sync).
+//
+// Every ServerSession exchange reports its outcome here, so real traffic
+// doubles as the health signal and probes are only sent after a quiet
+// period. While the server is down NetworkTask re-probes with jittered
+// exponential backoff. Consumers read one packed status word without
+// taking a lock; reporters serialize on a spinlock.
+class Reachability {
+public:
+    enum State : uint8_t { UNKNOWN = 0, UP = 1, DOWN = 2 };
+
+    // Probe after this long without a successful exchange while up
+    static constexpr unsigned long IDLE_PROBE_MS = 5000;
+    // Retry delay while down: doubles per failure, +/- 25 % jitter
+    static constexpr unsigned long BACKOFF_MIN_MS = 2000;
+    static constexpr unsigned long BACKOFF_MAX_MS = 60000;
+
+    // Status word layout: bits 0-7 State, bits 8-15 consecutive failures
+    // (saturating), bits 16-31 transition counter (wraps).
+    static State stateOf(uint32_t word) { return static_cast<State>(word & 0xFF); }
+    static uint8_t failuresOf(uint32_t word) { return static_cast<uint8_t>(word >> 8); }
+    static uint16_t transitionsOf(uint32_t word) { return static_cast<uint16_t>(word >> 16); }
+
+    uint32_t word() const { return word_.load(std::memory_order_acquire); }
+    State state() const { return stateOf(word()); }
+    bool up() const { return state() == UP; }
+    bool down() const { return state() == DOWN; }
+
+    // Outcome of a real exchange (any task)
+    void reportSuccess(unsigned long now);
+    void reportFailure(unsigned long now);
+
+    // NetworkTask: true when a `/api/status` probe should be sent now
+    bool probeDue(unsigned long now) const;
+
+private:
+    std::atomic<uint32_t> word_{0};
+    unsigned long lastOk_ = 0;
+    unsigned long nextProbe_ = 0;
+    unsigned long backoff_ = BACKOFF_MIN_MS;
+    portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+
+    void publish(State state, uint8_t failures);
+};
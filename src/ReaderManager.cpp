@@ -0,0 +1,160 @@
+#include "ReaderManager.h"
+#include "Latency.h"
+#include "Log.h"
+#include <algorithm>
+#include <new>
+
+// ReaderManager
+// -------------
+// One task owns the SPI traffic of every reader, so MFRC522 command
+// sequences never interleave between chips. Each round re-arms the IRQ
+// readers that are due, polls the poll readers, then sleeps on the task
+// notification: IRQ readers set their bit, so the wait ends as soon as any
+// of them hears a card.
+
+namespace {
+    constexpr int64_t US_PER_MS = 1000;
+}
+
+ReaderManager::~ReaderManager() {
+    if (task_) vTaskDelete(task_);
+    for (size_t i = 0; i < count_; ++i) delete readers_[i];
+}
+
+bool ReaderManager::addReader(uint8_t ssPin, uint8_t rstPin, CardReader::Mode mode, int irqPin) {
+    if (task_ || count_ >= MAX_READERS) return false;
+    CardReader *reader = new (std::nothrow) CardReader(static_cast<uint8_t>(count_), ssPin, rstPin);
+    if (!reader) return false;
+    reader->begin(mode, irqPin);
+    readers_[count_++] = reader;
+    LOG_I("[Reader] Reader %u: SS=%u %s", reader->id(), ssPin, CardReader::modeName(reader->mode()));
+    return true;
+}
+
+bool ReaderManager::begin(UBaseType_t priority, BaseType_t core) {
+    if (task_) return true;
+    if (count_ == 0) return false;
+
+    const int64_t now = Latency::now();
+    for (size_t i = 0; i < count_; ++i) lastLook_[i] = now;
+#if defined(CONFIG_FREERTOS_UNICORE)
+    (void)core;
+    const BaseType_t ok = xTaskCreate(taskEntry, "rfid_task", 3072, this, priority, &task_);
+#else
+    const BaseType_t ok = xTaskCreatePinnedToCore(taskEntry, "rfid_task", 3072, this, priority, &task_, core);
+#endif
+    if (ok != pdPASS) {
+        task_ = nullptr;
+        LOG_E("[Reader] Failed to start reader task");
+        return false;
+    }
+    for (size_t i = 0; i < count_; ++i) readers_[i]->attachIrq(task_);
+    return true;
+}
+
+bool ReaderManager::next(CardReader::Scan &out, TickType_t wait) {
+    consumer_.store(xTaskGetCurrentTaskHandle(), std::memory_order_release);
+#ifdef SCAN_REPLAY
+    if (scans_.pop(out) || injected_.pop(out)) return true;
+    ulTaskNotifyTake(pdTRUE, wait);
+    return scans_.pop(out) || injected_.pop(out);
+#else
+    if (scans_.pop(out)) return true;
+    // A push between the pop and the wait leaves the notification pending
+    ulTaskNotifyTake(pdTRUE, wait);
+    return scans_.pop(out);
+#endif
+}
+
+#ifdef SCAN_REPLAY
+bool ReaderManager::inject(const CardReader::Scan &scan) {
+    ++injectedCount_;
+    if (!injected_.push(scan)) {
+        ++injectDropped_;
+        return false;
+    }
+    if (TaskHandle_t consumer = consumer_.load(std::memory_order_acquire)) xTaskNotifyGive(consumer);
+    return true;
+}
+#endif
+
+ReaderManager::Stats ReaderManager::stats() const {
+#ifdef SCAN_REPLAY
+    return Stats{read_, dropped_ + injectDropped_, injectedCount_};
+#else
+    return Stats{read_, dropped_, 0};
+#endif
+}
+
+void ReaderManager::taskEntry(void *self) {
+    static_cast<ReaderManager*>(self)->run();
+}
+
+void ReaderManager::run() {
+    for (;;) {
+        int64_t now = Latency::now();
+        int64_t wake = now + RFID_REQA_INTERVAL_MS * US_PER_MS;
+        bool polling = false;
+        for (size_t i = 0; i < count_; ++i) {
+            CardReader &reader = *readers_[i];
+            if (now < quietUntil_[i]) {
+                wake = std::min(wake, quietUntil_[i]);
+                continue;
+            }
+            if (reader.mode() == CardReader::MODE_IRQ) {
+                if (now >= nextArm_[i]) {
+                    noteLook(i, now);
+                    reader.arm();
+                    nextArm_[i] = now + RFID_REQA_INTERVAL_MS * US_PER_MS;
+                }
+                wake = std::min(wake, nextArm_[i]);
+            } else {
+                polling = true;
+                noteLook(i, now);
+                if (reader.poll()) service(i, now);
+                // A poll of an empty field lasts until the chip times out
+                now = Latency::now();
+            }
+        }
+
+        TickType_t wait = pdMS_TO_TICKS(RFID_POLL_INTERVAL_MS);
+        if (!polling) {
+            const int64_t us = std::max<int64_t>(0, wake - Latency::now());
+            wait = pdMS_TO_TICKS(static_cast<uint32_t>((us + US_PER_MS - 1) / US_PER_MS));
+        }
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, wait);
+        for (size_t i = 0; i < count_; ++i) {
+            if (!(bits & (1UL << i))) continue;
+            CardReader &reader = *readers_[i];
+            // Stale edges (our own reads) find no RxIRq
+            if (reader.mode() == CardReader::MODE_IRQ && reader.answered()) service(i, reader.irqAt());
+        }
+    }
+}
+
+void ReaderManager::noteLook(size_t i, int64_t now) {
+    const int64_t gap = now - lastLook_[i];
+    Latency::record(Latency::STAGE_READER_GAP, gap < 0 ? 0 : gap > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(gap));
+    lastLook_[i] = now;
+}
+
+void ReaderManager::service(size_t i, int64_t presented) {
+    CardReader::Scan scan;
+    if (!readers_[i]->read(scan, presented)) {
+        // Card left or collided: look again on the next round
+        nextArm_[i] = 0;
+        return;
+    }
+    ++read_;
+    if (!scans_.push(scan)) {
+        ++dropped_;
+        LOG_W("[Reader] Scan ring full; dropping card from reader %u", scan.reader);
+    } else if (TaskHandle_t consumer = consumer_.load(std::memory_order_acquire)) {
+        xTaskNotifyGive(consumer);
+    }
+    // Only this reader pauses; the hold-off is not counted as a gap
+    quietUntil_[i] = Latency::now() + RFID_DEBOUNCE_MS * US_PER_MS;
+    nextArm_[i] = quietUntil_[i];
+    lastLook_[i] = quietUntil_[i];
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include "CardReader.h"
+#include "Lockfree.h"
+
+// Several MFRC522 modules (one per door) on one SPI bus, scheduled by a
+// single task; every card read comes out of next() tagged with its reader.
+// Reads travel over a lock-free SPSC ring (the reader task produces, one
+// consumer task calls next()) and wake the consumer by task notification.
+//
+// IRQ readers are re-armed every RFID_REQA_INTERVAL_MS and otherwise cost
+// nothing until their IRQ bit arrives; poll readers are checked in turn on
+// each round. A read puts only that reader into its RFID_DEBOUNCE_MS
+// hold-off, the others keep being served. Worst-case detection delay per
+// reader is therefore about RFID_REQA_INTERVAL_MS (IRQ) or one polling
+// round (each poll of an empty field waits for the chip's ~25 ms timeout)
+// plus the reads of the other readers in between; the reader_gap latency
+// stage records the actual gaps.
+//
+// With SCAN_REPLAY, inject() feeds scans from a recorded trace (ScanReplay)
+// through a second ring of the same size, so next() hands them to loop()
+// exactly like card reads and a burst overflows it the same way.
+class ReaderManager {
+public:
+    static constexpr size_t MAX_READERS = 4;
+
+    struct Stats {
+        uint32_t scans;    // cards read
+        uint32_t dropped;  // reads lost to a full ring
+        uint32_t injected; // replayed scans handed in (SCAN_REPLAY)
+    };
+
+    ReaderManager() = default;
+    ~ReaderManager();
+
+    ReaderManager(const ReaderManager&) = delete;
+    ReaderManager& operator=(const ReaderManager&) = delete;
+
+    // Create and init the next reader; its index is the reader/door id.
+    // setup(), after SPI.begin() and before begin().
+    bool addReader(uint8_t ssPin, uint8_t rstPin, CardReader::Mode mode, int irqPin);
+
+    // Start the reader task (app core, above loop())
+    bool begin(UBaseType_t priority = 2, BaseType_t core = 1);
+
+    // Next card read on any reader, waiting up to `wait` ticks. Call from
+    // one task only (loop()); a stray notification of that task ends the
+    // wait early with false.
+    bool next(CardReader::Scan &out, TickType_t wait);
+
+#ifdef SCAN_REPLAY
+    // Queue a replayed scan as if a reader produced it; one producer task
+    // only (ScanReplay). False and counted as dropped when the ring is full.
+    bool inject(const CardReader::Scan &scan);
+#endif
+
+    size_t count() const { return count_; }
+    const CardReader *reader(size_t i) const { return i < count_ ? readers_[i] : nullptr; }
+    Stats stats() const;
+
+private:
+    CardReader *readers_[MAX_READERS] = {};
+    size_t count_ = 0;
+    SpscRing<CardReader::Scan, 4> scans_;
+    std::atomic<TaskHandle_t> consumer_{nullptr};
+    TaskHandle_t task_ = nullptr;
+    // Task-only schedule, Latency::now() units
+    int64_t nextArm_[MAX_READERS] = {};
+    int64_t quietUntil_[MAX_READERS] = {};
+    int64_t lastLook_[MAX_READERS] = {};
+    volatile uint32_t read_ = 0;
+    volatile uint32_t dropped_ = 0;
+#ifdef SCAN_REPLAY
+    SpscRing<CardReader::Scan, 4> injected_;
+    volatile uint32_t injectedCount_ = 0;
+    volatile uint32_t injectDropped_ = 0;
+#endif
+
+    static void taskEntry(void *self);
+    void run();
+    // Reader `i` is checked for a card now (records the reader_gap)
+    void noteLook(size_t i, int64_t now);
+    void service(size_t i, int64_t presented);
+};
@@ -0,0 +1,196 @@
+#include "ScanLog.h"
+#include "Latency.h"
+#include "Log.h"
+#include <LittleFS.h>
+#include <cstring>
+#include <esp_system.h>
+
+// ScanLog
+// -------
+// Sequence numbers are assigned at push() and stay contiguous: a full RAM
+// ring rejects the new scan (like the old scanQueue), while a full ring
+// file overwrites its oldest record. Record slot = seq % capacity.
+// The header is rewritten once per spill()/ack() batch; a power cut in
+// between loses at most that batch.
+
+namespace {
+    const char *SCAN_FILE = "/scans.bin";
+    // v2 records carry the reader id and raw UID bytes; a v1 file is
+    // discarded as invalid
+    constexpr uint32_t SCAN_MAGIC = 0x32514252UL; // "RBQ2"
+}
+
+ScanLog::ScanLog(size_t flashSlots) : flashSlots_(flashSlots) {}
+
+ScanLog::~ScanLog() {
+    if (file_) file_.close();
+}
+
+bool ScanLog::begin() {
+    if (flashSlots_ == 0 || !LittleFS.begin()) return ramOnly();
+
+    Header hdr{};
+    if (LittleFS.exists(SCAN_FILE)) {
+        file_ = LittleFS.open(SCAN_FILE, "r+");
+        const bool valid = file_ && file_.read(reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr)) == sizeof(hdr) &&
+                           hdr.magic == SCAN_MAGIC && hdr.capacity == flashSlots_ && hdr.tail - hdr.head <= flashSlots_;
+        if (!valid) {
+            LOG_W("[Scans] Ring file invalid or resized; starting empty");
+            if (file_) file_.close();
+            hdr = Header{};
+        }
+    }
+    if (!file_) {
+        file_ = LittleFS.open(SCAN_FILE, "w+");
+        if (!file_) return ramOnly();
+        hdr.magic = SCAN_MAGIC;
+        hdr.capacity = static_cast<uint32_t>(flashSlots_);
+        // The server de-duplicates by (device, boot, seq); a fresh ring must
+        // not reuse sequence numbers an earlier ring already uploaded
+        hdr.head = hdr.tail = esp_random() >> 1;
+    }
+    boot_ = hdr.boot + 1;
+    head_ = hdr.head;
+    tail_ = hdr.tail;
+    nextSeq_ = tail_;
+    droppedLifetime_ = hdr.dropped;
+    flashOk_ = writeHeader();
+    if (!flashOk_) return ramOnly();
+    LOG_I("[Scans] Ring file ready: boot=%u backlog=%u/%u", boot_,
+                  static_cast<unsigned>(tail_ - head_), static_cast<unsigned>(flashSlots_));
+    return true;
+}
+
+bool ScanLog::ramOnly() {
+    // Nothing keeps the boot counter or the last seq across reboots, so
+    // both start at random: restarting from 0 would collide with scans the
+    // server stored in an earlier boot and get them ignored as retries
+    if (file_) file_.close();
+    flashOk_ = false;
+    boot_ = esp_random();
+    nextSeq_ = esp_random() >> 1;
+    return false;
+}
+
+void ScanLog::push(const UidKey &uid, uint8_t reader, unsigned long now) {
+    Record r{};
+    r.seq = nextSeq_;
+    r.boot = boot_;
+    r.uptimeMs = static_cast<uint32_t>(now);
+    r.reader = reader;
+    r.uidLen = uid.len;
+    memcpy(r.uidBytes, uid.bytes, sizeof(r.uidBytes));
+    if (!ram_.push(r)) {
+        ++droppedRam_;
+        LOG_W("[Scans] RAM ring full; dropping scan");
+        return;
+    }
+    ++nextSeq_;
+    const size_t fill = ram_.size();
+    if (fill > ramHighWater_) ramHighWater_ = fill;
+}
+
+void ScanLog::spill() {
+    if (!flashOk_) return;
+    bool wrote = false;
+    Record r;
+    // A record leaves the RAM ring only once it is on flash
+    while (ram_.peek(0, r)) {
+        if (!writeRecord(r)) {
+            LOG_W("[Scans] Warning: ring file write failed");
+            break;
+        }
+        wrote = true;
+        ram_.drop(1);
+    }
+    if (wrote) {
+        file_.flush();
+        writeHeader();
+    }
+}
+
+size_t ScanLog::peek(Record *out, size_t max) {
+    size_t n = 0;
+    if (flashOk_) {
+        const uint32_t oldHead = head_;
+        for (uint32_t seq = head_; seq != tail_ && n < max; ++seq) {
+            if (readRecord(seq, out[n])) {
+                ++n;
+                continue;
+            }
+            if (n > 0) break;
+            // Unreadable oldest record: skip it rather than stall the queue
+            head_ = seq + 1;
+            ++droppedFlash_;
+            ++droppedLifetime_;
+        }
+        if (head_ != oldHead) writeHeader();
+        return n;
+    }
+    while (n < max && ram_.peek(n, out[n])) ++n;
+    return n;
+}
+
+void ScanLog::ack(uint32_t seq) {
+    if (flashOk_) {
+        // Ignore acks outside the backlog (stale replies, ring overwrites)
+        if (seq - head_ >= tail_ - head_) return;
+        uploaded_ += seq + 1 - head_;
+        head_ = seq + 1;
+        writeHeader();
+        return;
+    }
+    Record r;
+    while (ram_.peek(0, r) && static_cast<int32_t>(r.seq - seq) <= 0) {
+        ram_.drop(1);
+        ++uploaded_;
+    }
+}
+
+bool ScanLog::writeHeader() {
+    Header hdr{SCAN_MAGIC, static_cast<uint32_t>(flashSlots_), boot_, head_, tail_, droppedLifetime_, {0, 0}};
+    if (!file_.seek(0)) return false;
+    const bool ok = file_.write(reinterpret_cast<const uint8_t*>(&hdr), sizeof(hdr)) == sizeof(hdr);
+    file_.flush();
+    Latency::flashWrite(sizeof(hdr));
+    return ok;
+}
+
+bool ScanLog::writeRecord(const Record &r) {
+    if (tail_ - head_ >= flashSlots_) {
+        // Ring full: the oldest unacked record is overwritten
+        ++head_;
+        ++droppedFlash_;
+        ++droppedLifetime_;
+    }
+    const size_t offset = sizeof(Header) + (r.seq % flashSlots_) * sizeof(Record);
+    if (!file_.seek(offset)) return false;
+    if (file_.write(reinterpret_cast<const uint8_t*>(&r), sizeof(r)) != sizeof(r)) return false;
+    Latency::flashWrite(sizeof(r));
+    tail_ = r.seq + 1;
+    if (tail_ - head_ > flashHighWater_) flashHighWater_ = tail_ - head_;
+    return true;
+}
+
+bool ScanLog::readRecord(uint32_t seq, Record &r) {
+    const size_t offset = sizeof(Header) + (seq % flashSlots_) * sizeof(Record);
+    return file_.seek(offset) && file_.read(reinterpret_cast<uint8_t*>(&r), sizeof(r)) == sizeof(r) && r.seq == seq;
+}
+
+ScanLog::Stats ScanLog::stats() const {
+    Stats s{};
+    s.pending = static_cast<uint32_t>(ram_.size()) + (flashOk_ ? tail_ - head_ : 0);
+    s.ramHighWater = ramHighWater_;
+    s.flashHighWater = flashHighWater_;
+    s.droppedRam = droppedRam_;
+    s.droppedFlash = droppedFlash_;
+    s.uploaded = uploaded_;
+    return s;
+}
+
+void ScanLog::printStats(Print &out) const {
+    const Stats s = stats();
+    out.printf("[Scans] pending=%u uploaded=%u ram_hw=%u/%u flash_hw=%u/%u dropped ram=%u flash=%u%s\n",
+                  s.pending, s.uploaded, s.ramHighWater, static_cast<unsigned>(ram_.CAPACITY), s.flashHighWater,
+                  static_cast<unsigned>(flashSlots_), s.droppedRam, s.droppedFlash, flashOk_ ? "" : " (RAM only)");
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <FS.h>
+#include "Lockfree.h"
+#include "UidKey.h"
+
+// RAM/flash split of the scan-event buffer. Override in platformio.ini
+// build_flags, e.g. -DSCAN_RAM_SLOTS=32 -DSCAN_FLASH_SLOTS=4096. The RAM
+// ring size must be a power of two.
+#ifndef SCAN_RAM_SLOTS
+#define SCAN_RAM_SLOTS 16
+#endif
+#ifndef SCAN_FLASH_SLOTS
+#define SCAN_FLASH_SLOTS 1024
+#endif
+
+// Persistent queue of scan events waiting for `/api/last_scan/batch`.
+//
+// loop() pushes into a small lock-free SPSC ring (no flash I/O). NetworkTask
+// spills that ring into a fixed-size ring file `/scans.bin`, uploads the
+// oldest records in batches and drops them once the server acks their
+// sequence number. The backlog therefore survives reboots and long
+// outages; when a ring is full the oldest record is overwritten and
+// counted as dropped. Without a filesystem the RAM ring is used alone,
+// with a random boot id and first seq.
+class ScanLog {
+public:
+    struct __attribute__((packed)) Record {
+        uint32_t seq;       // monotonic across reboots, acked by the server
+        uint32_t boot;      // boot counter the scan happened in (random in RAM-only mode)
+        uint32_t uptimeMs;  // millis() at the scan
+        uint8_t reader;     // reader/door index (ReaderManager)
+        uint8_t uidLen;     // raw UID bytes; hex only when uploading
+        uint8_t uidBytes[UidKey::MAX_BYTES];
+        uint8_t reserved[8];
+
+        UidKey uid() const { return UidKey(uidBytes, uidLen); }
+    };
+    static_assert(sizeof(Record) == 32, "scan record is 32 bytes on flash");
+
+    struct Stats {
+        uint32_t pending;        // records not yet acked
+        uint32_t ramHighWater;   // max RAM ring fill
+        uint32_t flashHighWater; // max unacked backlog in the ring file
+        uint32_t droppedRam;     // overwritten before reaching flash
+        uint32_t droppedFlash;   // overwritten in the ring file
+        uint32_t uploaded;       // acked this boot
+    };
+
+    explicit ScanLog(size_t flashSlots = SCAN_FLASH_SLOTS);
+    ~ScanLog();
+
+    ScanLog(const ScanLog&) = delete;
+    ScanLog& operator=(const ScanLog&) = delete;
+
+    // Open or create the ring file and bump the boot counter (setup()).
+    // False means RAM-only operation.
+    bool begin();
+
+    // Queue a scan; loop() is the only producer. Never blocks.
+    void push(const UidKey &uid, uint8_t reader, unsigned long now);
+
+    // NetworkTask (the only consumer): move RAM records into the ring file
+    void spill();
+    // Copy up to `max` of the oldest unacked records; returns the count
+    size_t peek(Record *out, size_t max);
+    // Drop every record with seq <= `seq`
+    void ack(uint32_t seq);
+
+    uint32_t boot() const { return boot_; }
+    bool persistent() const { return flashOk_; }
+    Stats stats() const;
+    void printStats(Print &out = Serial) const;
+
+private:
+    struct __attribute__((packed)) Header {
+        uint32_t magic;
+        uint32_t capacity;
+        uint32_t boot;
+        uint32_t head;      // oldest unacked seq
+        uint32_t tail;      // next seq to assign
+        uint32_t dropped;   // lifetime overwrites
+        uint32_t reserved[2];
+    };
+    static_assert(sizeof(Header) == 32, "scan log header is 32 bytes");
+
+    SpscRing<Record, SCAN_RAM_SLOTS> ram_;
+
+    size_t flashSlots_;
+    bool flashOk_ = false;
+    File file_;
+    uint32_t boot_ = 0;
+    uint32_t head_ = 0;
+    uint32_t tail_ = 0;
+    uint32_t nextSeq_ = 0;
+    uint32_t droppedLifetime_ = 0;
+
+    // Producer side
+    uint32_t ramHighWater_ = 0;
+    uint32_t droppedRam_ = 0;
+    // Consumer side
+    uint32_t flashHighWater_ = 0;
+    uint32_t droppedFlash_ = 0;
+    uint32_t uploaded_ = 0;
+
+    // Seed boot and seq for a log without the ring file; returns false
+    bool ramOnly();
+    bool writeHeader();
+    bool writeRecord(const Record &r);
+    bool readRecord(uint32_t seq, Record &r);
+};
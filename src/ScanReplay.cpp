@@ -0,0 +1,166 @@
+#include "ScanReplay.h"
+#include "Latency.h"
+#include "Log.h"
+#include <LittleFS.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef SCAN_REPLAY
+
+// ScanReplay
+// ----------
+// Each line waits for its due time in short sleeps (so stop() is noticed)
+// and is injected when it wakes; a slow loop() shows up as ring drops, a
+// busy core as schedule lag. A pass that ends continues the schedule at
+// the time of its last line, so looping a trace keeps its rhythm.
+
+namespace {
+    // Longest single sleep while waiting for a line
+    constexpr int64_t REPLAY_SLEEP_MAX_US = 100 * 1000;
+
+    bool blankOrComment(const char *line) {
+        while (*line == ' ' || *line == '\t' || *line == '\r') ++line;
+        return *line == '\0' || *line == '#';
+    }
+}
+
+ScanReplay::~ScanReplay() {
+    if (running() && task_) vTaskDelete(task_);
+}
+
+bool ScanReplay::start(const char *path, uint16_t speedPct, uint16_t passes) {
+    if (running()) return false;
+    if (!path || strlen(path) > PATH_MAX_LEN || !LittleFS.exists(path)) {
+        LOG_W("[Replay] No trace at %s", path ? path : "(null)");
+        return false;
+    }
+    strncpy(path_, path, PATH_MAX_LEN);
+    path_[PATH_MAX_LEN] = '\0';
+    speedPct_ = speedPct ? speedPct : 100;
+    passes_ = passes;
+    injected_ = 0;
+    dropped_ = 0;
+    skipped_ = 0;
+    maxLagUs_ = 0;
+    elapsedMs_ = 0;
+    passesDone_ = 0;
+    stop_.store(false, std::memory_order_relaxed);
+    startedAt_ = Latency::now();
+    running_.store(true, std::memory_order_release);
+
+    // Where the reader task runs: the replay competes with loop() as the
+    // readers would
+#if defined(CONFIG_FREERTOS_UNICORE)
+    const BaseType_t ok = xTaskCreate(taskEntry, "replay_task", 3072, this, 2, &task_);
+#else
+    const BaseType_t ok = xTaskCreatePinnedToCore(taskEntry, "replay_task", 3072, this, 2, &task_, 1);
+#endif
+    if (ok != pdPASS) {
+        task_ = nullptr;
+        running_.store(false, std::memory_order_release);
+        LOG_E("[Replay] Failed to start replay task");
+        return false;
+    }
+    LOG_I("[Replay] %s at %u%%, %u pass(es)", path_, speedPct_, passes_);
+    return true;
+}
+
+ScanReplay::Stats ScanReplay::stats() const {
+    const bool live = running();
+    const uint32_t elapsed = live ? static_cast<uint32_t>((Latency::now() - startedAt_) / 1000) : elapsedMs_;
+    return Stats{injected_, dropped_, skipped_, maxLagUs_, elapsed, passesDone_, live};
+}
+
+bool ScanReplay::parseLine(const char *line, uint32_t &atMs, UidKey &uid, uint8_t &reader) {
+    char *end = nullptr;
+    const unsigned long t = strtoul(line, &end, 10);
+    if (end == line || *end != ',') return false;
+    const char *text = end + 1;
+    const char *comma = strchr(text, ',');
+    if (!comma || static_cast<size_t>(comma - text) > UidKey::HEX_CHARS) return false;
+    char hex[UidKey::HEX_CHARS + 1];
+    memcpy(hex, text, comma - text);
+    hex[comma - text] = '\0';
+    const UidKey key = UidKey::fromHex(hex);
+    const unsigned long r = strtoul(comma + 1, &end, 10);
+    if (key.empty() || end == comma + 1 || r > UINT8_MAX) return false;
+    while (*end == ' ' || *end == '\t' || *end == '\r') ++end;
+    if (*end != '\0') return false;
+    atMs = static_cast<uint32_t>(t);
+    uid = key;
+    reader = static_cast<uint8_t>(r);
+    return true;
+}
+
+void ScanReplay::taskEntry(void *self) {
+    static_cast<ScanReplay*>(self)->run();
+}
+
+void ScanReplay::run() {
+    int64_t origin = Latency::now();
+    for (uint16_t pass = 0; !stop_.load(std::memory_order_relaxed) && (passes_ == 0 || pass < passes_); ++pass) {
+        origin = replayPass(origin);
+        if (origin < 0) break;
+        passesDone_ = pass + 1;
+    }
+    elapsedMs_ = static_cast<uint32_t>((Latency::now() - startedAt_) / 1000);
+    LOG_I("[Replay] Done: injected=%u dropped=%u skipped=%u max_lag_us=%u", injected_, dropped_, skipped_,
+          maxLagUs_);
+    task_ = nullptr;
+    running_.store(false, std::memory_order_release);
+    vTaskDelete(nullptr);
+}
+
+int64_t ScanReplay::replayPass(int64_t origin) {
+    File f = LittleFS.open(path_, FILE_READ);
+    if (!f) {
+        LOG_W("[Replay] Cannot open %s", path_);
+        return -1;
+    }
+    // File data needs no waiting; a last line without '\n' ends at EOF
+    f.setTimeout(0);
+    char line[LINE_MAX];
+    bool first = true;
+    uint32_t firstMs = 0;
+    int64_t due = origin;
+    while (!stop_.load(std::memory_order_relaxed) && f.available()) {
+        const size_t n = f.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[n] = '\0';
+        uint32_t atMs = 0;
+        UidKey uid;
+        uint8_t reader = 0;
+        if (!parseLine(line, atMs, uid, reader)) {
+            if (!blankOrComment(line)) ++skipped_;
+            continue;
+        }
+        if (first) {
+            firstMs = atMs;
+            first = false;
+        }
+        // A line older than the one before goes out right after it
+        const int64_t offset = atMs > firstMs ? static_cast<int64_t>(atMs - firstMs) * 1000 * 100 / speedPct_ : 0;
+        due = std::max(due, origin + offset);
+        inject(uid, reader, due);
+    }
+    f.close();
+    return due;
+}
+
+void ScanReplay::inject(const UidKey &uid, uint8_t reader, int64_t due) {
+    for (int64_t now = Latency::now(); now < due; now = Latency::now()) {
+        if (stop_.load(std::memory_order_relaxed)) return;
+        const int64_t us = std::min(due - now, REPLAY_SLEEP_MAX_US);
+        vTaskDelay(std::max<TickType_t>(1, pdMS_TO_TICKS(static_cast<uint32_t>(us / 1000))));
+    }
+    CardReader::Scan scan;
+    scan.uid = uid;
+    scan.reader = reader;
+    scan.presented = Latency::now();
+    const int64_t lag = scan.presented - due;
+    if (lag > static_cast<int64_t>(maxLagUs_)) maxLagUs_ = lag > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(lag);
+    if (readers_.inject(scan)) ++injected_;
+    else ++dropped_;
+}
+
+#endif // SCAN_REPLAY
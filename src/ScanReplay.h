@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "ReaderManager.h"
+
+// Default trace file (LittleFS; `pio run -t uploadfs` from data/)
+#ifndef SCAN_REPLAY_FILE
+#define SCAN_REPLAY_FILE "/trace.csv"
+#endif
+
+// Replays a recorded scan trace through the decision pipeline, for load
+// tests on the bench without cards or readers (SCAN_REPLAY builds).
+//
+// The trace is CSV, one scan per line, times ascending:
+//   <t_ms>,<uid hex>,<reader>
+// with t_ms relative to any origin; blank lines and '#' comments are
+// skipped (lib/replay.py writes this format). A task of its own reads the
+// file line by line and injects each scan into ReaderManager when it is
+// due, scaled by the speed. loop() then takes it like a card read: hash,
+// AuthSync::isAuthorized(), display, ScanLog. The decision latency starts
+// at the injection, so it includes the wait for loop().
+//
+// The task runs at the reader task's priority on the app core, as the
+// readers it stands in for. Lines are read as they are due, so a trace of
+// any length costs one line buffer.
+class ScanReplay {
+public:
+    struct Stats {
+        uint32_t injected;   // scans handed to ReaderManager
+        uint32_t dropped;    // refused by its full ring
+        uint32_t skipped;    // malformed lines
+        uint32_t maxLagUs;   // worst delay behind the trace schedule
+        uint32_t elapsedMs;  // since start(), frozen when the run ends
+        uint16_t passes;     // passes over the file completed
+        bool running;
+    };
+
+    explicit ScanReplay(ReaderManager &readers) : readers_(readers) {}
+    ~ScanReplay();
+
+    ScanReplay(const ScanReplay&) = delete;
+    ScanReplay& operator=(const ScanReplay&) = delete;
+
+    // Replay `path` at `speedPct` percent of recorded time (200 = twice as
+    // fast), `passes` times over (0 = until stop()). False while a replay
+    // runs, when the file is missing or the task cannot start.
+    bool start(const char *path = SCAN_REPLAY_FILE, uint16_t speedPct = 100, uint16_t passes = 1);
+    // End the run at the next line
+    void stop() { stop_.store(true, std::memory_order_relaxed); }
+    bool running() const { return running_.load(std::memory_order_acquire); }
+    Stats stats() const;
+
+    // One trace line; false for anything else (comments included)
+    static bool parseLine(const char *line, uint32_t &atMs, UidKey &uid, uint8_t &reader);
+
+private:
+    static constexpr size_t LINE_MAX = 64;
+    static constexpr size_t PATH_MAX_LEN = 31;
+
+    ReaderManager &readers_;
+    char path_[PATH_MAX_LEN + 1] = {};
+    uint16_t speedPct_ = 100;
+    uint16_t passes_ = 1;
+    TaskHandle_t task_ = nullptr;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> stop_{false};
+
+    // Written by the task, read by stats()
+    int64_t startedAt_ = 0;
+    volatile uint32_t injected_ = 0;
+    volatile uint32_t dropped_ = 0;
+    volatile uint32_t skipped_ = 0;
+    volatile uint32_t maxLagUs_ = 0;
+    volatile uint32_t elapsedMs_ = 0;
+    volatile uint16_t passesDone_ = 0;
+
+    static void taskEntry(void *self);
+    void run();
+    // One pass over the file starting at `origin` (Latency::now() units)
+    int64_t replayPass(int64_t origin);
+    void inject(const UidKey &uid, uint8_t reader, int64_t due);
+};
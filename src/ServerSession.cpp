@@ -0,0 +1,86 @@
+#include "ServerSession.h"
+#include "Latency.h"
+
+// ServerSession
+// -------------
+// The mutex is held from Request construction until its destructor, so the
+// shared HTTPClient and socket are only ever touched by one task at a time.
+
+ServerSession::ServerSession(const String &baseUrl) : base_(baseUrl) {
+    mutex_ = xSemaphoreCreateMutex();
+    // Keep the socket open between exchanges (sends Connection: keep-alive)
+    http_.setReuse(true);
+}
+
+ServerSession::~ServerSession() {
+    client_.stop();
+    if (mutex_) {
+        vSemaphoreDelete(mutex_);
+        mutex_ = nullptr;
+    }
+}
+
+ServerSession::Request::Request(ServerSession &session, const String &path, uint16_t timeoutMs,
+                                TickType_t wait)
+    : session_(session) {
+    if (!session_.configured() || !session_.mutex_) return;
+    if (xSemaphoreTake(session_.mutex_, wait) != pdTRUE) {
+        ++session_.busySkips_;
+        return;
+    }
+    if (!session_.client_.connected()) {
+        ++session_.connects_;
+    }
+    http_ = &session_.http_;
+    http_->setTimeout(timeoutMs);
+    http_->begin(session_.client_, session_.base_ + path);
+}
+
+ServerSession::Request::~Request() {
+    if (!http_) return;
+    // Unread reply bytes would be parsed as the next response on this socket
+    const bool reusable = code_ > 0 && (consumed_ || code_ == 204 || code_ == 304);
+    http_->end();
+    if (!reusable) {
+        session_.client_.stop();
+    }
+    xSemaphoreGive(session_.mutex_);
+}
+
+int ServerSession::Request::track(int code) {
+    ++session_.requests_;
+    Latency::count(Latency::HTTP_REQUESTS);
+    code_ = code;
+    // Any HTTP answer proves the server is up; 5xx means its backend is not
+    if (code > 0 && code < 500) {
+        session_.health_.reportSuccess(millis());
+    } else {
+        session_.health_.reportFailure(millis());
+    }
+    return code;
+}
+
+int ServerSession::Request::GET() {
+    if (!http_) return HTTPC_ERROR_CONNECTION_REFUSED;
+    return track(http_->GET());
+}
+
+int ServerSession::Request::POST(const String &body) {
+    if (!http_) return HTTPC_ERROR_CONNECTION_REFUSED;
+    return track(http_->POST(body));
+}
+
+bool ServerSession::probe(uint16_t timeoutMs, TickType_t wait) {
+    Request req(*this, "/api/status", timeoutMs, wait);
+    if (!req.acquired()) return false;
+    const int code = req.GET();
+    if (code > 0) req.body();
+    return code == 200;
+}
+
+String ServerSession::Request::body() {
+    if (!http_ || code_ <= 0) return String();
+    String payload = http_->getString();
+    consumed_ = true;
+    return payload;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <HTTPClient.h>
+#include <WiFiClient.h>
+#include <freertos/semphr.h>
+#include "Reachability.h"
+
+// One long-lived HTTP/1.1 keep-alive connection to SERVER_BASE, shared by
+// every server call (scan posts, status polls, card lookups and syncs).
+//
+// HTTPClient cannot pipeline, so exchanges are serialized: a Request holds
+// the session for the duration of one request/response and the socket is
+// left open for the next one. A transport error or a reply whose body was
+// not read drops the socket; the next Request reconnects transparently.
+// Each exchange also reports to health(), the device-wide reachability.
+class ServerSession {
+public:
+    explicit ServerSession(const String &baseUrl);
+    ~ServerSession();
+
+    ServerSession(const ServerSession&) = delete;
+    ServerSession& operator=(const ServerSession&) = delete;
+
+    const String &baseUrl() const { return base_; }
+    bool configured() const { return base_.length() > 0; }
+
+    // Scoped exchange on the shared connection. `wait` bounds how long the
+    // caller blocks while another task owns the session; check acquired().
+    class Request {
+    public:
+        Request(ServerSession &session, const String &path, uint16_t timeoutMs,
+                TickType_t wait = portMAX_DELAY);
+        ~Request();
+
+        Request(const Request&) = delete;
+        Request& operator=(const Request&) = delete;
+
+        bool acquired() const { return http_ != nullptr; }
+        HTTPClient &http() { return *http_; }
+
+        // Send the request; negative codes are HTTPClient transport errors
+        int GET();
+        int POST(const String &body);
+
+        // Read the whole reply body (marks it consumed)
+        String body();
+        // The caller read the body through http().getStreamPtr() itself
+        void markConsumed() { consumed_ = true; }
+
+    private:
+        ServerSession &session_;
+        HTTPClient *http_ = nullptr;
+        int code_ = 0;
+        bool consumed_ = false;
+
+        int track(int code);
+    };
+
+    Reachability &health() { return health_; }
+    const Reachability &health() const { return health_; }
+
+    // GET /api/status; the outcome lands in health(). False when the server
+    // did not answer or the session stayed busy for `wait`.
+    bool probe(uint16_t timeoutMs, TickType_t wait = portMAX_DELAY);
+
+    uint32_t requests() const { return requests_; }
+    uint32_t connects() const { return connects_; }
+    uint32_t busySkips() const { return busySkips_; }
+
+private:
+    String base_;
+    WiFiClient client_;
+    HTTPClient http_;
+    SemaphoreHandle_t mutex_ = nullptr;
+    Reachability health_;
+    uint32_t requests_ = 0;
+    uint32_t connects_ = 0;
+    uint32_t busySkips_ = 0;
+};
@@ -0,0 +1,172 @@
+#include "SyncDecoder.h"
+#include <algorithm>
+#include <cstring>
+#include <esp_heap_caps.h>
+#include <esp32/rom/miniz.h>
+
+// SyncDecoder
+// -----------
+// tinfl in wrapping mode treats the output buffer as its dictionary: the
+// ring must be a power of two at least as large as the stream's window.
+// It is only refilled once every decoded byte was handed out, so tinfl may
+// write from ringPos_ to the end of the ring while the bytes before it stay
+// available for back-references.
+
+namespace {
+    constexpr uint32_t INFLATE_FLAGS = TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_COMPUTE_ADLER32;
+
+    static_assert((SyncFormat::DEFLATE_WINDOW & (SyncFormat::DEFLATE_WINDOW - 1)) == 0,
+                  "tinfl needs a power-of-two ring");
+}
+
+struct SyncDecoder::Work {
+    tinfl_decompressor inflater;
+    uint8_t ring[SyncFormat::DEFLATE_WINDOW];
+};
+
+SyncDecoder::~SyncDecoder() {
+    heap_caps_free(work_);
+}
+
+bool SyncDecoder::parse(const String &name, Encoding &out) {
+    if (name.length() == 0) {
+        out = IDENTITY;
+    } else if (name.equalsIgnoreCase(SyncFormat::ENCODING_DEFLATE)) {
+        out = DEFLATE;
+    } else if (name.equalsIgnoreCase(SyncFormat::ENCODING_RLE)) {
+        out = RLE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool SyncDecoder::begin() {
+    if (encoding_ != DEFLATE || work_) return true;
+    if (heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) < sizeof(Work) + HEAP_RESERVE) return false;
+    work_ = static_cast<Work*>(heap_caps_malloc(sizeof(Work), MALLOC_CAP_8BIT));
+    if (!work_) return false;
+    tinfl_init(&work_->inflater);
+    return true;
+}
+
+bool SyncDecoder::read(uint8_t *dst, size_t len) {
+    if (failed_) return false;
+    bool ok = true;
+    switch (encoding_) {
+    case DEFLATE:
+        ok = work_ && readDeflate(dst, len);
+        break;
+    case RLE:
+        ok = readRle(dst, len);
+        break;
+    default:
+        for (size_t got = 0; ok && got < len;) {
+            const size_t n = pull_(dst + got, len - got);
+            encoded_ += n;
+            got += n;
+            ok = n != 0;
+        }
+        break;
+    }
+    if (ok) decoded_ += len; else failed_ = true;
+    return ok;
+}
+
+bool SyncDecoder::finish() {
+    if (failed_) return false;
+    switch (encoding_) {
+    case DEFLATE:
+        // Reads the final block and the Adler-32; nothing may decode past
+        // the frame the caller read
+        while (work_ && pending_ == 0 && !streamDone_) {
+            if (!inflateMore()) return false;
+        }
+        return work_ && pending_ == 0 && streamDone_;
+    case RLE:
+        // A complete stream ends between tokens
+        return runLeft_ == 0 && inPos_ == inLen_ && (inEnd_ || !refill());
+    default:
+        return true;
+    }
+}
+
+bool SyncDecoder::refill() {
+    if (inEnd_) return false;
+    inPos_ = 0;
+    inLen_ = pull_(in_, sizeof(in_));
+    encoded_ += inLen_;
+    inEnd_ = inLen_ == 0;
+    return !inEnd_;
+}
+
+bool SyncDecoder::nextByte(uint8_t &b) {
+    if (inPos_ == inLen_ && !refill()) return false;
+    b = in_[inPos_++];
+    return true;
+}
+
+bool SyncDecoder::inflateMore() {
+    if (inPos_ == inLen_) refill();
+    size_t inBytes = inLen_ - inPos_;
+    size_t outBytes = SyncFormat::DEFLATE_WINDOW - ringPos_;
+    const tinfl_status status = tinfl_decompress(&work_->inflater, in_ + inPos_, &inBytes, work_->ring,
+                                                 work_->ring + ringPos_, &outBytes,
+                                                 INFLATE_FLAGS | (inEnd_ ? 0 : TINFL_FLAG_HAS_MORE_INPUT));
+    inPos_ += inBytes;
+    readPos_ = ringPos_;
+    pending_ = outBytes;
+    ringPos_ = (ringPos_ + outBytes) & (SyncFormat::DEFLATE_WINDOW - 1);
+    streamDone_ = status == TINFL_STATUS_DONE;
+    // Errors (including a window larger than the ring) are negative; a
+    // call that neither took input nor produced output means a cut body
+    return status >= 0 && (streamDone_ || inBytes || outBytes);
+}
+
+bool SyncDecoder::readDeflate(uint8_t *dst, size_t len) {
+    while (len) {
+        if (pending_ == 0) {
+            if (streamDone_ || !inflateMore()) return false;
+            continue;
+        }
+        const size_t n = std::min(len, pending_);
+        memcpy(dst, work_->ring + readPos_, n);
+        readPos_ += n;
+        pending_ -= n;
+        dst += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool SyncDecoder::readRle(uint8_t *dst, size_t len) {
+    while (len) {
+        if (runLeft_ == 0 && !nextRun()) return false;
+        size_t n = std::min<size_t>(len, runLeft_);
+        if (runRepeat_) {
+            memset(dst, runByte_, n);
+        } else {
+            if (inPos_ == inLen_ && !refill()) return false;
+            n = std::min(n, inLen_ - inPos_);
+            memcpy(dst, in_ + inPos_, n);
+            inPos_ += n;
+        }
+        runLeft_ -= n;
+        dst += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool SyncDecoder::nextRun() {
+    uint32_t token = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        uint8_t b;
+        if (shift > 28 || !nextByte(b)) return false;
+        token |= static_cast<uint32_t>(b & 0x7F) << shift;
+        if (!(b & 0x80)) break;
+    }
+    runLeft_ = token >> 1;
+    runRepeat_ = token & 1;
+    return runLeft_ != 0 && (!runRepeat_ || nextByte(runByte_));
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include "SyncFormat.h"
+
+// Streaming decoder for a compressed binary `/api/sync` body (see
+// SyncFormat::ENCODING_HEADER). read() hands out exactly the decoded bytes
+// asked for, pulling encoded bytes as it goes, so the reply is parsed as
+// if it came off the socket uncompressed.
+//
+// Deflate uses the ROM inflater (tinfl) with a DEFLATE_WINDOW byte output
+// ring, which the server's window never exceeds (the zlib header is
+// checked against it); RLE needs no state beyond the current run. Working
+// memory is one ~11 KB block for deflate, freed with the decoder.
+class SyncDecoder {
+public:
+    enum Encoding : uint8_t { IDENTITY, DEFLATE, RLE };
+
+    // Source of encoded bytes: up to `len` at `dst`, 0 at the end of the
+    // body or on error
+    using PullFn = std::function<size_t(uint8_t *dst, size_t len)>;
+
+    SyncDecoder(Encoding encoding, PullFn pull) : encoding_(encoding), pull_(std::move(pull)) {}
+    ~SyncDecoder();
+    SyncDecoder(const SyncDecoder&) = delete;
+    SyncDecoder& operator=(const SyncDecoder&) = delete;
+
+    // Reply header value to encoding; false for one we cannot decode
+    static bool parse(const String &name, Encoding &out);
+
+    // Allocate the working memory; false without memory
+    bool begin();
+    // Exactly `len` decoded bytes, or false (truncated/corrupt/short)
+    bool read(uint8_t *dst, size_t len);
+    // Consume the rest of the encoded body (deflate end of stream and zlib
+    // checksum); false when decoded bytes are left over or the stream is bad
+    bool finish();
+
+    Encoding encoding() const { return encoding_; }
+    size_t encodedBytes() const { return encoded_; }
+    size_t decodedBytes() const { return decoded_; }
+
+private:
+    static constexpr size_t IN_BYTES = 256;
+    // Keep this much internal heap free for WiFi/HTTP
+    static constexpr size_t HEAP_RESERVE = 32 * 1024;
+
+    struct Work;
+
+    Encoding encoding_;
+    PullFn pull_;
+    Work *work_ = nullptr;
+    bool failed_ = false;
+
+    // Encoded input (deflate and RLE)
+    uint8_t in_[IN_BYTES] = {};
+    size_t inPos_ = 0;
+    size_t inLen_ = 0;
+    bool inEnd_ = false;
+    size_t encoded_ = 0;
+    size_t decoded_ = 0;
+
+    // Deflate: decoded bytes in the ring not yet handed out
+    size_t ringPos_ = 0;
+    size_t readPos_ = 0;
+    size_t pending_ = 0;
+    bool streamDone_ = false;
+
+    // RLE: the current run
+    uint32_t runLeft_ = 0;
+    bool runRepeat_ = false;
+    uint8_t runByte_ = 0;
+
+    bool refill();
+    bool nextByte(uint8_t &b);
+    bool inflateMore();
+    bool readDeflate(uint8_t *dst, size_t len);
+    bool readRle(uint8_t *dst, size_t len);
+    bool nextRun();
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+// Wire formats shared with lib/server.py (`/api/sync`).
+// All multi-byte fields are little-endian, which matches the ESP32 so the
+// headers can be read straight into these structs.
+namespace SyncFormat {
+
+    // Content type the device sends in `Accept` to request binary framing.
+    constexpr const char *BINARY_MIME = "application/octet-stream";
+
+    // Full bitset reply: header followed by `length` raw bitset bytes.
+    constexpr uint32_t BITSET_MAGIC = 0x31534252UL; // "RBS1"
+
+    struct __attribute__((packed)) BitsetHeader {
+        uint32_t magic;
+        uint32_t max_id;
+        uint32_t length; // bitset bytes following the header
+        uint32_t crc32;  // zlib CRC-32 over the bitset bytes
+    };
+    static_assert(sizeof(BitsetHeader) == 16, "BitsetHeader must match server framing");
+
+    // Delta reply to `/api/sync?since=<version>`: header followed by `count`
+    // DeltaRange records. The server falls back to a full BitsetHeader reply
+    // when the gap is too large, so the device dispatches on `magic`.
+    constexpr uint32_t DELTA_MAGIC = 0x31444252UL; // "RBD1"
+
+    struct __attribute__((packed)) DeltaHeader {
+        uint32_t magic;
+        uint32_t from_version;
+        uint32_t to_version;
+        uint32_t max_id;
+        uint32_t count;  // number of DeltaRange records
+        uint32_t crc32;  // zlib CRC-32 over the records
+    };
+    static_assert(sizeof(DeltaHeader) == 24, "DeltaHeader must match server framing");
+
+    enum : uint8_t { DELTA_CLEAR = 0, DELTA_SET = 1 };
+
+    struct __attribute__((packed)) DeltaRange {
+        uint32_t start;  // first card_id
+        uint16_t length; // number of consecutive card_ids
+        uint8_t  op;     // DELTA_SET / DELTA_CLEAR
+        uint8_t  reserved;
+    };
+    static_assert(sizeof(DeltaRange) == 8, "DeltaRange must match server framing");
+
+    // Server-side cap (DELTA_MAX_RANGES in server.py); bounds the record buffer
+    constexpr size_t DELTA_MAX_RANGES = 64;
+
+    // Response header carrying the change-log version of the reply
+    constexpr const char *VERSION_HEADER = "X-Sync-Version";
+    // Optional JSON reply headers: entries in the allow / deny arrays, so
+    // the device can size its tables before the lists stream in
+    constexpr const char *ALLOW_COUNT_HEADER = "X-Allow-Count";
+    constexpr const char *DENY_COUNT_HEADER = "X-Deny-Count";
+
+    // Compressed transport for binary replies. The request header lists the
+    // encodings the device decodes, the reply header names the one applied
+    // to the whole body (absent: none). HTTP's Accept-Encoding is left alone
+    // because HTTPClient sends its own.
+    constexpr const char *ENCODING_HEADER = "X-Sync-Encoding";
+    // zlib stream (RFC 1950) with at most a DEFLATE_WINDOW byte window
+    constexpr const char *ENCODING_DEFLATE = "deflate";
+    // Tokens `varint(n << 1 | repeat)` (LEB128): repeat = 1 is followed by
+    // one byte written n times, repeat = 0 by n literal bytes; n >= 1
+    constexpr const char *ENCODING_RLE = "rle";
+    constexpr size_t DEFLATE_WINDOW = 512;
+
+    // UID index reply from `/api/sync/index` (also the `/uid_index.bin` file
+    // layout): header, `count` uint64 uid hashes in ascending order, then
+    // `count` uint32 card_ids in the same order.
+    constexpr uint32_t INDEX_MAGIC = 0x31494252UL; // "RBI1"
+
+    struct __attribute__((packed)) IndexHeader {
+        uint32_t magic;
+        uint32_t count;
+        uint32_t crc32;    // zlib CRC-32 over both arrays
+        uint32_t reserved;
+    };
+    static_assert(sizeof(IndexHeader) == 16, "IndexHeader must match server framing");
+
+    // Xor filter reply from `/api/sync/filter` (also `/filter.bin`): header
+    // then 3 * block_length one-byte fingerprints.
+    constexpr uint32_t FILTER_MAGIC = 0x31464252UL; // "RBF1"
+
+    struct __attribute__((packed)) FilterHeader {
+        uint32_t magic;
+        uint32_t count;        // keys the filter was built from
+        uint32_t block_length; // fingerprints per hash block
+        uint32_t crc32;        // zlib CRC-32 over the fingerprints
+        uint64_t seed;
+    };
+    static_assert(sizeof(FilterHeader) == 24, "FilterHeader must match server framing");
+
+    // Source for table images (HTTP stream or file): fills exactly `len`
+    // bytes at `dst` or returns false.
+    using ReadFn = std::function<bool(uint8_t *dst, size_t len)>;
+    // Sink for table images (file or flash slot): takes `len` bytes at `src`
+    using WriteFn = std::function<bool(const uint8_t *src, size_t len)>;
+
+    // Bytes read from the HTTP stream per iteration. Each piece goes straight
+    // into the CardSet builder, so this bounds the read buffer and the time
+    // spent per read call.
+    constexpr size_t STREAM_CHUNK = 512;
+}
@@ -0,0 +1,292 @@
+#include "SyncJson.h"
+#include "HashUtils.h"
+#include <cctype>
+#include <cstring>
+
+// SyncJsonReader
+// --------------
+// One state per position in the grammar of the reply; nested values of
+// members we do not use are skipped by counting brackets (strings inside
+// them are tracked so a quoted bracket does not count). Escapes are decoded
+// only as far as UIDs can use them.
+
+namespace {
+    bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+    int hexNibble(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    char unescape(char c) {
+        switch (c) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'b': return '\b';
+        case 'f': return '\f';
+        default:  return c;
+        }
+    }
+}
+
+bool SyncJsonReader::feed(const char *data, size_t len) {
+    if (state_ == FAILED) return false;
+    bytes_ += len;
+    for (size_t i = 0; i < len; ++i) {
+        if (!step(data[i])) {
+            state_ = FAILED;
+            builder_.reset();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SyncJsonReader::step(char c) {
+    switch (state_) {
+    case START:
+        if (isSpace(c)) return true;
+        if (c != '{') return false;
+        state_ = KEY_OR_END;
+        return true;
+
+    case KEY_OR_END:
+        if (isSpace(c)) return true;
+        if (c == '}') {
+            state_ = DONE;
+            return true;
+        }
+        if (c != '"') return false;
+        keyLen_ = 0;
+        escape_ = false;
+        state_ = KEY;
+        return true;
+
+    case KEY:
+        if (escape_) {
+            escape_ = false;
+        } else if (c == '\\') {
+            escape_ = true;
+            return true;
+        } else if (c == '"') {
+            // Keys longer than the buffer match nothing
+            key_[keyLen_ < sizeof(key_) ? keyLen_ : 0] = '\0';
+            field_ = strcmp(key_, "max_id") == 0 ? FIELD_MAX_ID
+                   : strcmp(key_, "bits") == 0 ? FIELD_BITS
+                   : (strcmp(key_, "allow") == 0 || strcmp(key_, "allow_uids") == 0) ? FIELD_ALLOW
+                   : (strcmp(key_, "deny") == 0 || strcmp(key_, "deny_uids") == 0) ? FIELD_DENY
+                   : FIELD_OTHER;
+            state_ = COLON;
+            return true;
+        }
+        if (keyLen_ < sizeof(key_) - 1) key_[keyLen_++] = c;
+        else keyLen_ = sizeof(key_);
+        return true;
+
+    case COLON:
+        if (isSpace(c)) return true;
+        if (c != ':') return false;
+        state_ = VALUE;
+        return true;
+
+    case VALUE:
+        if (isSpace(c)) return true;
+        return startValue(c);
+
+    case NUMBER:
+        if (c >= '0' && c <= '9') {
+            maxId_ = maxId_ > CardSet::MAX_ID ? maxId_ : maxId_ * 10 + (c - '0');
+            return true;
+        }
+        if (maxId_ > CardSet::MAX_ID) return false;
+        sawMaxId_ = true;
+        state_ = AFTER_VALUE;
+        return step(c);
+
+    case BITS:
+        if (c == '"') {
+            state_ = AFTER_VALUE;
+            return flushHex();
+        }
+        return hexChar(c);
+
+    case LIST:
+        if (isSpace(c) || c == ',') return true;
+        if (c == ']') {
+            state_ = AFTER_VALUE;
+            return true;
+        }
+        if (c == '"') {
+            uidLen_ = 0;
+            uidLong_ = false;
+            escape_ = false;
+            state_ = UID;
+            return true;
+        }
+        // Not a string: no UID, skip the element
+        skipValue(c, LIST);
+        return true;
+
+    case UID:
+        if (escape_) {
+            escape_ = false;
+            c = unescape(c);
+        } else if (c == '\\') {
+            escape_ = true;
+            return true;
+        } else if (c == '"') {
+            state_ = LIST;
+            return addUid();
+        }
+        if (uidLen_ < UID_MAX) uid_[uidLen_++] = c;
+        else uidLong_ = true;
+        return true;
+
+    case SKIP_STRING:
+        if (escape_) escape_ = false;
+        else if (c == '\\') escape_ = true;
+        else if (c == '"') state_ = nest_ ? SKIP_NESTED : skipReturn_;
+        return true;
+
+    case SKIP_NESTED:
+        if (c == '"') {
+            escape_ = false;
+            state_ = SKIP_STRING;
+        } else if (c == '{' || c == '[') {
+            ++nest_;
+        } else if ((c == '}' || c == ']') && --nest_ == 0) {
+            state_ = skipReturn_;
+        }
+        return true;
+
+    case SKIP_LITERAL:
+        if (isSpace(c) || c == ',' || c == '}' || c == ']') {
+            state_ = skipReturn_;
+            return step(c);
+        }
+        return true;
+
+    case AFTER_VALUE:
+        if (isSpace(c)) return true;
+        if (c == ',') {
+            state_ = KEY_OR_END;
+            return true;
+        }
+        if (c != '}') return false;
+        state_ = DONE;
+        return true;
+
+    case DONE:
+        return isSpace(c);
+
+    default:
+        return false;
+    }
+}
+
+bool SyncJsonReader::startValue(char c) {
+    if (c == ',' || c == '}' || c == ']' || c == ':') return false;
+    switch (field_) {
+    case FIELD_MAX_ID:
+        if (c < '0' || c > '9') break;
+        maxId_ = c - '0';
+        state_ = NUMBER;
+        return true;
+    case FIELD_BITS:
+        // A repeated "bits" member is skipped
+        if (c != '"' || started_) break;
+        span_ = sawMaxId_ ? maxId_ : CardSet::MAX_ID;
+        if (!builder_.begin(span_)) return false;
+        started_ = true;
+        hexHigh_ = -1;
+        hexDone_ = false;
+        state_ = BITS;
+        return true;
+    case FIELD_ALLOW:
+    case FIELD_DENY:
+        if (c != '[') break;
+        sawLists_ = true;
+        state_ = LIST;
+        return true;
+    default:
+        break;
+    }
+    skipValue(c, AFTER_VALUE);
+    return true;
+}
+
+void SyncJsonReader::skipValue(char c, State back) {
+    skipReturn_ = back;
+    nest_ = 0;
+    escape_ = false;
+    if (c == '"') {
+        state_ = SKIP_STRING;
+    } else if (c == '{' || c == '[') {
+        nest_ = 1;
+        state_ = SKIP_NESTED;
+    } else {
+        state_ = SKIP_LITERAL;
+    }
+}
+
+bool SyncJsonReader::hexChar(char c) {
+    // Like the old decoder: the bits end at the first non-hex character
+    if (hexDone_) return true;
+    const int nibble = hexNibble(c);
+    if (nibble < 0) {
+        hexDone_ = true;
+        return true;
+    }
+    if (hexHigh_ < 0) {
+        hexHigh_ = nibble;
+        return true;
+    }
+    hex_[hexLen_++] = static_cast<uint8_t>((hexHigh_ << 4) | nibble);
+    hexHigh_ = -1;
+    return hexLen_ < sizeof(hex_) || flushHex();
+}
+
+bool SyncJsonReader::flushHex() {
+    const bool ok = hexLen_ == 0 || builder_.append(hex_, hexLen_);
+    hexLen_ = 0;
+    return ok;
+}
+
+bool SyncJsonReader::addUid() {
+    if (uidLong_) {
+        ++skipped_;
+        return true;
+    }
+    // HashUtils::hashUid(): trim, uppercase, FNV-1a
+    size_t begin = 0;
+    size_t end = uidLen_;
+    while (begin < end && isspace(static_cast<unsigned char>(uid_[begin]))) ++begin;
+    while (end > begin && isspace(static_cast<unsigned char>(uid_[end - 1]))) --end;
+    for (size_t i = begin; i < end; ++i) uid_[i] = static_cast<char>(toupper(static_cast<unsigned char>(uid_[i])));
+    const uint64_t h = HashUtils::fnv1a64(uid_ + begin, end - begin);
+    FlatHashSet &set = field_ == FIELD_ALLOW ? allow_ : deny_;
+    // insert() is false for a duplicate too; a key still missing means the
+    // table could not grow
+    if (!set.insert(h) && !set.contains(h)) return false;
+    ++uids_;
+    return true;
+}
+
+bool SyncJsonReader::finish(CardSet &out) {
+    if (state_ != DONE) return false;
+    if (!started_) {
+        // No "bits": an empty set of that span
+        return builder_.begin(maxId_) && builder_.finish(out);
+    }
+    if (span_ == maxId_) return builder_.finish(out);
+    // "bits" came before "max_id": keep the chunks up to max_id
+    CardSet wide;
+    if (!builder_.finish(wide) || !builder_.begin(maxId_)) return false;
+    for (uint32_t c = 0; c <= (maxId_ >> 16); ++c) {
+        if (!builder_.copy(wide)) return false;
+    }
+    return builder_.finish(out);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+#include "CardSet.h"
+#include "FlatHashSet.h"
+
+// Incremental reader for the JSON `/api/sync` reply
+//   { "max_id": n, "bits": "<hex>", "allow": [uid, ...], "deny": [...] }
+// (`allow_uids` / `deny_uids` are accepted too). feed() takes the body in
+// pieces of any size as it comes off the socket. The hex bits go straight
+// into a CardSet::Builder, and each UID is normalized and hashed (as
+// HashUtils::hashUid) into the allow/deny set as its closing quote
+// arrives. Every other member is skipped without being stored, so memory
+// is the two sets plus a fixed state, however large the payload.
+//
+// Keys may come in any order. When "bits" precedes "max_id" (Flask sorts
+// keys) the set is built over CardSet::MAX_ID and re-spanned to max_id
+// chunk by chunk in finish().
+class SyncJsonReader {
+public:
+    // Longest UID string kept; longer ones are skipped and counted
+    static constexpr size_t UID_MAX = 64;
+
+    SyncJsonReader(FlatHashSet &allow, FlatHashSet &deny) : allow_(allow), deny_(deny) {}
+    SyncJsonReader(const SyncJsonReader&) = delete;
+    SyncJsonReader& operator=(const SyncJsonReader&) = delete;
+
+    // False on malformed JSON, an oversized max_id or without memory; the
+    // reader then stays failed
+    bool feed(const char *data, size_t len);
+    // After the last piece: the card set (empty when "bits" was missing).
+    // False unless the top-level object was complete.
+    bool finish(CardSet &out);
+
+    uint32_t maxId() const { return maxId_; }
+    // An allow or deny array was present (even an empty one)
+    bool sawLists() const { return sawLists_; }
+    size_t uids() const { return uids_; }
+    size_t skipped() const { return skipped_; }
+    size_t bytes() const { return bytes_; }
+
+private:
+    enum State : uint8_t {
+        START, KEY_OR_END, KEY, COLON, VALUE, NUMBER, BITS, LIST, UID,
+        SKIP_STRING, SKIP_NESTED, SKIP_LITERAL, AFTER_VALUE, DONE, FAILED
+    };
+    enum Field : uint8_t { FIELD_OTHER, FIELD_MAX_ID, FIELD_BITS, FIELD_ALLOW, FIELD_DENY };
+
+    FlatHashSet &allow_;
+    FlatHashSet &deny_;
+    CardSet::Builder builder_;
+    // Span the builder was started with (max_id, or MAX_ID before it)
+    uint32_t span_ = 0;
+    bool started_ = false;
+
+    State state_ = START;
+    // Where SKIP_* returns once the skipped value ends (AFTER_VALUE or LIST)
+    State skipReturn_ = AFTER_VALUE;
+    Field field_ = FIELD_OTHER;
+    uint32_t nest_ = 0;
+    bool escape_ = false;
+
+    char key_[12] = {};
+    uint8_t keyLen_ = 0;
+    char uid_[UID_MAX] = {};
+    size_t uidLen_ = 0;
+    bool uidLong_ = false;
+    // Hex bytes waiting for the builder, and a pending high nibble
+    uint8_t hex_[64] = {};
+    size_t hexLen_ = 0;
+    int hexHigh_ = -1;
+    bool hexDone_ = false;
+
+    uint32_t maxId_ = 0;
+    bool sawMaxId_ = false;
+    bool sawLists_ = false;
+    size_t uids_ = 0;
+    size_t skipped_ = 0;
+    size_t bytes_ = 0;
+
+    bool step(char c);
+    bool startValue(char c);
+    void skipValue(char c, State back);
+    bool hexChar(char c);
+    bool flushHex();
+    // False when the set is out of memory
+    bool addUid();
+};
@@ -0,0 +1,206 @@
+#include "TableStore.h"
+#include "HashUtils.h"
+#include "Latency.h"
+#include "Log.h"
+#include <algorithm>
+#include <cstring>
+
+// TableStore
+// ----------
+// Slots start on 64 KB boundaries because mappings do (MMU pages); erases
+// cover whole 4 KB sectors and only the part of the slot about to be used.
+// Sources may themselves live in the mapped old slot, and flash cannot be
+// programmed from flash, so every write goes through a RAM bounce buffer.
+
+namespace {
+    constexpr size_t MMAP_ALIGN = 64 * 1024;
+    constexpr size_t SECTOR_BYTES = 4096;
+    constexpr size_t SECTION_ALIGN = 16;
+
+    uint8_t bounce[1024];
+
+    size_t alignUp(size_t len, size_t to) { return (len + to - 1) & ~(to - 1); }
+
+    uint32_t headerCrc(const TableStore::SlotHeader &hdr) {
+        return HashUtils::crc32Update(0, reinterpret_cast<const uint8_t*>(&hdr), offsetof(TableStore::SlotHeader, crc32));
+    }
+}
+
+TableStore::~TableStore() {
+    unmap(previous_);
+    unmap(active_);
+}
+
+bool TableStore::begin() {
+    if (part_) return true;
+    part_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, static_cast<esp_partition_subtype_t>(PARTITION_SUBTYPE),
+                                     PARTITION_LABEL);
+    if (!part_) {
+        LOG_I("[TableStore] No '%s' partition; tables stay in LittleFS", PARTITION_LABEL);
+        return false;
+    }
+    slotBytes_ = (part_->size / 2) & ~(MMAP_ALIGN - 1);
+    if (slotBytes_ == 0) {
+        LOG_W("[TableStore] Partition of %u bytes is too small for two slots", static_cast<unsigned>(part_->size));
+        part_ = nullptr;
+        return false;
+    }
+
+    SlotHeader hdr[2];
+    const bool ok[2] = {readHeader(0, hdr[0]), readHeader(1, hdr[1])};
+    if (!ok[0] && !ok[1]) {
+        LOG_I("[TableStore] Partition empty (%u byte slots)", static_cast<unsigned>(slotBytes_));
+        return true;
+    }
+    // Sequence numbers only grow; the slot written last wins
+    const uint8_t best = (ok[0] && (!ok[1] || hdr[0].seq > hdr[1].seq)) ? 0 : 1;
+    if (!map(best, hdr[best], active_)) {
+        LOG_E("[TableStore] Failed to map slot %u", best);
+        return true;
+    }
+    LOG_I("[TableStore] Slot %u seq=%u mapped (%u bytes)", best, active_.header.seq,
+          static_cast<unsigned>(active_.header.used));
+    return true;
+}
+
+const uint8_t *TableStore::image(Table table, size_t &bytes) const {
+    bytes = 0;
+    if (!active_.base || table >= TABLE_COUNT) return nullptr;
+    const Section &s = active_.header.sections[table];
+    if (s.offset == 0) return nullptr;
+    bytes = s.bytes;
+    return active_.base + s.offset;
+}
+
+const char *TableStore::etag(Table table) const {
+    if (!active_.base || table >= TABLE_COUNT) return "";
+    return active_.header.sections[table].etag;
+}
+
+bool TableStore::readHeader(uint8_t slot, SlotHeader &out) const {
+    if (esp_partition_read(part_, slot * slotBytes_, &out, sizeof(out)) != ESP_OK) return false;
+    if (out.magic != MAGIC || out.crc32 != headerCrc(out) || out.used > slotBytes_) return false;
+    for (const Section &s : out.sections) {
+        if (s.offset == 0) continue;
+        if (s.offset < SECTOR_BYTES || s.offset % SECTION_ALIGN || s.bytes > out.used - s.offset) return false;
+    }
+    return true;
+}
+
+bool TableStore::map(uint8_t slot, const SlotHeader &header, Mapping &out) const {
+    const void *ptr = nullptr;
+    spi_flash_mmap_handle_t handle = 0;
+    if (esp_partition_mmap(part_, slot * slotBytes_, alignUp(header.used, MMAP_ALIGN), SPI_FLASH_MMAP_DATA, &ptr,
+                           &handle) != ESP_OK) {
+        return false;
+    }
+    out.base = static_cast<const uint8_t*>(ptr);
+    out.handle = handle;
+    out.slot = slot;
+    out.header = header;
+    return true;
+}
+
+void TableStore::unmap(Mapping &m) {
+    if (m.base) spi_flash_munmap(m.handle);
+    m = Mapping{};
+}
+
+void TableStore::releasePrevious() {
+    unmap(previous_);
+}
+
+bool TableStore::writeSection(size_t at, const Source &source, Section &section) {
+    size_t pos = at;
+    size_t fill = 0;
+    size_t total = 0;
+    uint32_t crc = 0;
+    auto flush = [&]() {
+        if (fill == 0) return true;
+        const bool ok = esp_partition_write(part_, pos, bounce, fill) == ESP_OK;
+        Latency::flashWrite(fill);
+        pos += fill;
+        fill = 0;
+        return ok;
+    };
+    const SyncFormat::WriteFn out = [&](const uint8_t *src, size_t len) {
+        if (len > section.bytes - total) return false;
+        crc = HashUtils::crc32Update(crc, src, len);
+        total += len;
+        while (len) {
+            const size_t n = std::min(len, sizeof(bounce) - fill);
+            memcpy(bounce + fill, src, n);
+            fill += n;
+            src += n;
+            len -= n;
+            if (fill == sizeof(bounce) && !flush()) return false;
+        }
+        return true;
+    };
+    if (!source.write(out) || !flush() || total != section.bytes) return false;
+    section.crc32 = crc;
+    return true;
+}
+
+bool TableStore::commit(const Source (&sources)[TABLE_COUNT]) {
+    if (!part_) return false;
+    if (previous_.base) {
+        // Tables may still be attached to the slot we would overwrite
+        LOG_E("[TableStore] Previous slot still mapped; commit refused");
+        ++failures_;
+        return false;
+    }
+    const uint8_t target = active_.base ? 1 - active_.slot : 0;
+    const size_t base = target * slotBytes_;
+
+    SlotHeader hdr{};
+    hdr.magic = MAGIC;
+    hdr.seq = seq() + 1;
+    size_t at = SECTOR_BYTES;
+    for (size_t t = 0; t < TABLE_COUNT; ++t) {
+        Section &s = hdr.sections[t];
+        if (sources[t].bytes == 0) continue;
+        s.offset = at;
+        s.bytes = sources[t].bytes;
+        strncpy(s.etag, sources[t].etag ? sources[t].etag : "", ETAG_MAX);
+        at = alignUp(at + sources[t].bytes, SECTION_ALIGN);
+    }
+    hdr.used = at;
+    if (at > slotBytes_) {
+        LOG_W("[TableStore] Tables need %u bytes, slot holds %u", static_cast<unsigned>(at),
+              static_cast<unsigned>(slotBytes_));
+        ++failures_;
+        return false;
+    }
+
+    // The erase takes the old header with it: from here the slot is invalid
+    // until the new header lands
+    bool ok = esp_partition_erase_range(part_, base, alignUp(at, SECTOR_BYTES)) == ESP_OK;
+    for (size_t t = 0; ok && t < TABLE_COUNT; ++t) {
+        Section &s = hdr.sections[t];
+        if (s.offset) ok = writeSection(base + s.offset, sources[t], s);
+    }
+    Mapping fresh;
+    ok = ok && map(target, hdr, fresh);
+    for (size_t t = 0; ok && t < TABLE_COUNT; ++t) {
+        const Section &s = hdr.sections[t];
+        if (s.offset) ok = HashUtils::crc32Update(0, fresh.base + s.offset, s.bytes) == s.crc32;
+    }
+    if (ok) {
+        hdr.crc32 = headerCrc(hdr);
+        ok = esp_partition_write(part_, base, &hdr, sizeof(hdr)) == ESP_OK;
+        Latency::flashWrite(sizeof(hdr));
+    }
+    if (!ok) {
+        LOG_E("[TableStore] Commit to slot %u failed; keeping seq=%u", target, seq());
+        unmap(fresh);
+        ++failures_;
+        return false;
+    }
+    fresh.header = hdr;
+    previous_ = active_;
+    active_ = fresh;
+    ++commits_;
+    LOG_I("[TableStore] Committed slot %u seq=%u (%u bytes)", target, hdr.seq, static_cast<unsigned>(hdr.used));
+    return true;
+}
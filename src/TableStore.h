@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+#include "SyncFormat.h"
+
+// Read-only table images (card set, uid index, xor filter) kept in the
+// `authdb` data partition and used in place through esp_partition_mmap and
+// the flash cache, so neither boot nor lookups copy them into RAM.
+//
+// The partition holds two A/B slots. A slot is a header sector (SlotHeader)
+// followed by the images, each 16-byte aligned. commit() erases and fills
+// the inactive slot while scans keep reading the active one, checks every
+// section through a fresh mapping, then writes the header last: that one
+// write flips the store to the new slot. A commit cut short leaves a slot
+// without a valid header, so begin() keeps using the other one. Boot costs
+// two header reads and a mapping; section CRCs are verified when written.
+//
+// One writer (the task running syncs). Flash writes stall both cores while
+// they run, lookups included, as LittleFS writes always did.
+class TableStore {
+public:
+    enum Table : uint8_t { TABLE_CARDS = 0, TABLE_INDEX = 1, TABLE_FILTER = 2, TABLE_COUNT = 3 };
+
+    static constexpr uint32_t MAGIC = 0x31544252UL; // "RBT1"
+    static constexpr uint8_t PARTITION_SUBTYPE = 0x40;
+    static constexpr const char *PARTITION_LABEL = "authdb";
+    static constexpr size_t ETAG_MAX = 47;
+
+    struct __attribute__((packed)) Section {
+        uint32_t offset;   // from the slot start; 0 when the table is absent
+        uint32_t bytes;
+        uint32_t crc32;    // zlib CRC-32 over the image
+        char etag[ETAG_MAX + 1];
+    };
+    static_assert(sizeof(Section) == 60, "TableStore::Section is the flash layout");
+
+    struct __attribute__((packed)) SlotHeader {
+        uint32_t magic;
+        uint32_t seq;      // the valid slot with the higher seq is active
+        uint32_t used;     // slot bytes including this header sector
+        Section sections[TABLE_COUNT];
+        uint32_t crc32;    // over the bytes above
+    };
+    static_assert(sizeof(SlotHeader) == 196, "TableStore::SlotHeader is the flash layout");
+
+    // One table of a commit: `bytes` image bytes emitted by `write` (0 and
+    // no writer when absent)
+    struct Source {
+        size_t bytes = 0;
+        std::function<bool(const SyncFormat::WriteFn &out)> write;
+        const char *etag = "";
+    };
+
+    TableStore() = default;
+    ~TableStore();
+    TableStore(const TableStore&) = delete;
+    TableStore& operator=(const TableStore&) = delete;
+
+    // Find the partition and map the newest valid slot. False without a
+    // partition (the tables then live in LittleFS).
+    bool begin();
+    bool ready() const { return part_ != nullptr; }
+
+    // Image of `table` in the active slot (nullptr when absent); valid
+    // until the next commit() plus releasePrevious()
+    const uint8_t *image(Table table, size_t &bytes) const;
+    const char *etag(Table table) const;
+
+    // Write all tables to the inactive slot and flip to it. The old slot
+    // stays mapped until releasePrevious(), so tables still attached to it
+    // can be moved over first. Fails (active slot unchanged) when the
+    // images do not fit, on a flash error or a verify mismatch.
+    bool commit(const Source (&sources)[TABLE_COUNT]);
+    void releasePrevious();
+
+    uint32_t seq() const { return active_.base ? active_.header.seq : 0; }
+    uint8_t slot() const { return active_.slot; }
+    size_t usedBytes() const { return active_.base ? active_.header.used : 0; }
+    size_t slotBytes() const { return slotBytes_; }
+    uint32_t commits() const { return commits_; }
+    uint32_t failures() const { return failures_; }
+
+private:
+    struct Mapping {
+        const uint8_t *base = nullptr;
+        spi_flash_mmap_handle_t handle = 0;
+        uint8_t slot = 0;
+        SlotHeader header{};
+    };
+
+    const esp_partition_t *part_ = nullptr;
+    size_t slotBytes_ = 0;
+    Mapping active_;
+    Mapping previous_;
+    uint32_t commits_ = 0;
+    uint32_t failures_ = 0;
+
+    bool readHeader(uint8_t slot, SlotHeader &out) const;
+    bool map(uint8_t slot, const SlotHeader &header, Mapping &out) const;
+    static void unmap(Mapping &m);
+    // Stream one source into the slot at `at`; fills in the section CRC
+    bool writeSection(size_t at, const Source &source, Section &section);
+};
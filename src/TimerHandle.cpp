@@ -2,17 +2,9 @@
 #include <freertos/FreeRTOS.h>
 
 
-TimerHandle_t serverCheckTimer = nullptr;
 TimerHandle_t authSyncTimer = nullptr;
 TimerHandle_t displayTimer = nullptr;
 
-bool createServerCheckTimer(TimerCallbackFunction_t callback, TickType_t periodTicks) {
-    if (serverCheckTimer != nullptr) return true;
-    serverCheckTimer = xTimerCreate("ServerCheck", periodTicks, pdTRUE, nullptr, callback);
-    if (!serverCheckTimer) return false;
-    return xTimerStart(serverCheckTimer, 0) == pdPASS;
-}
-
 bool createAuthSyncTimer(TimerCallbackFunction_t callback, TickType_t periodTicks) {
     if (authSyncTimer != nullptr) return true;
     authSyncTimer = xTimerCreate("AuthSync", periodTicks, pdTRUE, nullptr, callback);
@@ -27,13 +19,6 @@ bool createDisplayTimer(TimerCallbackFunction_t callback, TickType_t periodTicks
     return xTimerStart(displayTimer, 0) == pdPASS;
 }
 
-void deleteServerCheckTimer() {
-    if (serverCheckTimer) {
-        xTimerStop(serverCheckTimer, 0);
-        xTimerDelete(serverCheckTimer, 0);
-        serverCheckTimer = nullptr;
-    }
-}
 void deleteAuthSyncTimer() {
     if (authSyncTimer) {
         xTimerStop(authSyncTimer, 0);
@@ -9,7 +9,6 @@
 // The timers themselves are defined in Timers.cpp; include this header from
 // modules that need to create or reference the timers.
 
-extern TimerHandle_t serverCheckTimer;
 extern TimerHandle_t authSyncTimer;
 extern TimerHandle_t displayTimer;
 
@@ -17,12 +16,10 @@ extern TimerHandle_t displayTimer;
 // functions defined in main.cpp). `periodTicks` is the timer period in RTOS
 // ticks (use pdMS_TO_TICKS(ms) when calling).
 
-bool createServerCheckTimer(TimerCallbackFunction_t callback, TickType_t periodTicks);
 bool createAuthSyncTimer(TimerCallbackFunction_t callback, TickType_t periodTicks);
 bool createDisplayTimer(TimerCallbackFunction_t callback, TickType_t periodTicks);
 
 // Stop and delete helpers (optional)
-void deleteServerCheckTimer();
 void deleteAuthSyncTimer();
 void deleteDisplayTimer();
 
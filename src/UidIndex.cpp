@@ -0,0 +1,185 @@
+#include "UidIndex.h"
+#include "HashUtils.h"
+#include "Log.h"
+#include "SyncFormat.h"
+#include <algorithm>
+#include <LittleFS.h>
+#include <cstring>
+#include <esp_heap_caps.h>
+
+// UidIndex
+// --------
+// Storage comes from PSRAM when the board has it, otherwise from internal
+// heap as long as HEAP_RESERVE stays free for WiFi/HTTP. Sites whose index
+// does not fit simply run without it (lookups fall through to the caches).
+
+namespace {
+    const char *INDEX_FILE = "/uid_index.bin";
+    const char *INDEX_TMP  = "/uid_index.bin.tmp";
+
+    void *allocTable(size_t bytes) {
+        if (bytes == 0) return nullptr;
+        void *p = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+        if (p) return p;
+        if (heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) < bytes + UidIndex::HEAP_RESERVE) {
+            return nullptr;
+        }
+        return heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+    }
+}
+
+UidIndex::~UidIndex() {
+    clear();
+}
+
+void UidIndex::clear() {
+    if (owned_) release(hashes_, ids_);
+    hashes_ = nullptr;
+    ids_ = nullptr;
+    count_ = 0;
+    crc_ = 0;
+    owned_ = true;
+}
+
+void UidIndex::swap(UidIndex &other) noexcept {
+    std::swap(hashes_, other.hashes_);
+    std::swap(ids_, other.ids_);
+    std::swap(count_, other.count_);
+    std::swap(crc_, other.crc_);
+    std::swap(owned_, other.owned_);
+}
+
+bool UidIndex::find(uint64_t hash, uint32_t &cardId) const {
+    if (count_ == 0) return false;
+    const uint64_t *end = hashes_ + count_;
+    const uint64_t *it = std::lower_bound(static_cast<const uint64_t*>(hashes_), end, hash);
+    if (it == end || *it != hash) return false;
+    cardId = ids_[it - hashes_];
+    return true;
+}
+
+bool UidIndex::allocate(size_t count, uint64_t *&hashes, uint32_t *&ids) const {
+    hashes = static_cast<uint64_t*>(allocTable(count * sizeof(uint64_t)));
+    ids = static_cast<uint32_t*>(allocTable(count * sizeof(uint32_t)));
+    if (!hashes || !ids) {
+        release(hashes, ids);
+        hashes = nullptr;
+        ids = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void UidIndex::release(uint64_t *hashes, uint32_t *ids) {
+    if (hashes) heap_caps_free(hashes);
+    if (ids) heap_caps_free(ids);
+}
+
+void UidIndex::adopt(uint64_t *hashes, uint32_t *ids, size_t count, uint32_t crc) {
+    clear();
+    hashes_ = hashes;
+    ids_ = ids;
+    count_ = count;
+    crc_ = crc;
+}
+
+bool UidIndex::attach(const uint8_t *image, size_t bytes) {
+    SyncFormat::IndexHeader hdr{};
+    if (!image || bytes < sizeof(hdr)) return false;
+    memcpy(&hdr, image, sizeof(hdr));
+    if (hdr.magic != SyncFormat::INDEX_MAGIC || hdr.count > MAX_ENTRIES ||
+        bytes != sizeof(hdr) + hdr.count * (sizeof(uint64_t) + sizeof(uint32_t)) ||
+        reinterpret_cast<uintptr_t>(image) % alignof(uint64_t)) {
+        LOG_W("[UidIndex] Bad index image");
+        return false;
+    }
+    clear();
+    if (hdr.count == 0) return true;
+    // Read-only from here on; the casts only fit the owned-array members
+    hashes_ = reinterpret_cast<uint64_t*>(const_cast<uint8_t*>(image + sizeof(hdr)));
+    ids_ = reinterpret_cast<uint32_t*>(hashes_ + hdr.count);
+    count_ = hdr.count;
+    crc_ = hdr.crc32;
+    owned_ = false;
+    return true;
+}
+
+bool UidIndex::writeImage(const WriteFn &out) const {
+    const SyncFormat::IndexHeader hdr{SyncFormat::INDEX_MAGIC, static_cast<uint32_t>(count_), crc_, 0};
+    if (!out(reinterpret_cast<const uint8_t*>(&hdr), sizeof(hdr))) return false;
+    return count_ == 0 || (out(reinterpret_cast<const uint8_t*>(hashes_), count_ * sizeof(uint64_t)) &&
+                           out(reinterpret_cast<const uint8_t*>(ids_), count_ * sizeof(uint32_t)));
+}
+
+bool UidIndex::load(const ReadFn &readFn) {
+    SyncFormat::IndexHeader hdr{};
+    if (!readFn(reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr))) return false;
+    if (hdr.magic != SyncFormat::INDEX_MAGIC) {
+        LOG_W("[UidIndex] Bad index header");
+        return false;
+    }
+    if (hdr.count == 0) {
+        clear();
+        return true;
+    }
+    if (hdr.count > MAX_ENTRIES) {
+        LOG_W("[UidIndex] Index too large (%u entries)", hdr.count);
+        return false;
+    }
+
+    uint64_t *hashes = nullptr;
+    uint32_t *ids = nullptr;
+    if (!allocate(hdr.count, hashes, ids)) {
+        LOG_E("[UidIndex] No memory for %u entries; index disabled", hdr.count);
+        clear();
+        return false;
+    }
+    const size_t hashBytes = hdr.count * sizeof(uint64_t);
+    const size_t idBytes = hdr.count * sizeof(uint32_t);
+    bool ok = readFn(reinterpret_cast<uint8_t*>(hashes), hashBytes) &&
+              readFn(reinterpret_cast<uint8_t*>(ids), idBytes);
+    if (ok) {
+        uint32_t crc = HashUtils::crc32Update(0, reinterpret_cast<const uint8_t*>(hashes), hashBytes);
+        crc = HashUtils::crc32Update(crc, reinterpret_cast<const uint8_t*>(ids), idBytes);
+        ok = crc == hdr.crc32;
+    }
+    if (!ok) {
+        LOG_W("[UidIndex] Index image truncated or CRC mismatch");
+        release(hashes, ids);
+        return false;
+    }
+    adopt(hashes, ids, hdr.count, hdr.crc32);
+    return true;
+}
+
+bool UidIndex::saveToFS() const {
+    if (!LittleFS.begin()) return false;
+    File f = LittleFS.open(INDEX_TMP, FILE_WRITE);
+    if (!f) return false;
+    const bool ok = writeImage([&f](const uint8_t *src, size_t len) { return f.write(src, len) == len; });
+    f.close();
+    if (!ok) {
+        LittleFS.remove(INDEX_TMP);
+        return false;
+    }
+    LittleFS.remove(INDEX_FILE);
+    if (!LittleFS.rename(INDEX_TMP, INDEX_FILE)) {
+        LittleFS.remove(INDEX_TMP);
+        return false;
+    }
+    return true;
+}
+
+bool UidIndex::loadFromFS() {
+    if (!LittleFS.begin() || !LittleFS.exists(INDEX_FILE)) return false;
+    File f = LittleFS.open(INDEX_FILE, FILE_READ);
+    if (!f) return false;
+    const bool ok = load([&f](uint8_t *dst, size_t len) { return f.read(dst, len) == len; });
+    f.close();
+    if (ok) LOG_I("[UidIndex] Loaded %u entries from FS", static_cast<unsigned>(count_));
+    return ok;
+}
+
+void UidIndex::removeFromFS() {
+    if (LittleFS.begin() && LittleFS.exists(INDEX_FILE)) LittleFS.remove(INDEX_FILE);
+}
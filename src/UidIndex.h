@@ -0,0 +1,70 @@
+#pragma once
+
+#include <FS.h>
+#include "SyncFormat.h"
+
+// Sorted uid_hash -> card_id table delivered by `/api/sync/index`.
+// Lets AuthSync map a scanned UID to its bit in the synced bitset without
+// asking the server. Hashes and ids are kept in two parallel arrays so the
+// binary search only touches the 8-byte hash array.
+class UidIndex {
+public:
+    UidIndex() = default;
+    ~UidIndex();
+    UidIndex(const UidIndex &) = delete;
+    UidIndex &operator=(const UidIndex &) = delete;
+
+    // Look up a UID hash; true and sets cardId when present
+    bool find(uint64_t hash, uint32_t &cardId) const;
+
+    size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    // Heap bytes; an attached image costs none
+    size_t memoryBytes() const { return owned_ ? arrayBytes() : 0; }
+    // Arrays live in a mapped flash image rather than the heap
+    bool mapped() const { return count_ && !owned_; }
+
+    using ReadFn = SyncFormat::ReadFn;
+    using WriteFn = SyncFormat::WriteFn;
+
+    // Read an index image (SyncFormat::IndexHeader + arrays) from a source.
+    // The table is swapped in only if the image is complete and the CRC
+    // matches; on failure the current table is kept.
+    bool load(const ReadFn &readFn);
+
+    // Use an image (same layout) in place, e.g. in mapped flash. It must
+    // stay readable and 8-byte aligned until the index is cleared; its CRC
+    // is the writer's business.
+    bool attach(const uint8_t *image, size_t bytes);
+
+    // Emit the image (header and arrays)
+    size_t imageBytes() const { return sizeof(SyncFormat::IndexHeader) + arrayBytes(); }
+    bool writeImage(const WriteFn &out) const;
+
+    // Persist/load the `/uid_index.bin` snapshot (same layout as the wire)
+    bool saveToFS() const;
+    bool loadFromFS();
+    static void removeFromFS();
+
+    void clear();
+    // Exchange tables (publish a table loaded off to the side)
+    void swap(UidIndex &other) noexcept;
+
+    // Reject images that would leave less than this much internal heap
+    static constexpr size_t HEAP_RESERVE = 32 * 1024;
+    // Upper bound on entries accepted from the wire (guards size math)
+    static constexpr size_t MAX_ENTRIES = 4UL * 1024 * 1024;
+
+private:
+    uint64_t *hashes_ = nullptr;
+    uint32_t *ids_ = nullptr;
+    size_t count_ = 0;
+    uint32_t crc_ = 0;
+    bool owned_ = true;
+
+    size_t arrayBytes() const { return count_ * (sizeof(uint64_t) + sizeof(uint32_t)); }
+
+    bool allocate(size_t count, uint64_t *&hashes, uint32_t *&ids) const;
+    static void release(uint64_t *hashes, uint32_t *ids);
+    void adopt(uint64_t *hashes, uint32_t *ids, size_t count, uint32_t crc);
+};
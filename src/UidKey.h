@@ -0,0 +1,97 @@
+#pragma once
+
+#include "HashUtils.h"
+
+// Card UID as the reader returned it: up to 10 raw bytes (ISO 14443 triple
+// size) plus their count. A trivially copyable 11-byte value passed by value
+// from the reader through authorization, server lookups and the scan log,
+// so a scan needs no heap String.
+//
+// The text form is uppercase hex without separators (what the server
+// stores). hash() is FNV-1a 64 over that text, equal to
+// HashUtils::hashUid() and compute_uid_hash() in lib/server.py, but fed
+// from the raw bytes through a nibble table without building the text.
+struct UidKey {
+    static constexpr size_t MAX_BYTES = 10;
+    // Longest text form, without the terminating NUL
+    static constexpr size_t HEX_CHARS = MAX_BYTES * 2;
+    static constexpr char HEX_DIGITS[17] = "0123456789ABCDEF";
+
+    uint8_t len = 0;
+    uint8_t bytes[MAX_BYTES] = {};
+
+    constexpr UidKey() = default;
+    // Longer inputs are cut at MAX_BYTES
+    constexpr UidKey(const uint8_t *data, size_t n) : len(n < MAX_BYTES ? n : MAX_BYTES) {
+        for (size_t i = 0; i < len; ++i) bytes[i] = data[i];
+    }
+
+    // Parse hex text, surrounding whitespace ignored, any case. Returns an
+    // empty key for anything that is not 1..MAX_BYTES whole bytes of hex.
+    static constexpr UidKey fromHex(const char *text) {
+        UidKey key;
+        if (!text) return key;
+        while (*text == ' ' || *text == '\t' || *text == '\r' || *text == '\n') ++text;
+        size_t n = 0;
+        while (isHexDigit(text[n])) ++n;
+        for (size_t i = n; text[i]; ++i) {
+            if (text[i] != ' ' && text[i] != '\t' && text[i] != '\r' && text[i] != '\n') return UidKey();
+        }
+        if (n == 0 || n % 2 || n > HEX_CHARS) return key;
+        key.len = static_cast<uint8_t>(n / 2);
+        for (size_t i = 0; i < key.len; ++i) {
+            key.bytes[i] = static_cast<uint8_t>(nibble(text[2 * i]) << 4 | nibble(text[2 * i + 1]));
+        }
+        return key;
+    }
+
+    constexpr bool empty() const { return len == 0; }
+
+    constexpr uint64_t hash() const {
+        uint64_t h = HashUtils::FNV_OFFSET;
+        for (size_t i = 0; i < len; ++i) {
+            h = HashUtils::fnv1a64Step(h, HEX_DIGITS[bytes[i] >> 4]);
+            h = HashUtils::fnv1a64Step(h, HEX_DIGITS[bytes[i] & 0x0F]);
+        }
+        return h;
+    }
+
+    // Text form into `out` (at least HEX_CHARS + 1 bytes), NUL-terminated;
+    // returns the number of characters.
+    size_t toHex(char *out) const {
+        for (size_t i = 0; i < len; ++i) {
+            out[2 * i] = HEX_DIGITS[bytes[i] >> 4];
+            out[2 * i + 1] = HEX_DIGITS[bytes[i] & 0x0F];
+        }
+        out[2 * len] = '\0';
+        return 2 * len;
+    }
+
+    // Allocates: for URLs and JSON off the scan path
+    String toString() const {
+        char text[HEX_CHARS + 1];
+        toHex(text);
+        return String(text);
+    }
+
+    constexpr bool operator==(const UidKey &o) const {
+        if (len != o.len) return false;
+        for (size_t i = 0; i < len; ++i) {
+            if (bytes[i] != o.bytes[i]) return false;
+        }
+        return true;
+    }
+    constexpr bool operator!=(const UidKey &o) const { return !(*this == o); }
+
+private:
+    static constexpr bool isHexDigit(char c) {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+    }
+    static constexpr uint8_t nibble(char c) {
+        return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+    }
+};
+
+// Same hash as the server for the same card (lib/server.py compute_uid_hash)
+static_assert(UidKey::fromHex("04a1b2c3d4e5f6").hash() == 0x7D404A564FFDDC8BULL, "UidKey hash matches server");
+static_assert(sizeof(UidKey) == 11, "UidKey stays a small value type");
@@ -0,0 +1,165 @@
+#include "XorFilter.h"
+#include "HashUtils.h"
+#include "Log.h"
+#include <LittleFS.h>
+#include <cstring>
+#include <esp_heap_caps.h>
+#include <utility>
+
+// XorFilter
+// ---------
+// Lookup is three byte reads and a compare. The hash layout must stay in
+// lock-step with `_xor_mix`/`_xor_slots` in lib/server.py.
+
+namespace {
+    const char *FILTER_FILE = "/filter.bin";
+    const char *FILTER_TMP  = "/filter.bin.tmp";
+    // Keep this much internal heap free when PSRAM is not available
+    constexpr size_t HEAP_RESERVE = 32 * 1024;
+    // Guards size math for images from the wire (~40M keys)
+    constexpr uint32_t MAX_BLOCK_LENGTH = 16UL * 1024 * 1024;
+
+    // murmur3 64-bit finalizer
+    inline uint64_t mix64(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    inline uint64_t rotl64(uint64_t x, unsigned r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    // Map a 32-bit value onto [0, n) without a division
+    inline uint32_t reduce(uint32_t x, uint32_t n) {
+        return static_cast<uint32_t>((static_cast<uint64_t>(x) * n) >> 32);
+    }
+}
+
+XorFilter::~XorFilter() {
+    clear();
+}
+
+void XorFilter::clear() {
+    if (fingerprints_ && owned_) heap_caps_free(fingerprints_);
+    fingerprints_ = nullptr;
+    block_length_ = 0;
+    count_ = 0;
+    crc_ = 0;
+    seed_ = 0;
+    owned_ = true;
+}
+
+void XorFilter::swap(XorFilter &other) noexcept {
+    std::swap(fingerprints_, other.fingerprints_);
+    std::swap(block_length_, other.block_length_);
+    std::swap(count_, other.count_);
+    std::swap(crc_, other.crc_);
+    std::swap(seed_, other.seed_);
+    std::swap(owned_, other.owned_);
+}
+
+bool XorFilter::mayContain(uint64_t key) const {
+    if (!fingerprints_) return true;
+    const uint64_t h = mix64(key + seed_);
+    const uint8_t f = static_cast<uint8_t>(h ^ (h >> 32));
+    const uint32_t h0 = reduce(static_cast<uint32_t>(h), block_length_);
+    const uint32_t h1 = reduce(static_cast<uint32_t>(rotl64(h, 21)), block_length_) + block_length_;
+    const uint32_t h2 = reduce(static_cast<uint32_t>(rotl64(h, 42)), block_length_) + 2 * block_length_;
+    return f == (fingerprints_[h0] ^ fingerprints_[h1] ^ fingerprints_[h2]);
+}
+
+bool XorFilter::load(const SyncFormat::ReadFn &readFn) {
+    SyncFormat::FilterHeader hdr{};
+    if (!readFn(reinterpret_cast<uint8_t*>(&hdr), sizeof(hdr))) return false;
+    if (hdr.magic != SyncFormat::FILTER_MAGIC || hdr.block_length == 0 ||
+        hdr.block_length > MAX_BLOCK_LENGTH) {
+        LOG_W("[XorFilter] Bad filter header");
+        return false;
+    }
+    const size_t bytes = 3 * static_cast<size_t>(hdr.block_length);
+    auto *fps = static_cast<uint8_t*>(heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM));
+    if (!fps && heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) >= bytes + HEAP_RESERVE) {
+        fps = static_cast<uint8_t*>(heap_caps_malloc(bytes, MALLOC_CAP_8BIT));
+    }
+    if (!fps) {
+        // Without memory no filter is better than a stale one
+        LOG_E("[XorFilter] No memory for %u bytes; filter disabled", static_cast<unsigned>(bytes));
+        clear();
+        return false;
+    }
+    if (!readFn(fps, bytes) || HashUtils::crc32Update(0, fps, bytes) != hdr.crc32) {
+        LOG_W("[XorFilter] Filter image truncated or CRC mismatch");
+        heap_caps_free(fps);
+        return false;
+    }
+    clear();
+    fingerprints_ = fps;
+    block_length_ = hdr.block_length;
+    count_ = hdr.count;
+    crc_ = hdr.crc32;
+    seed_ = hdr.seed;
+    return true;
+}
+
+bool XorFilter::attach(const uint8_t *image, size_t bytes) {
+    SyncFormat::FilterHeader hdr{};
+    if (!image || bytes < sizeof(hdr)) return false;
+    memcpy(&hdr, image, sizeof(hdr));
+    if (hdr.magic != SyncFormat::FILTER_MAGIC || hdr.block_length == 0 ||
+        hdr.block_length > MAX_BLOCK_LENGTH || bytes != sizeof(hdr) + 3 * static_cast<size_t>(hdr.block_length)) {
+        LOG_W("[XorFilter] Bad filter image");
+        return false;
+    }
+    clear();
+    // Read-only from here on; the cast only fits the owned-array member
+    fingerprints_ = const_cast<uint8_t*>(image + sizeof(hdr));
+    block_length_ = hdr.block_length;
+    count_ = hdr.count;
+    crc_ = hdr.crc32;
+    seed_ = hdr.seed;
+    owned_ = false;
+    return true;
+}
+
+bool XorFilter::writeImage(const SyncFormat::WriteFn &out) const {
+    if (!fingerprints_) return false;
+    const SyncFormat::FilterHeader hdr{SyncFormat::FILTER_MAGIC, count_, block_length_, crc_, seed_};
+    return out(reinterpret_cast<const uint8_t*>(&hdr), sizeof(hdr)) &&
+           out(fingerprints_, 3 * static_cast<size_t>(block_length_));
+}
+
+bool XorFilter::saveToFS() const {
+    if (!fingerprints_ || !LittleFS.begin()) return false;
+    File f = LittleFS.open(FILTER_TMP, FILE_WRITE);
+    if (!f) return false;
+    const bool ok = writeImage([&f](const uint8_t *src, size_t len) { return f.write(src, len) == len; });
+    f.close();
+    if (!ok) {
+        LittleFS.remove(FILTER_TMP);
+        return false;
+    }
+    LittleFS.remove(FILTER_FILE);
+    if (!LittleFS.rename(FILTER_TMP, FILTER_FILE)) {
+        LittleFS.remove(FILTER_TMP);
+        return false;
+    }
+    return true;
+}
+
+bool XorFilter::loadFromFS() {
+    if (!LittleFS.begin() || !LittleFS.exists(FILTER_FILE)) return false;
+    File f = LittleFS.open(FILTER_FILE, FILE_READ);
+    if (!f) return false;
+    const bool ok = load([&f](uint8_t *dst, size_t len) { return f.read(dst, len) == len; });
+    f.close();
+    if (ok) LOG_I("[XorFilter] Loaded filter for %u keys from FS", static_cast<unsigned>(count_));
+    return ok;
+}
+
+void XorFilter::removeFromFS() {
+    if (LittleFS.begin() && LittleFS.exists(FILTER_FILE)) LittleFS.remove(FILTER_FILE);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <FS.h>
+#include "SyncFormat.h"
+
+// Xor filter (8-bit fingerprints, ~9.8 bits per key) over the uid_hash of
+// every card the server knows. Built server-side (`build_xor8` in
+// lib/server.py) and delivered by `/api/sync/filter`.
+//
+// mayContain() == false is definite: the card is unknown to the server as of
+// the last sync. true means "probably known" (~0.4% false positives), so the
+// exact structures still decide.
+class XorFilter {
+public:
+    XorFilter() = default;
+    ~XorFilter();
+    XorFilter(const XorFilter &) = delete;
+    XorFilter &operator=(const XorFilter &) = delete;
+
+    // Without a loaded filter every key "may" be present
+    bool mayContain(uint64_t key) const;
+
+    bool loaded() const { return fingerprints_ != nullptr; }
+    size_t keyCount() const { return count_; }
+    // Heap bytes; an attached image costs none
+    size_t memoryBytes() const { return fingerprints_ && owned_ ? 3 * block_length_ : 0; }
+    size_t imageBytes() const {
+        return fingerprints_ ? sizeof(SyncFormat::FilterHeader) + 3 * static_cast<size_t>(block_length_) : 0;
+    }
+    bool mapped() const { return fingerprints_ && !owned_; }
+
+    // Read a filter image (SyncFormat::FilterHeader + fingerprints). Swapped
+    // in only when complete and the CRC matches.
+    bool load(const SyncFormat::ReadFn &readFn);
+
+    // Use an image (same layout) in place, e.g. in mapped flash; it must
+    // stay readable until the filter is cleared. The CRC is not re-checked.
+    bool attach(const uint8_t *image, size_t bytes);
+    bool writeImage(const SyncFormat::WriteFn &out) const;
+
+    // Persist/load `/filter.bin` (same layout as the wire)
+    bool saveToFS() const;
+    bool loadFromFS();
+    static void removeFromFS();
+
+    void clear();
+    // Exchange filters (publish a filter loaded off to the side)
+    void swap(XorFilter &other) noexcept;
+
+private:
+    uint8_t *fingerprints_ = nullptr;
+    uint32_t block_length_ = 0;
+    uint32_t count_ = 0;
+    uint32_t crc_ = 0;
+    uint64_t seed_ = 0;
+    bool owned_ = true;
+};
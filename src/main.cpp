@@ -1,17 +1,35 @@
 #include <freertos/queue.h>
 #include "TimerHandle.h"
+#include "AppState.h"
 #include "AuthSync.h"
 #include "ConfigManager.h"
+#include "Console.h"
+#include "DecisionService.h"
+#include "Display.h"
+#include "EventChannel.h"
 #include "HardwareSerial.h"
 #include "HashUtils.h"
+#include "Latency.h"
+#include "Log.h"
+#ifdef MESH_SYNC
+#include "MeshSync.h"
+#endif
+#include "ReaderManager.h"
+#include "ScanLog.h"
+#ifdef SCAN_REPLAY
+#include "ScanReplay.h"
+#endif
+#include "ServerSession.h"
+#include "UidKey.h"
 #include <ArduinoJson.h>
 #include <HTTPClient.h>
 #include <LittleFS.h>
-#include <MFRC522.h>
 #include <SPI.h>
-#include <U8x8lib.h>
 #include <WiFi.h>
-#include <Wire.h>
+#include <esp_heap_caps.h>
+#ifdef MESH_SYNC
+#include <esp_wifi.h>
+#endif
 
 
 
@@ -20,29 +38,36 @@
 /*
   Runtime flow (high level)
 
-  1) Boot and setup()
-     - Initialize peripherals (display, SPI, RFID).
+  1) Boot and setup() -- offline first, nothing waits on the network
+     - Initialize peripherals (display, SPI).
      - Mount LittleFS and try to read `/config.json`.
        * If present, parse and populate SSID/PASS/SERVER_BASE.
        * If missing or parse fails, the strings remain empty and network/server
          related features are skipped.
-     - Create `AuthSync` at runtime if a `server_base` was provided in config.
-     - Call `WiFi.begin(SSID, PASS)` using the loaded credentials (may fail if
-       no config provided).
-     - If Wi‑Fi connects, call `authSync->begin()` (initial server sync) when
-       `AuthSync` exists.
+     - Create `AuthSync` at runtime if a `server_base` was provided in config
+       and load the offline tables (`preloadOffline()`).
+     - Start the scan log, NetworkTask and the reader task: cards are decided
+       from the cached tables from here on.
+     - Call `WiFi.begin(SSID, PASS)` and return. Association runs in the
+       background; the GOT_IP event wakes NetworkTask, which probes the
+       server and runs the initial sync.
+     - Boot phases are timestamped (Latency::Milestone, `latency` on the
+       console).
 
   2) Main loop
-     - Periodically poll `/api/status` (only when Wi‑Fi connected and
-       SERVER_BASE is configured) to update enroll mode.
      - On RFID scan:
-       * Post the scan to `/api/last_scan` (if configured/online).
+       * Log the scan (RAM ring -> LittleFS ring file); NetworkTask posts
+         the backlog to `/api/last_scan/batch` once the server is up.
        * Ask `authSync` whether the UID is authorized. `AuthSync` first
-         consults its persistent hashed allow/deny caches (offline), then
-         falls back to a server lookup / bitset when online. Results are
-         learned and persisted for offline use.
+         consults the synced bitset and its hashed allow/deny caches, then
+         hands unknown cards to NetworkTask for a server lookup and waits
+         at most AuthSync::LOOKUP_DEADLINE_MS before applying the offline
+         policy. Results (also late ones) are learned for offline use.
      - `AuthSync::update()` runs periodically to refresh the authorization
        bitset from the server when online.
+     - NetworkTask keeps the enroll mode current (event stream, or a
+       periodic `/api/status` poll while the stream is down) in the shared
+       status word (AppState.h); loop() redraws when it changes.
 
   Notes:
     - Configuration file format: JSON with keys `ssid`, `password`,
@@ -59,13 +84,19 @@
 constexpr uint8_t RST_PIN = 17;
 constexpr uint8_t SS_PIN  = 5;
 static constexpr unsigned long ENROLL_POLL_INTERVAL_MS = 5000;
-MFRC522 rfid(SS_PIN, RST_PIN);
+// Card readers (one per door, sharing the SPI bus): detection and UID reads
+// run in the reader task (ReaderManager.h); loop() takes finished reads
+// from its queue. SS_PIN/RST_PIN are the built-in reader's.
+static ReaderManager readers;
+#ifdef SCAN_REPLAY
+// Recorded scans injected into `readers` (console `replay`, lib/replay.py)
+static ScanReplay scanReplay(readers);
+// Scan log counters when the replay started; the report shows the change
+static ScanLog::Stats replayLogBase = {};
+#endif
 
-// Display
-U8X8_SSD1315_128X64_NONAME_SW_I2C u8x8(
-  /* clock=*/22,
-  /* data=*/21,
-  /* reset=*/U8X8_PIN_NONE);
+// Display: hardware I2C, redrawn by its own task from published snapshots
+static Display display(/* clock=*/22, /* data=*/21);
 
 // ----------------- CONFIG -----------------
 // Network and server configuration are moved out of the firmware and
@@ -82,67 +113,94 @@ String SERVER_BASE = "";
 // Authorization sync (created after config load) — allocated at runtime
 // so it can use the runtime `SERVER_BASE` value read from the JSON file.
 AuthSync *authSync = nullptr;
+// Keep-alive connection to SERVER_BASE shared by every server call
+ServerSession *serverSession = nullptr;
+// Server-sent events (enroll mode, revocations, sync notices); created and
+// driven by NetworkTask. While connected, /api/status is not polled.
+EventChannel *eventChannel = nullptr;
+// Telnet diagnostics console (Console.h); started by NetworkTask once Wi-Fi
+// is up, commands run in NetworkTask
+Console *console = nullptr;
+// Local decision service for devices next to the door (DecisionService.h);
+// started by NetworkTask once Wi-Fi is up, runs in AsyncTCP callbacks
+DecisionService *decisions = nullptr;
+#ifdef MESH_SYNC
+// Sync distribution between the doors of a site over ESP-NOW (MeshSync.h);
+// created with authSync, started once Wi-Fi is, driven by NetworkTask
+MeshSync *mesh = nullptr;
+#endif
 
 // ----------------- State -----------------
-String lastUID = "NONE";
-String enrollMode = "none";
+UidKey lastUID;               // Empty until the first scan ("UID:NONE")
 bool lastAuthorized = false;
 uint64_t lastHash = 0;        // Last computed hash for display
-bool serverReachable = false; // Track server/database reachability
-unsigned long lastDisplayUpdate = 0;
-unsigned long enrollBlinkMillis = 0;
-bool enrollBlinkState = false;
-// Simple millis-based enroll-mode poll
-
-static unsigned long lastEnrollPoll = 0;
-
-// Display state tracking (to avoid unnecessary redraws)
-String displayedUID = "";
-bool displayedAuth = false;
-uint64_t displayedHash = 0;
-String displayedEnrollMode = "";
-bool displayedEnrollBlink = false;
-bool displayedServerReachable = false;
-
-String getUidString();
+// Enroll mode and event stream state, written by NetworkTask (AppState.h)
+static AppStatus appStatus;
+// Work requested across tasks: NET_* for NetworkTask, LOOP_* for loop()
+static RequestBits netRequests;
+static RequestBits loopRequests;
+
+// Last snapshot handed to the display task and the status change counter
+// it was built from; setup()/loop() only
+static Display::State displayState;
+static uint16_t displayedChanges = 0;
+
+bool serverUp();
 void updateEnrollStatus();
 void updateDisplay();
-void drawHeader();
-void drawEnrollIndicator(bool on);
+void showStatus(const char *text);
 void NetworkTask(void *pv);
+void onServerEvent(const char *event, const char *data);
+void onServerEventDropped(const char *event);
+void onConsoleCommand(const char *line, Print &out);
 bool postLastScan(const String &uid, JsonDocument &out);
+bool uploadScanBatch();
+void onEnrollAcknowledged();
+#ifdef SCAN_REPLAY
+void printReplayReport(Print &out);
+#endif
 
-// Queue for deferred network posting of scanned UIDs
-struct ScanItem {
-  char uid[21];
-};
-static QueueHandle_t scanQueue = nullptr;
+// Scan events waiting for upload: RAM ring filled by loop(), spilled to a
+// LittleFS ring file and posted in batches by NetworkTask (ScanLog.h)
+static ScanLog scanLog;
+// Records per POST /api/last_scan/batch
+static constexpr size_t SCAN_UPLOAD_BATCH = 16;
+// Set when the server has no batch endpoint; fall back to /api/last_scan
+static bool scanBatchUnsupported = false;
 //---------------- FreeRTOS timers -----------------
-// AuthSync timer (non-blocking): callback only sets a flag; NetworkTask does
-// the work
-static volatile bool authSyncRequested = false;
-// Display update flag set by timer callback
-static volatile bool displayUpdateRequested = false;
-static void displayTimerCallback(TimerHandle_t xTimer) { (void)xTimer; displayUpdateRequested = true; }
+// NetworkTask; notified to wake it early (queued card lookups)
+static TaskHandle_t networkTaskHandle = nullptr;
+// Display timer: loop() republishes so the DB line follows reachability
+static void displayTimerCallback(TimerHandle_t xTimer) { (void)xTimer; loopRequests.raise(LOOP_DISPLAY); }
+
+// Wi-Fi events (Arduino event task): only record and hand over. The
+// driver reassociates on its own after a loss.
+static void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info)
+{
+  (void)info;
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+    Latency::mark(Latency::BOOT_WIFI_UP);
+    netRequests.raise(NET_WIFI_UP | NET_SYNC);
+    if (networkTaskHandle) xTaskNotifyGive(networkTaskHandle);
+  } else if (event != ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+    return;
+  }
+  loopRequests.raise(LOOP_WIFI);
+}
 
 // ----------------- SETUP -----------------
 void setup() {
+  Latency::mark(Latency::BOOT_SETUP);
   Serial.begin(115200);
-  vTaskDelay(500 / portTICK_PERIOD_MS);
   Serial.println(" hello world!");
 
-  // Force first auth line to render even if initial authorization is false
-  // by priming displayedAuth opposite of lastAuthorized.
-  displayedAuth = !lastAuthorized;
-
-  Wire.begin(21, 22);
-  u8x8.begin();
-  u8x8.setFont(u8x8_font_chroma48medium8_r);
-  drawHeader();
-  u8x8.drawString(0, 2, "FS Init...");
+  // Display task first so boot progress shows up
+  if (!display.begin()) {
+    Serial.println("[Tasks] Display task not started");
+  }
+  showStatus("FS Init...");
 
   SPI.begin();
-  rfid.PCD_Init();
 
   // Ensure FS is mounted before trying to load config
   if (LittleFS.begin()) {
@@ -151,12 +209,14 @@ void setup() {
       Serial.println("SSID: " + SSID);
       Serial.println("PASS: " + PASS);
       Serial.println("SERVER_BASE: " + SERVER_BASE);
-      u8x8.drawString(0, 2, "FS OK   ");
+      showStatus("FS OK");
       // Create AuthSync early so we can load offline caches from NVS
       if (SERVER_BASE.length() > 0) {
-        authSync = new AuthSync(SERVER_BASE);
-        // AuthSync constructed — delay offline preload until after WiFi
-        // initialization so any network-related state is stable.
+        serverSession = new ServerSession(SERVER_BASE);
+        authSync = new AuthSync(SERVER_BASE, serverSession);
+#ifdef MESH_SYNC
+        mesh = new MeshSync(*authSync);
+#endif
       } else {
         Serial.println("SERVER_BASE empty; offline authorization disabled "
           "until configured");
@@ -175,14 +235,14 @@ void setup() {
           Serial.println("SSID: " + SSID);
           Serial.println("PASS: " + PASS);
           Serial.println("SERVER_BASE: " + SERVER_BASE);
-          u8x8.drawString(0, 2, "PROVISION");
+          showStatus("PROVISION");
         } else {
           Serial.println("Provision write ok but reload failed");
-          u8x8.drawString(0, 2, "PROV ERR");
+          showStatus("PROV ERR");
         }
       } else {
         Serial.println("Failed to auto-provision config.json");
-        u8x8.drawString(0, 2, "PROV FAIL");
+        showStatus("PROV FAIL");
       }
     }
     ConfigManager::listFiles();
@@ -197,101 +257,76 @@ void setup() {
       }
     } else {
       Serial.println("LittleFS format/remount failed");
-      u8x8.drawString(0, 2, "FS FAIL");
+      showStatus("FS FAIL");
     }*/
   }
-  vTaskDelay(100 /
-             portTICK_PERIOD_MS); // Give some time for LittleFS to stabilize
-
-  WiFi.begin(SSID.c_str(), PASS.c_str());
-  // After Wi-Fi initialization, perform the offline preload (loads NVS + FS
-  // caches) so AuthSync can have its cached data ready before any network
-  // sync attempts. Doing this after WiFi.begin keeps the ordering stable.
+  // Offline tables first (NVS + FS, or the mapped table store): scans are
+  // decided from them until the background sync catches up
   if (authSync) {
     authSync->preloadOffline();
     authSync->dumpMemoryStats();
-    Serial.println("[AuthSync] Offline cache preloaded (after WiFi init)");
-  }
-  int tries = 0;
-  while (WiFiClass::status() != WL_CONNECTED && tries < 80) {
-    vTaskDelay(500 / portTICK_PERIOD_MS);
-    Serial.print(".");
-    tries++;
+    Serial.println("[AuthSync] Offline cache preloaded");
   }
+  Latency::mark(Latency::BOOT_CACHE_READY);
 
-  if (WiFiClass::status() == WL_CONNECTED) {
-    Serial.println("");
-    Serial.println("WiFi connected");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-    u8x8.drawString(0, 2, "WiFi OK     ");
-    // Wifi modem sleep
-    WiFi.setSleep(true);
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-
-    // Attempt an online sync now that WiFi is connected (we already loaded
-    // offline cache)
-    bool syncOk = false;
-    if (authSync) {
-      // Use public begin() to perform an immediate sync (reloads NVS + attempts
-      // server sync)
-      syncOk = authSync->begin();
-    }
-    if (syncOk) {
-      u8x8.drawString(0, 3, "DB OK");
-      serverReachable = true;
-      displayedServerReachable = true;
-    } else {
-      u8x8.drawString(0, 3, "DB OFFLINE  ");
-      serverReachable = false;
-      displayedServerReachable = false;
-      Serial.println(
-        "[AuthSync] Using offline cache (sync failed or server unreachable)");
-    }
-  } else {
-    u8x8.drawString(0, 2, "WiFi FAIL");
-    serverReachable = false;
-    displayedServerReachable = false;
+  // Scan log before the network task: it replays any backlog left from
+  // before the reboot
+  if (!scanLog.begin()) {
+    Serial.println("[Scans] Ring file unavailable; buffering scans in RAM only");
   }
-  vTaskDelay(100 / portTICK_PERIOD_MS);
+  scanLog.printStats();
 
-  // Create queue and network task (pin to core 0, lower priority than loop for
+  // From here on log lines are queued and written to Serial by a
+  // low-priority task, so scans do not wait on the UART (Log.h)
+  Log::begin();
+
+  // Create network task (pin to core 0, lower priority than loop for
   // RFID responsiveness)
   //Note: this was implemented in a phase where there was no NetworkTask yet
   // Could probably just be lower priority
-  if (!scanQueue) {
-    scanQueue = xQueueCreate(10, sizeof(ScanItem));
-
-
-    //Configure UNICORE flag in platformio.ini if using a single-core ESP32
+  //Configure UNICORE flag in platformio.ini if using a single-core ESP32
 #if defined(CONFIG_FREERTOS_UNICORE)
 
-    xTaskCreate(
-      NetworkTask,
-      "net_task",
-      4096,
-      nullptr,
-      tskIDLE_PRIORITY,
-      nullptr);
+  xTaskCreate(
+    NetworkTask,
+    "net_task",
+    4096,
+    nullptr,
+    tskIDLE_PRIORITY,
+    &networkTaskHandle);
 
-    Serial.println("[Tasks] NetworkTask started on  IdleTask priority");
+  Serial.println("[Tasks] NetworkTask started on  IdleTask priority");
 #else
-    xTaskCreatePinnedToCore(
-      NetworkTask,
-      "net_task",
-      4096,
-      nullptr,
-      tskIDLE_PRIORITY,
-      nullptr,
-      0);
-    Serial.println("[Tasks] NetworkTask started on  IdleTask priority");
+  xTaskCreatePinnedToCore(
+    NetworkTask,
+    "net_task",
+    4096,
+    nullptr,
+    tskIDLE_PRIORITY,
+    &networkTaskHandle,
+    0);
+  Serial.println("[Tasks] NetworkTask started on  IdleTask priority");
 #endif
-    // Runtime fallback: query chip info (works on Arduino and esp-idf)
-    if (scanQueue) {
-      Serial.println("[Tasks] scanQueue created");
-    } else {
-      Serial.println("[Tasks] Failed to create scanQueue");
-    }
+  // Unknown cards: the scan path hands server lookups to NetworkTask and
+  // waits at most AuthSync::LOOKUP_DEADLINE_MS for the answer
+  if (authSync && networkTaskHandle) {
+    authSync->setLookupWorker(networkTaskHandle);
+  }
+  // Readers and mode from config.json (`readers`, `reader_mode`); one
+  // polled reader on SS_PIN/RST_PIN unless configured otherwise
+  String readerMode = "poll";
+  ConfigManager::ReaderPins readerPins[ReaderManager::MAX_READERS] = {{SS_PIN, RST_PIN, RFID_IRQ_PIN}};
+  size_t readerCount = 1;
+  ConfigManager::loadReaderConfig(readerMode, readerPins, ReaderManager::MAX_READERS, readerCount);
+  const CardReader::Mode mode = CardReader::parseMode(readerMode.c_str());
+  for (size_t i = 0; i < readerCount; ++i) {
+    readers.addReader(readerPins[i].ss, readerPins[i].rst, mode, readerPins[i].irq);
+  }
+  if (!readers.begin()) {
+    Serial.println("[Tasks] Failed to start card reader task");
+  } else {
+    Latency::mark(Latency::BOOT_READERS_UP);
+    LOG_I("[Boot] Readers up after %u ms", static_cast<unsigned>(Latency::milestoneAt(Latency::BOOT_READERS_UP) / 1000));
   }
   // Create timers using centralized helpers (TimerHandle.cpp)
   if (!createDisplayTimer(displayTimerCallback, pdMS_TO_TICKS(500))) {
@@ -300,69 +335,81 @@ void setup() {
     Serial.println("[Tasks] Display timer started");
   }
 
+  // Network last and in the background: association, probe and the
+  // initial sync follow the GOT_IP event (NetworkTask)
+  if (SSID.length() > 0) {
+    WiFi.onEvent(onWiFiEvent);
+    WiFi.setAutoReconnect(true);
+    WiFi.begin(SSID.c_str(), PASS.c_str());
+    // Modem sleep between beacons
+    WiFi.setSleep(true);
+    showStatus("WiFi...");
+  } else {
+    showStatus("No WiFi cfg");
+  }
+#ifdef MESH_SYNC
+  // ESP-NOW on the AP's channel (or MESH_CHANNEL without one); the radio
+  // stays awake, a sleeping station misses its neighbours' frames
+  if (mesh) {
+    if (SSID.length() == 0) {
+      WiFi.mode(WIFI_STA);
+      esp_wifi_set_channel(MESH_CHANNEL, WIFI_SECOND_CHAN_NONE);
+    }
+    WiFi.setSleep(false);
+    String meshKey;
+    ConfigManager::loadMeshConfig(meshKey);
+    const uint16_t site = static_cast<uint16_t>(HashUtils::crc32Update(
+        0, reinterpret_cast<const uint8_t*>(SERVER_BASE.c_str()), SERVER_BASE.length()));
+    if (!mesh->begin(meshKey, site, networkTaskHandle)) {
+      delete mesh;
+      mesh = nullptr;
+    }
+  }
+#endif
 }
 
 void loop() {
-  // Server reachability check now handled by FreeRTOS timer in NetworkTask
-
-  if (rfid.PICC_IsNewCardPresent() && rfid.PICC_ReadCardSerial()) {
-    String uid = getUidString();
-    Serial.println("Scanned: " + uid);
+  // Server reachability is maintained by NetworkTask (see Reachability.h)
+
+  // Scan-path stage timings (Latency.h); `presented` is when the reader
+  // task detected the card. Waiting here replaces busy polling; the bound
+  // keeps the housekeeping below running.
+  CardReader::Scan scan;
+  if (readers.next(scan, pdMS_TO_TICKS(20))) {
+    const int64_t presented = scan.presented;
+    const UidKey &uid = scan.uid;
+    char uidHex[UidKey::HEX_CHARS + 1];
+    uid.toHex(uidHex);
+    LOG_I("Scanned: %s (reader %u)", uidHex, scan.reader);
     lastUID = uid;
 
-    // Compute hash for display (same method as AuthSync) ----------- FOR
-    // DEBUGGING ----
-    /*String normalized = uid;
-    normalized.trim();
-    normalized.toUpperCase();
-    uint64_t hash = 0xcbf29ce484222325ULL;
-    for (size_t i = 0; i < normalized.length(); i++) {
-      constexpr uint64_t prime = 0x100000001b3ULL;
-      hash ^= static_cast<uint8_t>(normalized[i]);
-      hash *= prime;
-    }*/
-
-    lastHash = HashUtils::hashUid(uid);
-    lastAuthorized = authSync ? authSync->isAuthorized(uid) : false;
-    updateEnrollStatus(); // Refresh after scan
+    int64_t t = Latency::now();
+    lastHash = uid.hash();
+    Latency::lap(Latency::STAGE_HASH, t);
+    // Cache and server stages are timed inside AuthSync
+    lastAuthorized = authSync ? authSync->isAuthorized(uid, lastHash) : false;
+    Latency::lap(Latency::STAGE_DECISION, presented);
+    Latency::mark(Latency::BOOT_FIRST_SCAN);
+    // Refresh the enroll mode after a scan (NetworkTask polls)
+    netRequests.raise(NET_ENROLL_POLL);
+    t = Latency::now();
     updateDisplay();
-    rfid.PICC_HaltA();
-    rfid.PCD_StopCrypto1();
-    vTaskDelay(100 / portTICK_PERIOD_MS); // Debounce recommended delay
-    // Defer network POST of last scan to network task via queue
-    if (scanQueue) {
-      ScanItem item{};
-      uid.toCharArray(item.uid, sizeof(item.uid));
-      if (xQueueSend(scanQueue, &item, 0) != pdPASS) {
-        Serial.println("[Queue] scanQueue full; dropping UID post");
-      } else {
-        Serial.printf("[Queue] Enqueued UID=%s\n", item.uid);
-      }
-    }
+    Latency::lap(Latency::STAGE_DISPLAY, t);
+    // HaltA and debounce happened in the reader task. Defer network POST
+    // of last scan to network task via the scan log
+    scanLog.push(uid, scan.reader, millis());
+    LOG_I("[Queue] Logged UID=%s", uidHex);
   }
 
-  // Periodic sync handled by NetworkTask
-
-  // Display updates are requested by a timer; perform the actual update in
-  // loop() context to keep display code single-threaded and safe for the
-  // U8x8 library.
-  if (displayUpdateRequested) {
-    displayUpdateRequested = false;
+  // Periodic sync and enroll mode handled by NetworkTask. The timer
+  // refreshes the DB line, a status change (enroll mode) shows at once;
+  // loop() owns the state it publishes. Unchanged tiles are not resent and
+  // the indicator blinks in the display task, so this costs a snapshot copy.
+  if (loopRequests.take(LOOP_WIFI)) {
+    // Row 2 is loop()'s to write; the event only flagged the change
+    showStatus(WiFiClass::status() == WL_CONNECTED ? "WiFi OK" : "WiFi lost");
+  } else if (loopRequests.take(LOOP_DISPLAY) || appStatus.load().changes != displayedChanges) {
     updateDisplay();
-    lastDisplayUpdate = millis();
-  }
-
-  // Blink indicator when waiting for enroll
-  if (enrollMode != "none" && millis() - enrollBlinkMillis > 500) {
-    enrollBlinkState = !enrollBlinkState;
-    enrollBlinkMillis = millis();
-    drawEnrollIndicator(enrollBlinkState);
-  }
-
-  // Simple millis-based enroll-mode poll
-  if (millis() - lastEnrollPoll > ENROLL_POLL_INTERVAL_MS) {
-    lastEnrollPoll = millis();
-    updateEnrollStatus();
   }
 
 #ifdef AUTH_TEST_HOOK
@@ -371,100 +418,49 @@ void loop() {
     int c = Serial.read();
     if (c == 'm' || c == 'M') {
       if (authSync) authSync->TEST_dumpMemoryStats();
+      scanLog.printStats();
+      Serial.printf("[Log] written=%u dropped=%u\n", Log::written(), Log::dropped());
+    } else if (c == 'l' || c == 'L') {
+      // One JSON line for scripts checking the latency budget
+      JsonDocument doc;
+      Latency::toJson(doc.to<JsonObject>());
+      serializeJson(doc, Serial);
+      Serial.println();
+    } else if (c == 'r' || c == 'R') {
+      Latency::reset();
+      Serial.println("[Latency] Reset");
     }
   }
 #endif
 }
 
 /* --------------------------------  helpers  ---------------------------------- */
-String getUidString()
+// Shared reachability (ServerSession health, maintained by NetworkTask and
+// by every exchange); lock-free, safe from any task
+bool serverUp()
 {
-  String uid = "";
-  for (byte i = 0; i < rfid.uid.size; i++) {
-    if (rfid.uid.uidByte[i] < 0x10)
-      uid += "0";
-    uid += String(rfid.uid.uidByte[i], HEX);
-  }
-  uid.toUpperCase();
-  return uid;
-}
-
-void drawHeader()
-{
-  static bool headerDrawn = false;
-  if (!headerDrawn) {
-    u8x8.clear();
-    u8x8.drawString(0, 0, "RFID Access");
-    headerDrawn = true;
-  }
+  return serverSession && serverSession->health().up();
 }
 
+// Publish the current state to the display task; never waits for the bus
 void updateDisplay()
 {
-  drawHeader(); // Only draws once
-
-  // Update DB status if changed
-  if (serverReachable != displayedServerReachable) {
-    if (serverReachable) {
-      u8x8.drawString(0, 3, "DB OK        ");
-    } else {
-      u8x8.drawString(0, 3, "DB LOST      ");
-    }
-    displayedServerReachable = serverReachable;
-  }
-
-  // Only update UID if changed
-  if (lastUID != displayedUID) {
-    String line = "UID:" + lastUID;
-    if (line.length() > 16)
-      line = line.substring(0, 16);
-    // Pad with spaces to clear old text
-    while (line.length() < 16)
-      line += " ";
-    u8x8.drawString(0, 1, line.c_str());
-    displayedUID = lastUID;
-  }
-
-  // Only update auth status if changed
-  if (lastAuthorized != displayedAuth) {
-    u8x8.drawString(
-      0, 4, (String("Auth:") + (lastAuthorized ? "YES" : "NO ")).c_str());
-    displayedAuth = lastAuthorized;
-  }
-
-  // Update hash display (last 8 hex digits on bottom row)
-  if (lastHash != displayedHash) {
-    char hashStr[17];
-    snprintf(hashStr, sizeof(hashStr), "H:%08X",
-             static_cast<uint32_t>(lastHash & 0xFFFFFFFF));
-    u8x8.drawString(0, 7, hashStr);
-    displayedHash = lastHash;
-  }
-
-  // Update enroll indicator if mode changed
-  if (enrollMode != displayedEnrollMode) {
-    drawEnrollIndicator(enrollMode != "none");
-  }
+  displayState.uid = lastUID;
+  displayState.hash = lastHash;
+  displayState.authorized = lastAuthorized;
+  displayState.serverUp = serverUp();
+  const AppStatus::Snapshot status = appStatus.load();
+  displayState.enroll = status.enroll;
+  displayedChanges = status.changes;
+  display.publish(displayState);
 }
 
-void drawEnrollIndicator(bool on)
+// Boot / Wi-Fi line (row 2)
+void showStatus(const char *text)
 {
-  String currentMode = enrollMode;
-  bool currentBlink = on;
-
-  // Only redraw if mode or blink state changed - Full redraws are visible
-  if (currentMode != displayedEnrollMode ||
-      currentBlink != displayedEnrollBlink) {
-    if (enrollMode == "none") {
-      u8x8.drawString(14, 0, "  ");
-    } else if (on) {
-      u8x8.drawString(14, 0, enrollMode == "grant" ? "GR" : "RV");
-    } else {
-      u8x8.drawString(14, 0, "  ");
-    }
-    displayedEnrollMode = currentMode;
-    displayedEnrollBlink = currentBlink;
-  }
+  strncpy(displayState.status, text, Display::STATUS_MAX);
+  displayState.status[Display::STATUS_MAX] = '\0';
+  updateDisplay();
 }
 
 bool postLastScan(const String &uid, JsonDocument &out)
@@ -477,31 +473,32 @@ bool postLastScan(const String &uid, JsonDocument &out)
     return false;
   if (SERVER_BASE.length() == 0)
     return false;
-  // Escape: if we already marked serverReachable false, skip HTTP entirely
-  if (!serverReachable) {
-    // Uncomment for verbose logging: Serial.println("[postLastScan] Skipped
-    // (serverReachable=false)");
+  // Escape: if the server is not known to be up, skip HTTP entirely
+  if (!serverUp()) {
+    // Uncomment for verbose logging: LOG_D("[postLastScan] Skipped
+    // (server not up)");
     return false;
   }
-  HTTPClient http;
-  http.setTimeout(1500); // shorter timeout to avoid long blocking
-  http.begin(String(SERVER_BASE) + "/api/last_scan");
-  http.addHeader("Content-Type", "application/json");
+  if (!serverSession)
+    return false;
+  // shorter timeout to avoid long blocking
+  ServerSession::Request req(*serverSession, "/api/last_scan", 1500);
+  if (!req.acquired())
+    return false;
+  req.http().addHeader("Content-Type", "application/json");
   String body = R"({"uid":")" + uid + "\"}";
-  int code = http.POST(body);
-  Serial.printf("[HTTP] POST /api/last_scan -> code=%d, body=%s\n", code, body.c_str());
+  int code = req.POST(body);
+  LOG_D("[HTTP] POST /api/last_scan -> code=%d, body=%s", code, body.c_str());
   if (code < 200 || code >= 300) {
-    Serial.printf("postLastScan failed: %d\n", code);
-    http.end();
+    LOG_W("postLastScan failed: %d", code);
     return false;
   }
-  String payload = http.getString();
-  Serial.printf("[HTTP] /api/last_scan payload: %s\n", payload.c_str());
-  http.end();
+  String payload = req.body();
+  LOG_D("[HTTP] /api/last_scan payload: %s", payload.c_str());
   // Parse into caller-provided document (prefer StaticJsonDocument in caller)
   DeserializationError err = deserializeJson(out, payload);
   if (err) {
-    Serial.printf("postLastScan: JSON parse error: %s\n", err.c_str());
+    LOG_W("postLastScan: JSON parse error: %s", err.c_str());
     out.clear();
     return false;
   }
@@ -509,141 +506,417 @@ bool postLastScan(const String &uid, JsonDocument &out)
 }
 
 
+// Poll the enroll mode (NetworkTask, while the event stream is down)
 void updateEnrollStatus()
 {
   // Skip poll if offline or no server configured. Keeps display consistent
   // and avoids pointless HTTP requests when not provisioned.
-  if (WiFi.status() != WL_CONNECTED || SERVER_BASE.length() == 0) {
-    enrollMode = "none";
-    serverReachable = false;
+  if (WiFi.status() != WL_CONNECTED || !serverSession) {
+    appStatus.setEnroll(ENROLL_NONE);
     return;
   }
-  // Simple synchronous status poll (called from loop() on a millis timer)
-  HTTPClient http;
-  http.setTimeout(1500);
-  String url = SERVER_BASE + "/api/status";
-  http.begin(url);
-  int code = http.GET();
-  if (code > 0 && code < 400)
-    serverReachable = true;
-  String payload = http.getString();
+  // Enroll mode arrives over the event stream while it is connected
+  if (eventChannel && eventChannel->connected())
+    return;
+#ifdef MESH_SYNC
+  // ... or in the mesh source's announcements
+  if (mesh && mesh->covered())
+    return;
+#endif
+  ServerSession::Request req(*serverSession, "/api/status", 1500);
+  if (!req.acquired())
+    return;
+  req.GET(); // outcome is reported to the shared reachability
+  String payload = req.body();
   JsonDocument doc;
   DeserializationError err = deserializeJson(doc, payload);
-  if (!err) {
-    const char *m = doc["enroll_mode"] | nullptr;
+  appStatus.setEnroll(err ? ENROLL_NONE : parseEnrollMode(doc["enroll_mode"] | "none"));
+}
 
-    if (m && strlen(m) > 0) {
-      enrollMode = m;
-    } else {
-      enrollMode = "none";
+// Server enrolled a scanned card (NetworkTask context)
+void onEnrollAcknowledged()
+{
+  // loop() sees the status change and publishes a new display snapshot
+  appStatus.setEnroll(ENROLL_NONE);
+  // The enrolled card is not in the synced tables yet
+  if (authSync) authSync->notifyServerChanged();
+  LOG_I("[Queue] Enrollment cleared");
+}
+
+// Post the oldest logged scans in one request and drop what the server
+// acked. Returns true when records were acked (more may be waiting).
+bool uploadScanBatch()
+{
+  // Static: NetworkTask only, keeps 512 bytes off its stack
+  static ScanLog::Record batch[SCAN_UPLOAD_BATCH];
+  const size_t n = scanLog.peek(batch, SCAN_UPLOAD_BATCH);
+  if (n == 0 || !serverSession)
+    return false;
+
+  char uid[UidKey::HEX_CHARS + 1];
+  if (scanBatchUnsupported) {
+    // Older server: one POST /api/last_scan per record
+    batch[0].uid().toHex(uid);
+    JsonDocument resp;
+    if (!postLastScan(String(uid), resp))
+      return false;
+    scanLog.ack(batch[0].seq);
+    if (resp["enrolled"] | false)
+      onEnrollAcknowledged();
+    return true;
+  }
+
+  JsonDocument doc;
+  doc["device"] = WiFi.macAddress();
+  doc["boot"] = scanLog.boot();
+  doc["now"] = static_cast<uint32_t>(millis());
+  const ScanLog::Stats st = scanLog.stats();
+  JsonObject stats = doc["stats"].to<JsonObject>();
+  stats["pending"] = st.pending;
+  stats["ram_high_water"] = st.ramHighWater;
+  stats["flash_high_water"] = st.flashHighWater;
+  stats["dropped_ram"] = st.droppedRam;
+  stats["dropped_flash"] = st.droppedFlash;
+  // Scan-path latency histograms, for checking builds against the budget
+  Latency::toJson(stats["latency"].to<JsonObject>());
+  JsonArray scans = doc["scans"].to<JsonArray>();
+  for (size_t i = 0; i < n; ++i) {
+    batch[i].uid().toHex(uid);
+    JsonObject o = scans.add<JsonObject>();
+    o["seq"] = batch[i].seq;
+    o["boot"] = batch[i].boot;
+    o["t"] = batch[i].uptimeMs;
+    o["reader"] = batch[i].reader;
+    o["uid"] = String(uid);
+  }
+  String body;
+  serializeJson(doc, body);
+
+  JsonDocument resp;
+  {
+    ServerSession::Request req(*serverSession, "/api/last_scan/batch", 2000);
+    if (!req.acquired())
+      return false;
+    req.http().addHeader("Content-Type", "application/json");
+    const int code = req.POST(body);
+    if (code == 404 || code == 405) {
+      LOG_I("[Queue] Server has no batch endpoint; posting scans singly");
+      scanBatchUnsupported = true;
+      return false;
+    }
+    if (code != 200) {
+      LOG_W("[Queue] Batch upload failed: %d", code);
+      return false;
+    }
+    if (deserializeJson(resp, req.body())) {
+      LOG_W("[Queue] Batch upload: bad reply");
+      return false;
     }
-  } else {
-    serverReachable = false;
-    enrollMode = "none";
   }
-  http.end();
+  if (resp["acked"].isNull())
+    return false;
+  scanLog.ack(resp["acked"].as<uint32_t>());
+  LOG_I("[Queue] Uploaded %u scans (acked seq=%u)", static_cast<unsigned>(n), resp["acked"].as<unsigned>());
+  if (resp["enrolled"] | false)
+    onEnrollAcknowledged();
+  return true;
 }
 
-// Timer callback for server reachability check
-void serverCheckTimerCallback(TimerHandle_t xTimer)
+// Event stream handler (NetworkTask context). See lib/server.py for the
+// event list; unknown events are ignored.
+void onServerEvent(const char *event, const char *data)
 {
-  bool nowReachable = false;
-  if (WiFiClass::status() == WL_CONNECTED && SERVER_BASE.length() > 0) {
-    HTTPClient http;
-    http.setTimeout(1500);
-    http.begin(SERVER_BASE + "/api/status");
-    int code = http.GET();
-    http.end();
-    nowReachable = (code == 200);
+  JsonDocument doc;
+  if (deserializeJson(doc, data)) {
+    LOG_W("[Events] Bad %s payload", event);
+    return;
+  }
+  LOG_I("[Events] %s %s", event, data);
+  if (strcmp(event, "state") == 0) {
+    // Snapshot after (re)connect: covers anything missed while offline
+    appStatus.setEnroll(parseEnrollMode(doc["enroll_mode"] | "none"));
+    if (authSync) authSync->notifyServerVersion(doc["version"] | 0);
+  } else if (strcmp(event, "enroll") == 0) {
+    appStatus.setEnroll(parseEnrollMode(doc["mode"] | "none"));
+  } else if (strcmp(event, "sync") == 0) {
+    if (authSync) authSync->notifyServerVersion(doc["version"] | 0);
+  } else if (strcmp(event, "revoke") == 0) {
+    const char *uid = doc["uid"] | "";
+    if (authSync && *uid) authSync->revokeLearned(String(uid));
+#ifdef MESH_SYNC
+    if (mesh && *uid) mesh->broadcastRevoke(HashUtils::hashUid(String(uid)));
+#endif
   }
-  if (nowReachable != serverReachable) {
-    serverReachable = nowReachable;
-    Serial.printf("[DB] Reachable=%d\n", serverReachable);
-    // Keep AuthSync's cached probe state in sync with the central timer so
-    // both modules make decisions from the same reachability information.
+}
+
+// Event too large for EventChannel (NetworkTask context): a lost revoke or
+// version bump would otherwise wait for the next periodic sync
+void onServerEventDropped(const char *event)
+{
+  if (authSync && (strcmp(event, "revoke") == 0 || strcmp(event, "sync") == 0))
+    authSync->notifyServerChanged();
+}
+
+// Remote console commands (NetworkTask context, see Console.h)
+void onConsoleCommand(const char *line, Print &out)
+{
+  if (strcmp(line, "help") == 0) {
+    out.println("stats           heap, caches, queues, latency");
+    out.println("latency [json|reset]");
+    out.println("etag            sync ETags and version");
+    out.println("sync            force a sync now");
+    out.println("log on|off      stream the log");
+#ifdef MESH_SYNC
+    out.println("mesh            mesh role, neighbours, counters");
+#endif
+#ifdef SCAN_REPLAY
+    out.println("replay start [speed%] [passes]   replay " SCAN_REPLAY_FILE);
+    out.println("replay stop | replay            stop / JSON report");
+#endif
+    out.println("quit");
+  } else if (strcmp(line, "stats") == 0) {
     if (authSync) {
-      authSync->setServerProbeResult(nowReachable, millis());
+      authSync->dumpMemoryStats(out);
+    } else {
+      out.printf("[Heap] free=%u largest=%u\n", static_cast<unsigned>(esp_get_free_heap_size()),
+                 static_cast<unsigned>(heap_caps_get_largest_free_block(MALLOC_CAP_8BIT)));
+      Latency::print(out);
     }
+    scanLog.printStats(out);
+    const Display::Stats ds = display.stats();
+    out.printf("[Display] published=%u frames=%u tiles=%u\n", ds.published, ds.frames, ds.tiles);
+    const ReaderManager::Stats rs = readers.stats();
+    out.printf("[Reader] readers=%u scans=%u dropped=%u\n", static_cast<unsigned>(readers.count()), rs.scans, rs.dropped);
+    out.printf("[Log] written=%u dropped=%u\n", Log::written(), Log::dropped());
+    if (decisions) decisions->print(out);
+    out.printf("[Net] server=%s push=%s events_dropped=%u enroll=%s stack_free=%u\n", serverUp() ? "up" : "down",
+               eventChannel && eventChannel->connected() ? "live" : "off",
+               eventChannel ? static_cast<unsigned>(eventChannel->dropped()) : 0u, enrollModeName(appStatus.enroll()),
+               static_cast<unsigned>(uxTaskGetStackHighWaterMark(nullptr)));
+  } else if (strcmp(line, "latency") == 0) {
+    Latency::print(out);
+  } else if (strcmp(line, "latency json") == 0) {
+    JsonDocument doc;
+    Latency::toJson(doc.to<JsonObject>());
+    serializeJson(doc, out);
+    out.println();
+  } else if (strcmp(line, "latency reset") == 0) {
+    Latency::reset();
+    out.println("latency reset");
+  } else if (strcmp(line, "etag") == 0) {
+    if (authSync) authSync->printSyncState(out);
+    else out.println("no server configured");
+  } else if (strcmp(line, "sync") == 0) {
+    if (authSync) {
+      authSync->requestSync();
+      netRequests.raise(NET_SYNC);
+      out.println("sync requested");
+    } else {
+      out.println("no server configured");
+    }
+  } else if (strcmp(line, "log on") == 0) {
+    console->setStreaming(true);
+    out.println("streaming log ('log off' to stop)");
+  } else if (strcmp(line, "log off") == 0) {
+    console->setStreaming(false);
+#ifdef SCAN_REPLAY
+  } else if (strncmp(line, "replay start", 12) == 0) {
+    unsigned speed = 100;
+    unsigned passes = 1;
+    sscanf(line + 12, "%u %u", &speed, &passes);
+    // The report covers this run only
+    Latency::reset();
+    replayLogBase = scanLog.stats();
+    if (scanReplay.start(SCAN_REPLAY_FILE, static_cast<uint16_t>(speed), static_cast<uint16_t>(passes))) {
+      out.printf("replaying at %u%%\n", speed);
+    } else {
+      out.println("replay not started (running, or no " SCAN_REPLAY_FILE ")");
+    }
+  } else if (strcmp(line, "replay stop") == 0) {
+    scanReplay.stop();
+    out.println("replay stopping");
+  } else if (strcmp(line, "replay") == 0) {
+    printReplayReport(out);
+#endif
+#ifdef MESH_SYNC
+  } else if (strcmp(line, "mesh") == 0) {
+    if (mesh) mesh->print(out);
+    else out.println("mesh off (no server or mesh_key)");
+#endif
+  } else if (strcmp(line, "quit") == 0) {
+    out.println("bye");
+    console->requestClose();
+  } else {
+    out.printf("unknown command '%s' (try 'help')\n", line);
   }
 }
 
+#ifdef SCAN_REPLAY
+// Replay results as one JSON line (console `replay`, read by lib/replay.py):
+// the replay's own counters, what the scan queue dropped, and the latency
+// snapshot, whose counters include http_requests and flash_writes
+void printReplayReport(Print &out)
+{
+  JsonDocument doc;
+  const ScanReplay::Stats rs = scanReplay.stats();
+  JsonObject replay = doc["replay"].to<JsonObject>();
+  replay["running"] = rs.running;
+  replay["injected"] = rs.injected;
+  replay["dropped"] = rs.dropped;
+  replay["skipped"] = rs.skipped;
+  replay["max_lag_us"] = rs.maxLagUs;
+  replay["elapsed_ms"] = rs.elapsedMs;
+  replay["passes"] = rs.passes;
+  const ScanLog::Stats ls = scanLog.stats();
+  JsonObject queue = doc["scan_log"].to<JsonObject>();
+  queue["pending"] = ls.pending;
+  queue["ram_high_water"] = ls.ramHighWater;
+  queue["dropped_ram"] = ls.droppedRam - replayLogBase.droppedRam;
+  queue["dropped_flash"] = ls.droppedFlash - replayLogBase.droppedFlash;
+  queue["uploaded"] = ls.uploaded - replayLogBase.uploaded;
+  doc["server_up"] = serverUp();
+  Latency::toJson(doc["latency"].to<JsonObject>());
+  serializeJson(doc, out);
+  out.println();
+}
+#endif
+
 // Non-blocking timer callback for triggering AuthSync work.
 
 void authSyncTimerCallback(TimerHandle_t xTimer)
 {
-  authSyncRequested = true;
+  netRequests.raise(NET_SYNC);
 }
 
 // ----------- Network Task (core 0) ------------
 void NetworkTask(void *pv)
 {
-  Serial.printf("[Tasks] NetworkTask running on core %d\n", xPortGetCoreID());
-
+  LOG_I("[Tasks] NetworkTask running on core %d", xPortGetCoreID());
 
-  // Create and start the timer (5000ms period, auto-reload)
-  if (!createServerCheckTimer(serverCheckTimerCallback, pdMS_TO_TICKS(5000))) {
-    Serial.println("[Tasks] Failed to create/start server check timer");
-  } else {
-    Serial.println("[Tasks] Server check timer started");
-  }
 
   // Create and start the auth sync timer (non-blocking callback)
   if (!createAuthSyncTimer(authSyncTimerCallback, pdMS_TO_TICKS(5000))) {
-    Serial.println("[Tasks] Failed to create/start auth sync timer");
+    LOG_W("[Tasks] Failed to create/start auth sync timer");
   } else {
-    Serial.println("[Tasks] AuthSync timer started");
+    LOG_I("[Tasks] AuthSync timer started");
   }
 
+  if (SERVER_BASE.length() > 0) {
+    eventChannel = new EventChannel(SERVER_BASE);
+    eventChannel->setHandler(onServerEvent);
+    eventChannel->setDropHandler(onServerEventDropped);
+  }
+
+#if CONSOLE_PORT
+  console = new Console();
+  console->setHandler(onConsoleCommand);
+#endif
+#if DECISION_PORT
+  if (authSync) decisions = new DecisionService(*authSync);
+#endif
+
+  bool pushWasLive = false;
+  unsigned long lastEnrollPoll = 0;
   for (;;) {
-    // AuthSync periodic sync — triggered by timer flag (non-blocking timer
-    // callback)
-    if (serverReachable && authSync && authSyncRequested) {
-      authSyncRequested = false; // clear flag before doing work
+    // Station just got an IP (boot or reassociation): find out right away
+    // whether the server answers, so the sync below does not wait for the
+    // next probe slot
+    if (netRequests.take(NET_WIFI_UP)) {
+      LOG_I("[WiFi] Connected, IP %s", WiFi.localIP().toString().c_str());
+      if (serverSession) serverSession->probe(1500);
+      if (authSync) authSync->requestSync();
+    }
+
+    // Console: listen once Wi-Fi is up, then run queued command lines
+    if (console) {
+      if (!console->started() && WiFiClass::status() == WL_CONNECTED) console->begin();
+      console->poll();
+    }
+    if (decisions && !decisions->started() && WiFiClass::status() == WL_CONNECTED) decisions->begin();
+
+    // Card lookups first: a scan in loop() is waiting on the answer
+    if (authSync) {
+      authSync->serviceLookups();
+    }
+
+#ifdef MESH_SYNC
+    // Mesh: frames from the neighbours, announcements, pulls. A covered
+    // door follows its source's enroll mode and keeps no event stream.
+    bool meshCovered = false;
+    if (mesh) {
+      mesh->setServerUp(serverUp());
+      mesh->setEnroll(static_cast<uint8_t>(appStatus.enroll()));
+      mesh->poll(millis());
+      meshCovered = mesh->covered();
+      if (meshCovered) {
+        appStatus.setEnroll(static_cast<EnrollMode>(mesh->sourceEnroll()));
+        if (eventChannel && eventChannel->connected()) eventChannel->stop();
+      }
+    }
+#else
+    const bool meshCovered = false;
+#endif
+
+    // Push channel: dispatches events, reconnects with backoff when down
+    if (eventChannel && !meshCovered) {
+      eventChannel->poll(millis());
+      const bool pushLive = eventChannel->connected();
+      if (pushLive != pushWasLive) {
+        pushWasLive = pushLive;
+        appStatus.setPushLive(pushLive);
+        if (authSync) authSync->setPushActive(pushLive);
+        // Resume /api/status polling promptly when the stream drops
+        if (!pushLive) netRequests.raise(NET_ENROLL_POLL);
+      }
+    }
+
+    // Enroll mode: pushed while the stream is live, polled otherwise
+    if (netRequests.take(NET_ENROLL_POLL) || millis() - lastEnrollPoll > ENROLL_POLL_INTERVAL_MS) {
+      lastEnrollPoll = millis();
+      updateEnrollStatus();
+    }
+
+    // Reachability: a live event stream (with server heartbeats) counts as
+    // traffic; otherwise probe only after a quiet period or when the
+    // backoff retry is due. Runs here, never in timer context.
+    if (serverSession) {
+      Reachability &health = serverSession->health();
+      const unsigned long now = millis();
+      if (WiFiClass::status() != WL_CONNECTED) {
+        if (!health.down() && health.probeDue(now)) health.reportFailure(now);
+      } else if (eventChannel && eventChannel->connected()) {
+        health.reportSuccess(now);
+      } else if (health.probeDue(now)) {
+        serverSession->probe(1500);
+      }
+    }
+
+    // Persist learned auth results in batches (flash I/O kept off the scan
+    // path); works offline too
+    if (authSync) {
+      authSync->flushLearned();
+    }
+
+    // AuthSync periodic sync — requested by the timer callback (NET_SYNC
+    // stays raised until the server is up)
+    if (serverUp() && authSync && netRequests.take(NET_SYNC)) {
       authSync->update();
-      Serial.println("[Tasks] Auth sync requested");
+      if (authSync->hasSynced()) Latency::mark(Latency::BOOT_SYNCED);
+      LOG_I("[Tasks] Auth sync requested");
+      // A sync can take seconds; answer lookups queued meanwhile (late,
+      // but learned for the next presentation)
+      authSync->serviceLookups();
     }
 
-    // Drain scan queue: post last_scan events (limit per cycle)
-    if (serverReachable && scanQueue) {
-      for (int i = 0; i < 3;
-           ++i) {
-        // process up to 3 per loop to avoid starving
-        ScanItem item;
-        if (xQueueReceive(scanQueue, &item, 0) == pdPASS) {
-          // Post scan to server and handle enrollment side-effects returned by
-          // the server.
-          Serial.printf("[Queue] Posting UID=%s\n", item.uid);
-          JsonDocument resp;
-
-          if (postLastScan(String(item.uid), resp)) {
-            Serial.printf("[Queue] postLastScan returned size=%u\n", static_cast<unsigned>(resp.size()));
-            // If server acknowledged enrollment, clear enroll mode and redraw
-            // indicator immediately
-            if (resp.size() > 0) {
-              bool enrolled = false;
-              if (resp["enrolled"].is<bool>()) {
-                enrolled = resp["enrolled"].as<bool>();
-              }
-              if (enrolled) {
-                enrollMode = "none";
-                // Request main loop to redraw the enroll indicator (display
-                // operations must run from loop context to be thread-safe).
-                displayUpdateRequested = true;
-                Serial.println("[Queue] Enrollment cleared (requested display update)");
-              }
-            }
-          } else {
-            Serial.println("[Queue] postLastScan: no valid response");
-          }
-        } else {
-          break;
-        }
+    // Scan log: move new scans to flash (also while offline), then upload
+    // the backlog in batches (a few per cycle to avoid starving the rest)
+    scanLog.spill();
+    if (serverUp()) {
+      for (int i = 0; i < 4 && uploadScanBatch(); ++i) {
       }
-    } else if (!serverReachable && scanQueue) {
-      // When offline, keep queued scans for later (do not drop them).
-      // Optionally we could limit queue size elsewhere, but avoid clearing here.
     }
 
-    vTaskDelay(pdMS_TO_TICKS(50));
+    // Sleep until the next cycle or until a scan queues a card lookup
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50));
   }
 }
@@ -0,0 +1,113 @@
+#pragma once
+
+// Host (`pio test -e native`) stand-ins for the parts of the Arduino core
+// the pure modules use: String, timing, Print/Serial. Only what the
+// benchmarks compile is covered; behavior follows arduino-esp32.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// FreeRTOS names that leak into headers through the core (Log.h)
+typedef unsigned int UBaseType_t;
+#define tskIDLE_PRIORITY 0
+
+class String {
+public:
+    String() = default;
+    String(const char *s) : s_(s ? s : "") {}
+    String(const std::string &s) : s_(s) {}
+    explicit String(char c) : s_(1, c) {}
+    explicit String(int v) : s_(std::to_string(v)) {}
+    explicit String(unsigned int v) : s_(std::to_string(v)) {}
+    explicit String(long v) : s_(std::to_string(v)) {}
+    explicit String(unsigned long v) : s_(std::to_string(v)) {}
+
+    const char *c_str() const { return s_.c_str(); }
+    unsigned int length() const { return static_cast<unsigned int>(s_.size()); }
+    bool isEmpty() const { return s_.empty(); }
+    bool reserve(unsigned int n) { s_.reserve(n); return true; }
+    char charAt(unsigned int i) const { return i < s_.size() ? s_[i] : '\0'; }
+    char operator[](unsigned int i) const { return charAt(i); }
+
+    void trim() {
+        const auto notSpace = [](unsigned char c) { return !isspace(c); };
+        s_.erase(s_.begin(), std::find_if(s_.begin(), s_.end(), notSpace));
+        s_.erase(std::find_if(s_.rbegin(), s_.rend(), notSpace).base(), s_.end());
+    }
+    void toUpperCase() { for (char &c : s_) c = static_cast<char>(toupper(static_cast<unsigned char>(c))); }
+    void toLowerCase() { for (char &c : s_) c = static_cast<char>(tolower(static_cast<unsigned char>(c))); }
+    long toInt() const { return strtol(s_.c_str(), nullptr, 10); }
+    bool startsWith(const String &p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+    bool equalsIgnoreCase(const String &o) const {
+        return s_.size() == o.s_.size() &&
+               std::equal(s_.begin(), s_.end(), o.s_.begin(), [](char a, char b) { return tolower(a) == tolower(b); });
+    }
+
+    String &operator+=(const String &o) { s_ += o.s_; return *this; }
+    String &operator+=(const char *o) { s_ += o ? o : ""; return *this; }
+    String &operator+=(char c) { s_ += c; return *this; }
+    friend String operator+(String a, const String &b) { return a += b; }
+    friend String operator+(String a, const char *b) { return a += b; }
+    bool operator==(const String &o) const { return s_ == o.s_; }
+    bool operator==(const char *o) const { return s_ == (o ? o : ""); }
+    bool operator!=(const String &o) const { return s_ != o.s_; }
+
+private:
+    std::string s_;
+};
+
+class Print {
+public:
+    virtual ~Print() = default;
+    virtual size_t write(uint8_t c) { return write(&c, 1); }
+    virtual size_t write(const uint8_t *buf, size_t len) { return fwrite(buf, 1, len, stdout); }
+    size_t print(const char *s) { return write(reinterpret_cast<const uint8_t*>(s), strlen(s)); }
+    size_t print(const String &s) { return print(s.c_str()); }
+    size_t println(const char *s = "") { return print(s) + print("\n"); }
+    size_t println(const String &s) { return println(s.c_str()); }
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+        char buf[512];
+        va_list ap;
+        va_start(ap, fmt);
+        const int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+        va_end(ap);
+        return n > 0 ? write(reinterpret_cast<const uint8_t*>(buf), std::min<size_t>(n, sizeof(buf) - 1)) : 0;
+    }
+    virtual void flush() { fflush(stdout); }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+};
+
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+};
+inline HardwareSerial Serial;
+
+namespace native_detail {
+    inline std::chrono::steady_clock::time_point start() {
+        static const auto t0 = std::chrono::steady_clock::now();
+        return t0;
+    }
+}
+
+inline unsigned long micros() {
+    return static_cast<unsigned long>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - native_detail::start()).count());
+}
+inline unsigned long millis() { return micros() / 1000; }
+inline void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+inline void yield() {}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Host files behind the arduino-esp32 fs::File / fs::FS interface. Paths
+// are relative to a root directory (see LittleFS.h).
+
+#include <Arduino.h>
+#include <memory>
+#include <sys/stat.h>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+    class File : public Stream {
+    public:
+        File() = default;
+        explicit File(FILE *f) : f_(f, fclose) {}
+
+        explicit operator bool() const { return f_ != nullptr; }
+        size_t write(uint8_t c) override { return write(&c, 1); }
+        size_t write(const uint8_t *buf, size_t len) override { return f_ ? fwrite(buf, 1, len, f_.get()) : 0; }
+        size_t read(uint8_t *buf, size_t len) { return f_ ? fread(buf, 1, len, f_.get()) : 0; }
+        int read() override {
+            uint8_t c;
+            return read(&c, 1) == 1 ? c : -1;
+        }
+        int available() override { return f_ ? static_cast<int>(size() - position()) : 0; }
+        size_t position() const { return f_ ? static_cast<size_t>(ftell(f_.get())) : 0; }
+        size_t size() const {
+            struct stat st;
+            return f_ && fstat(fileno(f_.get()), &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+        }
+        bool seek(uint32_t pos) { return f_ && fseek(f_.get(), pos, SEEK_SET) == 0; }
+        void flush() override { if (f_) fflush(f_.get()); }
+        void close() { f_.reset(); }
+
+    private:
+        std::shared_ptr<FILE> f_;
+    };
+
+    class FS {
+    public:
+        explicit FS(const char *root) : root_(root) {}
+
+        File open(const char *path, const char *mode = FILE_READ) {
+            const std::string m = std::string(mode) + "b";
+            return File(fopen(full(path).c_str(), m.c_str()));
+        }
+        File open(const String &path, const char *mode = FILE_READ) { return open(path.c_str(), mode); }
+        bool exists(const char *path) {
+            struct stat st;
+            return stat(full(path).c_str(), &st) == 0;
+        }
+        bool remove(const char *path) { return ::remove(full(path).c_str()) == 0; }
+        bool rename(const char *from, const char *to) { return ::rename(full(from).c_str(), full(to).c_str()) == 0; }
+
+    protected:
+        std::string root_;
+        std::string full(const char *path) const { return root_ + path; }
+    };
+}
+
+using fs::File;
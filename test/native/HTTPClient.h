@@ -0,0 +1,21 @@
+#pragma once
+
+// No network on the host: every request fails like an unreachable server
+#include <Arduino.h>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+
+class HTTPClient {
+public:
+    bool begin(const String &url) { (void)url; return true; }
+    void end() {}
+    void setTimeout(uint16_t ms) { (void)ms; }
+    void addHeader(const String &name, const String &value) { (void)name; (void)value; }
+    void collectHeaders(const char *headers[], size_t count) { (void)headers; (void)count; }
+    String header(const char *name) { (void)name; return String(); }
+    int GET() { return HTTPC_ERROR_CONNECTION_REFUSED; }
+    int POST(const String &body) { (void)body; return HTTPC_ERROR_CONNECTION_REFUSED; }
+    int getSize() { return -1; }
+    String getString() { return String(); }
+    bool connected() { return false; }
+};
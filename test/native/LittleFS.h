@@ -0,0 +1,22 @@
+#pragma once
+
+// LittleFS on the host: a directory, $NATIVE_FS_ROOT or /tmp/native_littlefs
+#include <FS.h>
+
+class LittleFSFS : public fs::FS {
+public:
+    LittleFSFS() : fs::FS(rootDir()) {}
+    bool begin(bool formatOnFail = false) {
+        (void)formatOnFail;
+        struct stat st;
+        return stat(root_.c_str(), &st) == 0 || mkdir(root_.c_str(), 0755) == 0;
+    }
+
+private:
+    static const char *rootDir() {
+        const char *env = getenv("NATIVE_FS_ROOT");
+        return env && *env ? env : "/tmp/native_littlefs";
+    }
+};
+
+inline LittleFSFS LittleFS;
@@ -0,0 +1,20 @@
+#pragma once
+
+// Host heap: no PSRAM (as on the nodemcu-32s), internal heap is malloc
+#include <cstdlib>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline void *heap_caps_malloc(size_t size, uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) ? nullptr : malloc(size);
+}
+inline void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) ? nullptr : calloc(n, size);
+}
+inline void heap_caps_free(void *p) { free(p); }
+inline size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) ? 0 : static_cast<size_t>(1) << 30;
+}
+inline size_t heap_caps_get_free_size(uint32_t caps) { return heap_caps_get_largest_free_block(caps); }
@@ -0,0 +1,250 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <LittleFS.h>
+#include <string>
+
+// Auth hot-path benchmarks. Every case prints one line
+//   BENCH target=<esp32|native> name=<case> ops=<n> bytes=<per op> us_per_op=<t> [cycles_per_op=<c>]
+// (collect with `grep '^BENCH '`).
+//
+//   pio test -e bench    on the chip: AuthSync's own persistence paths
+//   pio test -e native   on the host: the pure algorithms, each case failing
+//                        when it exceeds its budget (BENCH_BUDGET_SCALE
+//                        scales all budgets for slower CI machines)
+
+#include "../../src/HashUtils.cpp"
+#include "../../src/FlatHashSet.cpp"
+#include "../../src/CardSet.cpp"
+#include "../../src/SyncJson.cpp"
+#ifdef ARDUINO
+#include <esp_timer.h>
+#include "../../src/Latency.cpp"
+#include "../../src/Log.cpp"
+#include "../../src/UidIndex.cpp"
+#include "../../src/XorFilter.cpp"
+#include "../../src/AuthJournal.cpp"
+#include "../../src/LearnedCache.cpp"
+#include "../../src/AuthBitset.cpp"
+#include "../../src/TableStore.cpp"
+#include "../../src/SyncDecoder.cpp"
+#include "../../src/Reachability.cpp"
+#include "../../src/ServerSession.cpp"
+#include "../../src/AuthSync.cpp"
+#endif
+
+#ifndef BENCH_BUDGET_SCALE
+#define BENCH_BUDGET_SCALE 1.0
+#endif
+
+namespace {
+    // Card set span of the decode and persistence cases (12.5 KB raw)
+    constexpr uint32_t BENCH_MAX_ID = 99999;
+    // Entries per list in the allow/deny snapshot cases
+    constexpr size_t BENCH_LIST_ENTRIES = 1000;
+
+    volatile uint64_t sink;
+
+    uint64_t nowNs() {
+#ifdef ARDUINO
+        return static_cast<uint64_t>(esp_timer_get_time()) * 1000;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Run `fn(i)` `ops` times after one warm-up call; print the BENCH line
+    // and, on the host, fail past `budgetUs` per op
+    template <typename Fn>
+    void bench(const char *name, uint32_t ops, size_t bytes, double budgetUs, Fn fn) {
+        fn(0);
+        const uint64_t start = nowNs();
+        for (uint32_t i = 0; i < ops; ++i) fn(i);
+        const double usPerOp = static_cast<double>(nowNs() - start) / 1000.0 / ops;
+#ifdef ARDUINO
+        (void)budgetUs;
+        Serial.printf("BENCH target=esp32 name=%s ops=%u bytes=%u us_per_op=%.3f cycles_per_op=%.0f\n", name,
+                      static_cast<unsigned>(ops), static_cast<unsigned>(bytes), usPerOp,
+                      usPerOp * ESP.getCpuFreqMHz());
+#else
+        Serial.printf("BENCH target=native name=%s ops=%u bytes=%u us_per_op=%.3f\n", name,
+                      static_cast<unsigned>(ops), static_cast<unsigned>(bytes), usPerOp);
+        TEST_ASSERT_TRUE_MESSAGE(usPerOp <= budgetUs * BENCH_BUDGET_SCALE, name);
+#endif
+    }
+
+    // Raw bitset of BENCH_MAX_ID with every third card set (bitmap chunks)
+    std::string benchBits() {
+        std::string bits(BENCH_MAX_ID / 8 + 1, '\0');
+        for (uint32_t id = 0; id <= BENCH_MAX_ID; id += 3) bits[id >> 3] |= static_cast<char>(1u << (id & 7));
+        return bits;
+    }
+
+    bool buildSet(const std::string &bits, CardSet &out) {
+        CardSet::Builder builder;
+        if (!builder.begin(BENCH_MAX_ID)) return false;
+        for (size_t at = 0; at < bits.size(); at += SyncFormat::STREAM_CHUNK) {
+            const size_t n = std::min(SyncFormat::STREAM_CHUNK, bits.size() - at);
+            if (!builder.append(reinterpret_cast<const uint8_t*>(bits.data()) + at, n)) return false;
+        }
+        return builder.finish(out);
+    }
+
+    uint64_t benchKey(size_t i) { return (i + 1) * 0x9E3779B97F4A7C15ULL; }
+
+    void benchLookup(const char *name, size_t entries) {
+        FlatHashSet set;
+        if (!set.reserve(entries)) {
+            Serial.printf("BENCH name=%s skipped=no_memory\n", name);
+            TEST_IGNORE_MESSAGE("not enough memory for the table");
+        }
+        for (size_t i = 0; i < entries; ++i) set.insert(benchKey(i));
+        // Alternate hits and misses, as allow and deny lookups of a scan do
+        bench(name, 100000, 0, 1.0, [&](uint32_t i) {
+            sink = sink + set.contains(benchKey(i & 1 ? i % entries : entries + i));
+        });
+    }
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_bench_hash_uid() {
+    String uids[16];
+    for (int i = 0; i < 16; ++i) {
+        char buf[24];
+        snprintf(buf, sizeof(buf), " 04a1b2c3%02x%02x80 ", i, 255 - i);
+        uids[i] = buf;
+    }
+    bench("hash_uid", 20000, 0, 5.0, [&](uint32_t i) { sink = sink ^ HashUtils::hashUid(uids[i & 15]); });
+}
+
+void test_bench_lookup_1k() {
+    benchLookup("lookup_1k", 1000);
+}
+
+void test_bench_lookup_10k() {
+    benchLookup("lookup_10k", 10000);
+}
+
+void test_bench_lookup_100k() {
+    benchLookup("lookup_100k", 100000);
+}
+
+void test_bench_hex_decode() {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    const std::string bits = benchBits();
+    std::string json = "{\"bits\": \"";
+    for (unsigned char b : bits) {
+        json += HEX_DIGITS[b >> 4];
+        json += HEX_DIGITS[b & 15];
+    }
+    json += "\", \"max_id\": " + std::to_string(BENCH_MAX_ID) + "}";
+    bench("hex_decode", 20, json.size(), 20000.0, [&](uint32_t) {
+        FlatHashSet allow;
+        FlatHashSet deny;
+        SyncJsonReader reader(allow, deny);
+        CardSet set;
+        for (size_t at = 0; at < json.size(); at += SyncFormat::STREAM_CHUNK) {
+            reader.feed(json.data() + at, std::min(SyncFormat::STREAM_CHUNK, json.size() - at));
+        }
+        TEST_ASSERT_TRUE(reader.finish(set));
+        sink = sink + set.cards();
+    });
+}
+
+void test_bench_binary_decode() {
+    const std::string bits = benchBits();
+    bench("binary_decode", 20, bits.size(), 5000.0, [&](uint32_t) {
+        CardSet set;
+        TEST_ASSERT_TRUE(buildSet(bits, set));
+        sink = sink + set.cards();
+    });
+}
+
+#ifdef ARDUINO
+// The AuthSync paths themselves (LittleFS on the chip's flash)
+void test_bench_save_allow_deny() {
+    AuthSync auth("");
+    TEST_ASSERT_TRUE(auth.TEST_fillTables(BENCH_LIST_ENTRIES, BENCH_MAX_ID));
+    bench("save_allow_deny", 5, 0, 0, [&](uint32_t) { TEST_ASSERT_TRUE(auth.TEST_saveAllowDenyToFS()); });
+}
+
+void test_bench_save_bitset() {
+    AuthSync auth("");
+    TEST_ASSERT_TRUE(auth.TEST_fillTables(0, BENCH_MAX_ID));
+    bench("save_bitset", 5, 0, 0, [&](uint32_t) { TEST_ASSERT_TRUE(auth.TEST_saveBitsetToFS()); });
+}
+
+void test_bench_load_bitset() {
+    AuthSync auth("");
+    TEST_ASSERT_TRUE(auth.TEST_fillTables(0, BENCH_MAX_ID));
+    TEST_ASSERT_TRUE(auth.TEST_saveBitsetToFS());
+    bench("load_bitset", 10, 0, 0, [&](uint32_t) { TEST_ASSERT_TRUE(auth.TEST_loadBitsetFromFS()); });
+}
+#else
+// What those AuthSync paths do, without NVS and the store
+void test_bench_save_allow_deny() {
+    FlatHashSet allow;
+    FlatHashSet deny;
+    for (size_t i = 0; i < BENCH_LIST_ENTRIES; ++i) {
+        allow.insert(benchKey(i));
+        deny.insert(benchKey(i + BENCH_LIST_ENTRIES));
+    }
+    bench("save_allow_deny", 20, allow.memoryBytes() + deny.memoryBytes(), 20000.0, [&](uint32_t) {
+        TEST_ASSERT_TRUE(LittleFS.begin());
+        File f = LittleFS.open("/allow_deny.bin.tmp", FILE_WRITE);
+        TEST_ASSERT_TRUE(f && allow.writeTo(f) && deny.writeTo(f));
+        f.close();
+        LittleFS.remove("/allow_deny.bin");
+        TEST_ASSERT_TRUE(LittleFS.rename("/allow_deny.bin.tmp", "/allow_deny.bin"));
+    });
+}
+
+void test_bench_save_bitset() {
+    CardSet set;
+    TEST_ASSERT_TRUE(buildSet(benchBits(), set));
+    bench("save_bitset", 20, set.imageBytes(), 20000.0, [&](uint32_t) { TEST_ASSERT_TRUE(set.saveToFS()); });
+}
+
+void test_bench_load_bitset() {
+    CardSet set;
+    TEST_ASSERT_TRUE(buildSet(benchBits(), set));
+    TEST_ASSERT_TRUE(set.saveToFS());
+    bench("load_bitset", 20, set.imageBytes(), 20000.0, [&](uint32_t) {
+        CardSet loaded;
+        TEST_ASSERT_TRUE(loaded.loadFromFS());
+        sink = sink + loaded.cards();
+    });
+}
+#endif
+
+int runBenchmarks() {
+    UNITY_BEGIN();
+    RUN_TEST(test_bench_hash_uid);
+    RUN_TEST(test_bench_lookup_1k);
+    RUN_TEST(test_bench_lookup_10k);
+    RUN_TEST(test_bench_lookup_100k);
+    RUN_TEST(test_bench_hex_decode);
+    RUN_TEST(test_bench_binary_decode);
+    RUN_TEST(test_bench_save_allow_deny);
+    RUN_TEST(test_bench_save_bitset);
+    RUN_TEST(test_bench_load_bitset);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup() {
+    Serial.begin(115200);
+    delay(2000);
+    LittleFS.begin(true);
+    runBenchmarks();
+}
+
+void loop() {}
+#else
+int main() {
+    return runBenchmarks();
+}
+#endif